@@ -241,6 +241,22 @@ argos_bitmap_istainted(argos_bitmap_t *map, unsigned long maddr)
 	return (ARGOS_BITMAP_ISON(map, maddr))? 1 : 0;
 }
 
+//! Check whether any byte of a range is tainted
+static inline int
+argos_bitmap_anytainted(argos_bitmap_t *map, unsigned long maddr, size_t len)
+{
+	for (; len > 0 && (maddr & 0x7) != 0; maddr++, len--)
+		if (ARGOS_BITMAP_ISON(map, maddr))
+			return 1;
+	if (argos_map_nonzero(map + ARGOS_BITMAP_OFF(maddr), len >> 3))
+		return 1;
+	maddr += len & ~7UL;
+	for (len &= 0x7; len > 0; maddr++, len--)
+		if (ARGOS_BITMAP_ISON(map, maddr))
+			return 1;
+	return 0;
+}
+
 static inline void
 argos_bitmap_clear(argos_bitmap_t *map, unsigned long paddr, size_t len)
 {
@@ -260,6 +276,25 @@ argos_bitmap_clear(argos_bitmap_t *map, unsigned long paddr, size_t len)
 	}
 }
 
+static inline void
+argos_bitmap_taint(argos_bitmap_t *map, unsigned long paddr, size_t len)
+{
+	while (len > 0) {
+		// Address aligned in 8 byte boundary
+		if ((paddr & 0x7) == 0) {
+			// Set 8 bytes a time
+			for (; len >= 8; paddr += 8, len -= 8)
+				map[ARGOS_BITMAP_OFF(paddr)] = 0xff;
+			if (len == 0)
+				break;
+		}
+
+		ARGOS_BITMAP_SET(map, paddr);
+		len--;
+		paddr++;
+	}
+}
+
 
 argos_bitmap_t *argos_bitmap_create(size_t len);
 argos_bitmap_t *argos_bitmap_createz(size_t len);
@@ -150,6 +150,31 @@ argos_bytemap_ldb(argos_bytemap_t *map, unsigned long maddr,
 		argos_tag_clear(tag);
 }
 
+#ifdef ARGOS_LABEL_SETS
+// Loads combine the labels of all the bytes
+static inline void
+argos_bytemap_ldn(argos_bytemap_t *map, unsigned long maddr,
+		unsigned long paddr, argos_rtag_t *tag, int n)
+{
+	argos_netidx_t idx = map[maddr];
+	int i;
+
+	for (i = 1; i < n; i++)
+		if (map[maddr + i] != idx)
+			idx = argos_label_merge(idx, map[maddr + i]);
+	if (idx)
+		argos_tag_set(tag, paddr, idx);
+	else
+		argos_tag_clear(tag);
+}
+
+#define argos_bytemap_ldw(map, maddr, paddr, tag) \
+	argos_bytemap_ldn(map, maddr, paddr, tag, 2)
+#define argos_bytemap_ldl(map, maddr, paddr, tag) \
+	argos_bytemap_ldn(map, maddr, paddr, tag, 4)
+#define argos_bytemap_ldq(map, maddr, paddr, tag) \
+	argos_bytemap_ldn(map, maddr, paddr, tag, 8)
+#else
 static inline void
 argos_bytemap_ldw(argos_bytemap_t *map, unsigned long maddr,
 		unsigned long paddr, argos_rtag_t *tag)
@@ -204,6 +229,7 @@ argos_bytemap_ldq(argos_bytemap_t *map, unsigned long maddr,
 #endif
 	argos_tag_clear(tag);
 }
+#endif
 
 static inline void
 argos_bytemap_stb(argos_bytemap_t *map, unsigned long maddr, 
@@ -379,6 +405,23 @@ argos_bytemap_istainted(argos_bytemap_t *map, unsigned long maddr)
 #endif
 }
 
+//! Check whether any byte of a range is tainted
+static inline int
+argos_bytemap_anytainted(argos_bytemap_t *map, unsigned long maddr,
+		size_t len)
+{
+#ifdef ARGOS_NET_TRACKER
+	argos_bytemap_t *p, *end;
+
+	for (p = map + maddr, end = p + len; p < end; p++)
+		if (ARGOS_GET_NETIDX(*p) != 0)
+			return 1;
+	return 0;
+#else
+	return argos_map_nonzero(map + maddr, len);
+#endif
+}
+
 static inline void
 argos_bytemap_clear(argos_bytemap_t *map, unsigned long maddr, size_t len)
 {
@@ -394,6 +437,15 @@ argos_bytemap_clear(argos_bytemap_t *map, unsigned long maddr, size_t len)
 	memset(map + maddr, 0, len);
 }
 
+#ifndef ARGOS_NET_TRACKER
+//! Taint a range. Bytes have no network index, their origin is their address
+static inline void
+argos_bytemap_taint(argos_bytemap_t *map, unsigned long maddr, size_t len)
+{
+	memset(map + maddr, 0xff, len);
+}
+#endif
+
 
 argos_bytemap_t *argos_bytemap_create(size_t len);
 argos_bytemap_t *argos_bytemap_createz(size_t len);
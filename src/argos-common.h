@@ -48,12 +48,14 @@ extern argos_tracksc_whitelist * argos_tracksc_loaded_whitelist;
 extern int argos_instance_id;
 
 #ifndef CONFIG_USER_ONLY
-extern int argos_os_hint;
 # ifdef ARGOS_NET_TRACKER
 extern FILE *argos_nt_fl;
 # endif
 #endif
 
 int argos_logf(const char *fmt, ...);
+//! Send an event of \a type. Text clients and the console get \a text,
+//! JSON clients a line with the members printed by \a fmt
+void argos_event(const char *type, const char *text, const char *fmt, ...);
 
 #endif
@@ -53,6 +53,9 @@
 # ifdef ARGOS_NET_TRACKER
 #  undef ARGOS_NET_TRACKER
 # endif
+# ifdef ARGOS_LABEL_SETS
+#  undef ARGOS_LABEL_SETS
+# endif
 
 #else
 
@@ -0,0 +1,128 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "qemu-common.h"
+#include "exec-all.h"
+#include "qemu-timer.h"
+#include "argos-counters.h"
+
+#ifdef ARGOS_COUNTERS
+//! Totals and time of the previous query, for the rates
+static argos_counters_t last;
+static int64_t last_time;
+
+void
+argos_counters_sum(argos_counters_t *sum)
+{
+	CPUState *env;
+
+	memset(sum, 0, sizeof(argos_counters_t));
+	for (env = first_cpu; env != NULL; env = env->next_cpu) {
+		sum->tainted_loads += env->counters.tainted_loads;
+		sum->tainted_stores += env->counters.tainted_stores;
+		sum->checks += env->counters.checks;
+		sum->ci_checks += env->counters.ci_checks;
+		sum->pc_walks += env->counters.pc_walks;
+		sum->alerts += env->counters.alerts;
+	}
+}
+
+static void
+dump_counter(FILE *f, int (*cpu_fprintf)(FILE *f, const char *fmt, ...),
+		const char *name, uint64_t val, uint64_t prev, double secs)
+{
+	cpu_fprintf(f, "%-15s %12" PRIu64 " %12.0f/s\n", name, val,
+			(secs > 0)? (val - prev) / secs : 0.0);
+}
+#endif
+
+// Scanning the whole map is slow, so the tainted bytes are only counted
+// when asked for. Unallocated pages of the pagemap are skipped.
+static uint64_t
+tainted_bytes(void)
+{
+	ram_addr_t addr, end;
+	uint64_t n = 0;
+
+	for (addr = 0; addr < phys_ram_size; addr = end) {
+		end = addr + TARGET_PAGE_SIZE;
+#if !defined(ARGOS_DISABLE_MEMTRACK) && ARGOS_MEMMAP == ARGOS_PAGEMAP
+		if (argos_memmap[ARGOS_PAGEMAP_PGOFF(addr)] == NULL)
+			continue;
+#endif
+		for (; addr < end; addr++)
+			if (argos_memmap_istainted(addr))
+				n++;
+	}
+	return n;
+}
+
+void
+argos_counters_dump_info(FILE *f,
+		int (*cpu_fprintf)(FILE *f, const char *fmt, ...))
+{
+#ifdef ARGOS_COUNTERS
+	argos_counters_t sum;
+	int64_t now;
+	double secs;
+#endif
+
+	cpu_fprintf(f, "tainted bytes   %12" PRIu64 " of %" PRIu64 "\n",
+			tainted_bytes(), (uint64_t)phys_ram_size);
+#ifdef ARGOS_COUNTERS
+	argos_counters_sum(&sum);
+	now = qemu_get_clock(rt_clock);
+	secs = (last_time)? (now - last_time) / 1000.0 : 0;
+	dump_counter(f, cpu_fprintf, "tainted loads", sum.tainted_loads,
+			last.tainted_loads, secs);
+	dump_counter(f, cpu_fprintf, "tainted stores", sum.tainted_stores,
+			last.tainted_stores, secs);
+	dump_counter(f, cpu_fprintf, "checks", sum.checks, last.checks, secs);
+	dump_counter(f, cpu_fprintf, "ci checks", sum.ci_checks,
+			last.ci_checks, secs);
+	dump_counter(f, cpu_fprintf, "pc page walks", sum.pc_walks,
+			last.pc_walks, secs);
+	dump_counter(f, cpu_fprintf, "alerts", sum.alerts, last.alerts, secs);
+	last = sum;
+	last_time = now;
+#else
+	cpu_fprintf(f, "taint counters: not compiled\n");
+#endif
+#ifdef CONFIG_PROFILER
+	cpu_fprintf(f, "qemu time       %12.3f s\n",
+			qemu_time / (double)ticks_per_sec);
+	cpu_fprintf(f, "async time      %12.3f s\n",
+			dev_time / (double)ticks_per_sec);
+#endif
+}
@@ -0,0 +1,68 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef ARGOS_COUNTERS_H
+#define ARGOS_COUNTERS_H
+
+// Taint operation counters
+//
+// The counters are plain increments of fields in the CPU state, so they
+// cost an add on the paths they are on and nothing at all unless argos was
+// configured with --enable-counters. They are read by "info argos" and by
+// the stats event of the control socket.
+
+typedef struct argos_counters {
+	uint64_t tainted_loads;		//!< Loads that returned tainted data
+	uint64_t tainted_stores;	//!< Stores of tainted data
+	uint64_t checks;		//!< Control transfers checked
+	uint64_t ci_checks;		//!< Code injection checks
+	uint64_t pc_walks;		//!< Page walks of argos_dest_pc_isdirty
+	uint64_t alerts;
+} argos_counters_t;
+
+#ifdef ARGOS_COUNTERS
+# define ARGOS_COUNT(env, counter) ((env)->counters.counter++)
+//! Count only if the tag is dirty
+# define ARGOS_COUNT_TAG(env, counter, tag)				\
+	do {								\
+		if (argos_tag_isdirty(tag))				\
+			(env)->counters.counter++;			\
+	} while (0)
+
+void argos_counters_sum(argos_counters_t *sum);
+#else
+# define ARGOS_COUNT(env, counter) do { } while (0)
+# define ARGOS_COUNT_TAG(env, counter, tag) do { } while (0)
+#endif
+
+void argos_counters_dump_info(FILE *f,
+		int (*cpu_fprintf)(FILE *f, const char *fmt, ...));
+
+#endif
@@ -0,0 +1,318 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config-host.h"
+#include "argos-csistore.h"
+#include "argos-csi-read.h"
+
+// Mirrors the format written by target-i386/argos-csi.c
+#define ARGOS_NT_MASK        128
+#define ARGOS_BE_MASK        64
+#define ARGOS_LS_MASK        32
+#define ARGOS_VERSION_MASK   31
+
+#define ARGOS_ARCH_I386   0
+#define ARGOS_ARCH_X86_64 1
+
+#define CSI_PAGE_SIZE 4096
+
+struct argos_csi_reader {
+	FILE *fp;
+	argos_csistore_t *store;
+	argos_csi_info_t info;
+	int wordsize;
+	uint8_t *data;
+	uint32_t *netidx;
+	uint8_t *blob;
+	uint8_t *page;		//!< Last page read from the store
+	int64_t page_offset;
+	int page_size;
+};
+
+static int
+read_u8(FILE *fp, uint8_t *v)
+{
+	return fread(v, 1, 1, fp) == 1 ? 0 : -1;
+}
+
+static int
+read_u16(FILE *fp, uint16_t *v)
+{
+	return fread(v, 2, 1, fp) == 1 ? 0 : -1;
+}
+
+static int
+read_u32(FILE *fp, uint32_t *v)
+{
+	return fread(v, 4, 1, fp) == 1 ? 0 : -1;
+}
+
+static int
+read_u64(FILE *fp, uint64_t *v)
+{
+	return fread(v, 8, 1, fp) == 1 ? 0 : -1;
+}
+
+//! Reads a word of the guest architecture
+static int
+read_word(argos_csi_reader_t *r, uint64_t *v)
+{
+	uint32_t w;
+
+	if (r->wordsize == 8)
+		return read_u64(r->fp, v);
+	if (read_u32(r->fp, &w) != 0)
+		return -1;
+	*v = w;
+	return 0;
+}
+
+static int
+read_words(argos_csi_reader_t *r, uint64_t *v, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (read_word(r, v + i) != 0)
+			return -1;
+	return 0;
+}
+
+static int
+read_header(argos_csi_reader_t *r)
+{
+	argos_csi_info_t *info = &r->info;
+	uint8_t format, arch;
+	uint16_t type;
+	int i;
+
+	if (read_u8(r->fp, &format) != 0 || read_u8(r->fp, &arch) != 0)
+		return -1;
+#ifdef WORDS_BIGENDIAN
+	if (!(format & ARGOS_BE_MASK)) {
+#else
+	if (format & ARGOS_BE_MASK) {
+#endif
+		fprintf(stderr, "log was written by a host of the other byte"
+				" order\n");
+		return -1;
+	}
+	info->version = format & ARGOS_VERSION_MASK;
+	if (info->version != 2 && info->version != 3) {
+		fprintf(stderr, "unsupported log version %d\n", info->version);
+		return -1;
+	}
+	info->net_tracker = (format & ARGOS_NT_MASK) != 0;
+	info->label_sets = (format & ARGOS_LS_MASK) != 0;
+	info->arch = arch;
+	switch (arch) {
+	case ARGOS_ARCH_I386:
+		r->wordsize = 4;
+		info->nregs = 8;
+		break;
+	case ARGOS_ARCH_X86_64:
+		r->wordsize = 8;
+		info->nregs = 16;
+		break;
+	default:
+		fprintf(stderr, "unknown architecture %d\n", arch);
+		return -1;
+	}
+
+	if (read_u16(r->fp, &type) != 0 || read_u32(r->fp, &info->ts) != 0 ||
+			read_words(r, info->reg, info->nregs) != 0 ||
+			read_words(r, info->rorigin, info->nregs) != 0)
+		return -1;
+	info->type = type;
+	if (info->net_tracker) {
+		for (i = 0; i < info->nregs; i++)
+			if (read_u32(r->fp, info->netidx + i) != 0)
+				return -1;
+	}
+	if (read_word(r, &info->eip) != 0 ||
+			read_word(r, &info->eiporigin) != 0)
+		return -1;
+	if (info->net_tracker && read_u32(r->fp, &info->eipnetidx) != 0)
+		return -1;
+	if (read_word(r, &info->old_eip) != 0 ||
+			read_word(r, &info->eflags) != 0)
+		return -1;
+	return 0;
+}
+
+argos_csi_reader_t *
+argos_csi_open(const char *filename, const char *store)
+{
+	argos_csi_reader_t *r;
+	char *fn = NULL, *slash;
+
+	if ((r = calloc(1, sizeof(argos_csi_reader_t))) == NULL)
+		return NULL;
+	r->page_offset = -1;
+	if ((r->fp = fopen(filename, "rb")) == NULL) {
+		perror(filename);
+		goto error;
+	}
+	if (read_header(r) != 0) {
+		fprintf(stderr, "%s: bad log header\n", filename);
+		goto error;
+	}
+	r->data = malloc(CSI_PAGE_SIZE);
+	r->netidx = malloc(4 * CSI_PAGE_SIZE);
+	r->blob = malloc(argos_csistore_bound(4 * CSI_PAGE_SIZE));
+	r->page = malloc(ARGOS_CSISTORE_MAX_BLOCK);
+	if (!r->data || !r->netidx || !r->blob || !r->page)
+		goto error;
+	if (r->info.version < 3)
+		return r;
+
+	if (!store) {
+		// The store next to the log
+		fn = malloc(strlen(filename) + sizeof(ARGOS_CSISTORE_FILE));
+		if (!fn)
+			goto error;
+		strcpy(fn, filename);
+		slash = strrchr(fn, '/');
+		strcpy(slash ? slash + 1 : fn, ARGOS_CSISTORE_FILE);
+		store = fn;
+	}
+	if ((r->store = argos_csistore_open(store, 0)) == NULL) {
+		perror(store);
+		goto error;
+	}
+	free(fn);
+	return r;
+error:
+	free(fn);
+	argos_csi_close(r);
+	return NULL;
+}
+
+const argos_csi_info_t *
+argos_csi_info(argos_csi_reader_t *r)
+{
+	return &r->info;
+}
+
+static int
+read_netidx(argos_csi_reader_t *r, unsigned int size)
+{
+	argos_csistore_blob_t blob;
+
+	if (r->info.version < 3)
+		return fread(r->netidx, 4, size, r->fp) == size ? 0 : -1;
+	if (fread(&blob, sizeof(blob), 1, r->fp) != 1 ||
+			blob.size != 4 * size ||
+			blob.stored > argos_csistore_bound(blob.size) ||
+			fread(r->blob, 1, blob.stored, r->fp) != blob.stored)
+		return -1;
+	return argos_csistore_decode(r->blob, blob.stored, blob.codec,
+			r->netidx, blob.size);
+}
+
+//! Points blk->data to the block in the page of the store
+static int
+read_stored(argos_csi_reader_t *r, argos_csi_block_t *blk)
+{
+	unsigned int off;
+
+	if (blk->offset != r->page_offset) {
+		r->page_offset = -1;
+		r->page_size = argos_csistore_get(r->store, blk->offset,
+				blk->hash, r->page, ARGOS_CSISTORE_MAX_BLOCK);
+		if (r->page_size < 0) {
+			fprintf(stderr, "block at %lld missing from the "
+					"store\n", (long long)blk->offset);
+			return -1;
+		}
+		r->page_offset = blk->offset;
+	}
+	off = blk->paddr & (CSI_PAGE_SIZE - 1);
+	if (off + blk->size > r->page_size)
+		return -1;
+	blk->data = r->page + off;
+	return 0;
+}
+
+int
+argos_csi_next(argos_csi_reader_t *r, argos_csi_block_t *blk)
+{
+	uint8_t format, tainted;
+	uint16_t size;
+
+	memset(blk, 0, sizeof(*blk));
+	if (read_u8(r->fp, &format) != 0 || read_u8(r->fp, &tainted) != 0 ||
+			read_u16(r->fp, &size) != 0 ||
+			read_word(r, &blk->paddr) != 0 ||
+			read_word(r, &blk->vaddr) != 0)
+		return -1;
+	blk->offset = -1;
+	if (r->info.version >= 3 && (read_u64(r->fp, &blk->hash) != 0 ||
+			read_u64(r->fp, (uint64_t *)&blk->offset) != 0))
+		return -1;
+	// The log ends with an empty header
+	if (format == 0)
+		return 0;
+	if (size > CSI_PAGE_SIZE)
+		return -1;
+	blk->tainted = tainted;
+	blk->size = size;
+
+	if (r->info.version < 3) {
+		if (fread(r->data, 1, size, r->fp) != size)
+			return -1;
+		blk->data = r->data;
+	} else if (read_stored(r, blk) != 0)
+		return -1;
+	if ((format & ARGOS_NT_MASK) && tainted) {
+		if (read_netidx(r, size) != 0)
+			return -1;
+		blk->netidx = r->netidx;
+	}
+	return 1;
+}
+
+void
+argos_csi_close(argos_csi_reader_t *r)
+{
+	if (!r)
+		return;
+	if (r->fp)
+		fclose(r->fp);
+	argos_csistore_close(r->store);
+	free(r->data);
+	free(r->netidx);
+	free(r->blob);
+	free(r->page);
+	free(r);
+}
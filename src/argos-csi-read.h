@@ -0,0 +1,81 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef ARGOS_CSI_READ_H
+#define ARGOS_CSI_READ_H
+
+#include <stdint.h>
+
+// Streaming reader of the CSI logs
+//
+// Reads the logs of version 2, which carry the contents of the blocks,
+// and of version 3, whose blocks are in the CSI store, of both the i386
+// and the x86_64 emulator. The log is read one block at a time, so that
+// it does not have to fit in memory.
+
+#define ARGOS_CSI_MAX_REGS 16
+
+typedef struct {
+	int version;
+	int arch;		//!< 0 for i386, 1 for x86_64
+	int net_tracker;
+	int label_sets;
+	unsigned int type;	//!< Attack type, see argos-check.h
+	uint32_t ts;
+	int nregs;
+	uint64_t reg[ARGOS_CSI_MAX_REGS];
+	uint64_t rorigin[ARGOS_CSI_MAX_REGS];
+	uint32_t netidx[ARGOS_CSI_MAX_REGS];
+	uint64_t eip, eiporigin, old_eip, eflags;
+	uint32_t eipnetidx;
+} argos_csi_info_t;
+
+typedef struct {
+	int tainted;
+	unsigned int size;
+	uint64_t paddr, vaddr;
+	const uint8_t *data;
+	const uint32_t *netidx;	//!< NULL if the block has none
+	uint64_t hash;		//!< Page of the block in the store
+	int64_t offset;		//!< -1 in logs of version 2
+} argos_csi_block_t;
+
+typedef struct argos_csi_reader argos_csi_reader_t;
+
+//! Opens a log. store is the CSI store of the log, by default the one in
+//! the directory of the log. Prints the reason if it fails.
+argos_csi_reader_t *argos_csi_open(const char *filename, const char *store);
+const argos_csi_info_t *argos_csi_info(argos_csi_reader_t *r);
+//! Returns 1 and fills blk with the next block, 0 at the end of the log
+//! and -1 on error. The data of the block are valid until the next call.
+int argos_csi_next(argos_csi_reader_t *r, argos_csi_block_t *blk);
+void argos_csi_close(argos_csi_reader_t *r);
+
+#endif
@@ -0,0 +1,172 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "argos-csi-read.h"
+
+// Prints the contents of CSI logs
+
+static const char *regs32[] = {
+	"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi"
+};
+
+static const char *regs64[] = {
+	"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+	"r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+
+static void
+usage(void)
+{
+	printf("usage: argos-csidump [-qx] [-s store] log...\n"
+		"\n"
+		"Prints the registers and the memory blocks of CSI logs\n"
+		"\n"
+		"  -q        print the header and a summary of the blocks\n"
+		"  -x        print the contents of the blocks\n"
+		"  -s store  read the pages from store instead of the\n"
+		"            argos.csi.store next to the log\n");
+	exit(1);
+}
+
+static void
+hexdump(const argos_csi_block_t *blk)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < blk->size; i += 16) {
+		printf("  %016llx ", (unsigned long long)blk->vaddr + i);
+		for (j = i; j < i + 16 && j < blk->size; j++)
+			printf(" %02x", blk->data[j]);
+		for (; j < i + 16; j++)
+			printf("   ");
+		printf("  ");
+		for (j = i; j < i + 16 && j < blk->size; j++)
+			putchar((blk->data[j] >= 32 && blk->data[j] < 127) ?
+					blk->data[j] : '.');
+		putchar('\n');
+	}
+}
+
+static void
+print_info(const argos_csi_info_t *info)
+{
+	time_t ts = info->ts;
+	const char **names = (info->nregs == 16) ? regs64 : regs32;
+	int i;
+
+	printf("version %d, %s%s%s\n", info->version,
+			info->arch ? "x86_64" : "i386",
+			info->net_tracker ? ", net tracker" : "",
+			info->label_sets ? ", label sets" : "");
+	printf("attack type %u at %s", info->type, ctime(&ts));
+	for (i = 0; i < info->nregs; i++) {
+		printf("%-3s %016llx origin %016llx", names[i],
+				(unsigned long long)info->reg[i],
+				(unsigned long long)info->rorigin[i]);
+		if (info->net_tracker)
+			printf(" netidx %u", info->netidx[i]);
+		putchar('\n');
+	}
+	printf("eip %016llx origin %016llx", (unsigned long long)info->eip,
+			(unsigned long long)info->eiporigin);
+	if (info->net_tracker)
+		printf(" netidx %u", info->eipnetidx);
+	printf("\nold eip %016llx eflags %08llx\n",
+			(unsigned long long)info->old_eip,
+			(unsigned long long)info->eflags);
+}
+
+static int
+dump(const char *filename, const char *store, int quiet, int hex)
+{
+	argos_csi_reader_t *r;
+	argos_csi_block_t blk;
+	unsigned long long blocks = 0, bytes = 0, tainted = 0;
+	int ret;
+
+	if ((r = argos_csi_open(filename, store)) == NULL)
+		return -1;
+	printf("%s: ", filename);
+	print_info(argos_csi_info(r));
+	while ((ret = argos_csi_next(r, &blk)) > 0) {
+		blocks++;
+		bytes += blk.size;
+		if (blk.tainted)
+			tainted += blk.size;
+		if (quiet)
+			continue;
+		printf("%016llx [%016llx] %5u %s\n",
+				(unsigned long long)blk.vaddr,
+				(unsigned long long)blk.paddr, blk.size,
+				blk.tainted ? "tainted" : "clean");
+		if (hex)
+			hexdump(&blk);
+	}
+	if (ret < 0)
+		fprintf(stderr, "%s: corrupted log\n", filename);
+	printf("%llu blocks, %llu bytes, %llu tainted\n", blocks, bytes,
+			tainted);
+	argos_csi_close(r);
+	return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *store = NULL;
+	int c, quiet = 0, hex = 0, ret = 0;
+
+	while ((c = getopt(argc, argv, "qxs:h")) != -1) {
+		switch (c) {
+		case 'q':
+			quiet = 1;
+			break;
+		case 'x':
+			hex = 1;
+			break;
+		case 's':
+			store = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind == argc)
+		usage();
+	for (; optind < argc; optind++)
+		if (dump(argv[optind], store, quiet, hex) != 0)
+			ret = 1;
+	return ret;
+}
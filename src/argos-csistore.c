@@ -0,0 +1,463 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "config-host.h"
+#include "argos-csistore.h"
+
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
+
+// The index maps the hashes of the blocks to their offsets. It is an open
+// addressing table, rebuilt from the records when the store is opened.
+// Blocks with the same hash are all kept, and told apart by their
+// contents.
+
+#define INDEX_MIN_SLOTS 1024
+
+typedef struct {
+	uint64_t hash;
+	int64_t offset;		//!< -1 if the slot is free
+} index_slot_t;
+
+struct argos_csistore {
+	int fd;
+	int writable;
+	dev_t dev;
+	ino_t ino;
+	index_slot_t *index;
+	unsigned int slots;
+	unsigned int blocks;
+	uint64_t bytes;
+	uint8_t *rbuf;		//!< A record, as read or about to be written
+	uint8_t *dbuf;		//!< A decoded block
+};
+
+#ifdef CONFIG_ZSTD
+int argos_csistore_level = 3;
+#else
+int argos_csistore_level = 0;
+#endif
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+//! FNV-1a over 64 bit words, the tail byte by byte
+uint64_t
+argos_csistore_hash(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	uint64_t h = FNV_OFFSET, w;
+
+	for (; len >= 8; len -= 8, p += 8) {
+		memcpy(&w, p, 8);
+		h = (h ^ w) * FNV_PRIME;
+	}
+	for (; len > 0; len--, p++)
+		h = (h ^ *p) * FNV_PRIME;
+	return h;
+}
+
+size_t
+argos_csistore_bound(size_t len)
+{
+#ifdef CONFIG_ZSTD
+	size_t b = ZSTD_compressBound(len);
+
+	return (b > len)? b : len;
+#else
+	return len;
+#endif
+}
+
+size_t
+argos_csistore_encode(const void *data, size_t len, void *out, uint8_t *codec)
+{
+#ifdef CONFIG_ZSTD
+	if (argos_csistore_level > 0) {
+		size_t n = ZSTD_compress(out, argos_csistore_bound(len),
+				data, len, argos_csistore_level);
+
+		if (!ZSTD_isError(n) && n < len) {
+			*codec = ARGOS_CSISTORE_ZSTD;
+			return n;
+		}
+	}
+#endif
+	memcpy(out, data, len);
+	*codec = ARGOS_CSISTORE_RAW;
+	return len;
+}
+
+int
+argos_csistore_decode(const void *in, size_t stored, uint8_t codec,
+		void *out, size_t size)
+{
+	switch (codec) {
+	case ARGOS_CSISTORE_RAW:
+		if (stored != size)
+			return -1;
+		memcpy(out, in, size);
+		return 0;
+#ifdef CONFIG_ZSTD
+	case ARGOS_CSISTORE_ZSTD:
+		if (ZSTD_decompress(out, size, in, stored) != size)
+			return -1;
+		return 0;
+#endif
+	default:
+		return -1;
+	}
+}
+
+static int
+index_resize(argos_csistore_t *st, unsigned int slots)
+{
+	index_slot_t *old = st->index, *s;
+	unsigned int i, j, old_slots = st->slots;
+
+	if ((st->index = malloc(slots * sizeof(index_slot_t))) == NULL) {
+		st->index = old;
+		return -1;
+	}
+	for (i = 0; i < slots; i++)
+		st->index[i].offset = -1;
+	st->slots = slots;
+	for (i = 0; i < old_slots; i++) {
+		if (old[i].offset < 0)
+			continue;
+		j = old[i].hash & (slots - 1);
+		while ((s = st->index + j)->offset >= 0)
+			j = (j + 1) & (slots - 1);
+		*s = old[i];
+	}
+	free(old);
+	return 0;
+}
+
+static int
+index_add(argos_csistore_t *st, uint64_t hash, int64_t offset)
+{
+	unsigned int j;
+
+	// At most half full
+	if ((st->blocks + 1) * 2 > st->slots &&
+			index_resize(st, st->slots * 2) != 0)
+		return -1;
+	j = hash & (st->slots - 1);
+	while (st->index[j].offset >= 0)
+		j = (j + 1) & (st->slots - 1);
+	st->index[j].hash = hash;
+	st->index[j].offset = offset;
+	st->blocks++;
+	return 0;
+}
+
+static int
+readn(int fd, void *buf, size_t len, off_t off)
+{
+	ssize_t n;
+	uint8_t *p = buf;
+
+	while (len > 0) {
+		n = pread(fd, p, len, off);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		off += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void
+store_lock(argos_csistore_t *st, int op)
+{
+	while (flock(st->fd, op) != 0 && errno == EINTR)
+		;
+}
+
+//! Whether rec, read at off, is a whole record header
+static int
+rec_valid(const argos_csistore_rec_t *rec, uint64_t off, uint64_t size)
+{
+	return rec->magic == ARGOS_CSISTORE_MAGIC &&
+		rec->size <= ARGOS_CSISTORE_MAX_BLOCK &&
+		rec->stored <= argos_csistore_bound(rec->size) &&
+		off + sizeof(*rec) + rec->stored <= size;
+}
+
+//! Whether the block of the record at off matches its hash
+static int
+rec_intact(argos_csistore_t *st, const argos_csistore_rec_t *rec,
+		uint64_t off)
+{
+	return argos_csistore_get(st, off, rec->hash, st->dbuf,
+			ARGOS_CSISTORE_MAX_BLOCK) == (int)rec->size &&
+		argos_csistore_hash(st->dbuf, rec->size) == rec->hash;
+}
+
+//! Offset of the first whole record header after off, size if none
+static uint64_t
+resync(argos_csistore_t *st, uint64_t off, uint64_t size)
+{
+	argos_csistore_rec_t rec;
+	uint32_t magic = ARGOS_CSISTORE_MAGIC;
+	uint8_t buf[4096];
+	size_t n, i;
+
+	// The chunks overlap by 3 bytes, for a magic that spans two of them
+	for (off++; off + sizeof(rec) <= size; off += n - 3) {
+		n = sizeof(buf);
+		if (off + n > size)
+			n = size - off;
+		if (readn(st->fd, buf, n, off) != 0)
+			break;
+		for (i = 0; i + 4 <= n; i++) {
+			if (memcmp(buf + i, &magic, 4) != 0 ||
+					off + i + sizeof(rec) > size)
+				continue;
+			if (readn(st->fd, &rec, sizeof(rec), off + i) == 0 &&
+					rec_valid(&rec, off + i, size))
+				return off + i;
+		}
+		if (n < sizeof(buf))
+			break;
+	}
+	return size;
+}
+
+// Reads the record headers and indexes them. The writers append under
+// the lock and roll back a record they could not write whole, but an
+// emulator that died while appending leaves a torn record. Other
+// emulators may have appended after it, and logs refer to their records,
+// so the store is never truncated: the scan skips to the next header.
+static int
+argos_csistore_scan(argos_csistore_t *st)
+{
+	argos_csistore_rec_t rec, nrec;
+	struct stat sb;
+	uint64_t off = 0, next, size;
+	int torn, ret = -1;
+
+	store_lock(st, LOCK_SH);
+	if (fstat(st->fd, &sb) != 0)
+		goto out;
+	st->dev = sb.st_dev;
+	st->ino = sb.st_ino;
+	size = sb.st_size;
+	while (off + sizeof(rec) <= size) {
+		if (readn(st->fd, &rec, sizeof(rec), off) != 0)
+			goto out;
+		if (!rec_valid(&rec, off, size))
+			torn = 1;
+		else {
+			// A torn record looks whole when its size reaches into
+			// the records appended after it, so its block is checked
+			// when no header follows it
+			next = off + sizeof(rec) + rec.stored;
+			torn = next < size &&
+				(readn(st->fd, &nrec, sizeof(nrec), next) != 0 ||
+				 !rec_valid(&nrec, next, size)) &&
+				!rec_intact(st, &rec, off);
+		}
+		if (torn) {
+			next = resync(st, off, size);
+			fprintf(stderr, "[ARGOS] CSI store has %llu bytes of "
+					"garbage at %llu\n",
+					(unsigned long long)(next - off),
+					(unsigned long long)off);
+			off = next;
+			continue;
+		}
+		if (index_add(st, rec.hash, off) != 0)
+			goto out;
+		off += sizeof(rec) + rec.stored;
+	}
+	st->bytes = size;
+	ret = 0;
+out:
+	store_lock(st, LOCK_UN);
+	return ret;
+}
+
+argos_csistore_t *
+argos_csistore_open(const char *filename, int writable)
+{
+	argos_csistore_t *st;
+	size_t bufsize;
+
+	if ((st = calloc(1, sizeof(argos_csistore_t))) == NULL)
+		return NULL;
+	st->writable = writable;
+	if (writable)
+		st->fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0644);
+	else
+		st->fd = open(filename, O_RDONLY);
+	if (st->fd < 0) {
+		free(st);
+		return NULL;
+	}
+	bufsize = sizeof(argos_csistore_rec_t) +
+		argos_csistore_bound(ARGOS_CSISTORE_MAX_BLOCK);
+	st->rbuf = malloc(bufsize);
+	st->dbuf = malloc(ARGOS_CSISTORE_MAX_BLOCK);
+	if (!st->rbuf || !st->dbuf ||
+			index_resize(st, INDEX_MIN_SLOTS) != 0 ||
+			argos_csistore_scan(st) != 0) {
+		argos_csistore_close(st);
+		return NULL;
+	}
+	return st;
+}
+
+void
+argos_csistore_close(argos_csistore_t *st)
+{
+	if (!st)
+		return;
+	if (st->fd >= 0)
+		close(st->fd);
+	free(st->index);
+	free(st->rbuf);
+	free(st->dbuf);
+	free(st);
+}
+
+int
+argos_csistore_moved(argos_csistore_t *st, const char *filename)
+{
+	struct stat sb;
+
+	if (stat(filename, &sb) != 0)
+		return 1;
+	return sb.st_dev != st->dev || sb.st_ino != st->ino;
+}
+
+int
+argos_csistore_get(argos_csistore_t *st, int64_t offset, uint64_t hash,
+		void *buf, size_t size)
+{
+	argos_csistore_rec_t rec;
+
+	if (offset < 0 || readn(st->fd, &rec, sizeof(rec), offset) != 0)
+		return -1;
+	if (rec.magic != ARGOS_CSISTORE_MAGIC || rec.hash != hash ||
+			rec.size > size ||
+			rec.stored > argos_csistore_bound(rec.size))
+		return -1;
+	offset += sizeof(rec);
+	if (rec.codec == ARGOS_CSISTORE_RAW) {
+		if (rec.stored != rec.size ||
+				readn(st->fd, buf, rec.size, offset) != 0)
+			return -1;
+	} else if (readn(st->fd, st->rbuf, rec.stored, offset) != 0 ||
+			argos_csistore_decode(st->rbuf, rec.stored, rec.codec,
+				buf, rec.size) != 0)
+		return -1;
+	return rec.size;
+}
+
+int64_t
+argos_csistore_put(argos_csistore_t *st, const void *data, size_t len,
+		uint64_t hash, int *added)
+{
+	argos_csistore_rec_t *rec;
+	unsigned int j;
+	ssize_t n;
+	size_t reclen;
+	off_t end;
+
+	*added = 0;
+	if (len > ARGOS_CSISTORE_MAX_BLOCK)
+		return -1;
+	for (j = hash & (st->slots - 1); st->index[j].offset >= 0;
+			j = (j + 1) & (st->slots - 1)) {
+		if (st->index[j].hash != hash)
+			continue;
+		if (argos_csistore_get(st, st->index[j].offset, hash,
+					st->dbuf, len) == len &&
+				memcmp(st->dbuf, data, len) == 0)
+			return st->index[j].offset;
+	}
+	if (!st->writable)
+		return -1;
+
+	rec = (argos_csistore_rec_t *)st->rbuf;
+	memset(rec, 0, sizeof(*rec));
+	rec->magic = ARGOS_CSISTORE_MAGIC;
+	rec->size = len;
+	rec->hash = hash;
+	rec->stored = argos_csistore_encode(data, len, rec + 1, &rec->codec);
+	reclen = sizeof(*rec) + rec->stored;
+
+	// A single write under the lock, so that a record is never
+	// interleaved with another and a short one can be rolled back
+	store_lock(st, LOCK_EX);
+	if ((end = lseek(st->fd, 0, SEEK_END)) < 0) {
+		store_lock(st, LOCK_UN);
+		return -1;
+	}
+	do {
+		n = write(st->fd, rec, reclen);
+	} while (n < 0 && errno == EINTR);
+	if (n != reclen) {
+		if (n > 0 && ftruncate(st->fd, end) != 0) {
+			perror("Could not roll back CSI store - ftruncate()");
+			st->writable = 0;
+		}
+		store_lock(st, LOCK_UN);
+		return -1;
+	}
+	store_lock(st, LOCK_UN);
+	st->bytes = end + reclen;
+	if (index_add(st, hash, end) != 0)
+		return -1;
+	*added = 1;
+	return end;
+}
+
+void
+argos_csistore_stats(argos_csistore_t *st, unsigned int *blocks,
+		uint64_t *bytes)
+{
+	*blocks = st->blocks;
+	*bytes = st->bytes;
+}
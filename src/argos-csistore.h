@@ -0,0 +1,110 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef ARGOS_CSISTORE_H
+#define ARGOS_CSISTORE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// CSI page store
+//
+// The contents of the pages that a CSI log refers to are kept in an append
+// only file, shared by all the logs written in the same directory. Each
+// page is written once, keyed by the hash of its contents, so that a log
+// only adds the pages that changed since the previous one. The store has
+// no header: it is a sequence of records, each one an
+// argos_csistore_rec_t followed by the stored bytes. The fields are in
+// the byte order of the host that wrote them.
+
+#define ARGOS_CSISTORE_FILE  "argos.csi.store"
+#define ARGOS_CSISTORE_MAGIC 0x42534341 //!< "ACSB"
+
+#define ARGOS_CSISTORE_RAW   0
+#define ARGOS_CSISTORE_ZSTD  1
+
+//! Largest block that can be stored
+#define ARGOS_CSISTORE_MAX_BLOCK 65536
+
+struct argos_csistore_rec_struct {
+	uint32_t magic;
+	uint32_t size;		//!< Size of the block
+	uint32_t stored;	//!< Bytes that follow the record header
+	uint8_t codec;
+	uint8_t pad[3];
+	uint64_t hash;
+} __attribute__((packed));
+
+typedef struct argos_csistore_rec_struct argos_csistore_rec_t;
+
+//! Header of a block kept inline in a log, e.g. the net tracker indices
+struct argos_csistore_blob_struct {
+	uint32_t size;
+	uint32_t stored;
+	uint8_t codec;
+	uint8_t pad[3];
+} __attribute__((packed));
+
+typedef struct argos_csistore_blob_struct argos_csistore_blob_t;
+
+typedef struct argos_csistore argos_csistore_t;
+
+//! zstd level of the new blocks, 0 stores them uncompressed
+extern int argos_csistore_level;
+
+uint64_t argos_csistore_hash(const void *data, size_t len);
+
+argos_csistore_t *argos_csistore_open(const char *filename, int writable);
+void argos_csistore_close(argos_csistore_t *st);
+//! Non zero if filename is no longer the file that st has open
+int argos_csistore_moved(argos_csistore_t *st, const char *filename);
+
+//! Returns the offset of the block, -1 on error. *added is set if the
+//! block was not in the store.
+int64_t argos_csistore_put(argos_csistore_t *st, const void *data,
+		size_t len, uint64_t hash, int *added);
+//! Reads the block at offset into buf. Returns its size, -1 on error.
+int argos_csistore_get(argos_csistore_t *st, int64_t offset, uint64_t hash,
+		void *buf, size_t size);
+
+void argos_csistore_stats(argos_csistore_t *st, unsigned int *blocks,
+		uint64_t *bytes);
+
+//! Compresses len bytes of data into out, which must be able to hold
+//! argos_csistore_bound(len) bytes. Returns the stored size and sets
+//! *codec.
+size_t argos_csistore_encode(const void *data, size_t len, void *out,
+		uint8_t *codec);
+size_t argos_csistore_bound(size_t len);
+//! Returns 0 if exactly size bytes were decoded
+int argos_csistore_decode(const void *in, size_t stored, uint8_t codec,
+		void *out, size_t size);
+
+#endif
@@ -0,0 +1,461 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "qemu-common.h"
+#include "block_int.h"
+#include "argos-disktaint.h"
+
+// The extents of a device are kept in a treap ordered by their first
+// sector. Extents never overlap, and adjacent extents with the same label
+// are merged, so a device that received a single tainted file usually has
+// a handful of them.
+
+#define DT_MAGIC	"ARGOSDT"
+#define DT_VERSION	1
+
+typedef struct DTExtent {
+	uint64_t start;		//!< First sector
+	uint64_t end;		//!< Sector after the last one
+	uint32_t label;
+	uint32_t prio;
+	struct DTExtent *l, *r;
+} DTExtent;
+
+struct ArgosDiskTaint {
+	BlockDriverState *bs;
+	char filename[1024];	//!< Where the map is saved, if at all
+	int dirty;
+	DTExtent *root;
+	int nb_extents;
+	//! Statistics
+	uint64_t rd_hits;	//!< Tainted sectors read
+	uint64_t rd_misses;	//!< Clean sectors read
+	uint64_t wr_tainted;	//!< Tainted sectors written
+	uint64_t wr_clean;	//!< Clean sectors written
+	struct ArgosDiskTaint *next;
+};
+
+//! On disk format, all fields are big endian
+typedef struct DTHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t nb_extents;
+	uint64_t nb_sectors;	//!< Size of the image
+} DTHeader;
+
+typedef struct DTRecord {
+	uint64_t start;
+	uint64_t end;
+	uint32_t label;
+	uint32_t reserved;
+} DTRecord;
+
+int argos_disktaint_enabled = 0;
+
+static ArgosDiskTaint *first_dt = NULL;
+static uint32_t dt_seed = 2463534242U;
+
+//////////////////////////////////////////////////////////////////////////////
+// Extent treap
+
+static uint32_t
+dt_random(void)
+{
+	dt_seed ^= dt_seed << 13;
+	dt_seed ^= dt_seed >> 17;
+	dt_seed ^= dt_seed << 5;
+	return dt_seed;
+}
+
+static DTExtent *
+dt_new(uint64_t start, uint64_t end, uint32_t label)
+{
+	DTExtent *e;
+
+	e = qemu_mallocz(sizeof(DTExtent));
+	if (!e) {
+		fprintf(stderr, "[ARGOS] out of memory\n");
+		exit(1);
+	}
+	e->start = start;
+	e->end = end;
+	e->label = label;
+	e->prio = dt_random();
+	return e;
+}
+
+//! Free a tree and return the number of extents in it
+static int
+dt_free(DTExtent *t)
+{
+	int n;
+
+	if (!t)
+		return 0;
+	n = dt_free(t->l) + dt_free(t->r) + 1;
+	qemu_free(t);
+	return n;
+}
+
+//! Join two trees, all the extents of a being before those of b
+static DTExtent *
+dt_merge(DTExtent *a, DTExtent *b)
+{
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+	if (a->prio > b->prio) {
+		a->r = dt_merge(a->r, b);
+		return a;
+	}
+	b->l = dt_merge(a, b->l);
+	return b;
+}
+
+//! Split a tree in the extents that start before sector and the rest
+static void
+dt_split(DTExtent *t, uint64_t sector, DTExtent **l, DTExtent **r)
+{
+	if (!t) {
+		*l = *r = NULL;
+	} else if (t->start < sector) {
+		dt_split(t->r, sector, &t->r, r);
+		*l = t;
+	} else {
+		dt_split(t->l, sector, l, &t->l);
+		*r = t;
+	}
+}
+
+//! Return the label of a sector, and in *run the number of the following
+//! sectors that have the same label
+static uint32_t
+dt_find(DTExtent *t, uint64_t sector, uint64_t *run)
+{
+	uint64_t next = UINT64_MAX;
+
+	while (t) {
+		if (sector < t->start) {
+			next = t->start;
+			t = t->l;
+		} else if (sector >= t->end) {
+			t = t->r;
+		} else {
+			*run = t->end - sector;
+			return t->label;
+		}
+	}
+	*run = next - sector;
+	return 0;
+}
+
+//! Make sure that no extent crosses sector
+static void
+dt_cut(ArgosDiskTaint *dt, uint64_t sector)
+{
+	DTExtent *e, *n, *l, *r;
+
+	for (e = dt->root; e; ) {
+		if (sector < e->start)
+			e = e->l;
+		else if (sector >= e->end)
+			e = e->r;
+		else
+			break;
+	}
+	if (!e || e->start == sector)
+		return;
+	n = dt_new(sector, e->end, e->label);
+	e->end = sector;
+	dt_split(dt->root, sector, &l, &r);
+	dt->root = dt_merge(dt_merge(l, n), r);
+	dt->nb_extents++;
+}
+
+//! Set the label of the sectors [start, end), 0 clearing them
+static void
+dt_set_range(ArgosDiskTaint *dt, uint64_t start, uint64_t end, uint32_t label)
+{
+	DTExtent *l, *m, *r, *e, *f;
+
+	dt_cut(dt, start);
+	dt_cut(dt, end);
+	dt_split(dt->root, start, &l, &m);
+	dt_split(m, end, &m, &r);
+	dt->nb_extents -= dt_free(m);
+	if (label) {
+		for (e = l; e && e->r; e = e->r)
+			;
+		if (e && e->end == start && e->label == label) {
+			e->end = end;
+		} else {
+			e = dt_new(start, end, label);
+			l = dt_merge(l, e);
+			dt->nb_extents++;
+		}
+		for (f = r; f && f->l; f = f->l)
+			;
+		if (f && f->start == end && f->label == label) {
+			dt_split(r, end + 1, &f, &r);
+			e->end = f->end;
+			dt->nb_extents -= dt_free(f);
+		}
+	}
+	dt->root = dt_merge(l, r);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Persistence
+
+static int
+dt_write_tree(FILE *fp, DTExtent *t)
+{
+	DTRecord rec;
+
+	if (!t)
+		return 0;
+	if (dt_write_tree(fp, t->l) != 0)
+		return -1;
+	memset(&rec, 0, sizeof(rec));
+	rec.start = cpu_to_be64(t->start);
+	rec.end = cpu_to_be64(t->end);
+	rec.label = cpu_to_be32(t->label);
+	if (fwrite(&rec, sizeof(rec), 1, fp) != 1)
+		return -1;
+	return dt_write_tree(fp, t->r);
+}
+
+static void
+dt_save(ArgosDiskTaint *dt)
+{
+	char tmp[1024 + 4];
+	DTHeader hdr;
+	uint64_t nb_sectors;
+	FILE *fp;
+
+	if (!dt->filename[0] || !dt->dirty)
+		return;
+	bdrv_get_geometry(dt->bs, &nb_sectors);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", dt->filename);
+	if ((fp = fopen(tmp, "wb")) == NULL) {
+		perror("Could not save disk taint - fopen()");
+		return;
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, DT_MAGIC, sizeof(DT_MAGIC));
+	hdr.version = cpu_to_be32(DT_VERSION);
+	hdr.nb_extents = cpu_to_be32(dt->nb_extents);
+	hdr.nb_sectors = cpu_to_be64(nb_sectors);
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    dt_write_tree(fp, dt->root) != 0) {
+		fprintf(stderr, "[ARGOS] error writing %s\n", tmp);
+		fclose(fp);
+		unlink(tmp);
+		return;
+	}
+	if (fclose(fp) != 0 || rename(tmp, dt->filename) != 0) {
+		perror("Could not save disk taint - rename()");
+		unlink(tmp);
+		return;
+	}
+	dt->dirty = 0;
+}
+
+static void
+dt_load(ArgosDiskTaint *dt, const char *filename)
+{
+	DTHeader hdr;
+	DTRecord rec;
+	uint64_t nb_sectors, start, end;
+	uint32_t i, n;
+	FILE *fp;
+
+	if ((fp = fopen(filename, "rb")) == NULL)
+		return;
+	bdrv_get_geometry(dt->bs, &nb_sectors);
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    memcmp(hdr.magic, DT_MAGIC, sizeof(DT_MAGIC)) != 0 ||
+	    be32_to_cpu(hdr.version) != DT_VERSION) {
+		fprintf(stderr, "[ARGOS] %s: not a disk taint file, "
+				"ignoring it\n", filename);
+		goto out;
+	}
+	if (be64_to_cpu(hdr.nb_sectors) != nb_sectors) {
+		fprintf(stderr, "[ARGOS] %s: image size changed, ignoring "
+				"it\n", filename);
+		goto out;
+	}
+	n = be32_to_cpu(hdr.nb_extents);
+	for (i = 0; i < n; i++) {
+		if (fread(&rec, sizeof(rec), 1, fp) != 1) {
+			fprintf(stderr, "[ARGOS] %s: truncated\n", filename);
+			break;
+		}
+		start = be64_to_cpu(rec.start);
+		end = be64_to_cpu(rec.end);
+		if (start >= end || end > nb_sectors)
+			continue;
+		dt_set_range(dt, start, end, be32_to_cpu(rec.label));
+	}
+out:
+	fclose(fp);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Interface
+
+//! Keep the taint of a device. The map is loaded from the image's .taint
+//! file, and saved there at exit unless the writes to the image are
+//! discarded.
+ArgosDiskTaint *
+argos_disktaint_open(BlockDriverState *bs)
+{
+	ArgosDiskTaint *dt;
+	char filename[1024 + 8];
+
+	dt = qemu_mallocz(sizeof(ArgosDiskTaint));
+	if (!dt)
+		return NULL;
+	dt->bs = bs;
+	if (bs->is_temporary) {
+		// -snapshot: start from the taint of the original image
+		snprintf(filename, sizeof(filename), "%s.taint",
+				bs->backing_file);
+	} else {
+		snprintf(filename, sizeof(filename), "%s.taint",
+				bs->filename);
+		pstrcpy(dt->filename, sizeof(dt->filename), filename);
+	}
+	dt_load(dt, filename);
+	if (!first_dt)
+		atexit(argos_disktaint_close_all);
+	dt->next = first_dt;
+	first_dt = dt;
+	return dt;
+}
+
+//! Save the maps of all the devices
+void
+argos_disktaint_close_all(void)
+{
+	ArgosDiskTaint *dt;
+
+	for (dt = first_dt; dt; dt = dt->next)
+		dt_save(dt);
+}
+
+//! A fork server child writes to a temporary overlay: its maps are not
+//! saved
+void
+argos_disktaint_after_fork(void)
+{
+	ArgosDiskTaint *dt;
+
+	for (dt = first_dt; dt; dt = dt->next)
+		dt->filename[0] = '\0';
+}
+
+//! Record the labels of sectors that were written
+void
+argos_disktaint_set(ArgosDiskTaint *dt, int64_t sector, int nb_sectors,
+		const uint32_t *labels)
+{
+	int i, n;
+
+	for (i = 0; i < nb_sectors; i += n) {
+		for (n = 1; i + n < nb_sectors && labels[i + n] == labels[i];
+				n++)
+			;
+		if (labels[i])
+			dt->wr_tainted += n;
+		else
+			dt->wr_clean += n;
+		// Clean writes to clean sectors are the common case
+		if (!labels[i] && !dt->root)
+			continue;
+		dt_set_range(dt, sector + i, sector + i + n, labels[i]);
+		dt->dirty = 1;
+	}
+}
+
+//! Get the labels of sectors that are read. Returns the number of tainted
+//! sectors.
+int
+argos_disktaint_get(ArgosDiskTaint *dt, int64_t sector, int nb_sectors,
+		uint32_t *labels)
+{
+	uint64_t run;
+	uint32_t label;
+	int i, j, n, tainted = 0;
+
+	if (!dt->root) {
+		memset(labels, 0, nb_sectors * sizeof(uint32_t));
+		dt->rd_misses += nb_sectors;
+		return 0;
+	}
+	for (i = 0; i < nb_sectors; i += n) {
+		label = dt_find(dt->root, sector + i, &run);
+		n = (run < nb_sectors - i)? run : nb_sectors - i;
+		for (j = 0; j < n; j++)
+			labels[i + j] = label;
+		if (label)
+			tainted += n;
+	}
+	dt->rd_hits += tainted;
+	dt->rd_misses += nb_sectors - tainted;
+	return tainted;
+}
+
+void
+argos_disktaint_dump_info(FILE *f,
+		int (*cpu_fprintf)(FILE *f, const char *fmt, ...))
+{
+	ArgosDiskTaint *dt;
+
+	if (!first_dt) {
+		cpu_fprintf(f, "disk taint is not kept\n");
+		return;
+	}
+	for (dt = first_dt; dt; dt = dt->next) {
+		cpu_fprintf(f, "%s: %d extents%s\n",
+				bdrv_get_device_name(dt->bs), dt->nb_extents,
+				(dt->filename[0])? "" : " (not saved)");
+		cpu_fprintf(f, "  read:    %" PRIu64 " tainted, %" PRIu64
+				" clean sectors\n", dt->rd_hits, dt->rd_misses);
+		cpu_fprintf(f, "  written: %" PRIu64 " tainted, %" PRIu64
+				" clean sectors\n", dt->wr_tainted,
+				dt->wr_clean);
+	}
+}
@@ -0,0 +1,85 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef ARGOS_DISKTAINT_H
+#define ARGOS_DISKTAINT_H
+
+// Disk taint
+//
+// Keeps the taint of the data that the guest writes to its disks, so that
+// tainted data written to disk and read back later are still tainted. The
+// granularity is the sector: a sector is tainted if any of the bytes
+// written to it were, and all of its bytes are tainted when it is read.
+// Each device has a sparse map of extents of sectors that share the same
+// label, which is saved in <image>.taint and loaded again the next time the
+// image is used.
+//
+// A label is the network index of the first tainted byte of a sector, or 1
+// without the network tracker. Network indexes refer to the argos.netlog of
+// the run that wrote the sector.
+
+#include "argos-tag.h"
+
+struct BlockDriverState;
+typedef struct ArgosDiskTaint ArgosDiskTaint;
+
+//! Non zero if the taint of the hard disks is kept
+extern int argos_disktaint_enabled;
+
+ArgosDiskTaint *argos_disktaint_open(struct BlockDriverState *bs);
+void argos_disktaint_close_all(void);
+void argos_disktaint_after_fork(void);
+void argos_disktaint_set(ArgosDiskTaint *dt, int64_t sector, int nb_sectors,
+		const uint32_t *labels);
+int argos_disktaint_get(ArgosDiskTaint *dt, int64_t sector, int nb_sectors,
+		uint32_t *labels);
+void argos_disktaint_dump_info(FILE *f,
+		int (*cpu_fprintf)(FILE *f, const char *fmt, ...));
+
+//! Label of the data of a dirty tag
+static inline uint32_t
+argos_disktaint_label(const argos_rtag_t *tag)
+{
+#ifdef ARGOS_NET_TRACKER
+#ifdef ARGOS_LABEL_SETS
+	const argos_netidx_t *members;
+
+	// Sets only live as long as the process, keep one of their members
+	if (argos_label_isset(tag->netidx) &&
+	    argos_label_members(tag->netidx, &members) > 0)
+		return members[0];
+#endif
+	return argos_tag_netidx(tag);
+#else
+	return 1;
+#endif
+}
+
+#endif
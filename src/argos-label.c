@@ -0,0 +1,353 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "argos-config.h"
+#ifdef ARGOS_LABEL_SETS
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <errno.h>
+
+#include "cpu.h"
+#include "argos.h"
+#include "argos-tag.h"
+#include "hw/hw.h"
+
+//! Buckets of the set hash table
+#define LABEL_HASH_BITS  16
+#define LABEL_HASH_SIZE  (1 << LABEL_HASH_BITS)
+//! Entries of the union cache
+#define LABEL_CACHE_BITS 16
+#define LABEL_CACHE_SIZE (1 << LABEL_CACHE_BITS)
+//! Maximum number of interned sets
+#define LABEL_MAX_SETS   (1 << 22)
+
+struct argos_label_set {
+	uint32_t start;		//!< Offset of the members in the pool
+	uint32_t count;		//!< Number of members
+	uint32_t hash;		//!< Hash of the members
+	uint32_t next;		//!< Next set in the bucket plus one
+};
+
+typedef struct argos_label_set argos_label_set_t;
+
+struct argos_label_cache {
+	argos_netidx_t a, b;
+	argos_netidx_t r;
+};
+
+static argos_label_set_t *label_sets = NULL;
+static uint8_t *label_marks = NULL;	//!< Marks of each log, per set
+static uint32_t label_nb_sets = 0, label_max_sets = 0;
+
+// Sorted members of all sets, back to back
+static argos_netidx_t *label_pool = NULL;
+static uint32_t label_pool_used = 0, label_pool_size = 0;
+
+static uint32_t label_hash[LABEL_HASH_SIZE];
+static struct argos_label_cache label_cache[LABEL_CACHE_SIZE];
+
+static uint32_t
+label_hash_members(const argos_netidx_t *m, int count)
+{
+	uint32_t h = 2166136261U;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		h ^= m[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static int
+label_grow(void)
+{
+	argos_label_set_t *sets;
+	uint8_t *marks;
+	uint32_t n;
+
+	n = (label_max_sets)? label_max_sets * 2 : 4096;
+	if (n > LABEL_MAX_SETS)
+		n = LABEL_MAX_SETS;
+	if (n == label_max_sets)
+		return -1;
+	if (!(sets = realloc(label_sets, n * sizeof(argos_label_set_t))))
+		return -1;
+	label_sets = sets;
+	if (!(marks = realloc(label_marks, n)))
+		return -1;
+	memset(marks + label_max_sets, 0, n - label_max_sets);
+	label_marks = marks;
+	label_max_sets = n;
+	return 0;
+}
+
+static int
+label_pool_reserve(int count)
+{
+	argos_netidx_t *pool;
+	uint32_t n;
+
+	if (label_pool_used + count <= label_pool_size)
+		return 0;
+	n = (label_pool_size)? label_pool_size * 2 : 65536;
+	if (!(pool = realloc(label_pool, n * sizeof(argos_netidx_t))))
+		return -1;
+	label_pool = pool;
+	label_pool_size = n;
+	return 0;
+}
+
+// Return the id of the set holding the count sorted members, adding it to
+// the table if it does not exist yet. Returns 0 if the table is full.
+static argos_netidx_t
+label_intern(const argos_netidx_t *m, int count)
+{
+	argos_label_set_t *s;
+	uint32_t h, i;
+
+	h = label_hash_members(m, count);
+	for (i = label_hash[h & (LABEL_HASH_SIZE - 1)]; i != 0; i = s->next) {
+		s = label_sets + i - 1;
+		if (s->hash == h && s->count == count &&
+		    memcmp(label_pool + s->start, m,
+			   count * sizeof(argos_netidx_t)) == 0)
+			return ARGOS_LABEL_SET_FLAG | (i - 1);
+	}
+
+	if (label_nb_sets == label_max_sets && label_grow() != 0)
+		return 0;
+	if (label_pool_reserve(count) != 0)
+		return 0;
+
+	s = label_sets + label_nb_sets;
+	s->start = label_pool_used;
+	s->count = count;
+	s->hash = h;
+	s->next = label_hash[h & (LABEL_HASH_SIZE - 1)];
+	memcpy(label_pool + label_pool_used, m, count * sizeof(argos_netidx_t));
+	label_pool_used += count;
+	label_hash[h & (LABEL_HASH_SIZE - 1)] = ++label_nb_sets;
+	return ARGOS_LABEL_SET_FLAG | (label_nb_sets - 1);
+}
+
+//! Get the members of a set label. Returns their number, 0 if the label
+//! is not a known set.
+int
+argos_label_members(argos_netidx_t label, const argos_netidx_t **members)
+{
+	argos_label_set_t *s;
+	uint32_t id;
+
+	id = ARGOS_GET_NETIDX(label) & ~ARGOS_LABEL_SET_FLAG;
+	if (id >= label_nb_sets) {
+		*members = NULL;
+		return 0;
+	}
+	s = label_sets + id;
+	*members = label_pool + s->start;
+	return s->count;
+}
+
+// Union of two labels without stage bits
+static argos_netidx_t
+label_union(argos_netidx_t a, argos_netidx_t b)
+{
+	argos_netidx_t m[ARGOS_LABEL_MAX_MEMBERS];
+	const argos_netidx_t *ma, *mb;
+	int na, nb, i, j, n;
+
+	if (argos_label_isset(a)) {
+		na = argos_label_members(a, &ma);
+	} else {
+		ma = &a;
+		na = 1;
+	}
+	if (argos_label_isset(b)) {
+		nb = argos_label_members(b, &mb);
+	} else {
+		mb = &b;
+		nb = 1;
+	}
+
+	for (i = j = n = 0; (i < na || j < nb) && n < ARGOS_LABEL_MAX_MEMBERS;)
+	{
+		if (j == nb || (i < na && ma[i] < mb[j]))
+			m[n++] = ma[i++];
+		else if (i == na || mb[j] < ma[i])
+			m[n++] = mb[j++];
+		else {
+			m[n++] = ma[i++];
+			j++;
+		}
+	}
+
+	// One of the two already contains the other
+	if (n == na && i == na && j == nb)
+		return a;
+	if (n == nb && i == na && j == nb)
+		return b;
+	return label_intern(m, n);
+}
+
+//! Union of two dirty netidx values
+argos_netidx_t
+argos_label_union(argos_netidx_t a, argos_netidx_t b)
+{
+	struct argos_label_cache *c;
+	argos_netidx_t la, lb, r;
+	uint32_t stage;
+
+	la = ARGOS_GET_NETIDX(a);
+	lb = ARGOS_GET_NETIDX(b);
+	if (la > lb) {
+		r = la;
+		la = lb;
+		lb = r;
+	}
+
+	c = label_cache + (((la * 2654435761U) ^ lb) & (LABEL_CACHE_SIZE - 1));
+	if (c->a == la && c->b == lb && c->r != 0) {
+		r = c->r;
+	} else {
+		if (la == lb)
+			r = la;
+		else if (!(r = label_union(la, lb)))
+			// Table is full, fall back to the first label
+			r = ARGOS_GET_NETIDX(a);
+		c->a = la;
+		c->b = lb;
+		c->r = r;
+	}
+
+	stage = ARGOS_GET_STAGE(a);
+	if (ARGOS_GET_STAGE(b) > stage)
+		stage = ARGOS_GET_STAGE(b);
+	ARGOS_SET_STAGE(r, stage);
+	return r;
+}
+
+//! Mark a label to be written out by argos_label_write_marked()
+void
+argos_label_mark(argos_netidx_t label, int mark)
+{
+	uint32_t i;
+
+	if (!argos_label_isset(label))
+		return;
+	i = ARGOS_GET_NETIDX(label) & ~ARGOS_LABEL_SET_FLAG;
+	if (i >= label_nb_sets)
+		return;
+	label_marks[i] |= mark;
+}
+
+// Label table format
+// Id | Count | Members, for every marked set, terminated by a zero id
+// Id = 32 bit set label, as it appears in the netidx fields
+// Count = 32 bit number of members
+// Members = 32 bit network indexes, in ascending order
+int
+argos_label_write_marked(FILE *fp, int mark)
+{
+	argos_label_set_t *s;
+	uint32_t i, hdr[2];
+
+	for (i = 0; i < label_nb_sets; i++) {
+		if (!(label_marks[i] & mark))
+			continue;
+		label_marks[i] &= ~mark;
+		s = label_sets + i;
+		hdr[0] = ARGOS_LABEL_SET_FLAG | i;
+		hdr[1] = s->count;
+		if (fwrite(hdr, sizeof(hdr), 1, fp) != 1 ||
+		    fwrite(label_pool + s->start, sizeof(argos_netidx_t),
+			   s->count, fp) != s->count)
+			goto error;
+	}
+	hdr[0] = 0;
+	if (fwrite(hdr, sizeof(uint32_t), 1, fp) != 1)
+		goto error;
+	return 0;
+error:
+	perror("Could not write label sets - fwrite()");
+	return -1;
+}
+
+void
+argos_label_save(QEMUFile *f, void *opaque)
+{
+	argos_label_set_t *s;
+	uint32_t i;
+	int j;
+
+	qemu_put_be32(f, label_nb_sets);
+	for (i = 0; i < label_nb_sets; i++) {
+		s = label_sets + i;
+		qemu_put_be32(f, s->count);
+		for (j = 0; j < s->count; j++)
+			qemu_put_be32(f, label_pool[s->start + j]);
+	}
+}
+
+// Sets are interned again in the saved order, so that they get their
+// old ids back
+int
+argos_label_load(QEMUFile *f, void *opaque, int version_id)
+{
+	argos_netidx_t m[ARGOS_LABEL_MAX_MEMBERS];
+	uint32_t i, n;
+	int j, count;
+
+	if (version_id != 1)
+		return -EINVAL;
+
+	label_nb_sets = 0;
+	label_pool_used = 0;
+	memset(label_hash, 0, sizeof(label_hash));
+	memset(label_cache, 0, sizeof(label_cache));
+	if (label_marks)
+		memset(label_marks, 0, label_max_sets);
+
+	n = qemu_get_be32(f);
+	for (i = 0; i < n; i++) {
+		count = qemu_get_be32(f);
+		if (count < 2 || count > ARGOS_LABEL_MAX_MEMBERS)
+			return -EINVAL;
+		for (j = 0; j < count; j++)
+			m[j] = qemu_get_be32(f);
+		if (label_intern(m, count) != (ARGOS_LABEL_SET_FLAG | i))
+			return -EINVAL;
+	}
+	return 0;
+}
+
+#endif
@@ -0,0 +1,73 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef ARGOS_LABEL_H
+#define ARGOS_LABEL_H
+
+// Label sets are included by argos-tag.h, after the netidx macros.
+//
+// With label sets the netidx part of a tag is either a plain network
+// index, when the data come from a single byte of argos.netlog, or the id
+// of an interned set of network indexes, when data from several bytes have
+// been combined. Sets are hash-consed, so equal sets always have the same
+// id and ids can be compared directly. The top bit of the netidx part
+// tells the two apart, which limits plain network indexes to
+// ARGOS_LABEL_SET_FLAG - 1.
+
+#define ARGOS_LABEL_SET_FLAG ( (ARGOS_NETIDX_MASK) ^ ((ARGOS_NETIDX_MASK) >> 1) )
+//! Maximum number of network indexes in a set; larger unions are truncated
+#define ARGOS_LABEL_MAX_MEMBERS 64
+
+//! Marks of the logs that reference label sets
+#define ARGOS_LABEL_MARK_CSI     1
+#define ARGOS_LABEL_MARK_TRACKSC 2
+
+#define argos_label_isset(L) ( ARGOS_GET_NETIDX(L) & (ARGOS_LABEL_SET_FLAG) )
+
+argos_netidx_t argos_label_union(argos_netidx_t a, argos_netidx_t b);
+int argos_label_members(argos_netidx_t label, const argos_netidx_t **members);
+void argos_label_mark(argos_netidx_t label, int mark);
+int argos_label_write_marked(FILE *fp, int mark);
+struct QEMUFile;
+void argos_label_save(struct QEMUFile *f, void *opaque);
+int argos_label_load(struct QEMUFile *f, void *opaque, int version_id);
+
+//! Combine two netidx values, keeping the highest stage
+static inline argos_netidx_t
+argos_label_merge(argos_netidx_t a, argos_netidx_t b)
+{
+	if (ARGOS_GET_NETIDX(a) == 0 || a == b)
+		return b;
+	if (ARGOS_GET_NETIDX(b) == 0)
+		return a;
+	return argos_label_union(a, b);
+}
+
+#endif
@@ -56,6 +56,7 @@ extern uint8_t *phys_ram_base;
 #define ARGOS_MEMMAP_STq(p, tag) argos_memmap_stq(ARGOS_OFFSET(p), tag)
 
 #define ARGOS_MEMMAP_CLEAR(p, len) argos_memmap_clear(ARGOS_OFFSET(p), len)
+#define ARGOS_MEMMAP_TAINT(p, len) argos_memmap_taint(ARGOS_OFFSET(p), len)
 
 #ifdef ARGOS_DISABLE_MEMTRACK
 #include "argos-tag.h"
@@ -76,8 +77,10 @@ extern uint8_t *phys_ram_base;
 #define argos_memmap_clrq(addr)
 
 #define argos_memmap_clear(addr, len)
+#define argos_memmap_taint(addr, len)
 
 #define argos_memmap_istainted(addr)	0
+#define argos_memmap_anytainted(addr, len)	0
 
 #define argos_memmap_create(len)	1
 #define argos_memmap_createz(len)	1
@@ -109,9 +112,14 @@ extern uint8_t *phys_ram_base;
 
 #define argos_memmap_clear(addr, len) 			\
 	argos_bytemap_clear(argos_memmap, addr, len)
+//! Bulk tainting is only available without the network tracker
+#define argos_memmap_taint(addr, len) 			\
+	argos_bytemap_taint(argos_memmap, addr, len)
 
 #define argos_memmap_istainted(addr)			\
 	argos_bytemap_istainted(argos_memmap, addr)
+#define argos_memmap_anytainted(addr, len)		\
+	argos_bytemap_anytainted(argos_memmap, addr, len)
 
 #define argos_memmap_create(len)	argos_bytemap_create(len)
 #define argos_memmap_createz(len)	argos_bytemap_createz(len)
@@ -146,9 +154,13 @@ extern uint8_t *phys_ram_base;
 
 #define argos_memmap_clear(addr, len) 			\
 	argos_pagemap_clear(argos_memmap, addr, len)
+#define argos_memmap_taint(addr, len) 			\
+	argos_pagemap_taint(argos_memmap, addr, len)
 
 #define argos_memmap_istainted(addr)			\
 	argos_pagemap_istainted(argos_memmap, addr)
+#define argos_memmap_anytainted(addr, len)		\
+	argos_pagemap_anytainted(argos_memmap, addr, len)
 
 #define argos_memmap_create(len)	argos_pagemap_create(len)
 #define argos_memmap_createz(len)	argos_pagemap_createz(len)
@@ -182,9 +194,13 @@ extern uint8_t *phys_ram_base;
 
 #define argos_memmap_clear(addr, len) 			\
 	argos_bitmap_clear(argos_memmap, addr, len)
+#define argos_memmap_taint(addr, len) 			\
+	argos_bitmap_taint(argos_memmap, addr, len)
 
 #define argos_memmap_istainted(addr)			\
 	argos_bitmap_istainted(argos_memmap, addr)
+#define argos_memmap_anytainted(addr, len)		\
+	argos_bitmap_anytainted(argos_memmap, addr, len)
 
 #define argos_memmap_create(len)	argos_bitmap_create(len)
 #define argos_memmap_createz(len)	argos_bitmap_createz(len)
@@ -0,0 +1,989 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "qemu-common.h"
+#include "argos-netfilter.h"
+
+// Filter expressions
+//
+// expr      := term { ("or" | "||") term }
+// term      := factor { ("and" | "&&") factor }
+// factor    := ("not" | "!") factor | "(" expr ")" | primitive
+// primitive := "ip" | "ip6" | "arp" | "rarp" | "ether proto" N
+//            | "broadcast" | "multicast" | "vlan" [N]
+//            | ("tcp" | "udp") [[dir] "port" N] | "icmp" | "ip proto" N
+//            | [dir] "host" A.B.C.D | [dir] "net" A.B.C.D[/len]
+//            | [dir] "port" N
+//            | "greater" N | "less" N
+// dir       := "src" | "dst"
+//
+// The IP primitives also match frames with an 802.1Q tag.
+
+//! Classic BPF instruction classes and fields
+#define NF_LD		0x00
+#define NF_LDX		0x01
+#define NF_ST		0x02
+#define NF_STX		0x03
+#define NF_ALU		0x04
+#define NF_JMP		0x05
+#define NF_RET		0x06
+#define NF_MISC		0x07
+#define NF_CLASS(c)	((c) & 0x07)
+
+#define NF_W		0x00
+#define NF_H		0x08
+#define NF_B		0x10
+#define NF_SIZE(c)	((c) & 0x18)
+
+#define NF_IMM		0x00
+#define NF_ABS		0x20
+#define NF_IND		0x40
+#define NF_MEM		0x60
+#define NF_LEN		0x80
+#define NF_MSH		0xa0
+#define NF_MODE(c)	((c) & 0xe0)
+
+#define NF_ADD		0x00
+#define NF_SUB		0x10
+#define NF_MUL		0x20
+#define NF_DIV		0x30
+#define NF_OR		0x40
+#define NF_AND		0x50
+#define NF_LSH		0x60
+#define NF_RSH		0x70
+#define NF_NEG		0x80
+#define NF_MOD		0x90
+#define NF_XOR		0xa0
+#define NF_JA		0x00
+#define NF_JEQ		0x10
+#define NF_JGT		0x20
+#define NF_JGE		0x30
+#define NF_JSET		0x40
+#define NF_OP(c)	((c) & 0xf0)
+
+#define NF_K		0x00
+#define NF_X		0x08
+#define NF_SRC(c)	((c) & 0x08)
+#define NF_A		0x10
+#define NF_RVAL(c)	((c) & 0x18)
+
+#define NF_TAX		0x00
+#define NF_TXA		0x80
+#define NF_MISCOP(c)	((c) & 0xf8)
+
+#define NF_MEMWORDS	16
+#define NF_MAX_INSNS	4096
+#define NF_MAX_LABELS	(2 * NF_MAX_INSNS)
+
+//! Ethernet types
+#define NF_ETH_IP	0x0800
+#define NF_ETH_ARP	0x0806
+#define NF_ETH_RARP	0x8035
+#define NF_ETH_VLAN	0x8100
+#define NF_ETH_IP6	0x86dd
+
+struct nf_insn {
+	uint16_t code;
+	uint16_t jt;		//!< Relative jump if true
+	uint16_t jf;		//!< Relative jump if false
+	uint32_t k;
+};
+
+int argos_netfilter_enabled = 0;
+
+static struct nf_insn *nf_prog = NULL;
+static int nf_len = 0;
+static char nf_source[256];
+
+//! Statistics
+static uint64_t nf_hits = 0, nf_misses = 0;
+static uint64_t nf_hit_bytes = 0, nf_miss_bytes = 0;
+
+//////////////////////////////////////////////////////////////////////////////
+// Interpreter
+
+static inline uint32_t
+nf_load(const uint8_t *buf, int len, uint32_t off, int size, int *err)
+{
+	switch (size) {
+	case NF_W:
+		if (off > len - 4 || len < 4)
+			break;
+		return (buf[off] << 24) | (buf[off + 1] << 16) |
+			(buf[off + 2] << 8) | buf[off + 3];
+	case NF_H:
+		if (off > len - 2 || len < 2)
+			break;
+		return (buf[off] << 8) | buf[off + 1];
+	case NF_B:
+		if (off >= len)
+			break;
+		return buf[off];
+	}
+	*err = 1;
+	return 0;
+}
+
+//! Run the program on a frame. Returns 1 if it must be tainted.
+int
+argos_netfilter_run(const uint8_t *buf, int len)
+{
+	const struct nf_insn *pc;
+	uint32_t A = 0, X = 0, M[NF_MEMWORDS], v;
+	int err = 0, ret;
+
+	for (pc = nf_prog; ; pc++) {
+		switch (NF_CLASS(pc->code)) {
+		case NF_LD:
+			switch (NF_MODE(pc->code)) {
+			case NF_IMM:
+				A = pc->k;
+				break;
+			case NF_ABS:
+				A = nf_load(buf, len, pc->k,
+						NF_SIZE(pc->code), &err);
+				break;
+			case NF_IND:
+				A = nf_load(buf, len, X + pc->k,
+						NF_SIZE(pc->code), &err);
+				break;
+			case NF_MEM:
+				A = M[pc->k];
+				break;
+			case NF_LEN:
+				A = len;
+				break;
+			}
+			if (err)
+				goto reject;
+			break;
+		case NF_LDX:
+			switch (NF_MODE(pc->code)) {
+			case NF_IMM:
+				X = pc->k;
+				break;
+			case NF_MEM:
+				X = M[pc->k];
+				break;
+			case NF_LEN:
+				X = len;
+				break;
+			case NF_MSH:
+				X = (nf_load(buf, len, pc->k, NF_B, &err) & 0xf)
+					<< 2;
+				if (err)
+					goto reject;
+				break;
+			}
+			break;
+		case NF_ST:
+			M[pc->k] = A;
+			break;
+		case NF_STX:
+			M[pc->k] = X;
+			break;
+		case NF_ALU:
+			v = (NF_SRC(pc->code) == NF_X)? X : pc->k;
+			switch (NF_OP(pc->code)) {
+			case NF_ADD: A += v; break;
+			case NF_SUB: A -= v; break;
+			case NF_MUL: A *= v; break;
+			case NF_DIV:
+				if (v == 0)
+					goto reject;
+				A /= v;
+				break;
+			case NF_MOD:
+				if (v == 0)
+					goto reject;
+				A %= v;
+				break;
+			case NF_OR:  A |= v; break;
+			case NF_AND: A &= v; break;
+			case NF_XOR: A ^= v; break;
+			// A shift by X is taken modulo 32, as on x86
+			case NF_LSH: A <<= v & 31; break;
+			case NF_RSH: A >>= v & 31; break;
+			case NF_NEG: A = -A; break;
+			}
+			break;
+		case NF_JMP:
+			if (NF_OP(pc->code) == NF_JA) {
+				pc += pc->k;
+				break;
+			}
+			v = (NF_SRC(pc->code) == NF_X)? X : pc->k;
+			switch (NF_OP(pc->code)) {
+			case NF_JEQ:  ret = (A == v); break;
+			case NF_JGT:  ret = (A > v); break;
+			case NF_JGE:  ret = (A >= v); break;
+			default:      ret = (A & v) != 0; break;
+			}
+			pc += (ret)? pc->jt : pc->jf;
+			break;
+		case NF_RET:
+			ret = (NF_RVAL(pc->code) == NF_A)? A : pc->k;
+			goto done;
+		case NF_MISC:
+			if (NF_MISCOP(pc->code) == NF_TAX)
+				X = A;
+			else
+				A = X;
+			break;
+		}
+	}
+reject:
+	ret = 0;
+done:
+	if (ret) {
+		nf_hits++;
+		nf_hit_bytes += len;
+		return 1;
+	}
+	nf_misses++;
+	nf_miss_bytes += len;
+	return 0;
+}
+
+// Check that a program only uses known instructions, always terminates
+// and does not access memory outside the scratch words
+static int
+nf_validate(const struct nf_insn *prog, int len)
+{
+	const struct nf_insn *p;
+	int i, valid;
+
+	if (len <= 0 || len > NF_MAX_INSNS)
+		return -1;
+	for (i = 0; i < len; i++) {
+		p = prog + i;
+		valid = 0;
+		switch (NF_CLASS(p->code)) {
+		case NF_LD:
+		case NF_LDX:
+			switch (NF_MODE(p->code)) {
+			case NF_MEM:
+				valid = p->k < NF_MEMWORDS;
+				break;
+			case NF_MSH:
+				valid = NF_CLASS(p->code) == NF_LDX;
+				break;
+			case NF_ABS:
+			case NF_IND:
+				valid = NF_CLASS(p->code) == NF_LD &&
+					NF_SIZE(p->code) != 0x18;
+				break;
+			case NF_IMM:
+			case NF_LEN:
+				valid = 1;
+				break;
+			}
+			break;
+		case NF_ST:
+		case NF_STX:
+			valid = p->k < NF_MEMWORDS;
+			break;
+		case NF_ALU:
+			valid = NF_OP(p->code) <= NF_XOR &&
+				!((NF_OP(p->code) == NF_DIV ||
+				   NF_OP(p->code) == NF_MOD) &&
+				  NF_SRC(p->code) == NF_K && p->k == 0) &&
+				!((NF_OP(p->code) == NF_LSH ||
+				   NF_OP(p->code) == NF_RSH) &&
+				  NF_SRC(p->code) == NF_K && p->k >= 32);
+			break;
+		case NF_JMP:
+			if (NF_OP(p->code) == NF_JA)
+				valid = p->k < len - i - 1;
+			else
+				valid = NF_OP(p->code) <= NF_JSET &&
+					p->jt < len - i - 1 &&
+					p->jf < len - i - 1;
+			break;
+		case NF_RET:
+			valid = NF_RVAL(p->code) == NF_K ||
+				NF_RVAL(p->code) == NF_A;
+			break;
+		case NF_MISC:
+			valid = NF_MISCOP(p->code) == NF_TAX ||
+				NF_MISCOP(p->code) == NF_TXA;
+			break;
+		}
+		if (!valid) {
+			fprintf(stderr, "[ARGOS] invalid filter instruction %d: "
+					"%u %u %u %u\n", i, p->code, p->jt,
+					p->jf, p->k);
+			return -1;
+		}
+	}
+	if (NF_CLASS(prog[len - 1].code) != NF_RET) {
+		fprintf(stderr, "[ARGOS] filter does not end with a return\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int
+nf_install(struct nf_insn *prog, int len, const char *source)
+{
+	if (nf_validate(prog, len) != 0) {
+		free(prog);
+		return -1;
+	}
+	free(nf_prog);
+	nf_prog = prog;
+	nf_len = len;
+	pstrcpy(nf_source, sizeof(nf_source), source);
+	nf_hits = nf_misses = nf_hit_bytes = nf_miss_bytes = 0;
+	argos_netfilter_enabled = 1;
+	return 0;
+}
+
+//! Load a program in the format printed by "tcpdump -ddd"
+int
+argos_netfilter_load(const char *filename)
+{
+	struct nf_insn *prog;
+	unsigned int code, jt, jf, k;
+	FILE *fp;
+	int i, n;
+
+	if (!(fp = fopen(filename, "r"))) {
+		perror("Could not open taint filter - fopen()");
+		return -1;
+	}
+	if (fscanf(fp, "%d", &n) != 1 || n <= 0 || n > NF_MAX_INSNS) {
+		fprintf(stderr, "[ARGOS] %s: bad instruction count\n",
+				filename);
+		fclose(fp);
+		return -1;
+	}
+	prog = calloc(n, sizeof(struct nf_insn));
+	for (i = 0; prog && i < n; i++) {
+		if (fscanf(fp, "%u %u %u %u", &code, &jt, &jf, &k) != 4)
+			break;
+		prog[i].code = code;
+		prog[i].jt = jt;
+		prog[i].jf = jf;
+		prog[i].k = k;
+	}
+	fclose(fp);
+	if (!prog || i < n) {
+		fprintf(stderr, "[ARGOS] %s: truncated program\n", filename);
+		free(prog);
+		return -1;
+	}
+	return nf_install(prog, n, filename);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Compiler
+
+enum nf_node_type { NF_NODE_AND, NF_NODE_OR, NF_NODE_NOT, NF_NODE_PRIM };
+
+enum nf_prim {
+	NF_P_ETHER,		//!< Ethernet type
+	NF_P_BCAST,
+	NF_P_MCAST,
+	NF_P_VLAN,		//!< Any 802.1Q tag, or a VLAN id
+	NF_P_IPPROTO,
+	NF_P_HOST,
+	NF_P_PORT,
+	NF_P_GREATER,
+	NF_P_LESS,
+};
+
+//! Directions of host, net and port
+#define NF_DIR_SRC 1
+#define NF_DIR_DST 2
+#define NF_DIR_ANY (NF_DIR_SRC | NF_DIR_DST)
+
+struct nf_node {
+	enum nf_node_type type;
+	struct nf_node *l, *r;
+	enum nf_prim prim;
+	int dir;
+	int any;		//!< VLAN without an id
+	uint32_t val, mask;
+	uint32_t proto;		//!< IP protocol of a port, 0 for TCP or UDP
+};
+
+struct nf_compiler {
+	const char *p;		//!< Next character of the expression
+	char tok[64];		//!< Current token
+	struct nf_insn *prog;
+	int len;
+	int labels[NF_MAX_LABELS];
+	int nb_labels;
+	int error;
+};
+
+static void
+nf_next(struct nf_compiler *c)
+{
+	int n = 0;
+
+	while (isspace((unsigned char)*c->p))
+		c->p++;
+	if (*c->p == '\0') {
+		c->tok[0] = '\0';
+		return;
+	}
+	if ((c->p[0] == '&' && c->p[1] == '&') ||
+	    (c->p[0] == '|' && c->p[1] == '|')) {
+		c->tok[n++] = *c->p++;
+		c->tok[n++] = *c->p++;
+	} else if (strchr("()!", *c->p)) {
+		c->tok[n++] = *c->p++;
+	} else {
+		while (*c->p != '\0' && !isspace((unsigned char)*c->p) &&
+		       !strchr("()!&|", *c->p) && n < sizeof(c->tok) - 1)
+			c->tok[n++] = *c->p++;
+	}
+	c->tok[n] = '\0';
+}
+
+static void
+nf_error(struct nf_compiler *c, const char *msg)
+{
+	if (!c->error)
+		fprintf(stderr, "[ARGOS] taint filter: %s near \"%s\"\n",
+				msg, c->tok);
+	c->error = 1;
+}
+
+static int
+nf_accept(struct nf_compiler *c, const char *tok)
+{
+	if (strcmp(c->tok, tok) != 0)
+		return 0;
+	nf_next(c);
+	return 1;
+}
+
+static uint32_t
+nf_number(struct nf_compiler *c)
+{
+	char *end;
+	unsigned long v;
+
+	v = strtoul(c->tok, &end, 0);
+	if (c->tok[0] == '\0' || *end != '\0')
+		nf_error(c, "number expected");
+	nf_next(c);
+	return v;
+}
+
+//! Parse A.B.C.D[/len], with the net mask in *mask
+static uint32_t
+nf_address(struct nf_compiler *c, uint32_t *mask, int allow_len)
+{
+	unsigned int b[4], bits = 32;
+	char extra;
+	int n;
+
+	n = sscanf(c->tok, "%u.%u.%u.%u/%u%c", &b[0], &b[1], &b[2], &b[3],
+			&bits, &extra);
+	if (n < 4 || n == 6 || (n == 5 && !allow_len) || bits > 32 ||
+	    b[0] > 255 || b[1] > 255 || b[2] > 255 || b[3] > 255) {
+		nf_error(c, "address expected");
+		return 0;
+	}
+	nf_next(c);
+	*mask = (bits)? 0xffffffffU << (32 - bits) : 0;
+	return ((b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3]) & *mask;
+}
+
+static struct nf_node *
+nf_node(enum nf_node_type type, struct nf_node *l, struct nf_node *r)
+{
+	struct nf_node *n;
+
+	n = calloc(1, sizeof(struct nf_node));
+	if (!n) {
+		fprintf(stderr, "[ARGOS] out of memory\n");
+		exit(1);
+	}
+	n->type = type;
+	n->l = l;
+	n->r = r;
+	return n;
+}
+
+static struct nf_node *
+nf_prim(enum nf_prim prim, uint32_t val)
+{
+	struct nf_node *n;
+
+	n = nf_node(NF_NODE_PRIM, NULL, NULL);
+	n->prim = prim;
+	n->val = val;
+	n->mask = 0xffffffff;
+	n->dir = NF_DIR_ANY;
+	return n;
+}
+
+static void
+nf_free(struct nf_node *n)
+{
+	if (!n)
+		return;
+	nf_free(n->l);
+	nf_free(n->r);
+	free(n);
+}
+
+static struct nf_node *nf_parse_expr(struct nf_compiler *c);
+
+static struct nf_node *
+nf_parse_port(struct nf_compiler *c, int dir, uint32_t proto)
+{
+	struct nf_node *n;
+
+	n = nf_prim(NF_P_PORT, 0);
+	n->dir = dir;
+	n->proto = proto;
+	n->val = nf_number(c);
+	if (n->val > 0xffff)
+		nf_error(c, "bad port");
+	return n;
+}
+
+static struct nf_node *
+nf_parse_primitive(struct nf_compiler *c)
+{
+	struct nf_node *n;
+	int dir = NF_DIR_ANY;
+
+	if (nf_accept(c, "src"))
+		dir = NF_DIR_SRC;
+	else if (nf_accept(c, "dst"))
+		dir = NF_DIR_DST;
+
+	if (nf_accept(c, "host")) {
+		n = nf_prim(NF_P_HOST, 0);
+		n->val = nf_address(c, &n->mask, 0);
+	} else if (nf_accept(c, "net")) {
+		n = nf_prim(NF_P_HOST, 0);
+		n->val = nf_address(c, &n->mask, 1);
+	} else if (nf_accept(c, "port")) {
+		return nf_parse_port(c, dir, 0);
+	} else if (dir != NF_DIR_ANY) {
+		nf_error(c, "host, net or port expected");
+		return nf_prim(NF_P_BCAST, 0);
+	} else if (nf_accept(c, "ip")) {
+		if (nf_accept(c, "proto"))
+			return nf_prim(NF_P_IPPROTO, nf_number(c));
+		return nf_prim(NF_P_ETHER, NF_ETH_IP);
+	} else if (nf_accept(c, "ip6")) {
+		return nf_prim(NF_P_ETHER, NF_ETH_IP6);
+	} else if (nf_accept(c, "arp")) {
+		return nf_prim(NF_P_ETHER, NF_ETH_ARP);
+	} else if (nf_accept(c, "rarp")) {
+		return nf_prim(NF_P_ETHER, NF_ETH_RARP);
+	} else if (nf_accept(c, "ether")) {
+		if (nf_accept(c, "broadcast"))
+			return nf_prim(NF_P_BCAST, 0);
+		if (nf_accept(c, "multicast"))
+			return nf_prim(NF_P_MCAST, 0);
+		if (!nf_accept(c, "proto"))
+			nf_error(c, "proto expected");
+		return nf_prim(NF_P_ETHER, nf_number(c) & 0xffff);
+	} else if (nf_accept(c, "broadcast")) {
+		return nf_prim(NF_P_BCAST, 0);
+	} else if (nf_accept(c, "multicast")) {
+		return nf_prim(NF_P_MCAST, 0);
+	} else if (nf_accept(c, "vlan")) {
+		n = nf_prim(NF_P_VLAN, 0);
+		n->any = !isdigit((unsigned char)c->tok[0]);
+		if (!n->any)
+			n->val = nf_number(c) & 0xfff;
+	} else if (!strcmp(c->tok, "tcp") || !strcmp(c->tok, "udp")) {
+		uint32_t proto = (c->tok[0] == 't')? 6 : 17;
+
+		nf_next(c);
+		if (nf_accept(c, "src"))
+			dir = NF_DIR_SRC;
+		else if (nf_accept(c, "dst"))
+			dir = NF_DIR_DST;
+		if (nf_accept(c, "port"))
+			return nf_parse_port(c, dir, proto);
+		if (dir != NF_DIR_ANY)
+			nf_error(c, "port expected");
+		return nf_prim(NF_P_IPPROTO, proto);
+	} else if (nf_accept(c, "icmp")) {
+		return nf_prim(NF_P_IPPROTO, 1);
+	} else if (nf_accept(c, "greater")) {
+		return nf_prim(NF_P_GREATER, nf_number(c));
+	} else if (nf_accept(c, "less")) {
+		return nf_prim(NF_P_LESS, nf_number(c));
+	} else {
+		nf_error(c, "unknown primitive");
+		return nf_prim(NF_P_BCAST, 0);
+	}
+	n->dir = dir;
+	return n;
+}
+
+static struct nf_node *
+nf_parse_factor(struct nf_compiler *c)
+{
+	struct nf_node *n;
+
+	if (nf_accept(c, "not") || nf_accept(c, "!"))
+		return nf_node(NF_NODE_NOT, nf_parse_factor(c), NULL);
+	if (nf_accept(c, "(")) {
+		n = nf_parse_expr(c);
+		if (!nf_accept(c, ")"))
+			nf_error(c, "')' expected");
+		return n;
+	}
+	return nf_parse_primitive(c);
+}
+
+static struct nf_node *
+nf_parse_term(struct nf_compiler *c)
+{
+	struct nf_node *n;
+
+	n = nf_parse_factor(c);
+	while (!c->error && (nf_accept(c, "and") || nf_accept(c, "&&")))
+		n = nf_node(NF_NODE_AND, n, nf_parse_factor(c));
+	return n;
+}
+
+static struct nf_node *
+nf_parse_expr(struct nf_compiler *c)
+{
+	struct nf_node *n;
+
+	n = nf_parse_term(c);
+	while (!c->error && (nf_accept(c, "or") || nf_accept(c, "||")))
+		n = nf_node(NF_NODE_OR, n, nf_parse_term(c));
+	return n;
+}
+
+// Code generation
+//
+// Jumps are generated with label numbers in jt, jf and the k of JA, and
+// are made relative once the whole program has been emitted. All the
+// jumps are forward, as BPF requires.
+
+static int
+nf_label(struct nf_compiler *c)
+{
+	if (c->nb_labels == NF_MAX_LABELS) {
+		c->error = 1;
+		return 0;
+	}
+	c->labels[c->nb_labels] = -1;
+	return c->nb_labels++;
+}
+
+static void
+nf_place(struct nf_compiler *c, int label)
+{
+	c->labels[label] = c->len;
+}
+
+static void
+nf_emit(struct nf_compiler *c, uint16_t code, uint32_t k, int jt, int jf)
+{
+	struct nf_insn *i;
+
+	if (c->len == NF_MAX_INSNS) {
+		if (!c->error)
+			fprintf(stderr, "[ARGOS] taint filter too long\n");
+		c->error = 1;
+		return;
+	}
+	i = c->prog + c->len++;
+	i->code = code;
+	i->k = k;
+	i->jt = jt;
+	i->jf = jf;
+}
+
+#define nf_stmt(c, code, k) nf_emit(c, code, k, 0, 0)
+
+//! Leave the ethernet type in A and the offset of the L3 header in X
+static void
+nf_gen_l3(struct nf_compiler *c)
+{
+	int tagged = nf_label(c), untagged = nf_label(c), done = nf_label(c);
+
+	nf_stmt(c, NF_LD | NF_H | NF_ABS, 12);
+	nf_emit(c, NF_JMP | NF_JEQ | NF_K, NF_ETH_VLAN, tagged, untagged);
+	nf_place(c, tagged);
+	nf_stmt(c, NF_LDX | NF_IMM, 18);
+	nf_stmt(c, NF_LD | NF_H | NF_ABS, 16);
+	nf_stmt(c, NF_JMP | NF_JA, done);
+	nf_place(c, untagged);
+	nf_stmt(c, NF_LDX | NF_IMM, 14);
+	nf_place(c, done);
+}
+
+//! Check for an IPv4 header, after nf_gen_l3(). The fragment test is left
+//! to the primitives that read the transport header
+static void
+nf_gen_ipv4(struct nf_compiler *c, int f)
+{
+	int next = nf_label(c);
+
+	nf_emit(c, NF_JMP | NF_JEQ | NF_K, NF_ETH_IP, next, f);
+	nf_place(c, next);
+}
+
+static void
+nf_gen_prim(struct nf_compiler *c, struct nf_node *n, int t, int f)
+{
+	int next, next2, l4;
+
+	switch (n->prim) {
+	case NF_P_ETHER:
+		nf_gen_l3(c);
+		nf_emit(c, NF_JMP | NF_JEQ | NF_K, n->val, t, f);
+		break;
+	case NF_P_BCAST:
+		next = nf_label(c);
+		nf_stmt(c, NF_LD | NF_W | NF_ABS, 0);
+		nf_emit(c, NF_JMP | NF_JEQ | NF_K, 0xffffffff, next, f);
+		nf_place(c, next);
+		nf_stmt(c, NF_LD | NF_H | NF_ABS, 4);
+		nf_emit(c, NF_JMP | NF_JEQ | NF_K, 0xffff, t, f);
+		break;
+	case NF_P_MCAST:
+		nf_stmt(c, NF_LD | NF_B | NF_ABS, 0);
+		nf_emit(c, NF_JMP | NF_JSET | NF_K, 1, t, f);
+		break;
+	case NF_P_VLAN:
+		next = nf_label(c);
+		nf_stmt(c, NF_LD | NF_H | NF_ABS, 12);
+		nf_emit(c, NF_JMP | NF_JEQ | NF_K, NF_ETH_VLAN,
+				(n->any)? t : next, f);
+		if (n->any)
+			break;
+		nf_place(c, next);
+		nf_stmt(c, NF_LD | NF_H | NF_ABS, 14);
+		nf_stmt(c, NF_ALU | NF_AND | NF_K, 0xfff);
+		nf_emit(c, NF_JMP | NF_JEQ | NF_K, n->val, t, f);
+		break;
+	case NF_P_IPPROTO:
+		nf_gen_l3(c);
+		nf_gen_ipv4(c, f);
+		nf_stmt(c, NF_LD | NF_B | NF_IND, 9);
+		nf_emit(c, NF_JMP | NF_JEQ | NF_K, n->val, t, f);
+		break;
+	case NF_P_HOST:
+		next = nf_label(c);
+		nf_gen_l3(c);
+		nf_gen_ipv4(c, f);
+		if (n->dir & NF_DIR_SRC) {
+			nf_stmt(c, NF_LD | NF_W | NF_IND, 12);
+			if (n->mask != 0xffffffff)
+				nf_stmt(c, NF_ALU | NF_AND | NF_K, n->mask);
+			nf_emit(c, NF_JMP | NF_JEQ | NF_K, n->val, t,
+					(n->dir & NF_DIR_DST)? next : f);
+		}
+		nf_place(c, next);
+		if (n->dir & NF_DIR_DST) {
+			nf_stmt(c, NF_LD | NF_W | NF_IND, 16);
+			if (n->mask != 0xffffffff)
+				nf_stmt(c, NF_ALU | NF_AND | NF_K, n->mask);
+			nf_emit(c, NF_JMP | NF_JEQ | NF_K, n->val, t, f);
+		}
+		break;
+	case NF_P_PORT:
+		next = nf_label(c);
+		next2 = nf_label(c);
+		l4 = nf_label(c);
+		nf_gen_l3(c);
+		nf_gen_ipv4(c, f);
+		nf_stmt(c, NF_LD | NF_B | NF_IND, 9);
+		if (n->proto) {
+			nf_emit(c, NF_JMP | NF_JEQ | NF_K, n->proto, l4, f);
+		} else {
+			nf_emit(c, NF_JMP | NF_JEQ | NF_K, 6, l4, next);
+			nf_place(c, next);
+			nf_emit(c, NF_JMP | NF_JEQ | NF_K, 17, l4, f);
+		}
+		nf_place(c, l4);
+		// Only the first fragment has the ports
+		nf_stmt(c, NF_LD | NF_H | NF_IND, 6);
+		nf_emit(c, NF_JMP | NF_JSET | NF_K, 0x1fff, f, next2);
+		nf_place(c, next2);
+		// X += IHL * 4
+		nf_stmt(c, NF_LD | NF_B | NF_IND, 0);
+		nf_stmt(c, NF_ALU | NF_AND | NF_K, 0xf);
+		nf_stmt(c, NF_ALU | NF_LSH | NF_K, 2);
+		nf_stmt(c, NF_ALU | NF_ADD | NF_X, 0);
+		nf_stmt(c, NF_MISC | NF_TAX, 0);
+		next = nf_label(c);
+		if (n->dir & NF_DIR_SRC) {
+			nf_stmt(c, NF_LD | NF_H | NF_IND, 0);
+			nf_emit(c, NF_JMP | NF_JEQ | NF_K, n->val, t,
+					(n->dir & NF_DIR_DST)? next : f);
+		}
+		nf_place(c, next);
+		if (n->dir & NF_DIR_DST) {
+			nf_stmt(c, NF_LD | NF_H | NF_IND, 2);
+			nf_emit(c, NF_JMP | NF_JEQ | NF_K, n->val, t, f);
+		}
+		break;
+	case NF_P_GREATER:
+		nf_stmt(c, NF_LD | NF_W | NF_LEN, 0);
+		nf_emit(c, NF_JMP | NF_JGE | NF_K, n->val, t, f);
+		break;
+	case NF_P_LESS:
+		nf_stmt(c, NF_LD | NF_W | NF_LEN, 0);
+		nf_emit(c, NF_JMP | NF_JGT | NF_K, n->val, f, t);
+		break;
+	}
+}
+
+//! Generate code that jumps to label t if the node matches, f otherwise
+static void
+nf_gen(struct nf_compiler *c, struct nf_node *n, int t, int f)
+{
+	int next;
+
+	switch (n->type) {
+	case NF_NODE_AND:
+		next = nf_label(c);
+		nf_gen(c, n->l, next, f);
+		nf_place(c, next);
+		nf_gen(c, n->r, t, f);
+		break;
+	case NF_NODE_OR:
+		next = nf_label(c);
+		nf_gen(c, n->l, t, next);
+		nf_place(c, next);
+		nf_gen(c, n->r, t, f);
+		break;
+	case NF_NODE_NOT:
+		nf_gen(c, n->l, f, t);
+		break;
+	case NF_NODE_PRIM:
+		nf_gen_prim(c, n, t, f);
+		break;
+	}
+}
+
+//! Turn the labels into relative jumps
+static int
+nf_resolve(struct nf_compiler *c)
+{
+	struct nf_insn *i;
+	int pc, jt, jf;
+
+	for (pc = 0; pc < c->len; pc++) {
+		i = c->prog + pc;
+		if (NF_CLASS(i->code) != NF_JMP)
+			continue;
+		if (NF_OP(i->code) == NF_JA) {
+			i->k = c->labels[i->k] - pc - 1;
+			continue;
+		}
+		jt = c->labels[i->jt] - pc - 1;
+		jf = c->labels[i->jf] - pc - 1;
+		if (jt < 0 || jf < 0 || jt > 0xffff || jf > 0xffff)
+			return -1;
+		i->jt = jt;
+		i->jf = jf;
+	}
+	return 0;
+}
+
+//! Compile a filter expression and make it the taint filter
+int
+argos_netfilter_compile(const char *expr)
+{
+	struct nf_compiler *c;
+	struct nf_node *root;
+	struct nf_insn *prog;
+	int t, f, len;
+
+	c = calloc(1, sizeof(struct nf_compiler));
+	prog = calloc(NF_MAX_INSNS, sizeof(struct nf_insn));
+	if (!c || !prog) {
+		fprintf(stderr, "[ARGOS] out of memory\n");
+		exit(1);
+	}
+	c->p = expr;
+	c->prog = prog;
+	nf_next(c);
+	root = nf_parse_expr(c);
+	if (!c->error && c->tok[0] != '\0')
+		nf_error(c, "end of expression expected");
+	if (!c->error) {
+		t = nf_label(c);
+		f = nf_label(c);
+		nf_gen(c, root, t, f);
+		nf_place(c, t);
+		nf_stmt(c, NF_RET | NF_K, 1);
+		nf_place(c, f);
+		nf_stmt(c, NF_RET | NF_K, 0);
+		if (!c->error && nf_resolve(c) != 0) {
+			fprintf(stderr, "[ARGOS] taint filter too long\n");
+			c->error = 1;
+		}
+	}
+	nf_free(root);
+	len = c->len;
+	if (c->error) {
+		free(c);
+		free(prog);
+		return -1;
+	}
+	free(c);
+	return nf_install(prog, len, expr);
+}
+
+void
+argos_netfilter_dump_info(FILE *f,
+		int (*cpu_fprintf)(FILE *f, const char *fmt, ...))
+{
+	if (!argos_netfilter_enabled) {
+		cpu_fprintf(f, "no taint filter, all received frames are "
+				"tainted\n");
+		return;
+	}
+	cpu_fprintf(f, "taint filter: %s (%d instructions)\n", nf_source,
+			nf_len);
+	cpu_fprintf(f, "tainted frames: %" PRIu64 " (%" PRIu64 " bytes)\n",
+			nf_hits, nf_hit_bytes);
+	cpu_fprintf(f, "clean frames:   %" PRIu64 " (%" PRIu64 " bytes)\n",
+			nf_misses, nf_miss_bytes);
+}
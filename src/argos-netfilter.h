@@ -0,0 +1,60 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef ARGOS_NETFILTER_H
+#define ARGOS_NETFILTER_H
+
+// Taint source filter
+//
+// Decides which of the received frames are tainted. The filter is a
+// classic BPF program, either compiled from a small tcpdump like
+// expression or loaded from the output of "tcpdump -ddd". Frames that it
+// rejects are delivered clean and are not written to argos.netlog.
+
+int argos_netfilter_compile(const char *expr);
+int argos_netfilter_load(const char *filename);
+void argos_netfilter_dump_info(FILE *f,
+		int (*cpu_fprintf)(FILE *f, const char *fmt, ...));
+
+//! Non zero if the program is loaded
+extern int argos_netfilter_enabled;
+
+int argos_netfilter_run(const uint8_t *buf, int len);
+
+//! Returns 1 if the frame must be tainted
+static inline int
+argos_netfilter_match(const uint8_t *buf, int len)
+{
+	if (!argos_netfilter_enabled)
+		return 1;
+	return argos_netfilter_run(buf, len);
+}
+
+#endif
@@ -0,0 +1,383 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "cpu.h"
+#include "argos-osprofile.h"
+
+#ifdef TARGET_X86_64
+# define LINUX_KERNEL_START 0xffff810000000000ULL
+# define LINUX_USER_LAST    0x00007fffffffffffULL
+# define LINUX_KERNEL_LAST  0xffffffffffffffffULL
+#else
+# define LINUX_KERNEL_START 0xc0000000U
+# define LINUX_USER_LAST    0xbfffffffU
+# define LINUX_KERNEL_LAST  0xffffffffU
+#endif
+
+// The first and the last 64KB of the Windows user space are never mapped
+#define WINDOWS_KERNEL_START 0x80000000U
+#define WINDOWS_USER_FIRST   0x00010000U
+#define WINDOWS_USER_LAST    0x7ffeffffU
+#define WINDOWS_KERNEL_LAST  0xffffffffU
+
+static const argos_osprofile_t builtin_profiles[] = {
+	{
+		.name = "linux",
+		.os = ARGOS_OS_LINUX,
+		.kernel_start = LINUX_KERNEL_START,
+		.kernel_last = LINUX_KERNEL_LAST,
+		.nranges = { 1, 1 },
+		.ranges = {
+			{ { 0, LINUX_USER_LAST } },
+			{ { LINUX_KERNEL_START, LINUX_KERNEL_LAST } },
+		},
+		.syscall_int = 0x80,
+		.syscall_insns = ARGOS_SYSCALL_SYSENTER | ARGOS_SYSCALL_SYSCALL,
+	},
+	{
+		.name = "win2k",
+		.os = ARGOS_OS_WIN2K,
+		.kernel_start = WINDOWS_KERNEL_START,
+		.kernel_last = WINDOWS_KERNEL_LAST,
+		.nranges = { 1, 1 },
+		.ranges = {
+			{ { WINDOWS_USER_FIRST, WINDOWS_USER_LAST } },
+			{ { WINDOWS_KERNEL_START, WINDOWS_KERNEL_LAST } },
+		},
+		.syscall_int = 0x2e,
+		.syscall_insns = ARGOS_SYSCALL_SYSENTER | ARGOS_SYSCALL_SYSCALL,
+	},
+	{
+		.name = "winxp",
+		.os = ARGOS_OS_WINXP,
+		.kernel_start = WINDOWS_KERNEL_START,
+		.kernel_last = WINDOWS_KERNEL_LAST,
+		.nranges = { 1, 1 },
+		.ranges = {
+			{ { WINDOWS_USER_FIRST, WINDOWS_USER_LAST } },
+			{ { WINDOWS_KERNEL_START, WINDOWS_KERNEL_LAST } },
+		},
+		.has_internals = 1,
+		.teb_client_id = 0x20,
+		.teb_peb = 0x30,
+		.peb_ldr = 0xc,
+		.ldr_initialized = 0x4,
+		.ldr_load_order = 0xc,
+		.ldr_module_base = 0x18,
+		.ldr_module_name = 0x2c,
+		.client_id_thread = 0x4,
+		.syscall_int = -1,
+		.syscall_insns = ARGOS_SYSCALL_SYSENTER | ARGOS_SYSCALL_SYSCALL,
+	},
+};
+
+#define NB_BUILTIN_PROFILES \
+	(sizeof(builtin_profiles) / sizeof(builtin_profiles[0]))
+
+static const char *os_names[] = { "linux", "win2k", "winxp" };
+
+static const struct {
+	const char *key;
+	size_t offset;
+} internals_keys[] = {
+	{ "teb_client_id", offsetof(argos_osprofile_t, teb_client_id) },
+	{ "teb_peb", offsetof(argos_osprofile_t, teb_peb) },
+	{ "peb_ldr", offsetof(argos_osprofile_t, peb_ldr) },
+	{ "ldr_initialized", offsetof(argos_osprofile_t, ldr_initialized) },
+	{ "ldr_load_order", offsetof(argos_osprofile_t, ldr_load_order) },
+	{ "ldr_module_base", offsetof(argos_osprofile_t, ldr_module_base) },
+	{ "ldr_module_name", offsetof(argos_osprofile_t, ldr_module_name) },
+	{ "client_id_thread", offsetof(argos_osprofile_t, client_id_thread) },
+	{ NULL, 0 }
+};
+
+argos_osprofile_t argos_osprofile = builtin_profiles[ARGOS_OS_LINUX];
+
+static const argos_osprofile_t *
+builtin_find(const char *name)
+{
+	int i;
+
+	for (i = 0; i < NB_BUILTIN_PROFILES; i++)
+		if (strcmp(builtin_profiles[i].name, name) == 0)
+			return builtin_profiles + i;
+	return NULL;
+}
+
+int
+argos_osprofile_select(const char *name)
+{
+	const argos_osprofile_t *p = builtin_find(name);
+
+	if (!p)
+		return -1;
+	argos_osprofile = *p;
+	return 0;
+}
+
+//! Strips the blanks around s
+static char *
+trim(char *s)
+{
+	char *end;
+
+	if (!s)
+		return NULL;
+	s += strspn(s, " \t");
+	end = s + strlen(s);
+	while (end > s && (end[-1] == ' ' || end[-1] == '\t'))
+		*--end = '\0';
+	return *s ? s : NULL;
+}
+
+static int
+parse_num(const char *s, unsigned long long *v)
+{
+	char *end;
+
+	if (!s)
+		return -1;
+	*v = strtoull(s, &end, 0);
+	return (*end == '\0' && end != s)? 0 : -1;
+}
+
+static int
+parse_range(char *args, argos_osrange_t *r)
+{
+	unsigned long long start, last;
+	char *save;
+
+	if (parse_num(strtok_r(args, " \t\n", &save), &start) != 0 ||
+			parse_num(strtok_r(NULL, " \t\n", &save), &last) != 0 ||
+			start > last)
+		return -1;
+	r->start = start;
+	r->last = last;
+	return (r->start == start && r->last == last)? 0 : -1;
+}
+
+// Sets the ranges of a side that the file did not give to the whole side
+static void
+fill_split(argos_osprofile_t *p, int side)
+{
+	argos_osrange_t *r = p->ranges[side];
+
+	p->nranges[side] = 1;
+	if (side == ARGOS_OSPROFILE_USER) {
+		r->start = 0;
+		r->last = p->kernel_start - 1;
+	} else {
+		r->start = p->kernel_start;
+		r->last = p->kernel_last;
+	}
+}
+
+static int
+check_ranges(argos_osprofile_t *p)
+{
+	argos_osrange_t *r;
+	int i;
+
+	if (p->kernel_start == 0 || p->kernel_start > p->kernel_last)
+		return -1;
+	for (i = 0; i < p->nranges[ARGOS_OSPROFILE_USER]; i++) {
+		r = p->ranges[ARGOS_OSPROFILE_USER] + i;
+		if (r->last >= p->kernel_start)
+			return -1;
+	}
+	for (i = 0; i < p->nranges[ARGOS_OSPROFILE_KERNEL]; i++) {
+		r = p->ranges[ARGOS_OSPROFILE_KERNEL] + i;
+		if (r->start < p->kernel_start || r->last > p->kernel_last)
+			return -1;
+	}
+	return 0;
+}
+
+//! Starts from the current profile, so that the file only has to give
+//! what differs from the one selected with -linux, -win2k or -winxp
+int
+argos_osprofile_load(const char *filename)
+{
+	argos_osprofile_t p = argos_osprofile;
+	const argos_osprofile_t *base;
+	FILE *fp;
+	char buf[256], *key, *args, *save;
+	unsigned long long v;
+	int lineno = 0, i, side, ranges_set[2] = { 0, 0 }, split_set = 0;
+	unsigned int internals_set = 0, internals_all = 0;
+
+	if (!(fp = fopen(filename, "r"))) {
+		fprintf(stderr, "[ARGOS] OS profile \"%s\" cannot be opened\n",
+				filename);
+		return -1;
+	}
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		lineno++;
+		if ((key = strchr(buf, '#')) != NULL)
+			*key = '\0';
+		if (!(key = strtok_r(buf, " \t\n", &save)))
+			continue;
+		args = trim(strtok_r(NULL, "\n", &save));
+
+		if (strcmp(key, "base") == 0) {
+			if (!args || !(base = builtin_find(args)))
+				goto error;
+			p = *base;
+			internals_set = 0;
+		} else if (strcmp(key, "name") == 0) {
+			if (!args)
+				goto error;
+			snprintf(p.name, sizeof(p.name), "%s", args);
+		} else if (strcmp(key, "os") == 0) {
+			for (i = 0; i < 3; i++)
+				if (args && strcmp(args, os_names[i]) == 0)
+					break;
+			if (i == 3)
+				goto error;
+			p.os = i;
+		} else if (strcmp(key, "kernel") == 0) {
+			argos_osrange_t r;
+
+			if (!args || parse_range(args, &r) != 0)
+				goto error;
+			p.kernel_start = r.start;
+			p.kernel_last = r.last;
+			split_set = 1;
+		} else if (strcmp(key, "user_range") == 0 ||
+				strcmp(key, "kernel_range") == 0) {
+			side = (key[0] == 'k')? ARGOS_OSPROFILE_KERNEL :
+				ARGOS_OSPROFILE_USER;
+			// The ranges of the file replace those of the base
+			if (!ranges_set[side]) {
+				p.nranges[side] = 0;
+				ranges_set[side] = 1;
+			}
+			if (!args || p.nranges[side] == ARGOS_OSPROFILE_MAX_RANGES ||
+					parse_range(args,
+						p.ranges[side] + p.nranges[side]) != 0)
+				goto error;
+			p.nranges[side]++;
+		} else if (strcmp(key, "syscall") == 0) {
+			char *conv = args ? strtok_r(args, " \t", &save) : NULL;
+
+			if (!conv)
+				goto error;
+			if (strcmp(conv, "none") == 0) {
+				p.syscall_int = -1;
+				p.syscall_insns = 0;
+			} else if (strcmp(conv, "sysenter") == 0)
+				p.syscall_insns |= ARGOS_SYSCALL_SYSENTER;
+			else if (strcmp(conv, "syscall") == 0)
+				p.syscall_insns |= ARGOS_SYSCALL_SYSCALL;
+			else if (strcmp(conv, "int") == 0) {
+				if (parse_num(strtok_r(NULL, " \t", &save),
+							&v) != 0 || v > 255)
+					goto error;
+				p.syscall_int = v;
+			} else
+				goto error;
+		} else {
+			for (i = 0; internals_keys[i].key; i++)
+				if (strcmp(key, internals_keys[i].key) == 0)
+					break;
+			if (!internals_keys[i].key || !args ||
+					parse_num(args, &v) != 0)
+				goto error;
+			*(uint32_t *)((uint8_t *)&p +
+					internals_keys[i].offset) = v;
+			internals_set |= 1 << i;
+		}
+	}
+	fclose(fp);
+
+	// Offsets only complete a profile that already has all of them
+	for (i = 0; internals_keys[i].key; i++)
+		internals_all |= 1 << i;
+	if (internals_set == internals_all)
+		p.has_internals = 1;
+	else if (internals_set && !p.has_internals) {
+		fprintf(stderr, "[ARGOS] OS profile \"%s\": the base has no "
+				"Windows internals, all of their offsets "
+				"must be given\n", filename);
+		return -1;
+	}
+
+	for (side = 0; side < 2; side++)
+		if (split_set && !ranges_set[side])
+			fill_split(&p, side);
+	if (check_ranges(&p) != 0) {
+		fprintf(stderr, "[ARGOS] OS profile \"%s\": the page ranges do "
+				"not fit the kernel split\n", filename);
+		return -1;
+	}
+	argos_osprofile = p;
+	return 0;
+
+error:
+	fprintf(stderr, "[ARGOS] OS profile \"%s\", line %d: don't know what "
+			"to do with \"%s\"\n", filename, lineno, key);
+	fclose(fp);
+	return -1;
+}
+
+void
+argos_osprofile_dump_info(FILE *f,
+		int (*cpu_fprintf)(FILE *f, const char *fmt, ...))
+{
+	argos_osprofile_t *p = &argos_osprofile;
+	int i, side;
+
+	cpu_fprintf(f, "profile %s, %s guest\n", p->name, os_names[p->os]);
+	cpu_fprintf(f, "kernel 0x" TARGET_FMT_lx "-0x" TARGET_FMT_lx "\n",
+			p->kernel_start, p->kernel_last);
+	for (side = 0; side < 2; side++)
+		for (i = 0; i < p->nranges[side]; i++)
+			cpu_fprintf(f, "%s range 0x" TARGET_FMT_lx "-0x"
+					TARGET_FMT_lx "\n",
+					side ? "kernel" : "user",
+					p->ranges[side][i].start,
+					p->ranges[side][i].last);
+	if (p->syscall_int >= 0)
+		cpu_fprintf(f, "syscall int 0x%x\n", p->syscall_int);
+	if (p->syscall_insns & ARGOS_SYSCALL_SYSENTER)
+		cpu_fprintf(f, "syscall sysenter\n");
+	if (p->syscall_insns & ARGOS_SYSCALL_SYSCALL)
+		cpu_fprintf(f, "syscall syscall\n");
+	if (!p->has_internals)
+		return;
+	for (i = 0; internals_keys[i].key; i++)
+		cpu_fprintf(f, "%s 0x%x\n", internals_keys[i].key,
+				*(uint32_t *)((uint8_t *)p +
+					internals_keys[i].offset));
+}
@@ -0,0 +1,91 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef ARGOS_OSPROFILE_H
+#define ARGOS_OSPROFILE_H
+
+// Guest OS profile
+//
+// Describes the guest to the code that dumps and tracks its processes:
+// where the kernel starts, which pages are worth scanning, the offsets of
+// the Windows structures and how system calls are made. The profile is
+// one of the built in ones, selected by -linux, -win2k and -winxp, or is
+// loaded from a file with -osprofile. The file holds a "key value" pair
+// per line, see argos.1.
+
+#define ARGOS_OS_LINUX 0
+#define ARGOS_OS_WIN2K 1
+#define ARGOS_OS_WINXP 2
+
+#define ARGOS_SYSCALL_SYSENTER 1
+#define ARGOS_SYSCALL_SYSCALL  2
+
+#define ARGOS_OSPROFILE_USER   0
+#define ARGOS_OSPROFILE_KERNEL 1
+
+#define ARGOS_OSPROFILE_MAX_RANGES 16
+
+//! A range of addresses, last included
+typedef struct {
+	target_ulong start, last;
+} argos_osrange_t;
+
+typedef struct {
+	char name[32];
+	int os;			//!< ARGOS_OS_*, selects the forensics shellcode
+	target_ulong kernel_start;	//!< The user space is below
+	target_ulong kernel_last;
+	//! The pages scanned in the user and the kernel space, by default
+	//! all of each side of the split
+	int nranges[2];
+	argos_osrange_t ranges[2][ARGOS_OSPROFILE_MAX_RANGES];
+	//! Offsets of the Windows structures, set if has_internals
+	int has_internals;
+	uint32_t teb_client_id;
+	uint32_t teb_peb;
+	uint32_t peb_ldr;
+	uint32_t ldr_initialized;
+	uint32_t ldr_load_order;
+	uint32_t ldr_module_base;
+	uint32_t ldr_module_name;
+	uint32_t client_id_thread;
+	//! System calls: the interrupt vector, -1 if none, and ARGOS_SYSCALL_*
+	int syscall_int;
+	int syscall_insns;
+} argos_osprofile_t;
+
+extern argos_osprofile_t argos_osprofile;
+
+int argos_osprofile_select(const char *name);
+int argos_osprofile_load(const char *filename);
+void argos_osprofile_dump_info(FILE *f,
+		int (*cpu_fprintf)(FILE *f, const char *fmt, ...));
+
+#endif
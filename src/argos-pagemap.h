@@ -55,7 +55,9 @@
 # define ARGOS_PAGEMAP_INNER_ST        argos_bytemap_st
 # define ARGOS_PAGEMAP_INNER_CLR       argos_bytemap_clr
 # define ARGOS_PAGEMAP_INNER_CLEAR     argos_bytemap_clear
+# define ARGOS_PAGEMAP_INNER_TAINT     argos_bytemap_taint
 # define ARGOS_PAGEMAP_INNER_ISTAINTED argos_bytemap_istainted
+# define ARGOS_PAGEMAP_INNER_ANYTAINTED argos_bytemap_anytainted
 # define ARGOS_PAGEMAP_INNER_NTDATA    argos_bytemap_ntdata
 # define ARGOS_PAGEMAP_INNER_CREATEZ   argos_bytemap_createz
 # define ARGOS_PAGEMAP_INNER_DESTROY   argos_bytemap_destroy
@@ -64,7 +66,9 @@
 # define ARGOS_PAGEMAP_INNER_ST        argos_bitmap_st
 # define ARGOS_PAGEMAP_INNER_CLR       argos_bitmap_clr
 # define ARGOS_PAGEMAP_INNER_CLEAR     argos_bitmap_clear
+# define ARGOS_PAGEMAP_INNER_TAINT     argos_bitmap_taint
 # define ARGOS_PAGEMAP_INNER_ISTAINTED argos_bitmap_istainted
+# define ARGOS_PAGEMAP_INNER_ANYTAINTED argos_bitmap_anytainted
 # define ARGOS_PAGEMAP_INNER_NTDATA    argos_bitmap_ntdata
 # define ARGOS_PAGEMAP_INNER_CREATEZ   argos_bitmap_createz
 # define ARGOS_PAGEMAP_INNER_DESTROY   argos_bitmap_destroy
@@ -173,6 +177,31 @@ argos_pagemap_clear(argos_pagemap_t *map, unsigned long maddr, int len)
 	} while (len > 0);
 }
 
+#ifndef ARGOS_NET_TRACKER
+static inline void
+argos_pagemap_taint(argos_pagemap_t *map, unsigned long maddr, int len)
+{
+#ifndef PAGEMAP_DISABLE
+	int off, size;
+	argos_pagemap_t *page;
+
+	while (len > 0) {
+		page = map + ARGOS_PAGEMAP_PGOFF(maddr);
+		off = ARGOS_PAGEMAP_BOFF(maddr);
+		size = ARGOS_PAGEMAP_PAGE_SIZE - off;
+		if (size > len)
+			size = len;
+		if (!*page)
+			*page = ARGOS_PAGEMAP_INNER_CREATEZ(ARGOS_PAGEMAP_PAGE_SIZE);
+		if (*page)
+			ARGOS_PAGEMAP_INNER_TAINT(*page, off, size);
+		len -= size;
+		maddr += size;
+	}
+#endif
+}
+#endif
+
 static inline int
 argos_pagemap_istainted(argos_pagemap_t *map, unsigned long maddr)
 {
@@ -182,6 +211,29 @@ argos_pagemap_istainted(argos_pagemap_t *map, unsigned long maddr)
 	return ARGOS_PAGEMAP_INNER_ISTAINTED(page, ARGOS_PAGEMAP_BOFF(maddr));
 }
 
+//! Check whether any byte of a range is tainted, skipping the pages that
+//! were never allocated
+static inline int
+argos_pagemap_anytainted(argos_pagemap_t *map, unsigned long maddr,
+		size_t len)
+{
+	argos_pagemap_inner_t *page;
+	unsigned long off, size;
+
+	while (len > 0) {
+		page = map[ARGOS_PAGEMAP_PGOFF(maddr)];
+		off = ARGOS_PAGEMAP_BOFF(maddr);
+		size = ARGOS_PAGEMAP_PAGE_SIZE - off;
+		if (size > len)
+			size = len;
+		if (page && ARGOS_PAGEMAP_INNER_ANYTAINTED(page, off, size))
+			return 1;
+		len -= size;
+		maddr += size;
+	}
+	return 0;
+}
+
 static inline void
 argos_pagemap_reset(argos_pagemap_t *map, size_t len)
 {
@@ -0,0 +1,648 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "target-i386/libdasm/libdasm.h"
+
+// Decoder of the shellcode tracking logs, argos.sc.N
+//
+// The log is a header followed by an array of fixed size entries, one per
+// executed instruction. The entries are disassembled by a pool of
+// threads, each one formatting a contiguous slice of a window of the
+// array into its own buffer. The buffers are then written in order, so
+// that the output does not depend on the number of threads.
+
+// Mirrors target-i386/argos-tracksc-log.h
+#define SCLOG_SIGNATURE         0x4353
+#define SCLOG_ARCH_MASK         0x80000000
+#define SCLOG_NET_TRACKER_MASK  0x40000000
+#define SCLOG_HDR_SIZE          8
+
+#define SCLOG_MEMORY_NONE       0
+
+#define SCLOG_INSN_BYTES        15
+#define SCLOG_SYMBOL_SIZE       64
+
+#define SCLOG_MAX_THREADS       64
+//! Entries formatted by a thread in each window
+#define SCLOG_SLICE             16384
+
+enum { FORMAT_TEXT, FORMAT_JSON, FORMAT_SUMMARY };
+
+//! Offsets of the fields in an entry, which depend on the header
+typedef struct {
+	int wordsize;
+	int nregs;
+	int net_tracker;
+	size_t eip;
+	size_t insn;
+	size_t insn_size;
+	size_t symbol;
+	size_t stage;		//!< 0 if the entries have no stage
+	size_t mem[2];		//!< Load, then store
+	size_t size;
+} sclog_layout_t;
+
+typedef struct {
+	unsigned int access;
+	uint64_t vaddr, paddr, value, size;
+} sclog_mem_t;
+
+typedef struct {
+	unsigned long long entries, calls, jumps, loads, stores;
+	unsigned long long first;	//!< Index of the first entry
+	uint64_t first_eip;
+} sclog_stage_t;
+
+typedef struct {
+	char *data;
+	size_t len, cap;
+} sclog_buf_t;
+
+typedef struct {
+	pthread_t tid;
+	unsigned long long first, last;
+	sclog_buf_t out;
+	sclog_stage_t stages[256];
+} sclog_job_t;
+
+// Parameters
+static int format = FORMAT_TEXT;
+static int show_symbols, show_memrefs, skip_nopsled, roll_loops;
+
+static const uint8_t *entries;
+static unsigned long long nb_entries;
+static sclog_layout_t layout;
+//! Entries left out by roll_loops, one bit each
+static uint8_t *skipped;
+static uint8_t nopsled[SCLOG_INSN_BYTES];
+
+static void
+usage(void)
+{
+	printf("usage: argos-sclog [options] log\n"
+		"\n"
+		"Disassembles the instructions of a shellcode tracking log\n"
+		"\n"
+		"  -o file     write the output to file\n"
+		"  -f format   text (default), json or summary, which counts\n"
+		"              the instructions of each stage\n"
+		"  -j threads  decode with that many threads, default one\n"
+		"              per processor\n"
+		"  -m          show the memory accessed by the instructions\n"
+		"  -s          show symbols instead of values\n"
+		"  -n          skip the nopsled, if present\n"
+		"  -l          compress the execution paths of loops\n"
+		"\n"
+		"The instructions of x86_64 logs are shown as invalid, only\n"
+		"their registers and memory accesses are decoded\n");
+	exit(1);
+}
+
+static void
+buf_printf(sclog_buf_t *b, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(b->data + b->len, b->cap - b->len, fmt, ap);
+		va_end(ap);
+		if (n < 0)
+			return;
+		if (b->len + n < b->cap) {
+			b->len += n;
+			return;
+		}
+		b->cap = (b->cap + n + 1) * 2;
+		if ((b->data = realloc(b->data, b->cap)) == NULL) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+}
+
+static uint64_t
+get_word(const uint8_t *p)
+{
+	uint32_t w;
+	uint64_t q;
+
+	if (layout.wordsize == 8) {
+		memcpy(&q, p, 8);
+		return q;
+	}
+	memcpy(&w, p, 4);
+	return w;
+}
+
+static int
+layout_init(const uint8_t *hdr)
+{
+	uint16_t signature, version;
+	uint32_t flags;
+	int minor;
+	size_t off, memsize;
+
+	memcpy(&signature, hdr, 2);
+	memcpy(&version, hdr + 2, 2);
+	memcpy(&flags, hdr + 4, 4);
+	if (signature != SCLOG_SIGNATURE) {
+		fprintf(stderr, "Invalid log file.\n");
+		return -1;
+	}
+	minor = version & 0xff;
+	if ((version >> 8) != 1 || minor > 1) {
+		fprintf(stderr, "Unsupported log version %u.%u\n",
+				version >> 8, minor);
+		return -1;
+	}
+	layout.net_tracker = (flags & SCLOG_NET_TRACKER_MASK) != 0;
+	if (flags & SCLOG_ARCH_MASK) {
+		layout.wordsize = 8;
+		layout.nregs = 16;
+	} else {
+		layout.wordsize = 4;
+		layout.nregs = 8;
+	}
+
+	// Registers, eip and eflags
+	layout.eip = layout.nregs * layout.wordsize;
+	off = layout.insn = layout.eip + 2 * layout.wordsize;
+	layout.insn_size = off + SCLOG_INSN_BYTES;
+	// Version 1.0 had a byte of padding after the size
+	off = layout.symbol = layout.insn_size + 1 + (minor == 0);
+	off += SCLOG_SYMBOL_SIZE;
+	if (layout.net_tracker) {
+		off += 4 * SCLOG_INSN_BYTES;
+		if (minor > 0)
+			layout.stage = off++;
+	}
+	memsize = 4 + 4 * layout.wordsize;
+	if (layout.net_tracker)
+		memsize += 4 * layout.wordsize;
+	layout.mem[0] = off;
+	layout.mem[1] = off + memsize;
+	layout.size = off + 2 * memsize;
+	return 0;
+}
+
+static void
+get_mem(const uint8_t *e, int which, sclog_mem_t *m)
+{
+	const uint8_t *p = e + layout.mem[which];
+	int w = layout.wordsize;
+
+	memcpy(&m->access, p, 4);
+	m->vaddr = get_word(p + 4);
+	m->paddr = get_word(p + 4 + w);
+	m->value = get_word(p + 4 + 2 * w);
+	m->size = get_word(p + 4 + 3 * w);
+}
+
+//! As in Python's string.printable
+static int
+is_printable_char(unsigned int c)
+{
+	return (c >= 0x20 && c < 0x7f) || (c >= '\t' && c <= '\r');
+}
+
+//! The printable characters of the symbol, wherever they are
+static void
+get_symbol(const uint8_t *e, char *sym)
+{
+	const uint8_t *p = e + layout.symbol;
+	int i, n = 0;
+
+	for (i = 0; i < SCLOG_SYMBOL_SIZE; i++)
+		if (is_printable_char(p[i]))
+			sym[n++] = p[i];
+	sym[n] = '\0';
+}
+
+static void
+format_mem(sclog_buf_t *b, const char *dir, const sclog_mem_t *m)
+{
+	buf_printf(b, "%s [0x%llx] = 0x%llx ", dir,
+			(unsigned long long)m->vaddr,
+			(unsigned long long)m->value);
+	if (m->value <= 255 && is_printable_char(m->value))
+		buf_printf(b, "'%c'", (int)m->value);
+}
+
+static void
+format_text(sclog_buf_t *b, const uint8_t *e, INSTRUCTION *insn, int valid,
+		const char *text, const char *sym, const sclog_mem_t *mem)
+{
+	buf_printf(b, "0x%llx: ", (unsigned long long)get_word(e + layout.eip));
+	if (!show_symbols || !sym[0] || !valid)
+		buf_printf(b, "%s ", text);
+	else if (insn->type == INSTRUCTION_TYPE_CALL)
+		buf_printf(b, "call %s ", sym);
+	else if (insn->type == INSTRUCTION_TYPE_JMP)
+		buf_printf(b, "jmp %s ", sym);
+	else
+		buf_printf(b, "%s ", text);
+	if (show_memrefs && mem[0].access != SCLOG_MEMORY_NONE)
+		format_mem(b, "<-", mem);
+	if (show_memrefs && mem[1].access != SCLOG_MEMORY_NONE)
+		format_mem(b, "->", mem + 1);
+	buf_printf(b, "\n");
+}
+
+static void
+json_string(sclog_buf_t *b, const char *s)
+{
+	buf_printf(b, "\"");
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			buf_printf(b, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			buf_printf(b, "\\u%04x", *s);
+		else
+			buf_printf(b, "%c", *s);
+	}
+	buf_printf(b, "\"");
+}
+
+static void
+json_mem(sclog_buf_t *b, const char *name, const sclog_mem_t *m)
+{
+	if (m->access == SCLOG_MEMORY_NONE)
+		return;
+	buf_printf(b, ",\"%s\":{\"vaddr\":%llu,\"paddr\":%llu,\"value\":%llu,"
+			"\"size\":%llu}", name, (unsigned long long)m->vaddr,
+			(unsigned long long)m->paddr,
+			(unsigned long long)m->value,
+			(unsigned long long)m->size);
+}
+
+static void
+format_json(sclog_buf_t *b, unsigned long long i, const uint8_t *e,
+		const char *text, const char *sym, const sclog_mem_t *mem)
+{
+	unsigned int j, size = e[layout.insn_size];
+
+	buf_printf(b, "{\"entry\":%llu,\"eip\":%llu", i,
+			(unsigned long long)get_word(e + layout.eip));
+	if (layout.stage)
+		buf_printf(b, ",\"stage\":%u", e[layout.stage]);
+	buf_printf(b, ",\"bytes\":\"");
+	for (j = 0; j < size && j < SCLOG_INSN_BYTES; j++)
+		buf_printf(b, "%02x", e[layout.insn + j]);
+	buf_printf(b, "\",\"insn\":");
+	json_string(b, text);
+	if (sym[0]) {
+		buf_printf(b, ",\"symbol\":");
+		json_string(b, sym);
+	}
+	json_mem(b, "load", mem);
+	json_mem(b, "store", mem + 1);
+	buf_printf(b, "}\n");
+}
+
+static void
+count_stage(sclog_job_t *job, unsigned long long i, const uint8_t *e,
+		INSTRUCTION *insn, int valid, const sclog_mem_t *mem)
+{
+	sclog_stage_t *s;
+
+	s = job->stages + (layout.stage ? e[layout.stage] : 0);
+	if (!s->entries++) {
+		s->first = i;
+		s->first_eip = get_word(e + layout.eip);
+	}
+	if (valid && insn->type == INSTRUCTION_TYPE_CALL)
+		s->calls++;
+	if (valid && insn->type == INSTRUCTION_TYPE_JMP)
+		s->jumps++;
+	if (mem[0].access != SCLOG_MEMORY_NONE)
+		s->loads++;
+	if (mem[1].access != SCLOG_MEMORY_NONE)
+		s->stores++;
+}
+
+static void *
+decode(void *opaque)
+{
+	sclog_job_t *job = opaque;
+	INSTRUCTION insn;
+	sclog_mem_t mem[2];
+	const uint8_t *e;
+	char text[256], sym[SCLOG_SYMBOL_SIZE + 1];
+	unsigned long long i;
+	int valid;
+
+	for (i = job->first; i < job->last; i++) {
+		if (skipped && (skipped[i >> 3] & (1 << (i & 7))))
+			continue;
+		e = entries + i * layout.size;
+		if (skip_nopsled && memcmp(e + layout.insn, nopsled,
+					SCLOG_INSN_BYTES) == 0)
+			continue;
+
+		// libdasm only decodes 32 bit code
+		valid = layout.wordsize == 4 &&
+			get_instruction(&insn, (BYTE *)e + layout.insn,
+				MODE_32) > 0;
+		get_mem(e, 0, mem);
+		get_mem(e, 1, mem + 1);
+		if (format == FORMAT_SUMMARY) {
+			count_stage(job, i, e, &insn, valid, mem);
+			continue;
+		}
+		if (!valid || !get_instruction_string(&insn, FORMAT_INTEL, 0,
+					text, sizeof(text)))
+			strcpy(text, "invalid");
+		get_symbol(e, sym);
+		if (format == FORMAT_JSON)
+			format_json(&job->out, i, e, text, sym, mem);
+		else
+			format_text(&job->out, e, &insn, valid, text, sym, mem);
+	}
+	return NULL;
+}
+
+//! The most frequent instruction of the first 10 entries
+static void
+detect_nopsled(void)
+{
+	unsigned long long i, j, n = nb_entries < 10 ? nb_entries : 10;
+	unsigned int count, best = 0;
+	const uint8_t *a;
+
+	if (layout.net_tracker) {
+		fprintf(stderr, "Using net-tracker info to locate nop-sled.\n");
+		skip_nopsled = 0;
+		return;
+	}
+	fprintf(stderr, "Net-tracker information is not available.\n"
+			"Trying to search for nop-sled instruction by "
+			"sampling first 10 instructions.\n");
+	for (i = 0; i < n; i++) {
+		a = entries + i * layout.size + layout.insn;
+		count = 0;
+		for (j = 0; j < n; j++)
+			if (memcmp(a, entries + j * layout.size + layout.insn,
+						SCLOG_INSN_BYTES) == 0)
+				count++;
+		if (count > best) {
+			best = count;
+			memcpy(nopsled, a, SCLOG_INSN_BYTES);
+		}
+	}
+	if (!best)
+		skip_nopsled = 0;
+}
+
+//! Marks the entries whose eip was already executed
+static int
+mark_loops(void)
+{
+	uint64_t *set, eip;
+	unsigned long long i, slots = 1024, used = 0, j;
+
+	skipped = calloc(nb_entries / 8 + 1, 1);
+	set = calloc(slots, sizeof(uint64_t));
+	if (!skipped || !set)
+		return -1;
+	for (i = 0; i < nb_entries; i++) {
+		// Stored plus one, 0 is a free slot
+		eip = get_word(entries + i * layout.size + layout.eip) + 1;
+		if (used * 2 >= slots) {
+			uint64_t *old = set;
+			unsigned long long k;
+
+			set = calloc(slots * 2, sizeof(uint64_t));
+			if (!set)
+				return -1;
+			for (k = 0; k < slots; k++) {
+				if (!old[k])
+					continue;
+				j = (old[k] * 0x9e3779b97f4a7c15ULL) &
+					(slots * 2 - 1);
+				while (set[j])
+					j = (j + 1) & (slots * 2 - 1);
+				set[j] = old[k];
+			}
+			free(old);
+			slots *= 2;
+		}
+		j = (eip * 0x9e3779b97f4a7c15ULL) & (slots - 1);
+		while (set[j] && set[j] != eip)
+			j = (j + 1) & (slots - 1);
+		if (set[j])
+			skipped[i >> 3] |= 1 << (i & 7);
+		else {
+			set[j] = eip;
+			used++;
+		}
+	}
+	free(set);
+	return 0;
+}
+
+static void
+print_summary(FILE *out, sclog_stage_t *stages)
+{
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		if (!stages[i].entries)
+			continue;
+		fprintf(out, "stage %d: %llu instructions, %llu calls, "
+				"%llu jumps, %llu loads, %llu stores, "
+				"first at entry %llu eip 0x%llx\n", i,
+				stages[i].entries, stages[i].calls,
+				stages[i].jumps, stages[i].loads,
+				stages[i].stores, stages[i].first,
+				(unsigned long long)stages[i].first_eip);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	static sclog_job_t jobs[SCLOG_MAX_THREADS];
+	sclog_stage_t stages[256];
+	FILE *out = stdout;
+	struct stat sb;
+	void *map;
+	unsigned long long pos, window;
+	int c, fd, i, k, nthreads, progress;
+
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((c = getopt(argc, argv, "o:f:j:msnlh")) != -1) {
+		switch (c) {
+		case 'o':
+			if ((out = fopen(optarg, "w")) == NULL) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		case 'f':
+			if (!strcmp(optarg, "text"))
+				format = FORMAT_TEXT;
+			else if (!strcmp(optarg, "json"))
+				format = FORMAT_JSON;
+			else if (!strcmp(optarg, "summary"))
+				format = FORMAT_SUMMARY;
+			else
+				usage();
+			break;
+		case 'j':
+			nthreads = atoi(optarg);
+			break;
+		case 'm':
+			show_memrefs = 1;
+			break;
+		case 's':
+			show_symbols = 1;
+			break;
+		case 'n':
+			skip_nopsled = 1;
+			break;
+		case 'l':
+			roll_loops = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1)
+		usage();
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > SCLOG_MAX_THREADS)
+		nthreads = SCLOG_MAX_THREADS;
+
+	if ((fd = open(argv[optind], O_RDONLY)) < 0 || fstat(fd, &sb) != 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (sb.st_size < SCLOG_HDR_SIZE) {
+		fprintf(stderr, "Invalid log file.\n");
+		return 1;
+	}
+	map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	madvise(map, sb.st_size, MADV_SEQUENTIAL);
+	if (layout_init(map) != 0)
+		return 1;
+	entries = (const uint8_t *)map + SCLOG_HDR_SIZE;
+	nb_entries = (sb.st_size - SCLOG_HDR_SIZE) / layout.size;
+
+	if (skip_nopsled)
+		detect_nopsled();
+	if (roll_loops && mark_loops() != 0) {
+		perror("calloc");
+		return 1;
+	}
+
+	progress = isatty(2);
+	fprintf(stderr, "Processing logged instructions.\n");
+	memset(stages, 0, sizeof(stages));
+	window = (unsigned long long)nthreads * SCLOG_SLICE;
+	for (pos = 0; pos < nb_entries; pos += window) {
+		for (i = 0; i < nthreads; i++) {
+			jobs[i].first = pos + (unsigned long long)i * SCLOG_SLICE;
+			jobs[i].last = jobs[i].first + SCLOG_SLICE;
+			if (jobs[i].first > nb_entries)
+				jobs[i].first = nb_entries;
+			if (jobs[i].last > nb_entries)
+				jobs[i].last = nb_entries;
+			jobs[i].out.len = 0;
+			memset(jobs[i].stages, 0, sizeof(jobs[i].stages));
+			if (i > 0 && pthread_create(&jobs[i].tid, NULL, decode,
+						jobs + i) != 0) {
+				perror("pthread_create");
+				return 1;
+			}
+		}
+		decode(jobs);
+		for (i = 0; i < nthreads; i++) {
+			if (i > 0)
+				pthread_join(jobs[i].tid, NULL);
+			if (jobs[i].out.len && fwrite(jobs[i].out.data, 1,
+					jobs[i].out.len, out) != jobs[i].out.len) {
+				perror("fwrite");
+				return 1;
+			}
+			for (k = 0; k < 256; k++) {
+				sclog_stage_t *s = stages + k;
+				sclog_stage_t *t = jobs[i].stages + k;
+
+				if (!t->entries)
+					continue;
+				if (!s->entries) {
+					s->first = t->first;
+					s->first_eip = t->first_eip;
+				}
+				s->entries += t->entries;
+				s->calls += t->calls;
+				s->jumps += t->jumps;
+				s->loads += t->loads;
+				s->stores += t->stores;
+			}
+		}
+		if (progress)
+			fprintf(stderr, "Processed: %llu%%\r",
+					(pos + window < nb_entries ?
+					 pos + window : nb_entries) * 100 /
+					nb_entries);
+	}
+	if (format == FORMAT_SUMMARY)
+		print_summary(out, stages);
+	if (progress)
+		fprintf(stderr, "\n");
+	fprintf(stderr, "Done...\n");
+
+	if (fclose(out) != 0) {
+		perror("fclose");
+		return 1;
+	}
+	munmap(map, sb.st_size);
+	close(fd);
+	return 0;
+}
@@ -103,10 +103,28 @@ do {					\
 #endif
 
 
+#ifdef ARGOS_LABEL_SETS
+#include "argos-label.h"
+
+// Keep the network indexes of both operands, instead of only the last
+// dirty one
+#define argos_tag_comb(dst, src)					\
+do {									\
+	if (argos_tag_isdirty(src)) {					\
+		if (argos_tag_isdirty(dst)) {				\
+			(dst)->origin = (src)->origin;			\
+			(dst)->netidx = argos_label_merge((dst)->netidx,\
+					(src)->netidx);			\
+		} else							\
+			argos_tag_copy(dst, src);			\
+	}								\
+} while (0)
+#else
 #define argos_tag_comb(dst, src)				\
 do {								\
 	if (argos_tag_isdirty(src)) argos_tag_copy(dst, src);	\
 } while (0)
+#endif
 
 #define argos_tag_comb2(dst1, dst2, src)\
 do {					\
@@ -129,6 +147,17 @@ do {						\
 		argos_tag_copy(dst1, dst2);	\
 } while (0)
 
+#ifdef ARGOS_LABEL_SETS
+#define argos_tag_cc(dst, src1, src2)				\
+do {								\
+	if (argos_tag_isdirty(src1)) {				\
+		argos_netidx_t __nidx = (src2)->netidx;		\
+		argos_tag_copy(dst, src1);			\
+		(dst)->netidx = argos_label_merge((dst)->netidx, __nidx);\
+	} else							\
+		argos_tag_copy(dst, src2);			\
+} while (0)
+#else
 #define argos_tag_cc(dst, src1, src2)		\
 do {						\
 	if (argos_tag_isdirty(src1))		\
@@ -136,5 +165,24 @@ do {						\
 	else					\
 		argos_tag_copy(dst, src2);	\
 } while (0)
+#endif
+
+//! Check whether a range of a map holds a non zero byte, a word at a time
+static inline int
+argos_map_nonzero(const uint8_t *p, unsigned long len)
+{
+	const uint8_t *end = p + len;
+
+	for (; p < end && ((unsigned long)p & (sizeof(long) - 1)); p++)
+		if (*p)
+			return 1;
+	for (; p + sizeof(long) <= end; p += sizeof(long))
+		if (*(const unsigned long *)p)
+			return 1;
+	for (; p < end; p++)
+		if (*p)
+			return 1;
+	return 0;
+}
 
 #endif
@@ -119,3 +119,28 @@ add_pc:
 	fclose(fp);
 	return 0;
 }
+
+//! Hash of the loaded whitelists, which does not depend on the order the
+//! entries were added in. The translation cache keys its file on it, as
+//! the translator looks up the whitelists.
+uint64_t argos_whitelist_hash(void)
+{
+	struct hashtable_node *n;
+	uint64_t h, sum = 0;
+	int i, bucket;
+
+	for (i = 0; i < HASHTABLES_NUM; i++) {
+		for (bucket = 0; bucket < HASHTABLE_BUCKETS_NUM; bucket++) {
+			for (n = whitelist_table[i][bucket]; n; n = n->next) {
+				h = ((uint64_t)i << 56) ^ (uint64_t)n->key;
+				h ^= h >> 33;
+				h *= 0xff51afd7ed558ccdULL;
+				h ^= h >> 33;
+				h *= 0xc4ceb9fe1a85ec53ULL;
+				h ^= h >> 33;
+				sum += h;
+			}
+		}
+	}
+	return sum;
+}
@@ -55,6 +55,8 @@ int add_argos_whitelist(const char *tname, target_ulong pc);
 
 int read_argos_whitelist(const char *osname, const char *filename);
 
+uint64_t argos_whitelist_hash(void);
+
 
 // Check if instruction at pc is in whitelist tname 1 = true, 0 = false
 static inline int in_argos_whitelist(argos_whitelist_tname tname, 
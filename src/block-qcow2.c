@@ -99,7 +99,33 @@ typedef struct __attribute__((packed)) QCowSnapshotHeader {
     /* name follows  */
 } QCowSnapshotHeader;
 
-#define L2_CACHE_SIZE 16
+/* default sizes of the metadata caches, in bytes */
+#define L2_CACHE_DEFAULT_SIZE       (2 * 1024 * 1024)
+#define REFCOUNT_CACHE_DEFAULT_SIZE (256 * 1024)
+#define L2_CACHE_MIN_ENTRIES        16
+#define REFCOUNT_CACHE_MIN_ENTRIES  4
+
+/* cache of cluster sized metadata tables (L2 tables, refcount blocks) */
+typedef struct QCowCacheEntry {
+    uint64_t offset; /* 0 if the entry is free */
+    int dirty;
+    struct QCowCacheEntry *hash_next;
+    struct QCowCacheEntry *lru_prev, *lru_next;
+} QCowCacheEntry;
+
+typedef struct QCowCache {
+    int nb_entries;
+    int table_size;
+    uint8_t *tables;
+    QCowCacheEntry *entries;
+    QCowCacheEntry **hash;
+    int hash_bits;
+    /* lru.lru_next is the most recently used entry */
+    QCowCacheEntry lru;
+    int nb_dirty;
+    /* flushed before any dirty table of this cache is written */
+    struct QCowCache *depends;
+} QCowCache;
 
 typedef struct QCowSnapshot {
     uint64_t l1_table_offset;
@@ -126,9 +152,7 @@ typedef struct BDRVQcowState {
     uint64_t cluster_offset_mask;
     uint64_t l1_table_offset;
     uint64_t *l1_table;
-    uint64_t *l2_cache;
-    uint64_t l2_cache_offsets[L2_CACHE_SIZE];
-    uint32_t l2_cache_counts[L2_CACHE_SIZE];
+    QCowCache *l2_cache;
     uint8_t *cluster_cache;
     uint8_t *cluster_data;
     uint64_t cluster_cache_offset;
@@ -136,8 +160,7 @@ typedef struct BDRVQcowState {
     uint64_t *refcount_table;
     uint64_t refcount_table_offset;
     uint32_t refcount_table_size;
-    uint64_t refcount_block_cache_offset;
-    uint16_t *refcount_block_cache;
+    QCowCache *refcount_block_cache;
     int64_t free_cluster_index;
     int64_t free_byte_offset;
 
@@ -151,6 +174,11 @@ typedef struct BDRVQcowState {
     QCowSnapshot *snapshots;
 } BDRVQcowState;
 
+int qcow2_l2_cache_size = L2_CACHE_DEFAULT_SIZE;
+int qcow2_refcount_cache_size = REFCOUNT_CACHE_DEFAULT_SIZE;
+
+static QCowCache *qcow_cache_new(int size, int min_entries, int table_size);
+static void qcow_cache_delete(QCowCache *c);
 static int decompress_cluster(BDRVQcowState *s, uint64_t cluster_offset);
 static int qcow_read(BlockDriverState *bs, int64_t sector_num,
                      uint8_t *buf, int nb_sectors);
@@ -194,6 +222,7 @@ static int qcow_open(BlockDriverState *bs, const char *filename, int flags)
     ret = bdrv_file_open(&s->hd, filename, flags);
     if (ret < 0)
         return ret;
+    bs->mapped = s->hd->mapped;
     if (bdrv_pread(s->hd, 0, &header, sizeof(header)) != sizeof(header))
         goto fail;
     be32_to_cpus(&header.magic);
@@ -256,7 +285,8 @@ static int qcow_open(BlockDriverState *bs, const char *filename, int flags)
         be64_to_cpus(&s->l1_table[i]);
     }
     /* alloc L2 cache */
-    s->l2_cache = qemu_malloc(s->l2_size * L2_CACHE_SIZE * sizeof(uint64_t));
+    s->l2_cache = qcow_cache_new(qcow2_l2_cache_size, L2_CACHE_MIN_ENTRIES,
+                                 s->cluster_size);
     if (!s->l2_cache)
         goto fail;
     s->cluster_cache = qemu_malloc(s->cluster_size);
@@ -270,6 +300,7 @@ static int qcow_open(BlockDriverState *bs, const char *filename, int flags)
 
     if (refcount_init(bs) < 0)
         goto fail;
+    s->l2_cache->depends = s->refcount_block_cache;
 
     /* read the backing file name */
     if (header.backing_file_offset != 0) {
@@ -292,7 +323,7 @@ static int qcow_open(BlockDriverState *bs, const char *filename, int flags)
     qcow_free_snapshots(bs);
     refcount_close(bs);
     qemu_free(s->l1_table);
-    qemu_free(s->l2_cache);
+    qcow_cache_delete(s->l2_cache);
     qemu_free(s->cluster_cache);
     qemu_free(s->cluster_data);
     bdrv_delete(s->hd);
@@ -391,31 +422,233 @@ static int copy_sectors(BlockDriverState *bs, uint64_t start_sect,
     return 0;
 }
 
-static void l2_cache_reset(BlockDriverState *bs)
+/*********************************************************/
+/* metadata caches */
+
+/* The L2 tables and the refcount blocks are kept in LRU caches indexed by
+   a hash of their offset. Modified tables are only marked dirty and are
+   written back when they are evicted or when the image is flushed, so
+   that the updates of consecutive allocations are batched. The refcount
+   blocks are always written before the L2 tables that reference the new
+   clusters. */
+
+static QCowCache *qcow_cache_new(int size, int min_entries, int table_size)
+{
+    QCowCache *c;
+    int i;
+
+    c = qemu_mallocz(sizeof(QCowCache));
+    if (!c)
+        return NULL;
+    c->nb_entries = size / table_size;
+    if (c->nb_entries < min_entries)
+        c->nb_entries = min_entries;
+    c->table_size = table_size;
+    c->hash_bits = 1;
+    while ((1 << c->hash_bits) < 2 * c->nb_entries)
+        c->hash_bits++;
+    c->tables = qemu_malloc(c->nb_entries * table_size);
+    c->entries = qemu_mallocz(c->nb_entries * sizeof(QCowCacheEntry));
+    c->hash = qemu_mallocz((1 << c->hash_bits) * sizeof(QCowCacheEntry *));
+    if (!c->tables || !c->entries || !c->hash) {
+        qemu_free(c->tables);
+        qemu_free(c->entries);
+        qemu_free(c->hash);
+        qemu_free(c);
+        return NULL;
+    }
+    c->lru.lru_next = c->lru.lru_prev = &c->lru;
+    for(i = 0; i < c->nb_entries; i++) {
+        c->entries[i].lru_prev = c->lru.lru_prev;
+        c->entries[i].lru_next = &c->lru;
+        c->lru.lru_prev->lru_next = &c->entries[i];
+        c->lru.lru_prev = &c->entries[i];
+    }
+    return c;
+}
+
+static void qcow_cache_delete(QCowCache *c)
+{
+    if (!c)
+        return;
+    qemu_free(c->tables);
+    qemu_free(c->entries);
+    qemu_free(c->hash);
+    qemu_free(c);
+}
+
+static inline void *qcow_cache_table(QCowCache *c, QCowCacheEntry *e)
+{
+    return c->tables + (e - c->entries) * c->table_size;
+}
+
+static inline QCowCacheEntry **qcow_cache_bucket(QCowCache *c,
+                                                 uint64_t offset)
+{
+    uint64_t h;
+
+    h = (offset >> 9) * 0x9e3779b97f4a7c15ULL;
+    return &c->hash[h >> (64 - c->hash_bits)];
+}
+
+static void qcow_cache_unhash(QCowCache *c, QCowCacheEntry *e)
+{
+    QCowCacheEntry **pe;
+
+    for(pe = qcow_cache_bucket(c, e->offset); *pe != NULL;
+        pe = &(*pe)->hash_next) {
+        if (*pe == e) {
+            *pe = e->hash_next;
+            break;
+        }
+    }
+    e->offset = 0;
+}
+
+static void qcow_cache_touch(QCowCache *c, QCowCacheEntry *e)
+{
+    e->lru_prev->lru_next = e->lru_next;
+    e->lru_next->lru_prev = e->lru_prev;
+    e->lru_prev = &c->lru;
+    e->lru_next = c->lru.lru_next;
+    c->lru.lru_next->lru_prev = e;
+    c->lru.lru_next = e;
+}
+
+static int qcow_cache_flush(BlockDriverState *bs, QCowCache *c);
+
+static int qcow_cache_write(BlockDriverState *bs, QCowCache *c,
+                            QCowCacheEntry *e)
 {
     BDRVQcowState *s = bs->opaque;
 
-    memset(s->l2_cache, 0, s->l2_size * L2_CACHE_SIZE * sizeof(uint64_t));
-    memset(s->l2_cache_offsets, 0, L2_CACHE_SIZE * sizeof(uint64_t));
-    memset(s->l2_cache_counts, 0, L2_CACHE_SIZE * sizeof(uint32_t));
+    if (!e->dirty)
+        return 0;
+    if (c->depends && qcow_cache_flush(bs, c->depends) < 0)
+        return -EIO;
+    if (bdrv_pwrite(s->hd, e->offset, qcow_cache_table(c, e),
+                    c->table_size) != c->table_size)
+        return -EIO;
+    e->dirty = 0;
+    c->nb_dirty--;
+    return 0;
+}
+
+static int qcow_cache_cmp_offset(const void *a, const void *b)
+{
+    const QCowCacheEntry *e1 = *(QCowCacheEntry * const *)a;
+    const QCowCacheEntry *e2 = *(QCowCacheEntry * const *)b;
+
+    if (e1->offset < e2->offset)
+        return -1;
+    return e1->offset > e2->offset;
+}
+
+/* write all the dirty tables, in the order of their offsets */
+static int qcow_cache_flush(BlockDriverState *bs, QCowCache *c)
+{
+    QCowCacheEntry **dirty;
+    int i, n, ret;
+
+    if (!c || c->nb_dirty == 0)
+        return 0;
+    if (c->depends && qcow_cache_flush(bs, c->depends) < 0)
+        return -EIO;
+    dirty = qemu_malloc(c->nb_dirty * sizeof(QCowCacheEntry *));
+    if (!dirty)
+        return -ENOMEM;
+    n = 0;
+    for(i = 0; i < c->nb_entries; i++) {
+        if (c->entries[i].dirty)
+            dirty[n++] = &c->entries[i];
+    }
+    qsort(dirty, n, sizeof(QCowCacheEntry *), qcow_cache_cmp_offset);
+    ret = 0;
+    for(i = 0; i < n; i++) {
+        if (qcow_cache_write(bs, c, dirty[i]) < 0)
+            ret = -EIO;
+    }
+    qemu_free(dirty);
+    return ret;
 }
 
-static inline int l2_cache_new_entry(BlockDriverState *bs)
+/* flush the cache and forget all the tables */
+static int qcow_cache_invalidate(BlockDriverState *bs, QCowCache *c)
+{
+    int i, ret;
+
+    ret = qcow_cache_flush(bs, c);
+    for(i = 0; i < c->nb_entries; i++) {
+        if (c->entries[i].offset)
+            qcow_cache_unhash(c, &c->entries[i]);
+        c->entries[i].dirty = 0;
+    }
+    c->nb_dirty = 0;
+    return ret;
+}
+
+/* return the table at 'offset'. If 'read' is 0, the table is a new one
+   and is filled with zeros instead of being read from the disk. */
+static void *qcow_cache_get(BlockDriverState *bs, QCowCache *c,
+                            uint64_t offset, int read)
 {
     BDRVQcowState *s = bs->opaque;
-    uint32_t min_count;
-    int min_index, i;
-
-    /* find a new entry in the least used one */
-    min_index = 0;
-    min_count = 0xffffffff;
-    for(i = 0; i < L2_CACHE_SIZE; i++) {
-        if (s->l2_cache_counts[i] < min_count) {
-            min_count = s->l2_cache_counts[i];
-            min_index = i;
+    QCowCacheEntry *e, **bucket;
+    void *table;
+
+    bucket = qcow_cache_bucket(c, offset);
+    for(e = *bucket; e != NULL; e = e->hash_next) {
+        if (e->offset == offset) {
+            qcow_cache_touch(c, e);
+            table = qcow_cache_table(c, e);
+            if (!read)
+                memset(table, 0, c->table_size);
+            return table;
         }
     }
-    return min_index;
+
+    /* evict the least recently used table */
+    e = c->lru.lru_prev;
+    if (qcow_cache_write(bs, c, e) < 0)
+        return NULL;
+    if (e->offset)
+        qcow_cache_unhash(c, e);
+    table = qcow_cache_table(c, e);
+    if (read) {
+        if (bdrv_pread(s->hd, offset, table, c->table_size) !=
+            c->table_size)
+            return NULL;
+    } else {
+        memset(table, 0, c->table_size);
+    }
+    e->offset = offset;
+    e->hash_next = *bucket;
+    *bucket = e;
+    qcow_cache_touch(c, e);
+    return table;
+}
+
+static void qcow_cache_set_dirty(QCowCache *c, void *table)
+{
+    QCowCacheEntry *e;
+
+    e = c->entries + ((uint8_t *)table - c->tables) / c->table_size;
+    if (!e->dirty) {
+        e->dirty = 1;
+        c->nb_dirty++;
+    }
+}
+
+/* write back all the metadata */
+static int qcow_flush_metadata(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+    int ret;
+
+    ret = qcow_cache_flush(bs, s->refcount_block_cache);
+    if (qcow_cache_flush(bs, s->l2_cache) < 0)
+        ret = -EIO;
+    return ret;
 }
 
 static int64_t align_offset(int64_t offset, int n)
@@ -460,6 +693,9 @@ static int grow_l1_table(BlockDriverState *bs, int min_size)
     for(i = 0; i < s->l1_size; i++)
         new_l1_table[i] = be64_to_cpu(new_l1_table[i]);
 
+    if (qcow_cache_flush(bs, s->refcount_block_cache) < 0)
+        goto fail;
+
     /* set new table */
     data64 = cpu_to_be64(new_l1_table_offset);
     if (bdrv_pwrite(s->hd, offsetof(QCowHeader, l1_table_offset),
@@ -499,7 +735,7 @@ static uint64_t get_cluster_offset(BlockDriverState *bs,
                                    int n_start, int n_end)
 {
     BDRVQcowState *s = bs->opaque;
-    int min_index, i, j, l1_index, l2_index, ret;
+    int l1_index, l2_index, ret;
     uint64_t l2_offset, *l2_table, cluster_offset, tmp, old_l2_offset;
 
     l1_index = offset >> (s->l2_bits + s->cluster_bits);
@@ -518,27 +754,29 @@ static uint64_t get_cluster_offset(BlockDriverState *bs,
         old_l2_offset = l2_offset;
         /* allocate a new l2 entry */
         l2_offset = alloc_clusters(bs, s->l2_size * sizeof(uint64_t));
-        /* update the L1 entry */
-        s->l1_table[l1_index] = l2_offset | QCOW_OFLAG_COPIED;
-        tmp = cpu_to_be64(l2_offset | QCOW_OFLAG_COPIED);
-        if (bdrv_pwrite(s->hd, s->l1_table_offset + l1_index * sizeof(tmp),
-                        &tmp, sizeof(tmp)) != sizeof(tmp))
+        l2_table = qcow_cache_get(bs, s->l2_cache, l2_offset, 0);
+        if (!l2_table)
             return 0;
-        min_index = l2_cache_new_entry(bs);
-        l2_table = s->l2_cache + (min_index << s->l2_bits);
-
-        if (old_l2_offset == 0) {
-            memset(l2_table, 0, s->l2_size * sizeof(uint64_t));
-        } else {
+        if (old_l2_offset != 0) {
             if (bdrv_pread(s->hd, old_l2_offset,
                            l2_table, s->l2_size * sizeof(uint64_t)) !=
                 s->l2_size * sizeof(uint64_t))
                 return 0;
         }
+        /* the new table and its refcount must be on the disk before the
+           L1 entry points to it */
         if (bdrv_pwrite(s->hd, l2_offset,
                         l2_table, s->l2_size * sizeof(uint64_t)) !=
             s->l2_size * sizeof(uint64_t))
             return 0;
+        if (qcow_cache_flush(bs, s->refcount_block_cache) < 0)
+            return 0;
+        /* update the L1 entry */
+        s->l1_table[l1_index] = l2_offset | QCOW_OFLAG_COPIED;
+        tmp = cpu_to_be64(l2_offset | QCOW_OFLAG_COPIED);
+        if (bdrv_pwrite(s->hd, s->l1_table_offset + l1_index * sizeof(tmp),
+                        &tmp, sizeof(tmp)) != sizeof(tmp))
+            return 0;
     } else {
         if (!(l2_offset & QCOW_OFLAG_COPIED)) {
             if (allocate) {
@@ -548,28 +786,10 @@ static uint64_t get_cluster_offset(BlockDriverState *bs,
         } else {
             l2_offset &= ~QCOW_OFLAG_COPIED;
         }
-        for(i = 0; i < L2_CACHE_SIZE; i++) {
-            if (l2_offset == s->l2_cache_offsets[i]) {
-                /* increment the hit count */
-                if (++s->l2_cache_counts[i] == 0xffffffff) {
-                    for(j = 0; j < L2_CACHE_SIZE; j++) {
-                        s->l2_cache_counts[j] >>= 1;
-                    }
-                }
-                l2_table = s->l2_cache + (i << s->l2_bits);
-                goto found;
-            }
-        }
-        /* not found: load a new entry in the least used one */
-        min_index = l2_cache_new_entry(bs);
-        l2_table = s->l2_cache + (min_index << s->l2_bits);
-        if (bdrv_pread(s->hd, l2_offset, l2_table, s->l2_size * sizeof(uint64_t)) !=
-            s->l2_size * sizeof(uint64_t))
+        l2_table = qcow_cache_get(bs, s->l2_cache, l2_offset, 1);
+        if (!l2_table)
             return 0;
     }
-    s->l2_cache_offsets[min_index] = l2_offset;
-    s->l2_cache_counts[min_index] = 1;
- found:
     l2_index = (offset >> s->cluster_bits) & (s->l2_size - 1);
     cluster_offset = be64_to_cpu(l2_table[l2_index]);
     if (!cluster_offset) {
@@ -610,6 +830,10 @@ static uint64_t get_cluster_offset(BlockDriverState *bs,
                                cluster_offset, n_end, s->cluster_sectors);
             if (ret < 0)
                 return 0;
+            /* the reads may have evicted the table */
+            l2_table = qcow_cache_get(bs, s->l2_cache, l2_offset, 1);
+            if (!l2_table)
+                return 0;
         }
         tmp = cpu_to_be64(cluster_offset | QCOW_OFLAG_COPIED);
     } else {
@@ -624,9 +848,7 @@ static uint64_t get_cluster_offset(BlockDriverState *bs,
     }
     /* update L2 table */
     l2_table[l2_index] = tmp;
-    if (bdrv_pwrite(s->hd,
-                    l2_offset + l2_index * sizeof(tmp), &tmp, sizeof(tmp)) != sizeof(tmp))
-        return 0;
+    qcow_cache_set_dirty(s->l2_cache, l2_table);
     return cluster_offset;
 }
 
@@ -855,7 +1077,15 @@ static void qcow_aio_read_cb(void *opaque, int ret)
             /* read from the base image */
             n1 = backing_read1(bs->backing_hd, acb->sector_num,
                                acb->buf, acb->n);
-            if (n1 > 0) {
+            if (n1 > 0 && bs->backing_hd->mapped) {
+                /* copied from the shared mapping: no need to wait */
+                if (bdrv_read(bs->backing_hd, acb->sector_num,
+                              acb->buf, n1) < 0) {
+                    ret = -EIO;
+                    goto fail;
+                }
+                goto redo;
+            } else if (n1 > 0) {
                 acb->hd_aiocb = bdrv_aio_read(bs->backing_hd, acb->sector_num,
                                     acb->buf, acb->n, qcow_aio_read_cb, acb);
                 if (acb->hd_aiocb == NULL)
@@ -1010,8 +1240,9 @@ static void qcow_aio_cancel(BlockDriverAIOCB *blockacb)
 static void qcow_close(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
+    qcow_flush_metadata(bs);
     qemu_free(s->l1_table);
-    qemu_free(s->l2_cache);
+    qcow_cache_delete(s->l2_cache);
     qemu_free(s->cluster_cache);
     qemu_free(s->cluster_data);
     refcount_close(bs);
@@ -1154,7 +1385,7 @@ static int qcow_make_empty(BlockDriverState *bs)
     if (ret < 0)
         return ret;
 
-    l2_cache_reset(bs);
+    qcow_cache_invalidate(bs, s->l2_cache);
 #endif
     return 0;
 }
@@ -1231,6 +1462,7 @@ static int qcow_write_compressed(BlockDriverState *bs, int64_t sector_num,
 static void qcow_flush(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
+    qcow_flush_metadata(bs);
     bdrv_flush(s->hd);
 }
 
@@ -1257,7 +1489,10 @@ static int update_snapshot_refcount(BlockDriverState *bs,
     int64_t old_offset, old_l2_offset;
     int l2_size, i, j, l1_modified, l2_modified, nb_csectors, refcount;
 
-    l2_cache_reset(bs);
+    /* the L2 tables are updated directly on the disk */
+    if (qcow_cache_flush(bs, s->refcount_block_cache) < 0 ||
+        qcow_cache_invalidate(bs, s->l2_cache) < 0)
+        return -EIO;
 
     l2_table = NULL;
     l1_table = NULL;
@@ -1482,6 +1717,9 @@ static int qcow_write_snapshots(BlockDriverState *bs)
         offset += name_size;
     }
 
+    if (qcow_cache_flush(bs, s->refcount_block_cache) < 0)
+        goto fail;
+
     /* update the various header fields */
     data64 = cpu_to_be64(snapshots_offset);
     if (bdrv_pwrite(s->hd, offsetof(QCowHeader, snapshots_offset),
@@ -1605,6 +1843,8 @@ static int qcow_snapshot_create(BlockDriverState *bs,
 
     if (qcow_write_snapshots(bs) < 0)
         goto fail;
+    if (qcow_flush_metadata(bs) < 0)
+        goto fail;
 #ifdef DEBUG_ALLOC
     check_refcounts(bs);
 #endif
@@ -1649,6 +1889,8 @@ static int qcow_snapshot_goto(BlockDriverState *bs,
 
     if (update_snapshot_refcount(bs, s->l1_table_offset, s->l1_size, 1) < 0)
         goto fail;
+    if (qcow_flush_metadata(bs) < 0)
+        goto fail;
 
 #ifdef DEBUG_ALLOC
     check_refcounts(bs);
@@ -1687,6 +1929,9 @@ static int qcow_snapshot_delete(BlockDriverState *bs, const char *snapshot_id)
         /* XXX: restore snapshot if error ? */
         return ret;
     }
+    ret = qcow_flush_metadata(bs);
+    if (ret < 0)
+        return ret;
 #ifdef DEBUG_ALLOC
     check_refcounts(bs);
 #endif
@@ -1732,7 +1977,9 @@ static int refcount_init(BlockDriverState *bs)
     BDRVQcowState *s = bs->opaque;
     int ret, refcount_table_size2, i;
 
-    s->refcount_block_cache = qemu_malloc(s->cluster_size);
+    s->refcount_block_cache = qcow_cache_new(qcow2_refcount_cache_size,
+                                             REFCOUNT_CACHE_MIN_ENTRIES,
+                                             s->cluster_size);
     if (!s->refcount_block_cache)
         goto fail;
     refcount_table_size2 = s->refcount_table_size * sizeof(uint64_t);
@@ -1755,29 +2002,17 @@ static int refcount_init(BlockDriverState *bs)
 static void refcount_close(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
-    qemu_free(s->refcount_block_cache);
+    qcow_cache_delete(s->refcount_block_cache);
     qemu_free(s->refcount_table);
 }
 
 
-static int load_refcount_block(BlockDriverState *bs,
-                               int64_t refcount_block_offset)
-{
-    BDRVQcowState *s = bs->opaque;
-    int ret;
-    ret = bdrv_pread(s->hd, refcount_block_offset, s->refcount_block_cache,
-                     s->cluster_size);
-    if (ret != s->cluster_size)
-        return -EIO;
-    s->refcount_block_cache_offset = refcount_block_offset;
-    return 0;
-}
-
 static int get_refcount(BlockDriverState *bs, int64_t cluster_index)
 {
     BDRVQcowState *s = bs->opaque;
     int refcount_table_index, block_index;
     int64_t refcount_block_offset;
+    uint16_t *refcount_block;
 
     refcount_table_index = cluster_index >> (s->cluster_bits - REFCOUNT_SHIFT);
     if (refcount_table_index >= s->refcount_table_size)
@@ -1785,14 +2020,14 @@ static int get_refcount(BlockDriverState *bs, int64_t cluster_index)
     refcount_block_offset = s->refcount_table[refcount_table_index];
     if (!refcount_block_offset)
         return 0;
-    if (refcount_block_offset != s->refcount_block_cache_offset) {
-        /* better than nothing: return allocated if read error */
-        if (load_refcount_block(bs, refcount_block_offset) < 0)
-            return 1;
-    }
+    refcount_block = qcow_cache_get(bs, s->refcount_block_cache,
+                                    refcount_block_offset, 1);
+    /* better than nothing: return allocated if read error */
+    if (!refcount_block)
+        return 1;
     block_index = cluster_index &
         ((1 << (s->cluster_bits - REFCOUNT_SHIFT)) - 1);
-    return be16_to_cpu(s->refcount_block_cache[block_index]);
+    return be16_to_cpu(refcount_block[block_index]);
 }
 
 /* return < 0 if error */
@@ -1949,7 +2184,6 @@ static int grow_refcount_table(BlockDriverState *bs, int min_size)
 }
 
 /* addend must be 1 or -1 */
-/* XXX: cache several refcount block clusters ? */
 static int update_cluster_refcount(BlockDriverState *bs,
                                    int64_t cluster_index,
                                    int addend)
@@ -1958,6 +2192,7 @@ static int update_cluster_refcount(BlockDriverState *bs,
     int64_t offset, refcount_block_offset;
     int ret, refcount_table_index, block_index, refcount;
     uint64_t data64;
+    uint16_t *refcount_block;
 
     refcount_table_index = cluster_index >> (s->cluster_bits - REFCOUNT_SHIFT);
     if (refcount_table_index >= s->refcount_table_size) {
@@ -1974,8 +2209,11 @@ static int update_cluster_refcount(BlockDriverState *bs,
         /* create a new refcount block */
         /* Note: we cannot update the refcount now to avoid recursion */
         offset = alloc_clusters_noref(bs, s->cluster_size);
-        memset(s->refcount_block_cache, 0, s->cluster_size);
-        ret = bdrv_pwrite(s->hd, offset, s->refcount_block_cache, s->cluster_size);
+        refcount_block = qcow_cache_get(bs, s->refcount_block_cache,
+                                        offset, 0);
+        if (!refcount_block)
+            return -EIO;
+        ret = bdrv_pwrite(s->hd, offset, refcount_block, s->cluster_size);
         if (ret != s->cluster_size)
             return -EINVAL;
         s->refcount_table[refcount_table_index] = offset;
@@ -1987,29 +2225,24 @@ static int update_cluster_refcount(BlockDriverState *bs,
             return -EINVAL;
 
         refcount_block_offset = offset;
-        s->refcount_block_cache_offset = offset;
         update_refcount(bs, offset, s->cluster_size, 1);
-    } else {
-        if (refcount_block_offset != s->refcount_block_cache_offset) {
-            if (load_refcount_block(bs, refcount_block_offset) < 0)
-                return -EIO;
-        }
     }
-    /* we can update the count and save it */
+    refcount_block = qcow_cache_get(bs, s->refcount_block_cache,
+                                    refcount_block_offset, 1);
+    if (!refcount_block)
+        return -EIO;
+    /* we can update the count, it is written back with the block */
     block_index = cluster_index &
         ((1 << (s->cluster_bits - REFCOUNT_SHIFT)) - 1);
-    refcount = be16_to_cpu(s->refcount_block_cache[block_index]);
+    refcount = be16_to_cpu(refcount_block[block_index]);
     refcount += addend;
     if (refcount < 0 || refcount > 0xffff)
         return -EINVAL;
     if (refcount == 0 && cluster_index < s->free_cluster_index) {
         s->free_cluster_index = cluster_index;
     }
-    s->refcount_block_cache[block_index] = cpu_to_be16(refcount);
-    if (bdrv_pwrite(s->hd,
-                    refcount_block_offset + (block_index << REFCOUNT_SHIFT),
-                    &s->refcount_block_cache[block_index], 2) != 2)
-        return -EIO;
+    refcount_block[block_index] = cpu_to_be16(refcount);
+    qcow_cache_set_dirty(s->refcount_block_cache, refcount_block);
     return refcount;
 }
 
@@ -28,7 +28,9 @@
 #endif
 #include "block_int.h"
 #include <assert.h>
-#include <aio.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #ifdef CONFIG_COCOA
 #include <paths.h>
@@ -78,6 +80,9 @@ typedef struct BDRVRawState {
     int fd;
     int type;
     unsigned int lseek_err_cnt;
+    /* shared read only mapping of the file (BDRV_O_MMAP) */
+    uint8_t *map;
+    int64_t map_size;
 #if defined(__linux__)
     /* linux floppy specific */
     int fd_open_flags;
@@ -90,6 +95,31 @@ typedef struct BDRVRawState {
 
 static int fd_open(BlockDriverState *bs);
 
+/* Map the whole file read only and shared, so that the images opened by
+   several processes use the same pages of the host page cache and the
+   reads are a memcpy. Writes still go through the fd, which keeps the
+   mapping coherent. */
+static void raw_map(BlockDriverState *bs)
+{
+    BDRVRawState *s = bs->opaque;
+    struct stat st;
+    void *map;
+
+    if (fstat(s->fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+        return;
+    if ((uint64_t)st.st_size != (size_t)st.st_size)
+        return;
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, s->fd, 0);
+    if (map == MAP_FAILED) {
+        DEBUG_BLOCK_PRINT("raw_map(%d:%s) mmap failed : %d = %s\n",
+                          s->fd, bs->filename, errno, strerror(errno));
+        return;
+    }
+    s->map = map;
+    s->map_size = st.st_size;
+    bs->mapped = 1;
+}
+
 static int raw_open(BlockDriverState *bs, const char *filename, int flags)
 {
     BDRVRawState *s = bs->opaque;
@@ -121,6 +151,8 @@ static int raw_open(BlockDriverState *bs, const char *filename, int flags)
         return ret;
     }
     s->fd = fd;
+    if (flags & BDRV_O_MMAP)
+        raw_map(bs);
     return 0;
 }
 
@@ -147,6 +179,11 @@ static int raw_pread(BlockDriverState *bs, int64_t offset,
     BDRVRawState *s = bs->opaque;
     int ret;
 
+    if (s->map && offset >= 0 && offset + count <= s->map_size) {
+        memcpy(buf, s->map + offset, count);
+        return count;
+    }
+
     ret = fd_open(bs);
     if (ret < 0)
         return ret;
@@ -231,18 +268,47 @@ label__raw_write__success:
 }
 
 /***********************************************************/
-/* Unix AIO using POSIX AIO */
+/* Unix AIO using a pool of worker threads */
+
+/* Requests are queued to up to qemu_aio_max_threads threads that do
+   plain pread()/pwrite() calls, so several requests can be in flight at
+   once. Completions are reported with aio_sig_num, like POSIX AIO did,
+   but only once until the next qemu_aio_poll(), not for every request. */
+
+enum {
+    RAW_AIO_QUEUED,
+    RAW_AIO_ACTIVE,
+    RAW_AIO_DONE,
+};
 
 typedef struct RawAIOCB {
     BlockDriverAIOCB common;
-    struct aiocb aiocb;
-    struct RawAIOCB *next;
+    int fd;
+    int is_write;
+    uint8_t *buf;
+    size_t nbytes;
+    off_t offset;
+    int state;
+    int ret;
+    struct RawAIOCB *next;          /* issued requests */
+    struct RawAIOCB *next_queued;   /* requests not started yet */
 } RawAIOCB;
 
+int qemu_aio_max_threads = 8;
+
 static int aio_sig_num = SIGUSR2;
 static RawAIOCB *first_aio; /* AIO issued */
 static int aio_initialized = 0;
 
+static pthread_mutex_t aio_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t aio_queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t aio_done_cond = PTHREAD_COND_INITIALIZER;
+static RawAIOCB *aio_queue_head, **aio_queue_tail = &aio_queue_head;
+static int aio_nb_threads, aio_idle_threads;
+static pthread_t aio_main_thread;
+/* a completion signal was sent and not consumed by qemu_aio_poll() */
+static int aio_notify_pending;
+
 static void aio_signal_handler(int signum)
 {
 #ifndef QEMU_IMG
@@ -259,70 +325,182 @@ static void aio_signal_handler(int signum)
 #endif
 }
 
+static int raw_aio_do_rw(RawAIOCB *acb)
+{
+    size_t done = 0;
+    ssize_t len;
+
+    while (done < acb->nbytes) {
+        if (acb->is_write)
+            len = pwrite(acb->fd, acb->buf + done, acb->nbytes - done,
+                         acb->offset + done);
+        else
+            len = pread(acb->fd, acb->buf + done, acb->nbytes - done,
+                        acb->offset + done);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len < 0)
+            return -errno;
+        if (len == 0)
+            break;
+        done += len;
+    }
+    return (done == acb->nbytes) ? 0 : -EINVAL;
+}
+
+static void *aio_thread(void *opaque)
+{
+    RawAIOCB *acb;
+    int ret;
+
+    pthread_mutex_lock(&aio_lock);
+    for(;;) {
+        while (!aio_queue_head) {
+            aio_idle_threads++;
+            pthread_cond_wait(&aio_queue_cond, &aio_lock);
+            aio_idle_threads--;
+        }
+        acb = aio_queue_head;
+        aio_queue_head = acb->next_queued;
+        if (!aio_queue_head)
+            aio_queue_tail = &aio_queue_head;
+        acb->state = RAW_AIO_ACTIVE;
+        pthread_mutex_unlock(&aio_lock);
+
+        ret = raw_aio_do_rw(acb);
+
+        pthread_mutex_lock(&aio_lock);
+        acb->ret = ret;
+        acb->state = RAW_AIO_DONE;
+        pthread_cond_broadcast(&aio_done_cond);
+        if (!aio_notify_pending) {
+            aio_notify_pending = 1;
+            pthread_kill(aio_main_thread, aio_sig_num);
+        }
+    }
+    return NULL;
+}
+
+/* must be called with aio_lock held */
+static int aio_spawn_thread(void)
+{
+    pthread_attr_t attr;
+    pthread_t tid;
+    sigset_t all, old;
+    int ret;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    /* the completion signal and the alarm must go to the main thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    ret = pthread_create(&tid, &attr, aio_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    pthread_attr_destroy(&attr);
+    if (ret != 0)
+        return -1;
+    aio_nb_threads++;
+    return 0;
+}
+
 void qemu_aio_init(void)
 {
     struct sigaction act;
 
     aio_initialized = 1;
+    aio_main_thread = pthread_self();
 
     sigfillset(&act.sa_mask);
     act.sa_flags = 0; /* do not restart syscalls to interrupt select() */
     act.sa_handler = aio_signal_handler;
     sigaction(aio_sig_num, &act, NULL);
+}
 
-#if defined(__GLIBC__) && defined(__linux__)
-    {
-        /* XXX: aio thread exit seems to hang on RedHat 9 and this init
-           seems to fix the problem. */
-        struct aioinit ai;
-        memset(&ai, 0, sizeof(ai));
-        ai.aio_threads = 1;
-        ai.aio_num = 1;
-        ai.aio_idle_time = 365 * 100000;
-        aio_init(&ai);
+/* the worker threads are not inherited by a forked child, which starts
+   with an empty pool. The requests must have been flushed before the
+   fork, and the locks may have been held by a worker when it happened. */
+void qemu_aio_after_fork(void)
+{
+    if (!aio_initialized)
+        return;
+    pthread_mutex_init(&aio_lock, NULL);
+    pthread_cond_init(&aio_queue_cond, NULL);
+    pthread_cond_init(&aio_done_cond, NULL);
+    aio_queue_head = NULL;
+    aio_queue_tail = &aio_queue_head;
+    aio_nb_threads = 0;
+    aio_idle_threads = 0;
+    aio_notify_pending = 0;
+    aio_main_thread = pthread_self();
+}
+
+static int raw_aio_submit(RawAIOCB *acb)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&aio_lock);
+    if (aio_idle_threads == 0 && aio_nb_threads < qemu_aio_max_threads &&
+        aio_spawn_thread() < 0 && aio_nb_threads == 0)
+        ret = -1;
+    if (ret == 0) {
+        acb->state = RAW_AIO_QUEUED;
+        acb->next_queued = NULL;
+        *aio_queue_tail = acb;
+        aio_queue_tail = &acb->next_queued;
+        pthread_cond_signal(&aio_queue_cond);
     }
-#endif
+    pthread_mutex_unlock(&aio_lock);
+    return ret;
 }
 
 void qemu_aio_poll(void)
 {
-    RawAIOCB *acb, **pacb;
-    int ret;
+    RawAIOCB *acb, **pacb, *done, **pdone;
 
-    for(;;) {
-        pacb = &first_aio;
-        for(;;) {
-            acb = *pacb;
-            if (!acb)
-                goto the_end;
-            ret = aio_error(&acb->aiocb);
-            if (ret == ECANCELED) {
-                /* remove the request */
-                *pacb = acb->next;
-                qemu_aio_release(acb);
-            } else if (ret != EINPROGRESS) {
-                /* end of aio */
-                if (ret == 0) {
-                    ret = aio_return(&acb->aiocb);
-                    if (ret == acb->aiocb.aio_nbytes)
-                        ret = 0;
-                    else
-                        ret = -EINVAL;
-                } else {
-                    ret = -ret;
-                }
-                /* remove the request */
-                *pacb = acb->next;
-                /* call the callback */
-                acb->common.cb(acb->common.opaque, ret);
-                qemu_aio_release(acb);
-                break;
-            } else {
-                pacb = &acb->next;
-            }
+    if (!first_aio)
+        return;
+
+    /* unlink the completed requests first, the callbacks may issue new
+       ones */
+    done = NULL;
+    pdone = &done;
+    pthread_mutex_lock(&aio_lock);
+    aio_notify_pending = 0;
+    pacb = &first_aio;
+    while ((acb = *pacb) != NULL) {
+        if (acb->state == RAW_AIO_DONE) {
+            *pacb = acb->next;
+            acb->next = NULL;
+            *pdone = acb;
+            pdone = &acb->next;
+        } else {
+            pacb = &acb->next;
+        }
+    }
+    pthread_mutex_unlock(&aio_lock);
+
+    while ((acb = done) != NULL) {
+        done = acb->next;
+        /* call the callback */
+        acb->common.cb(acb->common.opaque, acb->ret);
+        qemu_aio_release(acb);
+    }
+}
+
+static int raw_aio_has_done(void)
+{
+    RawAIOCB *acb;
+    int ret = 0;
+
+    pthread_mutex_lock(&aio_lock);
+    for(acb = first_aio; acb != NULL; acb = acb->next) {
+        if (acb->state == RAW_AIO_DONE) {
+            ret = 1;
+            break;
         }
     }
- the_end: ;
+    pthread_mutex_unlock(&aio_lock);
+    return ret;
 }
 
 /* Wait for all IO requests to complete.  */
@@ -359,9 +537,13 @@ void qemu_aio_wait(void)
     if (qemu_bh_poll())
         return;
 #endif
-    sigemptyset(&set);
-    sigaddset(&set, aio_sig_num);
-    sigwait(&set, &nb_sigs);
+    /* the signal of a completion may have been taken by the handler
+       already */
+    if (!raw_aio_has_done()) {
+        sigemptyset(&set);
+        sigaddset(&set, aio_sig_num);
+        sigwait(&set, &nb_sigs);
+    }
     qemu_aio_poll();
 }
 
@@ -380,67 +562,82 @@ static RawAIOCB *raw_aio_setup(BlockDriverState *bs,
     if (fd_open(bs) < 0)
         return NULL;
 
+    if (!aio_initialized)
+        qemu_aio_init();
     acb = qemu_aio_get(bs, cb, opaque);
     if (!acb)
         return NULL;
-    acb->aiocb.aio_fildes = s->fd;
-    acb->aiocb.aio_sigevent.sigev_signo = aio_sig_num;
-    acb->aiocb.aio_sigevent.sigev_notify = SIGEV_SIGNAL;
-    acb->aiocb.aio_buf = buf;
+    acb->fd = s->fd;
+    acb->buf = buf;
     if (nb_sectors < 0)
-        acb->aiocb.aio_nbytes = -nb_sectors;
+        acb->nbytes = -nb_sectors;
     else
-        acb->aiocb.aio_nbytes = nb_sectors * 512;
-    acb->aiocb.aio_offset = sector_num * 512;
-    acb->next = first_aio;
-    first_aio = acb;
+        acb->nbytes = nb_sectors * 512;
+    acb->offset = sector_num * 512;
+    acb->ret = 0;
     return acb;
 }
 
-static BlockDriverAIOCB *raw_aio_read(BlockDriverState *bs,
+static BlockDriverAIOCB *raw_aio_rw(BlockDriverState *bs,
         int64_t sector_num, uint8_t *buf, int nb_sectors,
-        BlockDriverCompletionFunc *cb, void *opaque)
+        BlockDriverCompletionFunc *cb, void *opaque, int is_write)
 {
     RawAIOCB *acb;
 
     acb = raw_aio_setup(bs, sector_num, buf, nb_sectors, cb, opaque);
     if (!acb)
         return NULL;
-    if (aio_read(&acb->aiocb) < 0) {
+    acb->is_write = is_write;
+    acb->next = first_aio;
+    first_aio = acb;
+    if (raw_aio_submit(acb) < 0) {
+        first_aio = acb->next;
         qemu_aio_release(acb);
         return NULL;
     }
     return &acb->common;
 }
 
+static BlockDriverAIOCB *raw_aio_read(BlockDriverState *bs,
+        int64_t sector_num, uint8_t *buf, int nb_sectors,
+        BlockDriverCompletionFunc *cb, void *opaque)
+{
+    return raw_aio_rw(bs, sector_num, buf, nb_sectors, cb, opaque, 0);
+}
+
 static BlockDriverAIOCB *raw_aio_write(BlockDriverState *bs,
         int64_t sector_num, const uint8_t *buf, int nb_sectors,
         BlockDriverCompletionFunc *cb, void *opaque)
 {
-    RawAIOCB *acb;
-
-    acb = raw_aio_setup(bs, sector_num, (uint8_t*)buf, nb_sectors, cb, opaque);
-    if (!acb)
-        return NULL;
-    if (aio_write(&acb->aiocb) < 0) {
-        qemu_aio_release(acb);
-        return NULL;
-    }
-    return &acb->common;
+    return raw_aio_rw(bs, sector_num, (uint8_t*)buf, nb_sectors, cb, opaque,
+                      1);
 }
 
 static void raw_aio_cancel(BlockDriverAIOCB *blockacb)
 {
-    int ret;
     RawAIOCB *acb = (RawAIOCB *)blockacb;
     RawAIOCB **pacb;
 
-    ret = aio_cancel(acb->aiocb.aio_fildes, &acb->aiocb);
-    if (ret == AIO_NOTCANCELED) {
+    pthread_mutex_lock(&aio_lock);
+    if (acb->state == RAW_AIO_QUEUED) {
+        /* not started yet, take it off the queue */
+        for(pacb = &aio_queue_head; *pacb != NULL;
+            pacb = &(*pacb)->next_queued) {
+            if (*pacb == acb) {
+                *pacb = acb->next_queued;
+                if (!*pacb)
+                    aio_queue_tail = pacb;
+                break;
+            }
+        }
+        acb->state = RAW_AIO_DONE;
+    } else {
         /* fail safe: if the aio could not be canceled, we wait for
            it */
-        while (aio_error(&acb->aiocb) == EINPROGRESS);
+        while (acb->state != RAW_AIO_DONE)
+            pthread_cond_wait(&aio_done_cond, &aio_lock);
     }
+    pthread_mutex_unlock(&aio_lock);
 
     /* remove the callback from the queue */
     pacb = &first_aio;
@@ -452,13 +649,29 @@ static void raw_aio_cancel(BlockDriverAIOCB *blockacb)
             qemu_aio_release(acb);
             break;
         }
-        pacb = &acb->next;
+        pacb = &(*pacb)->next;
+    }
+
+    /* the completion of the cancelled request may have sent the signal:
+       keep the flag only if qemu_aio_poll() has something to consume,
+       or no later completion would be signalled */
+    pthread_mutex_lock(&aio_lock);
+    for(acb = first_aio; acb != NULL; acb = acb->next) {
+        if (acb->state == RAW_AIO_DONE)
+            break;
     }
+    if (!acb)
+        aio_notify_pending = 0;
+    pthread_mutex_unlock(&aio_lock);
 }
 
 static void raw_close(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
+    if (s->map) {
+        munmap(s->map, s->map_size);
+        s->map = NULL;
+    }
     if (s->fd >= 0) {
         close(s->fd);
         s->fd = -1;
@@ -59,6 +59,8 @@ static int bdrv_write_em(BlockDriverState *bs, int64_t sector_num,
 BlockDriverState *bdrv_first;
 static BlockDriver *first_drv;
 
+int bdrv_mmap_backing;
+
 int path_is_absolute(const char *path)
 {
     const char *p;
@@ -331,6 +333,7 @@ int bdrv_open2(BlockDriverState *bs, const char *filename, int flags,
     bs->read_only = 0;
     bs->is_temporary = 0;
     bs->encrypted = 0;
+    bs->mapped = 0;
 
     if (flags & BDRV_O_SNAPSHOT) {
         BlockDriverState *bs1;
@@ -380,12 +383,13 @@ int bdrv_open2(BlockDriverState *bs, const char *filename, int flags,
     /* Note: for compatibility, we open disk image files as RDWR, and
        RDONLY as fallback */
     if (!(flags & BDRV_O_FILE))
-        open_flags = BDRV_O_RDWR | (flags & BDRV_O_DIRECT);
+        open_flags = BDRV_O_RDWR | (flags & (BDRV_O_DIRECT | BDRV_O_MMAP));
     else
         open_flags = flags & ~(BDRV_O_FILE | BDRV_O_SNAPSHOT);
     ret = drv->bdrv_open(bs, filename, open_flags);
     if (ret == -EACCES && !(flags & BDRV_O_FILE)) {
-        ret = drv->bdrv_open(bs, filename, BDRV_O_RDONLY);
+        ret = drv->bdrv_open(bs, filename,
+                             BDRV_O_RDONLY | (open_flags & BDRV_O_MMAP));
         bs->read_only = 1;
     }
     if (ret < 0) {
@@ -412,8 +416,12 @@ int bdrv_open2(BlockDriverState *bs, const char *filename, int flags,
         }
         path_combine(backing_filename, sizeof(backing_filename),
                      filename, bs->backing_file);
-        if (bdrv_open(bs->backing_hd, backing_filename, 0) < 0)
+        if (bdrv_open(bs->backing_hd, backing_filename,
+                      (bdrv_mmap_backing || (flags & BDRV_O_MMAP)) ?
+                      BDRV_O_MMAP : 0) < 0)
             goto fail;
+        if (!bs->backing_hd->mapped)
+            bs->mapped = 0;
     }
 
     /* call the change callback */
@@ -453,6 +461,88 @@ void bdrv_delete(BlockDriverState *bs)
     qemu_free(bs);
 }
 
+/* Put a temporary qcow2 image over the current contents of 'bs', so that
+   the writes no longer reach the files it shares with the process it was
+   forked from. The old driver state becomes the backing image and is
+   kept open, as it may be a temporary file that has no name any more. */
+static int bdrv_fork_overlay(BlockDriverState *bs)
+{
+    BlockDriverState *base;
+    char tmp_filename[PATH_MAX];
+    void (*change_cb)(void *opaque);
+    int ret;
+
+    base = bdrv_new("");
+    if (!base)
+        return -ENOMEM;
+    base->drv = bs->drv;
+    base->opaque = bs->opaque;
+    base->total_sectors = bs->total_sectors;
+    base->read_only = 1;
+    base->encrypted = bs->encrypted;
+    /* the file, if temporary, belongs to the process we were forked
+       from, which unlinks it */
+    base->is_temporary = 0;
+    base->backing_hd = bs->backing_hd;
+    base->mapped = bs->mapped;
+    pstrcpy(base->filename, sizeof(base->filename), bs->filename);
+    pstrcpy(base->backing_file, sizeof(base->backing_file),
+            bs->backing_file);
+
+    get_tmp_filename(tmp_filename, sizeof(tmp_filename));
+    if (bdrv_create(&bdrv_qcow2, tmp_filename, bs->total_sectors,
+                    NULL, 0) < 0) {
+        qemu_free(base);
+        return -1;
+    }
+    /* the guest must not see a media change */
+    change_cb = bs->change_cb;
+    bs->change_cb = NULL;
+    bs->drv = NULL;
+    bs->opaque = NULL;
+    bs->backing_hd = NULL;
+    bs->backing_file[0] = '\0';
+    ret = bdrv_open2(bs, tmp_filename, 0, &bdrv_qcow2);
+    unlink(tmp_filename);
+    if (ret < 0) {
+        /* put the old state back */
+        bs->drv = base->drv;
+        bs->opaque = base->opaque;
+        bs->backing_hd = base->backing_hd;
+        pstrcpy(bs->filename, sizeof(bs->filename), base->filename);
+        pstrcpy(bs->backing_file, sizeof(bs->backing_file),
+                base->backing_file);
+        bs->change_cb = change_cb;
+        qemu_free(base);
+        return ret;
+    }
+    bs->change_cb = change_cb;
+    bs->is_temporary = 1;
+    bs->backing_hd = base;
+    pstrcpy(bs->backing_file, sizeof(bs->backing_file), base->filename);
+    return 0;
+}
+
+/* called in a forked child, after qemu_aio_flush() and bdrv_flush_all()
+   in the parent */
+int bdrv_fork_overlays(void)
+{
+    BlockDriverState *bs;
+    int ret;
+
+    for (bs = bdrv_first; bs != NULL; bs = bs->next) {
+        if (!bs->drv || bs->read_only || bs->type == BDRV_TYPE_CDROM)
+            continue;
+        ret = bdrv_fork_overlay(bs);
+        if (ret < 0) {
+            fprintf(stderr, "%s: could not create the overlay image\n",
+                    bs->device_name);
+            return ret;
+        }
+    }
+    return 0;
+}
+
 /* commit COW file into the raw image */
 int bdrv_commit(BlockDriverState *bs)
 {
@@ -867,12 +957,24 @@ const char *bdrv_get_device_name(BlockDriverState *bs)
 
 void bdrv_flush(BlockDriverState *bs)
 {
-    if (bs->drv->bdrv_flush)
+    /* a read only image has nothing to write back, and the base of a fork
+       overlay shares its file with the process it was forked from */
+    if (bs->drv->bdrv_flush && !bs->read_only)
         bs->drv->bdrv_flush(bs);
     if (bs->backing_hd)
         bdrv_flush(bs->backing_hd);
 }
 
+void bdrv_flush_all(void)
+{
+    BlockDriverState *bs;
+
+    for (bs = bdrv_first; bs != NULL; bs = bs->next) {
+        if (bs->drv && !bs->read_only)
+            bdrv_flush(bs);
+    }
+}
+
 #ifndef QEMU_IMG
 void bdrv_info(void)
 {
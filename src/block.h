@@ -45,6 +45,8 @@ typedef struct QEMUSnapshotInfo {
                                      it (default for
                                      bdrv_file_open()) */
 #define BDRV_O_DIRECT      0x0020
+#define BDRV_O_MMAP        0x0040 /* serve the reads from a shared read only
+                                     mapping of the file */
 
 #ifndef QEMU_IMG
 void bdrv_info(void);
@@ -63,6 +65,7 @@ int bdrv_open(BlockDriverState *bs, const char *filename, int flags);
 int bdrv_open2(BlockDriverState *bs, const char *filename, int flags,
                BlockDriver *drv);
 void bdrv_close(BlockDriverState *bs);
+int bdrv_fork_overlays(void);
 int bdrv_read(BlockDriverState *bs, int64_t sector_num,
               uint8_t *buf, int nb_sectors);
 int bdrv_write(BlockDriverState *bs, int64_t sector_num,
@@ -88,17 +91,26 @@ BlockDriverAIOCB *bdrv_aio_write(BlockDriverState *bs, int64_t sector_num,
                                  BlockDriverCompletionFunc *cb, void *opaque);
 void bdrv_aio_cancel(BlockDriverAIOCB *acb);
 
+extern int qemu_aio_max_threads;
+/* if true, backing files are opened with BDRV_O_MMAP */
+extern int bdrv_mmap_backing;
+/* sizes of the qcow2 L2 table and refcount block caches, in bytes */
+extern int qcow2_l2_cache_size;
+extern int qcow2_refcount_cache_size;
+
 void qemu_aio_init(void);
 void qemu_aio_poll(void);
 void qemu_aio_flush(void);
 void qemu_aio_wait_start(void);
 void qemu_aio_wait(void);
 void qemu_aio_wait_end(void);
+void qemu_aio_after_fork(void);
 
 int qemu_key_check(BlockDriverState *bs, const char *name);
 
 /* Ensure contents are flushed to disk.  */
 void bdrv_flush(BlockDriverState *bs);
+void bdrv_flush_all(void);
 
 #define BDRV_TYPE_HD     0
 #define BDRV_TYPE_CDROM  1
@@ -114,6 +114,8 @@ struct BlockDriverState {
     int media_changed;
 
     BlockDriverState *backing_hd;
+    int mapped; /* if true, reads are copied from a mapping of the image
+                   and can be done synchronously */
     /* async read/write emulation */
 
     void *sync_aiocb;
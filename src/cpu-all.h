@@ -876,6 +876,15 @@ int cpu_inl(CPUState *env, int addr);
 int argos_cpu_inb(CPUState *env, int addr, argos_rtag_t *tag);
 int argos_cpu_inw(CPUState *env, int addr, argos_rtag_t *tag);
 int argos_cpu_inl(CPUState *env, int addr, argos_rtag_t *tag);
+void argos_cpu_outb(CPUState *env, int addr, int val,
+		const argos_rtag_t *tag);
+void argos_cpu_outw(CPUState *env, int addr, int val,
+		const argos_rtag_t *tag);
+void argos_cpu_outl(CPUState *env, int addr, int val,
+		const argos_rtag_t *tag);
+/* tag of the value written by argos_cpu_out*, for the devices that keep
+   taint */
+extern const argos_rtag_t *argos_ioport_wtag;
 #endif
 
 #if USE_KQEMU
@@ -953,6 +962,9 @@ void argos_stl_phys(target_phys_addr_t addr, uint32_t val,
 		const argos_rtag_t *tag);
 void argos_stq_phys(target_phys_addr_t addr, uint64_t val, 
 		const argos_rtag_t *tag);
+uint32_t argos_physical_memory_label(target_phys_addr_t addr, int len);
+void argos_physical_memory_taint(target_phys_addr_t addr, int len,
+		uint32_t label);
 
 void cpu_physical_memory_write_rom(target_phys_addr_t addr,
                                    const uint8_t *buf, int len);
@@ -988,6 +1000,8 @@ void cpu_physical_memory_reset_dirty(ram_addr_t start, ram_addr_t end,
                                      int dirty_flags);
 void cpu_tlb_update_dirty(CPUState *env);
 
+void cpu_exec_init_all(unsigned long tb_size);
+
 void dump_exec_info(FILE *f,
                     int (*cpu_fprintf)(FILE *f, const char *fmt, ...));
 
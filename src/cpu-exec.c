@@ -175,8 +175,8 @@ static TranslationBlock *tb_find_slow(target_ulong pc,
     /* if no translated code available, then translate it now */
     tb = tb_alloc(pc);
     if (!tb) {
-        /* flush must be done */
-        tb_flush(env);
+        /* make room in the oldest region */
+        tb_flush_region(env);
         /* cannot fail at this point */
         tb = tb_alloc(pc);
         /* don't forget to invalidate previous TB info */
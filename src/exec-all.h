@@ -46,6 +46,14 @@ extern uint8_t gen_opc_cc_op[OPC_BUF_SIZE];
 extern uint8_t gen_opc_instr_start[OPC_BUF_SIZE];
 extern target_ulong gen_opc_jump_pc[2];
 extern uint32_t gen_opc_hflags[OPC_BUF_SIZE];
+extern int nb_gen_opc;
+extern int nb_gen_opparams;
+
+/* indexes of the opparam entries holding the address of the TB being
+   translated, which must be relocated when the micro ops are reused */
+#define MAX_TB_RELOCS 4
+extern uint16_t gen_tb_relocs[MAX_TB_RELOCS];
+extern int nb_gen_tb_relocs;
 
 typedef void (GenOpFunc)(void);
 typedef void (GenOpFunc1)(long);
@@ -65,6 +73,7 @@ int gen_intermediate_code(CPUState *env, struct TranslationBlock *tb);
 int gen_intermediate_code_pc(CPUState *env, struct TranslationBlock *tb);
 void dump_ops(const uint16_t *opc_buf, const uint32_t *opparam_buf);
 unsigned long code_gen_max_block_size(void);
+uint64_t dyngen_op_signature(void);
 int cpu_gen_code(CPUState *env, struct TranslationBlock *tb,
                  int *gen_code_size_ptr);
 int cpu_restore_state(struct TranslationBlock *tb,
@@ -112,19 +121,32 @@ static inline int tlb_set_page(CPUState *env, target_ulong vaddr,
    ppc   : signed 24 bits
    sparc : signed 32 bits
    alpha : signed 23 bits
+   x86_64: signed 32 bits (the buffer is mapped with MAP_32BIT)
 */
 
 #if defined(__alpha__)
-#define CODE_GEN_BUFFER_SIZE     (2 * 1024 * 1024)
+#define MAX_CODE_GEN_BUFFER_SIZE     (2 * 1024 * 1024)
 #elif defined(__ia64)
-#define CODE_GEN_BUFFER_SIZE     (4 * 1024 * 1024)	/* range of addl */
+#define MAX_CODE_GEN_BUFFER_SIZE     (4 * 1024 * 1024)	/* range of addl */
 #elif defined(__powerpc__)
-#define CODE_GEN_BUFFER_SIZE     (6 * 1024 * 1024)
+#define MAX_CODE_GEN_BUFFER_SIZE     (6 * 1024 * 1024)
+#elif defined(__x86_64__)
+#define MAX_CODE_GEN_BUFFER_SIZE     (800 * 1024 * 1024)
+#else
+#define MAX_CODE_GEN_BUFFER_SIZE     (1024 * 1024 * 1024)
+#endif
+
+/* size used when no -tb-size is given */
+#if MAX_CODE_GEN_BUFFER_SIZE < (16 * 1024 * 1024)
+#define DEFAULT_CODE_GEN_BUFFER_SIZE MAX_CODE_GEN_BUFFER_SIZE
 #else
-#define CODE_GEN_BUFFER_SIZE     (16 * 1024 * 1024)
+#define DEFAULT_CODE_GEN_BUFFER_SIZE (16 * 1024 * 1024)
 #endif
+#define MIN_CODE_GEN_BUFFER_SIZE     (1024 * 1024)
 
-//#define CODE_GEN_BUFFER_SIZE     (128 * 1024)
+/* the buffer is split in regions that are filled in turn. When it is
+   full only the oldest region is evicted */
+#define CODE_GEN_REGIONS 8
 
 /* estimated block size for TB allocation */
 /* XXX: use a per code average code fragment size and modulate it
@@ -135,8 +157,6 @@ static inline int tlb_set_page(CPUState *env, target_ulong vaddr,
 #define CODE_GEN_AVG_BLOCK_SIZE 64
 #endif
 
-#define CODE_GEN_MAX_BLOCKS    (CODE_GEN_BUFFER_SIZE / CODE_GEN_AVG_BLOCK_SIZE)
-
 #if defined(__powerpc__)
 #define USE_DIRECT_JUMP
 #endif
@@ -155,6 +175,7 @@ typedef struct TranslationBlock {
 #define CF_TB_FP_USED  0x0002 /* fp ops are used in the TB */
 #define CF_FP_USED     0x0004 /* fp ops are used in the TB or in a chained TB */
 #define CF_SINGLE_INSN 0x0008 /* compile only a single instruction */
+#define CF_INVALID     0x0010 /* block was removed by tb_phys_invalidate() */
 
     uint8_t *tc_ptr;    /* pointer to the translated code */
     /* next matching tb for physical address. */
@@ -202,12 +223,14 @@ static inline unsigned int tb_phys_hash_func(unsigned long pc)
 
 TranslationBlock *tb_alloc(target_ulong pc);
 void tb_flush(CPUState *env);
+void tb_flush_region(CPUState *env);
 void tb_link_phys(TranslationBlock *tb,
                   target_ulong phys_pc, target_ulong phys_page2);
 
 extern TranslationBlock *tb_phys_hash[CODE_GEN_PHYS_HASH_SIZE];
 
-extern uint8_t code_gen_buffer[CODE_GEN_BUFFER_SIZE];
+extern uint8_t *code_gen_buffer;
+extern unsigned long code_gen_buffer_size;
 extern uint8_t *code_gen_ptr;
 
 #if defined(USE_DIRECT_JUMP)
@@ -25,6 +25,9 @@
 #else
 #include <sys/types.h>
 #include <sys/mman.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
 #endif
 #include <stdlib.h>
 #include <stdio.h>
@@ -57,9 +60,6 @@
 #undef DEBUG_TB_CHECK
 #endif
 
-/* threshold to flush the translated code buffer */
-#define CODE_GEN_BUFFER_MAX_SIZE (CODE_GEN_BUFFER_SIZE - code_gen_max_block_size())
-
 #define SMC_BITMAP_USE_THRESHOLD 10
 
 #define MMAP_AREA_START        0x00000000
@@ -83,15 +83,37 @@
 #define TARGET_PHYS_ADDR_SPACE_BITS 32
 #endif
 
-TranslationBlock tbs[CODE_GEN_MAX_BLOCKS];
+TranslationBlock *tbs;
+static int code_gen_max_blocks;
 TranslationBlock *tb_phys_hash[CODE_GEN_PHYS_HASH_SIZE];
 int nb_tbs;
 /* any access to the tbs or the page table must use this lock */
 spinlock_t tb_lock = SPIN_LOCK_UNLOCKED;
 
-uint8_t code_gen_buffer[CODE_GEN_BUFFER_SIZE] __attribute__((aligned (32)));
+uint8_t *code_gen_buffer;
+unsigned long code_gen_buffer_size;
 uint8_t *code_gen_ptr;
 
+/* The translated code buffer is split in regions that are filled in
+   turn. Each region owns a slice of tbs[], so TBs stay sorted by
+   tc_ptr within a region. When the current region is full, the oldest
+   one is evicted and reused, and the TBs of the other regions are
+   kept. */
+typedef struct CodeGenRegion {
+    uint8_t *start;
+    uint8_t *end;               /* end of the code, when not current */
+    TranslationBlock *tbs;
+    int nb_tbs;
+} CodeGenRegion;
+
+static CodeGenRegion code_gen_regions[CODE_GEN_REGIONS];
+static int code_gen_nb_regions;
+static int code_gen_cur_region;
+static unsigned long code_gen_region_size;
+/* threshold to switch to the next region */
+static unsigned long code_gen_region_max_size;
+static int code_gen_region_max_blocks;
+
 ram_addr_t phys_ram_size;
 int phys_ram_fd;
 uint8_t *phys_ram_base;
@@ -100,6 +122,7 @@ static ram_addr_t phys_ram_alloc_offset = 0;
 
 #include "argos-assert.h"
 #include "argos-memmap.h"
+#include "argos-disktaint.h"
 
 argos_memmap_t *argos_memmap;
 const argos_rtag_t argos_clean_tag = { 0, };
@@ -165,7 +188,11 @@ static int log_append = 0;
 /* statistics */
 static int tlb_flush_count;
 static int tb_flush_count;
+static int tb_region_flush_count;
 static int tb_phys_invalidate_count;
+static uint64_t tb_gen_count;
+static uint64_t tb_target_bytes;
+static uint64_t tb_host_bytes;
 
 #define SUBPAGE_IDX(addr) ((addr) & ~TARGET_PAGE_MASK)
 typedef struct subpage_t {
@@ -182,29 +209,12 @@ static void page_init(void)
 #ifdef _WIN32
     {
         SYSTEM_INFO system_info;
-        DWORD old_protect;
 
         GetSystemInfo(&system_info);
         qemu_real_host_page_size = system_info.dwPageSize;
-
-        VirtualProtect(code_gen_buffer, sizeof(code_gen_buffer),
-                       PAGE_EXECUTE_READWRITE, &old_protect);
     }
 #else
     qemu_real_host_page_size = getpagesize();
-    {
-        unsigned long start, end;
-
-        start = (unsigned long)code_gen_buffer;
-        start &= ~(qemu_real_host_page_size - 1);
-
-        end = (unsigned long)code_gen_buffer + sizeof(code_gen_buffer);
-        end += qemu_real_host_page_size - 1;
-        end &= ~(qemu_real_host_page_size - 1);
-
-        mprotect((void *)start, end - start,
-                 PROT_READ | PROT_WRITE | PROT_EXEC);
-    }
 #endif
 
     if (qemu_host_page_size == 0)
@@ -313,16 +323,94 @@ static void tlb_unprotect_code_phys(CPUState *env, ram_addr_t ram_addr,
                                     target_ulong vaddr);
 #endif
 
+/* The generated code calls the helpers with 32 bit displacements, and
+   micro op parameters (which hold TB pointers) are 32 bit wide, so on
+   64 bit hosts both the code buffer and the TBs must live in the low
+   2 GB, like the static arrays they replace. */
+static void *code_gen_mmap(unsigned long size)
+{
+    void *p;
+#ifdef _WIN32
+    p = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE,
+                     PAGE_EXECUTE_READWRITE);
+#else
+    int flags;
+
+    flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(__x86_64__) && defined(MAP_32BIT)
+    flags |= MAP_32BIT;
+#endif
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC, flags, -1, 0);
+    if (p == MAP_FAILED)
+        p = NULL;
+#endif
+    return p;
+}
+
+static void code_gen_alloc(unsigned long tb_size)
+{
+    unsigned long max_block_size;
+    int i;
+
+    code_gen_buffer_size = tb_size;
+    if (code_gen_buffer_size == 0)
+        code_gen_buffer_size = DEFAULT_CODE_GEN_BUFFER_SIZE;
+    if (code_gen_buffer_size < MIN_CODE_GEN_BUFFER_SIZE)
+        code_gen_buffer_size = MIN_CODE_GEN_BUFFER_SIZE;
+    if (code_gen_buffer_size > MAX_CODE_GEN_BUFFER_SIZE)
+        code_gen_buffer_size = MAX_CODE_GEN_BUFFER_SIZE;
+
+    code_gen_buffer = code_gen_mmap(code_gen_buffer_size);
+    if (!code_gen_buffer) {
+        fprintf(stderr, "Could not allocate dynamic translator buffer\n");
+        exit(1);
+    }
+
+    /* a region must hold several maximum sized blocks, otherwise use
+       fewer of them */
+    max_block_size = code_gen_max_block_size();
+    code_gen_nb_regions = CODE_GEN_REGIONS;
+    while (code_gen_nb_regions > 1 &&
+           code_gen_buffer_size / code_gen_nb_regions < 4 * max_block_size)
+        code_gen_nb_regions >>= 1;
+    code_gen_region_size = (code_gen_buffer_size / code_gen_nb_regions) &
+        ~(CODE_GEN_ALIGN - 1);
+    code_gen_region_max_size = code_gen_region_size - max_block_size;
+
+    code_gen_max_blocks = code_gen_buffer_size / CODE_GEN_AVG_BLOCK_SIZE;
+    code_gen_region_max_blocks = code_gen_max_blocks / code_gen_nb_regions;
+    tbs = code_gen_mmap(code_gen_max_blocks * sizeof(TranslationBlock));
+    if (!tbs) {
+        fprintf(stderr, "Could not allocate translation blocks\n");
+        exit(1);
+    }
+
+    for (i = 0; i < code_gen_nb_regions; i++) {
+        code_gen_regions[i].start = code_gen_buffer + i * code_gen_region_size;
+        code_gen_regions[i].end = code_gen_regions[i].start;
+        code_gen_regions[i].tbs = tbs + i * code_gen_region_max_blocks;
+        code_gen_regions[i].nb_tbs = 0;
+    }
+    code_gen_cur_region = 0;
+}
+
+/* allocate the translated code buffer. 'tb_size' is its size in bytes,
+   or 0 to use the default size */
+void cpu_exec_init_all(unsigned long tb_size)
+{
+    code_gen_alloc(tb_size);
+    code_gen_ptr = code_gen_buffer;
+    page_init();
+    io_mem_init();
+}
+
 void cpu_exec_init(CPUState *env)
 {
     CPUState **penv;
     int cpu_index;
 
-    if (!code_gen_ptr) {
-        code_gen_ptr = code_gen_buffer;
-        page_init();
-        io_mem_init();
-    }
+    if (!code_gen_ptr)
+        cpu_exec_init_all(0);
     env->next_cpu = NULL;
     penv = &first_cpu;
     cpu_index = 0;
@@ -367,13 +455,16 @@ static void page_flush_tb(void)
 void tb_flush(CPUState *env1)
 {
     CPUState *env;
+    int i;
 #if defined(DEBUG_FLUSH)
-    printf("qemu: flush code_size=%ld nb_tbs=%d avg_tb_size=%ld\n",
-           (unsigned long)(code_gen_ptr - code_gen_buffer),
-           nb_tbs, nb_tbs > 0 ?
-           ((unsigned long)(code_gen_ptr - code_gen_buffer)) / nb_tbs : 0);
+    printf("qemu: flush nb_tbs=%d\n", nb_tbs);
 #endif
     nb_tbs = 0;
+    for (i = 0; i < code_gen_nb_regions; i++) {
+        code_gen_regions[i].end = code_gen_regions[i].start;
+        code_gen_regions[i].nb_tbs = 0;
+    }
+    code_gen_cur_region = 0;
 
     for(env = first_cpu; env != NULL; env = env->next_cpu) {
         memset (env->tb_jmp_cache, 0, TB_JMP_CACHE_SIZE * sizeof (void *));
@@ -551,6 +642,7 @@ static inline void tb_phys_invalidate(TranslationBlock *tb, target_ulong page_ad
     /* suppress this TB from the two jump lists */
     tb_jmp_remove(tb, 0);
     tb_jmp_remove(tb, 1);
+    tb->cflags |= CF_INVALID;
 
     /* suppress any remaining jumps to this TB */
     tb1 = tb->jmp_first;
@@ -641,8 +733,8 @@ static void tb_gen_code(CPUState *env,
     phys_pc = get_phys_addr_code(env, pc);
     tb = tb_alloc(pc);
     if (!tb) {
-        /* flush must be done */
-        tb_flush(env);
+        /* make room in the oldest region */
+        tb_flush_region(env);
         /* cannot fail at this point */
         tb = tb_alloc(pc);
     }
@@ -934,21 +1026,52 @@ static inline void tb_alloc_page(TranslationBlock *tb,
 #endif /* TARGET_HAS_SMC */
 }
 
-/* Allocate a new translation block. Flush the translation buffer if
-   too many translation blocks or too much generated code. */
+/* Allocate a new translation block in the current region. Return NULL
+   if the region holds too many translation blocks or too much generated
+   code, in which case tb_flush_region() must be called. */
 TranslationBlock *tb_alloc(target_ulong pc)
 {
+    CodeGenRegion *r = &code_gen_regions[code_gen_cur_region];
     TranslationBlock *tb;
 
-    if (nb_tbs >= CODE_GEN_MAX_BLOCKS ||
-        (code_gen_ptr - code_gen_buffer) >= CODE_GEN_BUFFER_MAX_SIZE)
+    if (r->nb_tbs >= code_gen_region_max_blocks ||
+        (code_gen_ptr - r->start) >= code_gen_region_max_size)
         return NULL;
-    tb = &tbs[nb_tbs++];
+    tb = &r->tbs[r->nb_tbs++];
+    nb_tbs++;
     tb->pc = pc;
     tb->cflags = 0;
     return tb;
 }
 
+/* switch to the next region, invalidating the TBs it still holds. This
+   is the oldest region, so the most recently translated code survives */
+void tb_flush_region(CPUState *env1)
+{
+    CodeGenRegion *r;
+    int i;
+
+    if (code_gen_nb_regions == 1) {
+        tb_flush(env1);
+        return;
+    }
+    code_gen_regions[code_gen_cur_region].end = code_gen_ptr;
+    code_gen_cur_region = (code_gen_cur_region + 1) % code_gen_nb_regions;
+    r = &code_gen_regions[code_gen_cur_region];
+#if defined(DEBUG_FLUSH)
+    printf("qemu: flush region %d nb_tbs=%d\n", code_gen_cur_region, r->nb_tbs);
+#endif
+    for (i = 0; i < r->nb_tbs; i++) {
+        if (!(r->tbs[i].cflags & CF_INVALID))
+            tb_phys_invalidate(&r->tbs[i], -1);
+    }
+    nb_tbs -= r->nb_tbs;
+    r->nb_tbs = 0;
+    r->end = r->start;
+    code_gen_ptr = r->start;
+    tb_region_flush_count++;
+}
+
 /* add a new TB and link it to the physical page tables. phys_page2 is
    (-1) to indicate that only one page contains the TB. */
 void tb_link_phys(TranslationBlock *tb,
@@ -980,6 +1103,10 @@ void tb_link_phys(TranslationBlock *tb,
     if (tb->tb_next_offset[1] != 0xffff)
         tb_reset_jump(tb, 1);
 
+    tb_gen_count++;
+    tb_target_bytes += tb->size;
+    tb_host_bytes += code_gen_ptr - tb->tc_ptr;
+
 #ifdef DEBUG_TB_CHECK
     tb_page_check();
 #endif
@@ -989,21 +1116,31 @@ void tb_link_phys(TranslationBlock *tb,
    tb[1].tc_ptr. Return NULL if not found */
 TranslationBlock *tb_find_pc(unsigned long tc_ptr)
 {
-    int m_min, m_max, m;
+    int m_min, m_max, m, n;
     unsigned long v;
     TranslationBlock *tb;
+    CodeGenRegion *r;
 
     if (nb_tbs <= 0)
         return NULL;
-    if (tc_ptr < (unsigned long)code_gen_buffer ||
-        tc_ptr >= (unsigned long)code_gen_ptr)
+    if (tc_ptr < (unsigned long)code_gen_buffer)
+        return NULL;
+    n = (tc_ptr - (unsigned long)code_gen_buffer) / code_gen_region_size;
+    if (n >= code_gen_nb_regions)
         return NULL;
+    r = &code_gen_regions[n];
+    if (n == code_gen_cur_region) {
+        if (tc_ptr >= (unsigned long)code_gen_ptr)
+            return NULL;
+    } else if (tc_ptr >= (unsigned long)r->end) {
+        return NULL;
+    }
     /* binary search (cf Knuth) */
     m_min = 0;
-    m_max = nb_tbs - 1;
+    m_max = r->nb_tbs - 1;
     while (m_min <= m_max) {
         m = (m_min + m_max) >> 1;
-        tb = &tbs[m];
+        tb = &r->tbs[m];
         v = (unsigned long)tb->tc_ptr;
         if (v == tc_ptr)
             return tb;
@@ -1013,7 +1150,7 @@ TranslationBlock *tb_find_pc(unsigned long tc_ptr)
             m_min = m + 1;
         }
     }
-    return &tbs[m_max];
+    return &r->tbs[m_max];
 }
 
 static void tb_reset_jump_recursive(TranslationBlock *tb);
@@ -2725,6 +2862,68 @@ void cpu_physical_memory_write_rom(target_phys_addr_t addr,
     }
 }
 
+/* Label of the first tainted byte of a range of RAM, or 0 if the range is
+   clean */
+uint32_t argos_physical_memory_label(target_phys_addr_t addr, int len)
+{
+    int l, i;
+    unsigned long pd, addr1;
+    PhysPageDesc *p;
+    argos_rtag_t tag;
+
+    while (len > 0) {
+        l = (addr & TARGET_PAGE_MASK) + TARGET_PAGE_SIZE - addr;
+        if (l > len)
+            l = len;
+        p = phys_page_find(addr >> TARGET_PAGE_BITS);
+        pd = (p) ? p->phys_offset : IO_MEM_UNASSIGNED;
+        if ((pd & ~TARGET_PAGE_MASK) == IO_MEM_RAM) {
+            addr1 = (pd & TARGET_PAGE_MASK) + (addr & ~TARGET_PAGE_MASK);
+            for (i = 0; i < l; i++) {
+                if (argos_memmap_istainted(addr1 + i)) {
+                    argos_memmap_ldb(addr1 + i, &tag);
+                    return argos_disktaint_label(&tag);
+                }
+            }
+        }
+        len -= l;
+        addr += l;
+    }
+    return 0;
+}
+
+/* Taint a range of RAM with a label returned by
+   argos_physical_memory_label() */
+void argos_physical_memory_taint(target_phys_addr_t addr, int len,
+                                 uint32_t label)
+{
+    int l, i;
+    unsigned long pd, addr1;
+    PhysPageDesc *p;
+    argos_rtag_t tag;
+
+    while (len > 0) {
+        l = (addr & TARGET_PAGE_MASK) + TARGET_PAGE_SIZE - addr;
+        if (l > len)
+            l = len;
+        p = phys_page_find(addr >> TARGET_PAGE_BITS);
+        pd = (p) ? p->phys_offset : IO_MEM_UNASSIGNED;
+        if ((pd & ~TARGET_PAGE_MASK) == IO_MEM_RAM) {
+            addr1 = (pd & TARGET_PAGE_MASK) + (addr & ~TARGET_PAGE_MASK);
+            for (i = 0; i < l; i++) {
+#ifdef ARGOS_NET_TRACKER
+                argos_tag_set(&tag, addr + i, label);
+#else
+                argos_tag_set(&tag, addr + i);
+#endif
+                argos_memmap_stb(addr1 + i, &tag);
+            }
+        }
+        len -= l;
+        addr += l;
+    }
+}
+
 
 /* warning: addr must be aligned */
 uint32_t ldl_phys(target_phys_addr_t addr)
@@ -3086,37 +3285,50 @@ int cpu_memory_rw_debug(CPUState *env, target_ulong addr,
 void dump_exec_info(FILE *f,
                     int (*cpu_fprintf)(FILE *f, const char *fmt, ...))
 {
-    int i, target_code_size, max_target_code_size;
+    int i, n, target_code_size, max_target_code_size;
     int direct_jmp_count, direct_jmp2_count, cross_page;
+    unsigned long host_code_size;
     TranslationBlock *tb;
+    CodeGenRegion *r;
 
     target_code_size = 0;
     max_target_code_size = 0;
     cross_page = 0;
     direct_jmp_count = 0;
     direct_jmp2_count = 0;
-    for(i = 0; i < nb_tbs; i++) {
-        tb = &tbs[i];
-        target_code_size += tb->size;
-        if (tb->size > max_target_code_size)
-            max_target_code_size = tb->size;
-        if (tb->page_addr[1] != -1)
-            cross_page++;
-        if (tb->tb_next_offset[0] != 0xffff) {
-            direct_jmp_count++;
-            if (tb->tb_next_offset[1] != 0xffff) {
-                direct_jmp2_count++;
+    host_code_size = 0;
+    for(n = 0; n < code_gen_nb_regions; n++) {
+        r = &code_gen_regions[n];
+        if (n == code_gen_cur_region)
+            host_code_size += code_gen_ptr - r->start;
+        else
+            host_code_size += r->end - r->start;
+        for(i = 0; i < r->nb_tbs; i++) {
+            tb = &r->tbs[i];
+            target_code_size += tb->size;
+            if (tb->size > max_target_code_size)
+                max_target_code_size = tb->size;
+            if (tb->page_addr[1] != -1)
+                cross_page++;
+            if (tb->tb_next_offset[0] != 0xffff) {
+                direct_jmp_count++;
+                if (tb->tb_next_offset[1] != 0xffff) {
+                    direct_jmp2_count++;
+                }
             }
         }
     }
     /* XXX: avoid using doubles ? */
-    cpu_fprintf(f, "TB count            %d\n", nb_tbs);
+    cpu_fprintf(f, "Translation buffer  %lu KB in %d regions\n",
+                code_gen_buffer_size >> 10, code_gen_nb_regions);
+    cpu_fprintf(f, "TB count            %d (max %d)\n", nb_tbs,
+                code_gen_region_max_blocks * code_gen_nb_regions);
     cpu_fprintf(f, "TB avg target size  %d max=%d bytes\n",
                 nb_tbs ? target_code_size / nb_tbs : 0,
                 max_target_code_size);
     cpu_fprintf(f, "TB avg host size    %d bytes (expansion ratio: %0.1f)\n",
-                nb_tbs ? (code_gen_ptr - code_gen_buffer) / nb_tbs : 0,
-                target_code_size ? (double) (code_gen_ptr - code_gen_buffer) / target_code_size : 0);
+                nb_tbs ? (int)(host_code_size / nb_tbs) : 0,
+                target_code_size ? (double) host_code_size / target_code_size : 0);
     cpu_fprintf(f, "cross page TB count %d (%d%%)\n",
             cross_page,
             nb_tbs ? (cross_page * 100) / nb_tbs : 0);
@@ -3125,7 +3337,11 @@ void dump_exec_info(FILE *f,
                 nb_tbs ? (direct_jmp_count * 100) / nb_tbs : 0,
                 direct_jmp2_count,
                 nb_tbs ? (direct_jmp2_count * 100) / nb_tbs : 0);
-    cpu_fprintf(f, "TB flush count      %d\n", tb_flush_count);
+    cpu_fprintf(f, "TB flush count      %d (region %d)\n", tb_flush_count,
+                tb_region_flush_count);
+    cpu_fprintf(f, "TB translated       %" PRIu64 " (target %" PRIu64
+                " bytes, host %" PRIu64 " bytes)\n", tb_gen_count,
+                tb_target_bytes, tb_host_bytes);
     cpu_fprintf(f, "TB invalidate count %d\n", tb_phys_invalidate_count);
     cpu_fprintf(f, "TLB flush count     %d\n", tlb_flush_count);
 }
@@ -0,0 +1,348 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Fork server
+ *
+ * The master runs a fixed number of slots. The children are reaped from
+ * the main loop: the SIGCHLD handler only writes to a pipe, and the
+ * children of the slots are waited for by pid, so that the scripts
+ * launched by the rest of the emulator are not reaped behind their
+ * back. A child that exits soon after it was forked is restarted with a
+ * delay, so that a guest that crashes at once does not make the master
+ * spin.
+ *
+ * Each child gets the next instance id after the one of the master, so
+ * that its log files do not overwrite those of the children that ran
+ * before it.
+ */
+#include "qemu-common.h"
+#include "exec-all.h"
+#include "qemu-timer.h"
+#include "qemu-char.h"
+#include "sysemu.h"
+#include "block.h"
+#include "argos-common.h"
+#include "forkserver.h"
+
+#ifdef USE_FORKSERVER
+
+#include <signal.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+//#define DEBUG_FORKSERVER
+
+#define FORKSERVER_MAX_SLOTS 64
+
+/* a child that exits sooner than this is restarted with a delay (ms) */
+#define FORKSERVER_MIN_LIFE 5000
+#define FORKSERVER_RESPAWN_DELAY 1000
+
+typedef struct ForkSlot {
+    pid_t pid;          /* 0 if no child runs in the slot */
+    int instance_id;
+    int64_t started;    /* rt_clock time of the fork */
+    int64_t respawn;    /* time of the next fork, if pid is 0 */
+    unsigned int forks;
+    int status;         /* of the last child that exited */
+} ForkSlot;
+
+int forkserver_size = 4;
+
+static ForkSlot slots[FORKSERVER_MAX_SLOTS];
+/* 0 if the pool is not running */
+static int nb_slots;
+/* slot of this process, if it is a child */
+static int forkserver_slot = -1;
+static int base_instance_id;
+static unsigned int generation;
+static int sigchld_fds[2] = { -1, -1 };
+static struct sigaction old_sigchld;
+static QEMUTimer *respawn_timer;
+
+static void forkserver_sigchld(int signum)
+{
+    int saved_errno = errno;
+    char c = 0;
+
+    if (write(sigchld_fds[1], &c, 1) < 0) {
+        /* the pipe is full, a wakeup is pending anyway */
+    }
+    errno = saved_errno;
+}
+
+/* called in the child, before it resumes the guest */
+static void forkserver_child(int slot)
+{
+    /* the pool belongs to the master */
+    sigaction(SIGCHLD, &old_sigchld, NULL);
+    qemu_del_timer(respawn_timer);
+    qemu_free_timer(respawn_timer);
+    respawn_timer = NULL;
+    nb_slots = 0;
+    forkserver_slot = slot;
+    argos_instance_id = slots[slot].instance_id;
+#ifdef __linux__
+    /* the pool goes away with the master */
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+
+    /* no handler may change before the child has its own epoll set */
+    if (qemu_after_fork(slot) < 0) {
+        fprintf(stderr, "forkserver: slot %d could not be set up\n", slot);
+        _exit(1);
+    }
+    qemu_set_fd_handler(sigchld_fds[0], NULL, NULL, NULL);
+    close(sigchld_fds[0]);
+    close(sigchld_fds[1]);
+    sigchld_fds[0] = sigchld_fds[1] = -1;
+    vm_start();
+}
+
+/* returns the pid of the child in the master, 0 in the child */
+static int forkserver_spawn(int slot)
+{
+    ForkSlot *s = &slots[slot];
+    char text[128];
+    pid_t pid;
+
+    s->instance_id = base_instance_id + (int)++generation;
+    /* the buffered output would be written by both */
+    fflush(NULL);
+    pid = fork();
+    if (pid < 0) {
+        perror("forkserver: fork");
+        s->respawn = qemu_get_clock(rt_clock) + FORKSERVER_RESPAWN_DELAY;
+        return -1;
+    }
+    if (pid == 0) {
+        forkserver_child(slot);
+        return 0;
+    }
+    s->pid = pid;
+    s->started = qemu_get_clock(rt_clock);
+    s->forks++;
+    snprintf(text, sizeof(text), "Forked instance %d in slot %d, pid %d\n",
+             s->instance_id, slot, (int)pid);
+    argos_event("fork", text, "\"slot\":%d,\"pid\":%d,\"instance\":%d",
+                slot, (int)pid, s->instance_id);
+    return pid;
+}
+
+static void forkserver_respawn(void *opaque)
+{
+    ForkSlot *s;
+    int64_t now, next;
+    int i;
+
+    now = qemu_get_clock(rt_clock);
+    next = 0;
+    for (i = 0; i < nb_slots; i++) {
+        s = &slots[i];
+        if (s->pid)
+            continue;
+        if (s->respawn <= now && forkserver_spawn(i) == 0)
+            return; /* in the child */
+        if (!s->pid && (!next || s->respawn < next))
+            next = s->respawn;
+    }
+    if (next)
+        qemu_mod_timer(respawn_timer, next);
+}
+
+static void forkserver_exited(int slot, int status)
+{
+    ForkSlot *s = &slots[slot];
+    char text[128];
+
+    if (WIFSIGNALED(status))
+        snprintf(text, sizeof(text),
+                 "Instance %d in slot %d killed by signal %d\n",
+                 s->instance_id, slot, WTERMSIG(status));
+    else
+        snprintf(text, sizeof(text),
+                 "Instance %d in slot %d exited with status %d\n",
+                 s->instance_id, slot, WEXITSTATUS(status));
+    argos_event("exit", text,
+                "\"slot\":%d,\"pid\":%d,\"instance\":%d,\"status\":%d,"
+                "\"signal\":%d", slot, (int)s->pid, s->instance_id,
+                WIFEXITED(status) ? WEXITSTATUS(status) : -1,
+                WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+    s->pid = 0;
+    s->status = status;
+}
+
+static void forkserver_reap(void *opaque)
+{
+    ForkSlot *s;
+    char buf[64];
+    int64_t now;
+    int i, status;
+
+    while (read(sigchld_fds[0], buf, sizeof(buf)) > 0)
+        ;
+    now = qemu_get_clock(rt_clock);
+    for (i = 0; i < nb_slots; i++) {
+        s = &slots[i];
+        if (!s->pid || waitpid(s->pid, &status, WNOHANG) != s->pid)
+            continue;
+        if (now - s->started < FORKSERVER_MIN_LIFE)
+            s->respawn = now + FORKSERVER_RESPAWN_DELAY;
+        else
+            s->respawn = now;
+        forkserver_exited(i, status);
+    }
+    forkserver_respawn(NULL);
+}
+
+int forkserver_start(int n)
+{
+    struct sigaction act;
+    int i;
+
+    if (forkserver_slot >= 0 || nb_slots)
+        return -1;
+    if (n <= 0)
+        n = forkserver_size;
+    if (n > FORKSERVER_MAX_SLOTS)
+        n = FORKSERVER_MAX_SLOTS;
+#ifdef USE_KQEMU
+    /* the kqemu state cannot be shared */
+    if (first_cpu->kqemu_enabled)
+        return -1;
+#endif
+
+    if (pipe(sigchld_fds) < 0) {
+        perror("forkserver: pipe");
+        return -1;
+    }
+    for (i = 0; i < 2; i++) {
+        fcntl(sigchld_fds[i], F_SETFL, O_NONBLOCK);
+        fcntl(sigchld_fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    qemu_set_fd_handler(sigchld_fds[0], forkserver_reap, NULL, NULL);
+    respawn_timer = qemu_new_timer(rt_clock, forkserver_respawn, NULL);
+
+    sigfillset(&act.sa_mask);
+    act.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    act.sa_handler = forkserver_sigchld;
+    sigaction(SIGCHLD, &act, &old_sigchld);
+
+    /* the children start from the state the guest has now, with no disk
+       request in flight and no dirty metadata cached: the children keep
+       the images open read only as the base of their overlays */
+    vm_stop(0);
+    qemu_aio_flush();
+    bdrv_flush_all();
+
+    base_instance_id = argos_instance_id;
+    memset(slots, 0, sizeof(slots));
+    nb_slots = n;
+#ifdef DEBUG_FORKSERVER
+    printf("forkserver: forking %d children\n", n);
+#endif
+    for (i = 0; i < n; i++) {
+        if (forkserver_spawn(i) == 0)
+            return 0; /* in the child */
+    }
+    forkserver_respawn(NULL);
+    return 0;
+}
+
+void forkserver_stop(void)
+{
+    ForkSlot *s;
+    int i, status;
+
+    if (!nb_slots)
+        return;
+    qemu_del_timer(respawn_timer);
+    qemu_free_timer(respawn_timer);
+    respawn_timer = NULL;
+    for (i = 0; i < nb_slots; i++) {
+        s = &slots[i];
+        if (!s->pid)
+            continue;
+        kill(s->pid, SIGTERM);
+        while (waitpid(s->pid, &status, 0) < 0 && errno == EINTR)
+            ;
+        forkserver_exited(i, status);
+    }
+    nb_slots = 0;
+    sigaction(SIGCHLD, &old_sigchld, NULL);
+    qemu_set_fd_handler(sigchld_fds[0], NULL, NULL, NULL);
+    close(sigchld_fds[0]);
+    close(sigchld_fds[1]);
+    sigchld_fds[0] = sigchld_fds[1] = -1;
+}
+
+int forkserver_active(void)
+{
+    return nb_slots > 0;
+}
+
+void forkserver_dump_info(FILE *f,
+                          int (*cpu_fprintf)(FILE *f, const char *fmt, ...))
+{
+    ForkSlot *s;
+    int64_t now;
+    int i;
+
+    if (forkserver_slot >= 0) {
+        cpu_fprintf(f, "child in slot %d, instance %d, master pid %d\n",
+                    forkserver_slot, argos_instance_id, (int)getppid());
+        return;
+    }
+    if (!nb_slots) {
+        cpu_fprintf(f, "fork server not started, pool size %d\n",
+                    forkserver_size);
+        return;
+    }
+    now = qemu_get_clock(rt_clock);
+    cpu_fprintf(f, "%d slots, %u children forked\n", nb_slots, generation);
+    for (i = 0; i < nb_slots; i++) {
+        s = &slots[i];
+        if (s->pid)
+            cpu_fprintf(f, "slot %d: pid %d instance %d up %llds forks %u\n",
+                        i, (int)s->pid, s->instance_id,
+                        (long long)(now - s->started) / 1000, s->forks);
+        else
+            cpu_fprintf(f, "slot %d: restarting in %lldms forks %u "
+                        "last status 0x%x\n", i,
+                        (long long)(s->respawn > now ? s->respawn - now : 0),
+                        s->forks, s->status);
+    }
+}
+
+#endif /* USE_FORKSERVER */
@@ -0,0 +1,63 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Fork server
+ *
+ * Once the guest has booted, the master stops it and forks a pool of
+ * children that resume it. They share the guest RAM, the translated code
+ * and the taint map with the master copy-on-write. The master keeps the
+ * guest stopped, and forks a new child in the slot of every child that
+ * exits.
+ */
+#ifndef FORKSERVER_H
+#define FORKSERVER_H
+
+#ifndef _WIN32
+#define USE_FORKSERVER
+#endif
+
+#ifdef USE_FORKSERVER
+/* children forked by default, set by -forkserver */
+extern int forkserver_size;
+
+int forkserver_start(int n);
+void forkserver_stop(void);
+/* true in the master while it has a pool, the guest must stay stopped */
+int forkserver_active(void);
+void forkserver_dump_info(FILE *f,
+                          int (*cpu_fprintf)(FILE *f, const char *fmt, ...));
+
+/* in vl.c: make a child independent of the master */
+int qemu_after_fork(int slot);
+#endif
+
+#endif
@@ -21,6 +21,8 @@ int qemu_get_byte(QEMUFile *f);
 unsigned int qemu_get_be16(QEMUFile *f);
 unsigned int qemu_get_be32(QEMUFile *f);
 uint64_t qemu_get_be64(QEMUFile *f);
+void qemu_put_sparse(QEMUFile *f, const uint8_t *buf, size_t size);
+int qemu_get_sparse(QEMUFile *f, uint8_t *buf, size_t size);
 
 static inline void qemu_put_be64s(QEMUFile *f, const uint64_t *pv)
 {
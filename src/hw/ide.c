@@ -31,6 +31,7 @@
 #include "qemu-timer.h"
 #include "sysemu.h"
 #include "ppc_mac.h"
+#include "argos-disktaint.h"
 
 /* debug IDE devices */
 //#define DEBUG_IDE
@@ -374,6 +375,9 @@ typedef struct IDEState {
     uint32_t mdata_size;
     uint8_t *mdata_storage;
     int media_changed;
+    /* disk taint, and the labels of the sectors in io_buffer */
+    ArgosDiskTaint *taint;
+    uint32_t io_taint[MAX_MULT_SECTORS];
 } IDEState;
 
 #define BM_STATUS_DMAING 0x01
@@ -679,6 +683,8 @@ static void ide_transfer_start(IDEState *s, uint8_t *buf, int size,
     s->end_transfer_func = end_transfer_func;
     s->data_ptr = buf;
     s->data_end = buf + size;
+    if (s->taint)
+        memset(s->io_taint, 0, sizeof(s->io_taint));
     if (!(s->status & ERR_STAT))
         s->status |= DRQ_STAT;
 }
@@ -760,12 +766,40 @@ static void ide_sector_read(IDEState *s)
             n = s->req_nb_sectors;
         ret = bdrv_read(s->bs, sector_num, s->io_buffer, n);
         ide_transfer_start(s, s->io_buffer, 512 * n, ide_sector_read);
+        if (s->taint)
+            argos_disktaint_get(s->taint, sector_num, n, s->io_taint);
         ide_set_irq(s);
         ide_set_sector(s, sector_num + n);
         s->nsector -= n;
     }
 }
 
+/* move the taint of a DMA transfer between RAM and io_buffer, starting at
+   io_buffer_index */
+static void ide_dma_taint(IDEState *s, target_phys_addr_t addr, int len,
+                          int to_ram)
+{
+    int index, l;
+    uint32_t *label;
+
+    index = s->io_buffer_index;
+    while (len > 0) {
+        l = 512 - (index & 511);
+        if (l > len)
+            l = len;
+        label = &s->io_taint[index >> 9];
+        if (to_ram) {
+            if (*label)
+                argos_physical_memory_taint(addr, l, *label);
+        } else if (!*label) {
+            *label = argos_physical_memory_label(addr, l);
+        }
+        addr += l;
+        index += l;
+        len -= l;
+    }
+}
+
 /* return 0 if buffer completed */
 static int dma_buf_rw(BMDMAState *bm, int is_write)
 {
@@ -806,6 +840,8 @@ static int dma_buf_rw(BMDMAState *bm, int is_write)
                 cpu_physical_memory_read(bm->cur_prd_addr,
                                           s->io_buffer + s->io_buffer_index, l);
             }
+            if (s->taint)
+                ide_dma_taint(s, bm->cur_prd_addr, l, is_write);
             bm->cur_prd_addr += l;
             bm->cur_prd_len -= l;
             s->io_buffer_index += l;
@@ -825,6 +861,8 @@ static void ide_read_dma_cb(void *opaque, int ret)
     n = s->io_buffer_size >> 9;
     sector_num = ide_get_sector(s);
     if (n > 0) {
+        if (s->taint)
+            argos_disktaint_get(s->taint, sector_num, n, s->io_taint);
         sector_num += n;
         ide_set_sector(s, sector_num);
         s->nsector -= n;
@@ -885,6 +923,8 @@ static void ide_sector_write(IDEState *s)
     n = s->nsector;
     if (n > s->req_nb_sectors)
         n = s->req_nb_sectors;
+    if (s->taint)
+        argos_disktaint_set(s->taint, sector_num, n, s->io_taint);
     ret = bdrv_write(s->bs, sector_num, s->io_buffer, n);
     s->nsector -= n;
     if (s->nsector == 0) {
@@ -951,8 +991,12 @@ static void ide_write_dma_cb(void *opaque, int ret)
     s->io_buffer_index = 0;
     s->io_buffer_size = n * 512;
 
+    if (s->taint)
+        memset(s->io_taint, 0, sizeof(s->io_taint));
     if (dma_buf_rw(bm, 0) == 0)
         goto eot;
+    if (s->taint)
+        argos_disktaint_set(s->taint, sector_num, n, s->io_taint);
 #ifdef DEBUG_AIO
     printf("aio_write: sector_num=%lld n=%d\n", sector_num, n);
 #endif
@@ -2278,12 +2322,39 @@ static void ide_cmd_write(void *opaque, uint32_t addr, uint32_t val)
     ide_if[1].cmd = val;
 }
 
+#define IDE_DIRTY_TAG -1
+
+/* taint of the PIO data, with the granularity of the sectors in io_buffer */
+static inline void ide_taint_write(IDEState *s, uint8_t *p)
+{
+    unsigned long sector = (unsigned long)(p - s->io_buffer) >> 9;
+
+    if (sector < MAX_MULT_SECTORS && !s->io_taint[sector] &&
+        argos_tag_isdirty(argos_ioport_wtag))
+        s->io_taint[sector] = argos_disktaint_label(argos_ioport_wtag);
+}
+
+static inline void ide_taint_read(IDEState *s, uint8_t *p, argos_rtag_t *t)
+{
+    unsigned long sector = (unsigned long)(p - s->io_buffer) >> 9;
+
+    if (sector < MAX_MULT_SECTORS && s->io_taint[sector]) {
+#ifdef ARGOS_NET_TRACKER
+        argos_tag_set(t, IDE_DIRTY_TAG, s->io_taint[sector]);
+#else
+        argos_tag_set(t, IDE_DIRTY_TAG);
+#endif
+    }
+}
+
 static void ide_data_writew(void *opaque, uint32_t addr, uint32_t val)
 {
     IDEState *s = ((IDEState *)opaque)->cur_drive;
     uint8_t *p;
 
     p = s->data_ptr;
+    if (s->taint)
+        ide_taint_write(s, p);
     *(uint16_t *)p = le16_to_cpu(val);
     p += 2;
     s->data_ptr = p;
@@ -2297,6 +2368,8 @@ static uint32_t ide_data_readw(void *opaque, uint32_t addr, argos_rtag_t *t)
     uint8_t *p;
     int ret;
     p = s->data_ptr;
+    if (s->taint)
+        ide_taint_read(s, p, t);
     ret = cpu_to_le16(*(uint16_t *)p);
     p += 2;
     s->data_ptr = p;
@@ -2311,6 +2384,8 @@ static void ide_data_writel(void *opaque, uint32_t addr, uint32_t val)
     uint8_t *p;
 
     p = s->data_ptr;
+    if (s->taint)
+        ide_taint_write(s, p);
     *(uint32_t *)p = le32_to_cpu(val);
     p += 4;
     s->data_ptr = p;
@@ -2325,6 +2400,8 @@ static uint32_t ide_data_readl(void *opaque, uint32_t addr, argos_rtag_t *t)
     int ret;
 
     p = s->data_ptr;
+    if (s->taint)
+        ide_taint_read(s, p, t);
     ret = cpu_to_le32(*(uint32_t *)p);
     p += 4;
     s->data_ptr = p;
@@ -2494,6 +2571,8 @@ static void ide_init2(IDEState *ide_state,
             if (bdrv_get_type_hint(s->bs) == BDRV_TYPE_CDROM) {
                 s->is_cdrom = 1;
 		bdrv_set_change_cb(s->bs, cdrom_change_cb, s);
+            } else if (argos_disktaint_enabled) {
+                s->taint = argos_disktaint_open(s->bs);
             }
         }
         s->drive_serial = drive_serial++;
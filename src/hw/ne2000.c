@@ -30,6 +30,7 @@
 //#define DEBUG_NE2000
 
 #include "argos-tag.h"
+#include "argos-netfilter.h"
 
 #define MAX_ETH_FRAME_SIZE 1514
 
@@ -348,6 +349,7 @@ static void ne2000_receive(void *opaque, const uint8_t *buf, int size)
     uint8_t *p;
     unsigned int total_len, next, avail, len, index, mcast_idx;
     uint8_t buf1[60];
+    int taint;
     static const uint8_t broadcast_macaddr[6] =
         { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
 #ifdef ARGOS_NET_TRACKER
@@ -389,6 +391,8 @@ static void ne2000_receive(void *opaque, const uint8_t *buf, int size)
         }
     }
 
+    /* frames rejected by the taint filter are delivered clean */
+    taint = argos_netfilter_match(buf, size);
 
     /* if too small buffer, then expand it */
     if (size < MIN_BUF_SIZE) {
@@ -419,7 +423,7 @@ static void ne2000_receive(void *opaque, const uint8_t *buf, int size)
     lenbuf[0] = size;
     lenbuf[1] = size >> 8;
     // Write length of ethernet frame in little endian
-    if (fwrite(lenbuf, 2, 1, argos_nt_fl) != 1) 
+    if (taint && fwrite(lenbuf, 2, 1, argos_nt_fl) != 1) 
     { 
 	    fprintf(stderr, "Error writing net trace data header\n"); 
 	    exit(1); 
@@ -441,23 +445,33 @@ static void ne2000_receive(void *opaque, const uint8_t *buf, int size)
             len = avail;
         memcpy(s->mem + index, buf, len);
 #ifdef ARGOS_NET_TRACKER
-	// Write data to log
-	if (fwrite(buf, len, 1, argos_nt_fl) != 1)
+	if (taint)
 	{
-		fprintf(stderr, "Error writing net trace data\n");
-		exit(1);
-	}
-	for (i = 0; i < len; i++)
-	{
-		//s->tag[index + i] = argos_ne2000_netidx++;
-		// Here we split the assignment and the post increment operator, 
-		// because this can give unformentioned effects in combination
-		// with macro's.
-		ARGOS_SET_NETIDX(s->tag[index + i], argos_ne2000_netidx);
-		argos_ne2000_netidx++;
+		// Write data to log
+		if (fwrite(buf, len, 1, argos_nt_fl) != 1)
+		{
+			fprintf(stderr, "Error writing net trace data\n");
+			exit(1);
+		}
+		for (i = 0; i < len; i++)
+		{
+			//s->tag[index + i] = argos_ne2000_netidx++;
+			// Here we split the assignment and the post increment operator, 
+			// because this can give unformentioned effects in combination
+			// with macro's.
+			ARGOS_SET_NETIDX(s->tag[index + i], argos_ne2000_netidx);
+			argos_ne2000_netidx++;
+#ifdef ARGOS_LABEL_SETS
+			// Plain indexes must stay below the set flag
+			if (argos_ne2000_netidx == ARGOS_LABEL_SET_FLAG)
+				argos_ne2000_netidx = 1;
+#endif
+		}
 	}
+	else
+		memset(s->tag + index, 0, len * sizeof(argos_netidx_t));
 #else
-	memset(s->tag + index, 0xff, len);
+	memset(s->tag + index, (taint)? 0xff : 0, len);
 #endif
 
         buf += len;
@@ -470,7 +484,8 @@ static void ne2000_receive(void *opaque, const uint8_t *buf, int size)
 
     /* now we can signal we have received something */
 #ifdef ARGOS_NET_TRACKER
-    fflush(argos_nt_fl);
+    if (taint)
+        fflush(argos_nt_fl);
 #endif
     s->isr |= ENISR_RX;
     ne2000_update_irq(s);
@@ -524,6 +539,7 @@ static void ne2000_ioport_write(void *opaque, uint32_t addr, uint32_t val)
             break;
         case EN0_BOUNDARY:
             s->boundary = val;
+            qemu_flush_queued_packets(s->vc);
             break;
         case EN0_IMR:
             s->imr = val;
@@ -845,6 +861,8 @@ static void ne2000_save(QEMUFile* f,void* opaque)
         tmp = 0;
 	qemu_put_be32s(f, &tmp); /* ignored, was irq */
 	qemu_put_buffer(f, s->mem, NE2000_MEM_SIZE);
+	qemu_put_be32(f, sizeof(s->tag[0]));
+	qemu_put_sparse(f, (uint8_t *)s->tag, sizeof(s->tag));
 }
 
 static int ne2000_load(QEMUFile* f,void* opaque,int version_id)
@@ -853,7 +871,7 @@ static int ne2000_load(QEMUFile* f,void* opaque,int version_id)
         int ret;
         uint32_t tmp;
 
-        if (version_id > 3)
+        if (version_id > 4)
             return -EINVAL;
 
         if (s->pci_dev && version_id >= 3) {
@@ -886,11 +904,19 @@ static int ne2000_load(QEMUFile* f,void* opaque,int version_id)
 	qemu_get_buffer(f, s->mult, 8);
 	qemu_get_be32s(f, &tmp); /* ignored */
 	qemu_get_buffer(f, s->mem, NE2000_MEM_SIZE);
+	if (version_id >= 4) {
+		if (qemu_get_be32(f) != sizeof(s->tag[0]))
+			return -EINVAL;
+		ret = qemu_get_sparse(f, (uint8_t *)s->tag, sizeof(s->tag));
+		if (ret < 0)
+			return ret;
+	} else {
 #ifdef ARGOS_NET_TRACKER 
-	memset(s->tag, 0, sizeof(argos_netidx_t) * NE2000_MEM_SIZE);
+		memset(s->tag, 0, sizeof(argos_netidx_t) * NE2000_MEM_SIZE);
 #else 
-	memset(s->tag, 0, NE2000_MEM_SIZE);
+		memset(s->tag, 0, NE2000_MEM_SIZE);
 #endif
+	}
 
 	return 0;
 }
@@ -930,7 +956,7 @@ void isa_ne2000_init(int base, qemu_irq irq, NICInfo *nd)
              s->macaddr[4],
              s->macaddr[5]);
 
-    register_savevm("ne2000", 0, 2, ne2000_save, ne2000_load, s);
+    register_savevm("ne2000", 0, 4, ne2000_save, ne2000_load, s);
 }
 
 /***********************************************************/
@@ -1001,5 +1027,5 @@ void pci_ne2000_init(PCIBus *bus, NICInfo *nd, int devfn)
              s->macaddr[5]);
 
     /* XXX: instance number ? */
-    register_savevm("ne2000", 0, 3, ne2000_save, ne2000_load, s);
+    register_savevm("ne2000", 0, 4, ne2000_save, ne2000_load, s);
 }
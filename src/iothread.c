@@ -0,0 +1,344 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * I/O thread
+ *
+ * The thread polls the registered fds and reads each of them into the
+ * free slots of its ring. The CPU thread is woken with a byte on a pipe,
+ * which the main loop watches, and with SIGUSR1, which makes cpu_exec()
+ * return. The rings are lock free: the head is only written by the I/O
+ * thread and the tail only by the CPU thread. An fd whose ring is full
+ * is not polled until the CPU thread has consumed some of it.
+ */
+#include "qemu-common.h"
+#include "exec-all.h"
+#include "qemu-char.h"
+#include "iothread.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/poll.h>
+
+#ifdef USE_IOTHREAD
+
+//#define DEBUG_IOTHREAD
+
+/* number of buffers per fd, must be a power of 2 */
+#define IOTHREAD_RING_SIZE 256
+
+#define IOTHREAD_MAX_READERS 32
+
+#define IOTHREAD_SIGNAL SIGUSR1
+
+#define iothread_barrier() __sync_synchronize()
+
+struct IOThreadReader {
+    int fd;
+    int buf_size;
+    IOThreadReadHandler *fd_read;
+    void *opaque;
+    uint8_t *bufs;
+    int sizes[IOTHREAD_RING_SIZE];
+    /* next slot filled by the I/O thread */
+    volatile unsigned int head;
+    /* next slot consumed by the CPU thread */
+    volatile unsigned int tail;
+    struct IOThreadReader *next;
+};
+
+int iothread_enabled;
+
+static pthread_t iothread_tid, iothread_main_tid;
+static pthread_mutex_t iothread_lock = PTHREAD_MUTEX_INITIALIZER;
+static IOThreadReader *first_reader;
+static int iothread_running;
+
+/* wakes the I/O thread when a reader is added or a full ring drains */
+static int iothread_wake_fds[2] = { -1, -1 };
+/* wakes the main loop when there are buffers to consume */
+static int iothread_notify_fds[2] = { -1, -1 };
+static volatile int iothread_notify_pending;
+
+static void iothread_write_byte(int fd)
+{
+    char c = 0;
+    ssize_t ret;
+
+    do {
+        ret = write(fd, &c, 1);
+    } while (ret < 0 && errno == EINTR);
+}
+
+static void iothread_drain(int fd)
+{
+    char buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+}
+
+static int iothread_ring_full(IOThreadReader *r)
+{
+    return r->head - r->tail == IOTHREAD_RING_SIZE;
+}
+
+/* I/O thread: read as many buffers as there is room for */
+static int iothread_fill(IOThreadReader *r)
+{
+    unsigned int slot;
+    int size, n = 0;
+
+    while (!iothread_ring_full(r)) {
+        slot = r->head & (IOTHREAD_RING_SIZE - 1);
+        size = read(r->fd, r->bufs + slot * r->buf_size, r->buf_size);
+        if (size <= 0)
+            break;
+        r->sizes[slot] = size;
+        /* the buffer must be visible before the slot is published */
+        iothread_barrier();
+        r->head++;
+        n++;
+    }
+    return n;
+}
+
+static void iothread_notify(void)
+{
+    iothread_barrier();
+    if (!iothread_notify_pending) {
+        iothread_notify_pending = 1;
+        iothread_write_byte(iothread_notify_fds[1]);
+        pthread_kill(iothread_main_tid, IOTHREAD_SIGNAL);
+    }
+}
+
+static void *iothread_main(void *opaque)
+{
+    struct pollfd fds[IOTHREAD_MAX_READERS + 1];
+    IOThreadReader *readers[IOTHREAD_MAX_READERS + 1];
+    IOThreadReader *r;
+    int i, n, produced;
+
+    for(;;) {
+        fds[0].fd = iothread_wake_fds[0];
+        fds[0].events = POLLIN;
+        n = 1;
+        pthread_mutex_lock(&iothread_lock);
+        for(r = first_reader; r != NULL && n <= IOTHREAD_MAX_READERS;
+            r = r->next) {
+            if (iothread_ring_full(r))
+                continue;
+            fds[n].fd = r->fd;
+            fds[n].events = POLLIN;
+            readers[n] = r;
+            n++;
+        }
+        pthread_mutex_unlock(&iothread_lock);
+
+        if (poll(fds, n, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("iothread: poll");
+            break;
+        }
+        if (fds[0].revents)
+            iothread_drain(iothread_wake_fds[0]);
+        produced = 0;
+        for(i = 1; i < n; i++) {
+            if (fds[i].revents)
+                produced += iothread_fill(readers[i]);
+        }
+        if (produced)
+            iothread_notify();
+    }
+    return NULL;
+}
+
+/* CPU thread: hand the buffers read so far to the callbacks */
+static void iothread_dispatch(void *opaque)
+{
+    IOThreadReader *r;
+    unsigned int slot;
+    int was_full, wake = 0;
+
+    /* drained before pending is cleared, so that the byte of a notify
+       that comes after the clear is not lost */
+    iothread_drain(iothread_notify_fds[0]);
+    iothread_barrier();
+    iothread_notify_pending = 0;
+    iothread_barrier();
+
+    for(r = first_reader; r != NULL; r = r->next) {
+        was_full = iothread_ring_full(r);
+        while (r->tail != r->head) {
+            iothread_barrier();
+            slot = r->tail & (IOTHREAD_RING_SIZE - 1);
+            r->fd_read(r->opaque, r->bufs + slot * r->buf_size,
+                       r->sizes[slot]);
+            iothread_barrier();
+            r->tail++;
+        }
+        if (was_full)
+            wake = 1;
+    }
+    /* the I/O thread stopped polling the fds with a full ring */
+    if (wake)
+        iothread_write_byte(iothread_wake_fds[1]);
+}
+
+static void iothread_signal(int host_signum)
+{
+    if (cpu_single_env)
+        cpu_interrupt(cpu_single_env, CPU_INTERRUPT_EXIT);
+}
+
+static int iothread_pipe(int fds[2])
+{
+    if (pipe(fds) < 0)
+        return -1;
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+}
+
+int iothread_start(void)
+{
+    struct sigaction act;
+    sigset_t all, old;
+    int ret;
+
+    if (iothread_running)
+        return 0;
+    if (iothread_pipe(iothread_wake_fds) < 0 ||
+        iothread_pipe(iothread_notify_fds) < 0) {
+        perror("iothread: pipe");
+        return -1;
+    }
+    qemu_set_fd_handler(iothread_notify_fds[0], iothread_dispatch, NULL,
+                        NULL);
+
+    sigfillset(&act.sa_mask);
+    act.sa_flags = SA_RESTART;
+    act.sa_handler = iothread_signal;
+    sigaction(IOTHREAD_SIGNAL, &act, NULL);
+
+    iothread_main_tid = pthread_self();
+    /* all signals, the alarm and the AIO completions included, must go
+       to the CPU thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    ret = pthread_create(&iothread_tid, NULL, iothread_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+        fprintf(stderr, "iothread: could not create thread: %s\n",
+                strerror(ret));
+        return -1;
+    }
+    iothread_running = 1;
+    return 0;
+}
+
+/* the thread is not inherited by a forked child: drop the readers, whose
+   fds the child reopens, and let the next iothread_add_reader() start a
+   new thread */
+void iothread_after_fork(void)
+{
+    IOThreadReader *r;
+
+    if (!iothread_running)
+        return;
+    qemu_set_fd_handler(iothread_notify_fds[0], NULL, NULL, NULL);
+    close(iothread_wake_fds[0]);
+    close(iothread_wake_fds[1]);
+    close(iothread_notify_fds[0]);
+    close(iothread_notify_fds[1]);
+    iothread_wake_fds[0] = iothread_wake_fds[1] = -1;
+    iothread_notify_fds[0] = iothread_notify_fds[1] = -1;
+    while ((r = first_reader) != NULL) {
+        first_reader = r->next;
+        qemu_free(r->bufs);
+        qemu_free(r);
+    }
+    pthread_mutex_init(&iothread_lock, NULL);
+    iothread_notify_pending = 0;
+    iothread_running = 0;
+}
+
+IOThreadReader *iothread_add_reader(int fd, int buf_size,
+                                    IOThreadReadHandler *fd_read,
+                                    void *opaque)
+{
+    IOThreadReader *r, **pr;
+    int n;
+
+    if (iothread_start() < 0)
+        return NULL;
+
+    n = 0;
+    for(r = first_reader; r != NULL; r = r->next)
+        n++;
+    if (n == IOTHREAD_MAX_READERS)
+        return NULL;
+
+    r = qemu_mallocz(sizeof(IOThreadReader));
+    if (!r)
+        return NULL;
+    r->bufs = qemu_malloc(IOTHREAD_RING_SIZE * buf_size);
+    if (!r->bufs) {
+        qemu_free(r);
+        return NULL;
+    }
+    r->fd = fd;
+    r->buf_size = buf_size;
+    r->fd_read = fd_read;
+    r->opaque = opaque;
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    /* appended, so that the CPU thread can walk the list unlocked */
+    pthread_mutex_lock(&iothread_lock);
+    pr = &first_reader;
+    while (*pr != NULL)
+        pr = &(*pr)->next;
+    iothread_barrier();
+    *pr = r;
+    pthread_mutex_unlock(&iothread_lock);
+
+    iothread_write_byte(iothread_wake_fds[1]);
+#ifdef DEBUG_IOTHREAD
+    printf("iothread: reading fd %d\n", fd);
+#endif
+    return r;
+}
+
+#endif /* USE_IOTHREAD */
@@ -0,0 +1,62 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * I/O thread
+ *
+ * Reads from host fds are done by a separate thread into preallocated
+ * buffers, and the data are handed to the CPU thread through one
+ * single-producer single-consumer ring per fd. The callbacks run in the
+ * CPU thread, from the main loop, so device models need no locking.
+ */
+#ifndef IOTHREAD_H
+#define IOTHREAD_H
+
+#ifndef _WIN32
+#define USE_IOTHREAD
+#endif
+
+#ifdef USE_IOTHREAD
+typedef struct IOThreadReader IOThreadReader;
+
+/* called in the CPU thread for every buffer read from the fd */
+typedef void IOThreadReadHandler(void *opaque, const uint8_t *buf, int size);
+
+extern int iothread_enabled;
+
+int iothread_start(void);
+void iothread_after_fork(void);
+IOThreadReader *iothread_add_reader(int fd, int buf_size,
+                                    IOThreadReadHandler *fd_read,
+                                    void *opaque);
+#endif
+
+#endif
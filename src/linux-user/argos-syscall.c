@@ -0,0 +1,286 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "qemu.h"
+#include "argos-memmap.h"
+#include "argos-syscall.h"
+
+enum { RULE_SOCKETS, RULE_ALL, RULE_FD, RULE_PORT, RULE_PATH };
+
+struct taint_rule {
+	int type;
+	int arg;
+	char *path;
+};
+
+//! Maximum number of rules
+#define MAX_RULES 32
+//! Descriptors whose decision is cached
+#define MAX_CACHED_FDS 1024
+
+static struct taint_rule rules[MAX_RULES] = { { RULE_SOCKETS, 0, NULL } };
+static int nrules = 1;
+//! Set once the default policy has been replaced
+static int policy_set = 0;
+
+enum { FD_UNKNOWN = 0, FD_CLEAN, FD_TAINTED };
+static unsigned char fd_state[MAX_CACHED_FDS];
+
+
+static int
+add_rule(const char *rule, int len)
+{
+	struct taint_rule *r;
+	const char *num = NULL;
+	char *end;
+
+	if (len == 4 && strncmp(rule, "none", 4) == 0)
+		return 0;
+	if (nrules == MAX_RULES) {
+		fprintf(stderr, "Too many taint rules\n");
+		return -1;
+	}
+	r = rules + nrules;
+	memset(r, 0, sizeof(*r));
+
+	if (len == 7 && strncmp(rule, "sockets", 7) == 0)
+		r->type = RULE_SOCKETS;
+	else if (len == 3 && strncmp(rule, "all", 3) == 0)
+		r->type = RULE_ALL;
+	else if (len > 3 && strncmp(rule, "fd:", 3) == 0) {
+		r->type = RULE_FD;
+		num = rule + 3;
+	} else if (len > 5 && strncmp(rule, "port:", 5) == 0) {
+		r->type = RULE_PORT;
+		num = rule + 5;
+	} else if (len > 5 && strncmp(rule, "path:", 5) == 0) {
+		r->type = RULE_PATH;
+		if ((r->path = strndup(rule + 5, len - 5)) == NULL)
+			return -1;
+	} else
+		goto err;
+
+	if (num) {
+		r->arg = strtol(num, &end, 0);
+		if (end != rule + len || r->arg < 0)
+			goto err;
+	}
+	nrules++;
+	return 0;
+
+err:
+	fprintf(stderr, "Invalid taint rule: %.*s\n", len, rule);
+	return -1;
+}
+
+//! Add the comma separated rules of \a spec to the policy
+int
+argos_syscall_policy(const char *spec)
+{
+	const char *p;
+	int len;
+
+	// The first rules replace the default policy
+	if (!policy_set) {
+		nrules = 0;
+		policy_set = 1;
+	}
+	for (;;) {
+		p = strchr(spec, ',');
+		len = (p)? p - spec : strlen(spec);
+		if (add_rule(spec, len) != 0)
+			return -1;
+		if (p == NULL)
+			break;
+		spec = p + 1;
+	}
+	memset(fd_state, 0, sizeof(fd_state));
+	return 0;
+}
+
+//! Returns the local, or the remote, port of a socket, or -1
+static int
+socket_port(int fd, int remote)
+{
+	struct sockaddr_storage ss;
+	socklen_t len = sizeof(ss);
+	int e;
+
+	if (remote)
+		e = getpeername(fd, (struct sockaddr *)&ss, &len);
+	else
+		e = getsockname(fd, (struct sockaddr *)&ss, &len);
+	if (e != 0)
+		return -1;
+	switch (ss.ss_family) {
+	case AF_INET:
+		return ntohs(((struct sockaddr_in *)&ss)->sin_port);
+	case AF_INET6:
+		return ntohs(((struct sockaddr_in6 *)&ss)->sin6_port);
+	}
+	return -1;
+}
+
+static int
+fd_tainted(int fd)
+{
+	struct stat st;
+	char link[32], path[PATH_MAX];
+	int i, issock, n = -1, lport = -2, rport = -2;
+
+	if (fstat(fd, &st) != 0)
+		return 0;
+	issock = S_ISSOCK(st.st_mode);
+
+	for (i = 0; i < nrules; i++) {
+		switch (rules[i].type) {
+		case RULE_ALL:
+			return 1;
+		case RULE_SOCKETS:
+			if (issock)
+				return 1;
+			break;
+		case RULE_FD:
+			if (fd == rules[i].arg)
+				return 1;
+			break;
+		case RULE_PORT:
+			if (!issock)
+				break;
+			if (lport == -2) {
+				lport = socket_port(fd, 0);
+				rport = socket_port(fd, 1);
+			}
+			if (lport == rules[i].arg || rport == rules[i].arg)
+				return 1;
+			break;
+		case RULE_PATH:
+			if (issock)
+				break;
+			if (n < 0) {
+				snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+				if ((n = readlink(link, path, sizeof(path) - 1)) < 0)
+					n = 0;
+				path[n] = '\0';
+			}
+			if (n > 0 && strncmp(path, rules[i].path, 
+						strlen(rules[i].path)) == 0)
+				return 1;
+			break;
+		}
+	}
+	return 0;
+}
+
+//! Forget the decision about \a fd, it has been closed or changed
+void
+argos_syscall_forget(int fd)
+{
+	if (fd >= 0 && fd < MAX_CACHED_FDS)
+		fd_state[fd] = FD_UNKNOWN;
+}
+
+//! Taint or clean the \a len bytes read from \a fd at guest address \a addr
+void
+argos_syscall_input(int fd, abi_ulong addr, abi_long len)
+{
+	int taint;
+
+	if (len <= 0 || addr >= ARGOS_USER_MEMMAP_SIZE)
+		return;
+	if (len > ARGOS_USER_MEMMAP_SIZE - addr)
+		len = ARGOS_USER_MEMMAP_SIZE - addr;
+
+	if (nrules == 0)
+		taint = 0;
+	else if (fd >= 0 && fd < MAX_CACHED_FDS) {
+		if (fd_state[fd] == FD_UNKNOWN)
+			fd_state[fd] = (fd_tainted(fd))? FD_TAINTED : FD_CLEAN;
+		taint = fd_state[fd] == FD_TAINTED;
+	} else
+		taint = fd_tainted(fd);
+
+	if (taint)
+		ARGOS_MEMMAP_TAINT(g2h(addr), len);
+	else
+		ARGOS_MEMMAP_CLEAR(g2h(addr), len);
+}
+
+int argos_syscall_debug_enabled = 0;
+
+//! The debug hook, see argos-syscall.h
+abi_long
+argos_syscall_debug(void *cpu_env, abi_long op, abi_ulong addr, abi_long len)
+{
+	abi_long n = 0;
+	int i;
+
+	if (op == ARGOS_DEBUG_REGS) {
+#ifdef TARGET_I386
+		CPUX86State *env = cpu_env;
+
+		for (i = 0; i < CPU_NB_REGS; i++)
+			if (argos_tag_isdirty(&env->regtags[i]))
+				n |= 1 << i;
+		return n;
+#else
+		return -TARGET_EINVAL;
+#endif
+	}
+
+	if (len < 0 || addr >= ARGOS_USER_MEMMAP_SIZE ||
+			len > ARGOS_USER_MEMMAP_SIZE - addr)
+		return -TARGET_EFAULT;
+	switch (op) {
+	case ARGOS_DEBUG_TAINT:
+		ARGOS_MEMMAP_TAINT(g2h(addr), len);
+		break;
+	case ARGOS_DEBUG_CLEAR:
+		ARGOS_MEMMAP_CLEAR(g2h(addr), len);
+		break;
+	case ARGOS_DEBUG_COUNT:
+		for (i = 0; i < len; i++)
+			if (argos_memmap_istainted(ARGOS_OFFSET(g2h(addr + i))))
+				n++;
+		break;
+	default:
+		return -TARGET_EINVAL;
+	}
+	return n;
+}
@@ -0,0 +1,82 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef ARGOS_SYSCALL_H
+#define ARGOS_SYSCALL_H
+
+// Taint sources of the user mode emulator
+//
+// The data that the system calls read into the guest's memory are tainted
+// when the file descriptor they are read from matches the taint policy, and
+// cleaned otherwise. The policy is a list of rules, any of which is enough
+// to taint the data of a descriptor:
+//
+//   sockets      every socket (the default)
+//   all          every descriptor
+//   none         no descriptor
+//   fd:N         descriptor N
+//   port:N       TCP and UDP sockets with local or remote port N
+//   path:PREFIX  files, devices and pipes opened with a path under PREFIX
+//
+// The decision is cached for every descriptor, until it is closed, replaced
+// by dup2() or a socket is bound or connected.
+
+//! Size of the memory map of the user mode emulator
+#define ARGOS_USER_MEMMAP_SIZE (3UL * 1024 * 1024 * 1024)
+
+int argos_syscall_policy(const char *spec);
+void argos_syscall_forget(int fd);
+void argos_syscall_input(int fd, abi_ulong addr, abi_long len);
+
+// Debug hook
+//
+// With -taint-debug the guest can seed and inspect the taint through system
+// call ARGOS_NR_debug, with the operation in the first argument. It is used
+// by tests/argos-taint-test.c, which keeps its own copy of these numbers.
+// Without the option the call fails with ENOSYS, so that a program cannot
+// clean its own taint.
+
+#define ARGOS_NR_debug 0x4152
+
+//! Taint the len bytes at addr
+#define ARGOS_DEBUG_TAINT 1
+//! Clean the len bytes at addr
+#define ARGOS_DEBUG_CLEAR 2
+//! Return how many of the len bytes at addr are tainted
+#define ARGOS_DEBUG_COUNT 3
+//! Return a mask of the general purpose registers with tainted tags
+#define ARGOS_DEBUG_REGS  4
+
+extern int argos_syscall_debug_enabled;
+
+abi_long argos_syscall_debug(void *cpu_env, abi_long op, abi_ulong addr,
+		abi_long len);
+
+#endif
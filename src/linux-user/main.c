@@ -33,11 +33,12 @@ const char *qemu_uname_release = CONFIG_UNAME_RELEASE;
 
 /* Argos */
 #include <time.h>
+#include <sys/resource.h>
 #include "argos-whitelist.h"
+#include "argos-syscall.h"
 
 #define DEFAULT_WHITELIST_FILE "argos-whitelist"
 
-const int argos_os_hint = 0;
 int argos_csilog = 1;
 const int argos_fsc = 0;
 const char *ctrl_socket_laddr = NULL;
@@ -98,6 +99,21 @@ void cpu_outl(CPUState *env, int addr, int val)
     fprintf(stderr, "outl: port=0x%04x, data=%08x\n", addr, val);
 }
 
+void argos_cpu_outb(CPUState *env, int addr, int val, const argos_rtag_t *t)
+{
+    cpu_outb(env, addr, val);
+}
+
+void argos_cpu_outw(CPUState *env, int addr, int val, const argos_rtag_t *t)
+{
+    cpu_outw(env, addr, val);
+}
+
+void argos_cpu_outl(CPUState *env, int addr, int val, const argos_rtag_t *t)
+{
+    cpu_outl(env, addr, val);
+}
+
 int argos_cpu_inb(CPUState *env, int addr, argos_rtag_t *t)
 {
     fprintf(stderr, "inb: port=0x%04x\n", addr);
@@ -1921,15 +1937,21 @@ void usage(void)
 	   "Argos specific:\n"
            "-no-csilog   do not generate an argos log when an attack is detected\n"
            "-wp profile  set the whitelist OS to profile\n"
+           "-taint rules taint the data read from the matching descriptors\n"
+           "             (sockets, all, none, fd:N, port:N, path:PREFIX;\n"
+           "             default=sockets)\n"
            "\n"
            "Debug options:\n"
            "-d options   activate log (logfile=%s)\n"
            "-p pagesize  set the host page size to 'pagesize'\n"
            "-strace      log system calls\n"
+           "-taint-debug let the program seed and inspect the taint (tests)\n"
            "\n"
            "Environment variables:\n"
            "ARGOS_STRACE       Print system calls and arguments similar to the\n"
            "                  'strace' program.  Enable by setting to any value.\n"
+           "ARGOS_STATS        Write the translation statistics to this file\n"
+           "                  when the program exits.\n"
            ,
            TARGET_ARCH,
            interp_prefix,
@@ -1944,6 +1966,23 @@ CPUState *global_env;
 /* used to free thread contexts */
 TaskState *first_task_state;
 
+/* the benchmarks set ARGOS_STATS to the file that receives the translation
+   statistics when the program exits */
+void dump_exit_stats(void)
+{
+    const char *filename;
+    struct rusage ru;
+    FILE *f;
+
+    filename = getenv("ARGOS_STATS");
+    if (!filename || !(f = fopen(filename, "w")))
+        return;
+    dump_exec_info(f, fprintf);
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+        fprintf(f, "Max RSS             %ld KB\n", ru.ru_maxrss);
+    fclose(f);
+}
+
 int main(int argc, char **argv)
 {
     const char *filename;
@@ -2030,6 +2069,11 @@ int main(int argc, char **argv)
             do_strace = 1;
 	} else if (!strcmp(r, "no-csilog")) {
             argos_csilog = 0;
+        } else if (!strcmp(r, "taint")) {
+            if (argos_syscall_policy(argv[optind++]) != 0)
+                _exit(1);
+        } else if (!strcmp(r, "taint-debug")) {
+            argos_syscall_debug_enabled = 1;
         } else
         {
             usage();
@@ -2113,7 +2157,7 @@ int main(int argc, char **argv)
     read_argos_whitelist(argos_wprofile, DEFAULT_WHITELIST_FILE);
 
     srand(time(NULL));
-    if (!(argos_memmap = argos_memmap_createz(3UL * 1024 * 1024 * 1024))) {
+    if (!(argos_memmap = argos_memmap_createz(ARGOS_USER_MEMMAP_SIZE))) {
         fprintf(stderr, "Could not allocate argos memory map\n");
         exit(1);
     }
@@ -166,6 +166,7 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
 void gemu_log(const char *fmt, ...) __attribute__((format(printf,1,2)));
 extern CPUState *global_env;
 void cpu_loop(CPUState *env);
+void dump_exit_stats(void);
 void init_paths(const char *prefix);
 const char *path(const char *pathname);
 char *target_strerror(int err);
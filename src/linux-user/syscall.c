@@ -70,6 +70,7 @@
 #include <linux/kd.h>
 
 #include "qemu.h"
+#include "argos-syscall.h"
 
 //#define DEBUG
 
@@ -1062,6 +1063,28 @@ static abi_long unlock_iovec(struct iovec *vec, abi_ulong target_addr,
     return 0;
 }
 
+/* taint or clean the first len bytes read into a guest iovec */
+static void argos_input_iovec(int fd, abi_ulong target_addr, int count,
+                              abi_long len)
+{
+    struct target_iovec *target_vec;
+    abi_ulong base, l;
+    int i;
+
+    target_vec = lock_user(VERIFY_READ, target_addr, count * sizeof(struct target_iovec), 1);
+    if (!target_vec)
+        return;
+    for(i = 0; i < count && len > 0; i++) {
+        base = tswapl(target_vec[i].iov_base);
+        l = tswapl(target_vec[i].iov_len);
+        if (l > len)
+            l = len;
+        argos_syscall_input(fd, base, l);
+        len -= l;
+    }
+    unlock_user (target_vec, target_addr, 0);
+}
+
 /* do_socket() Must return target values and target errnos. */
 static abi_long do_socket(int domain, int type, int protocol)
 {
@@ -1099,6 +1122,7 @@ static abi_long do_bind(int sockfd, abi_ulong target_addr,
     void *addr = alloca(addrlen);
 
     target_to_host_sockaddr(addr, target_addr, addrlen);
+    argos_syscall_forget(sockfd);
     return get_errno(bind(sockfd, addr, addrlen));
 }
 
@@ -1109,6 +1133,7 @@ static abi_long do_connect(int sockfd, abi_ulong target_addr,
     void *addr = alloca(addrlen);
 
     target_to_host_sockaddr(addr, target_addr, addrlen);
+    argos_syscall_forget(sockfd);
     return get_errno(connect(sockfd, addr, addrlen));
 }
 
@@ -1155,8 +1180,10 @@ static abi_long do_sendrecvmsg(int fd, abi_ulong target_msg,
             ret = get_errno(sendmsg(fd, &msg, flags));
     } else {
         ret = get_errno(recvmsg(fd, &msg, flags));
-        if (!is_error(ret))
+        if (!is_error(ret)) {
+            argos_input_iovec(fd, target_vec, count, ret);
             ret = host_to_target_cmsg(msgp, &msg);
+        }
     }
     unlock_iovec(vec, target_vec, count, !send);
     unlock_user_struct(msgp, target_msg, send ? 0 : 1);
@@ -1300,6 +1327,7 @@ static abi_long do_recvfrom(int fd, abi_ulong msg, size_t len, int flags,
             }
         }
         unlock_user(host_msg, msg, len);
+        argos_syscall_input(fd, msg, ret);
     } else {
 fail:
         unlock_user(host_msg, msg, 0);
@@ -3072,6 +3100,7 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
 #ifdef HAVE_GPROF
         _mcleanup();
 #endif
+        dump_exit_stats();
         gdb_exit(cpu_env, arg1);
         /* XXX: should free thread stack and CPU env */
         _exit(arg1);
@@ -3082,6 +3111,8 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
             goto efault;
         ret = get_errno(read(arg1, p, arg3));
         unlock_user(p, arg2, ret);
+        if (!is_error(ret))
+            argos_syscall_input(arg1, arg2, ret);
         break;
     case TARGET_NR_write:
         if (!(p = lock_user(VERIFY_READ, arg2, arg3, 1)))
@@ -3110,6 +3141,7 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
 #endif
     case TARGET_NR_close:
         ret = get_errno(close(arg1));
+        argos_syscall_forget(arg1);
         break;
     case TARGET_NR_brk:
         ret = do_brk(arg1);
@@ -3595,6 +3627,8 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
         goto unimplemented;
     case TARGET_NR_dup2:
         ret = get_errno(dup2(arg1, arg2));
+        if (!is_error(ret))
+            argos_syscall_forget(arg2);
         break;
 #ifdef TARGET_NR_getppid /* not on alpha */
     case TARGET_NR_getppid:
@@ -4482,6 +4516,7 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
 #ifdef __NR_exit_group
         /* new thread calls */
     case TARGET_NR_exit_group:
+        dump_exit_stats();
         gdb_exit(cpu_env, arg1);
         ret = get_errno(exit_group(arg1));
         break;
@@ -4726,6 +4761,8 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
             lock_iovec(VERIFY_WRITE, vec, arg2, count, 0);
             ret = get_errno(readv(arg1, vec, count));
             unlock_iovec(vec, arg2, count, 1);
+            if (!is_error(ret))
+                argos_input_iovec(arg1, arg2, count, ret);
         }
         break;
     case TARGET_NR_writev:
@@ -4859,6 +4896,8 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
             goto efault;
         ret = get_errno(pread(arg1, p, arg3, arg4));
         unlock_user(p, arg2, ret);
+        if (!is_error(ret))
+            argos_syscall_input(arg1, arg2, ret);
         break;
     case TARGET_NR_pwrite:
         if (!(p = lock_user(VERIFY_READ, arg2, arg3, 1)))
@@ -5549,6 +5588,12 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
 	break;
 #endif
 
+    case ARGOS_NR_debug:
+        if (!argos_syscall_debug_enabled)
+            goto unimplemented;
+        ret = argos_syscall_debug(cpu_env, arg1, arg2, arg3);
+        break;
+
     default:
     unimplemented:
         gemu_log("qemu: Unsupported syscall: %d\n", num);
@@ -0,0 +1,181 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Guest RAM merging
+ *
+ * The kernel shares a merged page until one of the processes writes to
+ * it, and then gives the writer a private copy at the same address. The
+ * emulator does its bookkeeping for a guest write, the phys_ram_dirty
+ * bits and the invalidation of the translated code in exec.c, before the
+ * host store that faults, and the taint of the guest RAM is kept in a
+ * separate map, so merging changes neither of them.
+ *
+ * The RAM is handled in chunks. A chunk that holds tainted data is taken
+ * out of the mergeable area: it is written by the attack that is being
+ * tracked, every write to a merged page costs a copy-on-write fault, and
+ * the time of such a fault would tell the attacker whether another
+ * instance holds the same data. A chunk goes back once it is clean. The
+ * chunks are rescanned a few at a time from a timer, so that the scan
+ * never stalls the guest; the map is read a word at a time and the
+ * unallocated pages of the pagemap are skipped at once.
+ */
+#include "qemu-common.h"
+#include "exec-all.h"
+#include "qemu-timer.h"
+#include "memmerge.h"
+
+#ifdef USE_MEMMERGE
+
+#define MEMMERGE_CHUNK_BITS 21
+#define MEMMERGE_CHUNK_SIZE (1 << MEMMERGE_CHUNK_BITS)
+
+/* chunks scanned every MEMMERGE_SCAN_INTERVAL ms */
+#define MEMMERGE_SCAN_CHUNKS 4
+#define MEMMERGE_SCAN_INTERVAL 250
+
+static int memmerge_running;
+static QEMUTimer *scan_timer;
+static unsigned int nb_chunks, scan_pos;
+/* 1 if the chunk is not mergeable because it is tainted */
+static uint8_t *chunk_excluded;
+static unsigned int nb_excluded;
+static unsigned int nb_passes, nb_errors;
+
+static void memmerge_scan(void *opaque)
+{
+    ram_addr_t addr, len;
+    int i, tainted;
+
+    for (i = 0; i < MEMMERGE_SCAN_CHUNKS; i++) {
+        addr = (ram_addr_t)scan_pos << MEMMERGE_CHUNK_BITS;
+        len = MIN(MEMMERGE_CHUNK_SIZE, phys_ram_size - addr);
+        tainted = argos_memmap_anytainted(addr, len) != 0;
+        if (tainted != chunk_excluded[scan_pos]) {
+            if (madvise(phys_ram_base + addr, len,
+                        tainted ? MADV_UNMERGEABLE : MADV_MERGEABLE) == 0) {
+                chunk_excluded[scan_pos] = tainted;
+                if (tainted)
+                    nb_excluded++;
+                else
+                    nb_excluded--;
+            } else {
+                nb_errors++;
+            }
+        }
+        if (++scan_pos == nb_chunks) {
+            scan_pos = 0;
+            nb_passes++;
+        }
+    }
+    qemu_mod_timer(scan_timer,
+                   qemu_get_clock(rt_clock) + MEMMERGE_SCAN_INTERVAL);
+}
+
+int memmerge_start(void)
+{
+    if (memmerge_running)
+        return 0;
+    if (madvise(phys_ram_base, phys_ram_size, MADV_MERGEABLE) < 0) {
+        perror("madvise(MADV_MERGEABLE)");
+        return -1;
+    }
+    nb_chunks = (phys_ram_size + MEMMERGE_CHUNK_SIZE - 1) >>
+        MEMMERGE_CHUNK_BITS;
+    chunk_excluded = qemu_mallocz(nb_chunks);
+    if (!chunk_excluded)
+        return -1;
+    scan_timer = qemu_new_timer(rt_clock, memmerge_scan, NULL);
+    qemu_mod_timer(scan_timer,
+                   qemu_get_clock(rt_clock) + MEMMERGE_SCAN_INTERVAL);
+    memmerge_running = 1;
+    return 0;
+}
+
+/* the guest RAM was mapped again, from a saved state: the new mapping
+   is not mergeable and the chunks are scanned again from the start */
+void memmerge_remapped(void)
+{
+    if (!memmerge_running)
+        return;
+    if (madvise(phys_ram_base, phys_ram_size, MADV_MERGEABLE) < 0)
+        nb_errors++;
+    memset(chunk_excluded, 0, nb_chunks);
+    nb_excluded = 0;
+    scan_pos = 0;
+}
+
+/* -1 if the file cannot be read */
+static long read_counter(const char *filename)
+{
+    FILE *f;
+    long val;
+
+    f = fopen(filename, "r");
+    if (!f)
+        return -1;
+    if (fscanf(f, "%ld", &val) != 1)
+        val = -1;
+    fclose(f);
+    return val;
+}
+
+void memmerge_dump_info(FILE *f,
+                        int (*cpu_fprintf)(FILE *f, const char *fmt, ...))
+{
+    long run, shared, sharing, merging;
+
+    if (!memmerge_running) {
+        cpu_fprintf(f, "guest RAM merging is off\n");
+        return;
+    }
+    cpu_fprintf(f, "chunks          %u of %d KB\n", nb_chunks,
+                MEMMERGE_CHUNK_SIZE / 1024);
+    cpu_fprintf(f, "tainted chunks  %u\n", nb_excluded);
+    cpu_fprintf(f, "scan passes     %u\n", nb_passes);
+    if (nb_errors)
+        cpu_fprintf(f, "madvise errors  %u\n", nb_errors);
+
+    merging = read_counter("/proc/self/ksm_merging_pages");
+    if (merging >= 0)
+        cpu_fprintf(f, "merged pages    %ld\n", merging);
+    run = read_counter("/sys/kernel/mm/ksm/run");
+    shared = read_counter("/sys/kernel/mm/ksm/pages_shared");
+    sharing = read_counter("/sys/kernel/mm/ksm/pages_sharing");
+    if (run < 0) {
+        cpu_fprintf(f, "host: no KSM\n");
+    } else {
+        cpu_fprintf(f, "host: KSM %s, %ld pages shared by %ld\n",
+                    run == 1 ? "running" : "stopped", shared, sharing);
+    }
+}
+
+#endif /* USE_MEMMERGE */
@@ -34,6 +34,14 @@
 #include "block.h"
 #include "audio/audio.h"
 #include "disas.h"
+#include "tbcache.h"
+#include "tbprofile.h"
+#include "forkserver.h"
+#include "memmerge.h"
+#include "argos-netfilter.h"
+#include "argos-osprofile.h"
+#include "argos-disktaint.h"
+#include "argos-counters.h"
 #include <dirent.h>
 
 #ifdef CONFIG_PROFILER
@@ -339,10 +347,54 @@ static void do_cpu_set(int index)
         term_printf("Invalid CPU index\n");
 }
 
+static void do_info_taintfilter(void)
+{
+    argos_netfilter_dump_info(NULL, monitor_fprintf);
+}
+
+static void do_info_disktaint(void)
+{
+    argos_disktaint_dump_info(NULL, monitor_fprintf);
+}
+
+static void do_info_argos(void)
+{
+    argos_counters_dump_info(NULL, monitor_fprintf);
+}
+
+static void do_info_osprofile(void)
+{
+    argos_osprofile_dump_info(NULL, monitor_fprintf);
+}
+
 static void do_info_jit(void)
 {
     dump_exec_info(NULL, monitor_fprintf);
+#ifdef USE_TBCACHE
+    tbcache_dump_info(NULL, monitor_fprintf);
+#endif
+}
+
+#ifdef USE_TBPROFILE
+static void do_info_tbprofile(void)
+{
+    tbprofile_dump_info(NULL, monitor_fprintf);
+}
+#endif
+
+#ifdef USE_MEMMERGE
+static void do_info_memmerge(void)
+{
+    memmerge_dump_info(NULL, monitor_fprintf);
+}
+#endif
+
+#ifdef USE_FORKSERVER
+static void do_info_forkserver(void)
+{
+    forkserver_dump_info(NULL, monitor_fprintf);
 }
+#endif
 
 static void do_info_history (void)
 {
@@ -470,6 +522,39 @@ static void do_log(const char *items)
     cpu_set_log(mask);
 }
 
+#ifdef USE_TBPROFILE
+static void do_tbprofile(const char *cmd, const char *arg)
+{
+    if (!strcmp(cmd, "start")) {
+        if (tbprofile_start(arg ? atoi(arg) : 0) < 0)
+            term_printf("Could not start the TB profiler\n");
+    } else if (!strcmp(cmd, "stop")) {
+        tbprofile_stop();
+    } else if (!strcmp(cmd, "reset")) {
+        tbprofile_reset();
+    } else if (!strcmp(cmd, "save") && arg) {
+        if (tbprofile_save(arg) < 0)
+            term_printf("Could not save the profile to '%s'\n", arg);
+    } else {
+        help_cmd("tbprofile");
+    }
+}
+#endif
+
+#ifdef USE_FORKSERVER
+static void do_forkserver(const char *cmd, const char *arg)
+{
+    if (!strcmp(cmd, "start")) {
+        if (forkserver_start(arg ? atoi(arg) : 0) < 0)
+            term_printf("Could not start the fork server\n");
+    } else if (!strcmp(cmd, "stop")) {
+        forkserver_stop();
+    } else {
+        help_cmd("forkserver");
+    }
+}
+#endif
+
 static void do_stop(void)
 {
     vm_stop(EXCP_INTERRUPT);
@@ -1275,10 +1360,22 @@ static term_cmd_t term_cmds[] = {
       "filename", "output logs to 'filename'" },
     { "log", "s", do_log,
       "item1[,...]", "activate logging of the specified items to '/tmp/argos.log'" },
+#ifdef USE_TBPROFILE
+    { "tbprofile", "ss?", do_tbprofile,
+      "start [hz]|stop|reset|save file", "sample the executed translated blocks (see 'info tbprofile')" },
+#endif
+#ifdef USE_FORKSERVER
+    { "forkserver", "ss?", do_forkserver,
+      "start [n]|stop", "fork n instances of the stopped guest, and fork them again when they exit (see 'info forkserver')" },
+#endif
     { "savevm", "s?", do_savevm,
       "tag|id", "save a VM snapshot. If no tag or id are provided, a new snapshot is created" },
     { "loadvm", "s", do_loadvm,
       "tag|id", "restore a VM snapshot from its tag or id" },
+    { "savevm_raw", "F", do_savevm_raw,
+      "filename", "save a raw VM snapshot to 'filename', which can be restored quickly" },
+    { "loadvm_raw", "F", do_loadvm_raw,
+      "filename", "restore a raw VM snapshot from 'filename'" },
     { "delvm", "s", do_delvm,
       "tag|id", "delete a VM snapshot from its tag or id" },
     { "stop", "", do_stop,
@@ -1359,6 +1456,26 @@ static term_cmd_t info_cmds[] = {
 #endif
     { "jit", "", do_info_jit,
       "", "show dynamic compiler info", },
+#ifdef USE_TBPROFILE
+    { "tbprofile", "", do_info_tbprofile,
+      "", "show the most sampled translated blocks", },
+#endif
+#ifdef USE_FORKSERVER
+    { "forkserver", "", do_info_forkserver,
+      "", "show the slots of the fork server", },
+#endif
+#ifdef USE_MEMMERGE
+    { "memmerge", "", do_info_memmerge,
+      "", "show how much of the guest RAM the host merged", },
+#endif
+    { "taintfilter", "", do_info_taintfilter,
+      "", "show the taint filter and how many frames it tainted", },
+    { "disktaint", "", do_info_disktaint,
+      "", "show the tainted extents of the disks", },
+    { "argos", "", do_info_argos,
+      "", "show the tainted memory and the taint operation counters", },
+    { "osprofile", "", do_info_osprofile,
+      "", "show the guest OS profile", },
     /*
     { "kqemu", "", do_info_kqemu,
       "", "show kqemu information", },
@@ -5,6 +5,23 @@
 
 typedef struct VLANClientState VLANClientState;
 
+/* maximum number of packets queued for a client that cannot receive */
+#define VLAN_QUEUE_MAX_LEN 256
+
+/* size of the pooled packet buffers, enough for any frame of the backends */
+#define VLAN_PACKET_SIZE 4096
+
+/* Refcounted packet buffer. A backend fills one and sends it to the VLAN;
+   the clients that cannot receive it at once queue a reference instead of
+   a copy. Packets must not be modified once they have been sent. */
+typedef struct VLANPacket {
+    struct VLANPacket *next; /* free list of the pool */
+    int refcnt;
+    int size;
+    int buf_size;
+    uint8_t data[0];
+} VLANPacket;
+
 struct VLANClientState {
     IOReadHandler *fd_read;
     /* Packets may still be sent if this returns zero.  It's used to
@@ -14,6 +31,10 @@ struct VLANClientState {
     struct VLANClientState *next;
     struct VLANState *vlan;
     char info_str[256];
+    /* ring of the packets received while fd_can_read returned zero */
+    VLANPacket *queue[VLAN_QUEUE_MAX_LEN];
+    int queue_first, queue_len, queue_max_len;
+    unsigned long queue_drops;
 };
 
 struct VLANState {
@@ -30,8 +51,18 @@ VLANClientState *qemu_new_vlan_client(VLANState *vlan,
                                       void *opaque);
 int qemu_can_send_packet(VLANClientState *vc);
 void qemu_send_packet(VLANClientState *vc, const uint8_t *buf, int size);
+VLANPacket *qemu_packet_alloc(int size);
+void qemu_packet_unref(VLANPacket *p);
+void qemu_send_packet_buf(VLANClientState *vc, VLANPacket *p);
+void qemu_flush_queued_packets(VLANClientState *vc);
 void qemu_handler_true(void *opaque);
 
+static inline VLANPacket *qemu_packet_ref(VLANPacket *p)
+{
+    p->refcnt++;
+    return p;
+}
+
 void do_info_network(void);
 
 /* NIC info */
@@ -24,6 +24,7 @@
 #include "qemu-common.h"
 #include "block_int.h"
 #include <assert.h>
+#include <sys/time.h>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -92,6 +93,7 @@ static void help(void)
            "  commit [-f fmt] filename\n"
            "  convert [-c] [-e] [-6] [-f fmt] filename [filename2 [...]] [-O output_fmt] output_filename\n"
            "  info [-f fmt] filename\n"
+           "  bench [-f fmt] [-n count] [-s sectors] [-S seed] [-C l2_cache_kb] filename\n"
            "\n"
            "Command parameters:\n"
            "  'filename' is a disk image filename\n"
@@ -105,6 +107,9 @@ static void help(void)
            "  '-c' indicates that target image must be compressed (qcow format only)\n"
            "  '-e' indicates that the target image must be encrypted (qcow format only)\n"
            "  '-6' indicates that the target image must use compatibility level 6 (vmdk format only)\n"
+           "  'count' is the number of random reads done by 'bench' (default 100000)\n"
+           "  'sectors' is the size of each read in sectors (default 8)\n"
+           "  'l2_cache_kb' is the size of the qcow2 L2 cache in kilobytes\n"
            );
     printf("\nSupported format:");
     bdrv_iterate_format(format_print, NULL);
@@ -729,6 +734,101 @@ static int img_info(int argc, char **argv)
     return 0;
 }
 
+static int64_t get_time_us(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/* random reads over the whole image, to measure the metadata caches */
+static int img_bench(int argc, char **argv)
+{
+    int c, i, count, nb_sectors;
+    const char *filename, *fmt;
+    BlockDriver *drv;
+    BlockDriverState *bs;
+    uint64_t total_sectors, sector_num, seed;
+    uint8_t *buf;
+    int64_t start, elapsed;
+
+    fmt = NULL;
+    count = 100000;
+    nb_sectors = 8;
+    seed = 1;
+    for(;;) {
+        c = getopt(argc, argv, "f:n:s:S:C:h");
+        if (c == -1)
+            break;
+        switch(c) {
+        case 'h':
+            help();
+            break;
+        case 'f':
+            fmt = optarg;
+            break;
+        case 'n':
+            count = strtol(optarg, NULL, 0);
+            break;
+        case 's':
+            nb_sectors = strtol(optarg, NULL, 0);
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'C':
+            qcow2_l2_cache_size = strtol(optarg, NULL, 0) * 1024;
+            break;
+        }
+    }
+    if (optind >= argc)
+        help();
+    filename = argv[optind++];
+    if (count <= 0 || nb_sectors <= 0 || qcow2_l2_cache_size <= 0)
+        error("Invalid parameters");
+
+    bs = bdrv_new("");
+    if (!bs)
+        error("Not enough memory");
+    if (fmt) {
+        drv = bdrv_find_format(fmt);
+        if (!drv)
+            error("Unknown file format '%s'", fmt);
+    } else {
+        drv = NULL;
+    }
+    if (bdrv_open2(bs, filename, BDRV_O_RDONLY, drv) < 0) {
+        error("Could not open '%s'", filename);
+    }
+    bdrv_get_geometry(bs, &total_sectors);
+    if (total_sectors < nb_sectors)
+        error("Image too small");
+    buf = qemu_malloc(nb_sectors * 512);
+    if (!buf)
+        error("Not enough memory");
+
+    start = get_time_us();
+    for(i = 0; i < count; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        sector_num = ((seed >> 16) % (total_sectors - nb_sectors + 1)) &
+            ~(uint64_t)(nb_sectors - 1);
+        if (bdrv_read(bs, sector_num, buf, nb_sectors) < 0)
+            error("error while reading sector %" PRId64, (int64_t)sector_num);
+    }
+    elapsed = get_time_us() - start;
+    if (elapsed <= 0)
+        elapsed = 1;
+
+    printf("%d reads of %d bytes in %0.3f s: %0.0f reads/s, %0.2f MB/s\n",
+           count, nb_sectors * 512, elapsed / 1000000.0,
+           count * 1000000.0 / elapsed,
+           (double)count * nb_sectors * 512 / elapsed);
+    qemu_free(buf);
+    bdrv_delete(bs);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     const char *cmd;
@@ -746,6 +846,8 @@ int main(int argc, char **argv)
         img_convert(argc, argv);
     } else if (!strcmp(cmd, "info")) {
         img_info(argc, argv);
+    } else if (!strcmp(cmd, "bench")) {
+        img_bench(argc, argv);
     } else {
         help();
     }
@@ -282,6 +282,7 @@ static inline RES_TYPE glue(glue(ld, USUFFIX), MEMSUFFIX)(target_ulong ptr)
 #else
         //glue(glue(ARGOS_LD, USUFFIX), _raw)((uint8_t *)physaddr, res, tag);
         glue(glue(ARGOS_LD, USUFFIX), _raw)(physaddr, res, tag);
+        ARGOS_COUNT_TAG(env, tainted_loads, tag);
 #endif // ACCESS_TYPE
 #else
         res = glue(glue(ld, USUFFIX), _raw)((uint8_t *)physaddr);
@@ -332,6 +333,7 @@ static inline int glue(glue(lds, SUFFIX), MEMSUFFIX)(target_ulong ptr)
 #else
         //glue(glue(ARGOS_LDs, SUFFIX), _raw)((uint8_t *)physaddr, res, tag);
         glue(glue(ARGOS_LDs, SUFFIX), _raw)(physaddr, res, tag);
+        ARGOS_COUNT_TAG(env, tainted_loads, tag);
 #endif // ACCESS_TYPE
 #else
         res = glue(glue(lds, SUFFIX), _raw)((uint8_t *)physaddr);
@@ -381,6 +383,7 @@ static inline void glue(glue(st, SUFFIX), MEMSUFFIX)(target_ulong ptr, RES_TYPE
 #ifdef ARGOS_SOFTMMU
         //glue(glue(ARGOS_ST, SUFFIX), _raw)((uint8_t *)physaddr, v, tag);
         glue(glue(ARGOS_ST, SUFFIX), _raw)(physaddr, v, tag);
+        ARGOS_COUNT_TAG(env, tainted_stores, tag);
 #else
         glue(glue(st, SUFFIX), _raw)((uint8_t *)physaddr, v);
 	glue(ARGOS_MEMMAP_CLR, SUFFIX)((uint8_t *)physaddr);
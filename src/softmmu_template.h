@@ -163,6 +163,7 @@ DATA_TYPE REGPARM(1) glue(glue(__ld, SUFFIX), MMUSUFFIX)(target_ulong addr,
 #ifdef ARGOS_SOFTMMU
             //glue(glue(ARGOS_LD, USUFFIX), _raw)((uint8_t *)(long)physaddr, res, tag);
             glue(glue(ARGOS_LD, USUFFIX), _raw)(physaddr, res, tag);
+            ARGOS_COUNT_TAG(env, tainted_loads, tag);
 #else
             res = glue(glue(ld, USUFFIX), _raw)((uint8_t *)(long)physaddr);
 #endif
@@ -385,6 +386,7 @@ void REGPARM(2) glue(glue(__st, SUFFIX), MMUSUFFIX)(target_ulong addr,
 #ifdef ARGOS_SOFTMMU
             //glue(glue(ARGOS_ST, SUFFIX), _raw)((uint8_t *)(long)physaddr, val, tag);
             glue(glue(ARGOS_ST, SUFFIX), _raw)(physaddr, val, tag);
+            ARGOS_COUNT_TAG(env, tainted_stores, tag);
 #else
             glue(glue(st, SUFFIX), _raw)((uint8_t *)(long)physaddr, val);
 	    glue(ARGOS_MEMMAP_CLR, SUFFIX)((uint8_t *)(long)physaddr);
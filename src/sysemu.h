@@ -42,6 +42,8 @@ int cpu_load(QEMUFile *f, void *opaque, int version_id);
 
 void do_savevm(const char *name);
 void do_loadvm(const char *name);
+void do_savevm_raw(const char *filename);
+void do_loadvm_raw(const char *filename);
 void do_delvm(const char *name);
 void do_info_snapshots(void);
 
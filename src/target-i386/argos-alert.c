@@ -44,11 +44,21 @@
 #include "../exec-all.h"
 
 #define ALERT_TEMPLATE "[ARGOS] Attack detected, code <%s> PC <%x> TARGET <%x>\n"
+#define ALERT_EVENT "\"code\":\"%s\",\"pc\":%lu,\"target\":%lu"
 
 static const char *adesc[] = { "JMP", "P_JMP", "TSS", "CALL", "RET", 
     "CI", "R_IRET", "SYSEXIT", "SYSRET", "R_JMP", "P_CALL", "R_CALL",
     "P_RET" };
 
+static void alert_event(int code, target_ulong old_pc, target_ulong new_pc)
+{
+    char text[128];
+
+    snprintf(text, sizeof(text), ALERT_TEMPLATE, adesc[code], old_pc, new_pc);
+    argos_event("alert", text, ALERT_EVENT, adesc[code], 
+            (unsigned long)old_pc, (unsigned long)new_pc);
+}
+
 void argos_alert(CPUX86State *env, target_ulong new_pc, argos_rtag_t *tag,
         target_ulong old_pc, int code)
 {
@@ -58,6 +68,8 @@ void argos_alert(CPUX86State *env, target_ulong new_pc, argos_rtag_t *tag,
     if (sigprocmask(SIG_BLOCK, &alrmset, NULL) != 0)
         perror("could not temporarily block signals");
 
+    ARGOS_COUNT(env, alerts);
+
     if (!argos_tag_isdirty(tag))
         code = ARGOS_ALERT_CI;
 
@@ -65,10 +77,10 @@ void argos_alert(CPUX86State *env, target_ulong new_pc, argos_rtag_t *tag,
     //if ( !argos_tracksc_is_tracking(env) )
     if ( !ARGOS_TRACKSC_IS_TRACKING )
     {
-        argos_logf(ALERT_TEMPLATE, adesc[code], old_pc, new_pc);
+        alert_event(code, old_pc, new_pc);
     }
 #else
-        argos_logf(ALERT_TEMPLATE, adesc[code], old_pc, new_pc);
+        alert_event(code, old_pc, new_pc);
 #endif
 
     if (argos_csilog)
@@ -39,6 +39,7 @@ argos_dest_pc_isdirty(CPUX86State *env, target_ulong new_eip)
 {
 	target_phys_addr_t paddr;
 
+	ARGOS_COUNT(env, pc_walks);
 	paddr = cpu_get_phys_page_debug(env, new_eip + env->segs[R_CS].base);
 	if (paddr == -1)
 		return 0;
@@ -51,6 +51,7 @@ enum { ARGOS_ALERT_JMP = 0, ARGOS_ALERT_P_JMP,
 // env contains the new eip
 # define ARGOS_CS_CHECK(tag, old_pc, code)				\
 	do {								\
+		ARGOS_COUNT(env, checks);				\
 		if (argos_tag_isdirty(tag) ||				\
 				argos_dest_pc_isdirty(env, env->eip)) {	\
 			regs_to_env();					\
@@ -62,6 +63,7 @@ enum { ARGOS_ALERT_JMP = 0, ARGOS_ALERT_P_JMP,
 // env contains the new eip
 # define ARGOS_CHECK(tag, old_pc, code)					\
 	do {								\
+		ARGOS_COUNT(env, checks);				\
 		if (argos_tag_isdirty(tag) ||				\
 				argos_dest_pc_isdirty(env, env->eip)) {	\
 			regs_to_env();					\
@@ -73,6 +75,7 @@ enum { ARGOS_ALERT_JMP = 0, ARGOS_ALERT_P_JMP,
 // env contains the new eip
 # define ARGOS_CI_CHECK(tag, old_pc, code)					\
 	do {								\
+		ARGOS_COUNT(env, ci_checks);				\
 		if (argos_dest_pc_isdirty(env, env->eip)) {		\
 			regs_to_env();					\
 			argos_alert(env, env->eip + env->segs[R_CS].base,\
@@ -37,6 +37,8 @@
 #include "argos-csi.h"
 #include "argos-check.h"
 #include "argos-memmap.h"
+#include "argos-csistore.h"
+#include "argos-osprofile.h"
 #include "exec-all.h"
 
 #ifndef CONFIG_USER_ONLY
@@ -44,40 +46,17 @@
 #define LOG_FL_TEMPLATE "argos.csi.%d"
 #define LOG_MSG_TEMPLATE "[ARGOS] Log generated <%s>\n"
 
-#define ARGOS_LOG_VERSION    2
-#define ARGOS_MBLOCK_VERSION 1
+#define ARGOS_LOG_VERSION    3
+#define ARGOS_MBLOCK_VERSION 2
 #define ARGOS_NT_MASK        128 //!< Net tracker version mask
 #define ARGOS_BE_MASK        64	 //!< Non-arch data are in big-endian
+#define ARGOS_LS_MASK        32	 //!< Label set table follows the log
 
 #define ARGOS_ARCH_I386   0
 #define ARGOS_ARCH_X86_64 1 
 
 #define PHYS_ADDR_MASK 0xfffff000
 
-static uint64_t as_start_kernel[][2] = { 
-	{ 0xc0000000U, 0xffff810000000000ULL }, // Linux kernel
-	{ 0x80000000U, 0x0000000080000000ULL },  // Windows 2k kernel
-	{ 0x80000000U, 0x0000000080000000ULL },  // Windows XP kernel
-};
-
-static uint64_t as_stop_kernel[][2] = { 
-	{ 0xffffffffU, 0xffffffffffffffffULL }, // Linux kernel
-	{ 0xffffffffU, 0x00000000ffffffffULL },  // Windows 2k kernel
-	{ 0xffffffffU, 0x00000000ffffffffULL },  // Windows XP kernel
-};
-
-#ifdef TARGET_X86_64
-#define FIRST_KERNEL_ADDR(os) (as_start_kernel[(os)][1])
-#define LAST_KERNEL_ADDR(os) (as_stop_kernel[(os)][1] - TARGET_PAGE_SIZE + 1)
-#define FIRST_USER_ADDR(os) (0x00000000)
-#define LAST_USER_ADDR(os) (as_start_kernel[(os)][1] - TARGET_PAGE_SIZE + 1)
-#else
-#define FIRST_KERNEL_ADDR(os) (as_start_kernel[(os)][0])
-#define LAST_KERNEL_ADDR(os) (as_stop_kernel[(os)][0] - TARGET_PAGE_SIZE + 1)
-#define FIRST_USER_ADDR(os) (0x00000000)
-#define LAST_USER_ADDR(os) (as_start_kernel[(os)][0] - TARGET_PAGE_SIZE + 1)
-#endif
-
 // Forensics shellcode
 
 // RID: 62
@@ -125,12 +104,18 @@ static char win32_shellcode[] =
 
 // Log headers
 
+// The contents of a block are not in the log. hash and offset locate the
+// page that holds it in the CSI store, and the block starts at the offset
+// of paddr in that page. The net tracker indices of a tainted block
+// follow its header as an argos_csistore_blob_t.
 struct argos_mblock_hdr_struct {
 	uint8_t format;
 	uint8_t tainted;
 	uint16_t size;
 	target_ulong paddr;
 	target_ulong vaddr;
+	uint64_t hash;
+	int64_t offset;
 } __attribute__((packed));
 
 typedef struct argos_mblock_hdr_struct argos_mblock_hdr_t;
@@ -172,6 +157,9 @@ static inline int argos_header_write(FILE *fp, CPUX86State *env,
 #ifdef WORDS_BIGENDIAN
 	hdr.format |= ARGOS_BE_MASK;
 #endif
+#ifdef ARGOS_LABEL_SETS
+	hdr.format |= ARGOS_LS_MASK;
+#endif
 #ifdef TARGET_X86_64
 	hdr.arch = ARGOS_ARCH_X86_64;
 #else
@@ -184,6 +172,9 @@ static inline int argos_header_write(FILE *fp, CPUX86State *env,
 		hdr.rorigin[i] = argos_tag_origin(env->regtags + i);
 #ifdef ARGOS_NET_TRACKER
 		hdr.netidx[i] = argos_tag_netidx(env->regtags + i);
+#endif
+#ifdef ARGOS_LABEL_SETS
+		argos_label_mark(hdr.netidx[i], ARGOS_LABEL_MARK_CSI);
 #endif
 	}
 	hdr.eip = new_pc;
@@ -191,6 +182,9 @@ static inline int argos_header_write(FILE *fp, CPUX86State *env,
 	hdr.old_eip = old_pc;
 #ifdef ARGOS_NET_TRACKER
 	hdr.eipnetidx = (eiptag)? argos_tag_netidx(eiptag) : 0;
+#endif
+#ifdef ARGOS_LABEL_SETS
+	argos_label_mark(hdr.eipnetidx, ARGOS_LABEL_MARK_CSI);
 #endif
 	// TODO: Do i need to incorporate hflags?
 	hdr.eflags = env->eflags;
@@ -202,6 +196,26 @@ static inline int argos_header_write(FILE *fp, CPUX86State *env,
 	return 0;
 }
 
+//! The store of the logs written in the current directory
+static argos_csistore_t *csi_store;
+//! Blocks written by the current log, and those that were new to the store
+static unsigned int csi_blocks, csi_new_blocks;
+
+static int argos_store_open(void)
+{
+	// A forked instance writes its logs in its own directory
+	if (csi_store && argos_csistore_moved(csi_store, ARGOS_CSISTORE_FILE)) {
+		argos_csistore_close(csi_store);
+		csi_store = NULL;
+	}
+	if (!csi_store && !(csi_store = argos_csistore_open(
+					ARGOS_CSISTORE_FILE, 1))) {
+		perror("Could not open CSI store - open()");
+		return -1;
+	}
+	return 0;
+}
+
 static inline int argos_log_finalize(FILE *fp)
 {
 	argos_mblock_hdr_t hdr;
@@ -250,14 +264,32 @@ argos_mblock_write(FILE *fp, argos_mblock_hdr_t *hdr)
 {
 	if (fwrite(hdr, sizeof(argos_mblock_hdr_t), 1, fp) != 1)
 		goto error;
-	if (fwrite(phys_ram_base + hdr->paddr, 1, hdr->size, fp) != hdr->size)
-		goto error;
+	csi_blocks++;
 #ifdef ARGOS_NET_TRACKER
 	if (hdr->tainted)
 	{
+		static uint8_t *blobbuf;
+		argos_csistore_blob_t blob;
 		argos_netidx_t *nt = argos_memmap_ntdata(hdr->paddr);
-		if (fwrite(nt, 4, hdr->size, fp) != hdr->size)
+
+		if (!blobbuf && !(blobbuf = qemu_malloc(
+				argos_csistore_bound(4 * TARGET_PAGE_SIZE))))
+			goto error;
+		memset(&blob, 0, sizeof(blob));
+		blob.size = 4 * hdr->size;
+		blob.stored = argos_csistore_encode(nt, blob.size, blobbuf,
+				&blob.codec);
+		if (fwrite(&blob, sizeof(blob), 1, fp) != 1 ||
+				fwrite(blobbuf, 1, blob.stored, fp) != blob.stored)
 			goto error;
+#ifdef ARGOS_LABEL_SETS
+		{
+			int i;
+
+			for (i = 0; i < hdr->size; i++)
+				argos_label_mark(nt[i], ARGOS_LABEL_MARK_CSI);
+		}
+#endif
 	}
 #endif
 	return 0;
@@ -269,16 +301,38 @@ error:
 static int argos_page_write(FILE *fp, CPUX86State *env, target_ulong pc,
 		target_ulong vaddr, target_ulong paddr)
 {
-	int i = 0, force = 0, tainted;
+	int i = 0, force = 0, tainted, added;
+	uint64_t hash = 0;
+	int64_t offset = -1;
 	argos_mblock_hdr_t hdr;
 
 	if ((pc & TARGET_PAGE_MASK) == vaddr)
 		force = 1;
+#if !defined(ARGOS_DISABLE_MEMTRACK) && ARGOS_MEMMAP == ARGOS_PAGEMAP
+	// Pages that were never tainted have no map
+	if (!force && argos_memmap[ARGOS_PAGEMAP_PGOFF(paddr)] == NULL)
+		return 0;
+#endif
 	while (i < TARGET_PAGE_SIZE) {
 		tainted = argos_memmap_istainted(paddr + i);
 		if (tainted || force) {
+			// The page goes to the store once, with its first block
+			if (offset < 0) {
+				hash = argos_csistore_hash(phys_ram_base + paddr,
+						TARGET_PAGE_SIZE);
+				offset = argos_csistore_put(csi_store,
+						phys_ram_base + paddr,
+						TARGET_PAGE_SIZE, hash, &added);
+				if (offset < 0) {
+					perror("Could not write to CSI store");
+					return -1;
+				}
+				csi_new_blocks += added;
+			}
 			i += argos_mblock_header_init(&hdr, vaddr + i, 
 					paddr + i, tainted);
+			hdr.hash = hash;
+			hdr.offset = offset;
 			if (argos_mblock_write(fp, &hdr) != 0)
 				return -1;
 		}
@@ -294,31 +348,36 @@ argos_process_proc(FILE *fp, CPUX86State *env, target_ulong pc,
 {
 	target_ulong page_i, page_max, paddr;
 	PhysPageDesc *pdesc;
+	argos_osrange_t *range;
+	int side, r;
 
 	// Code privilege level 0 (kernel)
-	if ((env->hflags & HF_CPL_MASK) == 0) {
-		page_i = FIRST_KERNEL_ADDR(argos_os_hint);
-		page_max = LAST_KERNEL_ADDR(argos_os_hint);
-	} else { // User
-		page_i = FIRST_USER_ADDR(argos_os_hint);
-		page_max = LAST_USER_ADDR(argos_os_hint);
-	}
-
-	do {
-		paddr = cpu_get_phys_page_debug(env, page_i);
-		if (paddr == -1)
-			goto next;
-		if (!(pdesc = phys_page_find(paddr >> TARGET_PAGE_BITS)))
-			goto next;
-		if (log && argos_page_write(fp, env, pc, page_i, 
-				pdesc->phys_offset & TARGET_PAGE_MASK) != 0)
-			return -1;
-		if (clean)
-			argos_memmap_clear(pdesc->phys_offset & 
-					TARGET_PAGE_MASK, TARGET_PAGE_SIZE);
+	if ((env->hflags & HF_CPL_MASK) == 0)
+		side = ARGOS_OSPROFILE_KERNEL;
+	else // User
+		side = ARGOS_OSPROFILE_USER;
+
+	// Only the pages that the profile says may be mapped
+	for (r = 0; r < argos_osprofile.nranges[side]; r++) {
+		range = argos_osprofile.ranges[side] + r;
+		page_i = range->start & TARGET_PAGE_MASK;
+		page_max = range->last & TARGET_PAGE_MASK;
+		do {
+			paddr = cpu_get_phys_page_debug(env, page_i);
+			if (paddr == -1)
+				goto next;
+			if (!(pdesc = phys_page_find(paddr >> TARGET_PAGE_BITS)))
+				goto next;
+			if (log && argos_page_write(fp, env, pc, page_i, 
+					pdesc->phys_offset & TARGET_PAGE_MASK) != 0)
+				return -1;
+			if (clean)
+				argos_memmap_clear(pdesc->phys_offset & 
+						TARGET_PAGE_MASK, TARGET_PAGE_SIZE);
 next:
-		page_i += (target_ulong)TARGET_PAGE_SIZE;
-	} while (page_i <= page_max && page_i > 0);
+			page_i += (target_ulong)TARGET_PAGE_SIZE;
+		} while (page_i <= page_max && page_i > 0);
+	}
 
 	if (clean) {
 		int i;
@@ -457,16 +516,16 @@ argos_sc_inject(CPUX86State *env, target_ulong vaddr,
 	uint8_t *sc_p;
 	unsigned int scrid_off, sc_len;
 
-	switch (argos_os_hint) {
+	switch (argos_osprofile.os) {
 		// Win32 systems
-		case 1:
-		case 2:
+		case ARGOS_OS_WIN2K:
+		case ARGOS_OS_WINXP:
 			sc_p = win32_shellcode;
 			scrid_off = WIN32SC_RID_OFF;
 			sc_len = WIN32SC_LENGTH;
 			break;
 		// Linux and default case
-		case 0:
+		case ARGOS_OS_LINUX:
 		default:
 			sc_p = linux_shellcode;
 			scrid_off = LINUXSC_RID_OFF;
@@ -492,26 +551,6 @@ argos_sanitize_process(CPUX86State *env)
 	qemu_fprintf(stderr, "forensics currently not supported\n");
 #else
 	argos_process_proc(NULL, env, 0, 0, 1);
-#if 0
-	target_ulong page_i, page_max, paddr;
-
-	// Code privilege level 0 (kernel)
-	if ((env->hflags & HF_CPL_MASK) == 0) {
-		page_i = FIRST_KERNEL_ADDR(argos_os_hint);
-		page_max = LAST_KERNEL_ADDR(argos_os_hint);
-	} else {
-		// User 
-		page_i = FIRST_USER_ADDR(argos_os_hint);
-		page_max = LAST_USER_ADDR(argos_os_hint);
-	}
-
-	do {
-		paddr = cpu_get_phys_page_debug(env, page_i);
-		if (paddr != -1) 
-			argos_memmap_clear(paddr, TARGET_PAGE_SIZE);
-		page_i += (target_ulong)TARGET_PAGE_SIZE;
-	} while (page_i <= page_max && page_i > 0);
-#endif
 #endif
 }
 
@@ -528,14 +567,16 @@ argos_forensics(CPUX86State *env, int rid)
 #else
 	target_ulong page_i, page_max, paddr, last_paddr, last_vaddr;
 	PhysPageDesc *pdesc;
+	argos_osrange_t *ranges = argos_osprofile.ranges[ARGOS_OSPROFILE_USER];
 
 	if ((env->hflags & HF_CPL_MASK) == 0) {
 		argos_logf("[ARGOS] Forensics shellcode will not be injected - "
 				"Attack located in kernel\n");
 		return;
 	}
-	page_i = FIRST_USER_ADDR(argos_os_hint);
-	page_max = LAST_USER_ADDR(argos_os_hint);
+	page_i = ranges[0].start & TARGET_PAGE_MASK;
+	page_max = ranges[argos_osprofile.nranges[ARGOS_OSPROFILE_USER] - 1].last
+		& TARGET_PAGE_MASK;
 
 	last_paddr = last_vaddr = -1;
 	do {
@@ -566,11 +607,14 @@ argos_forensics(CPUX86State *env, int rid)
 
 // Log header format
 // Version | Arch | Attack type | Timestamp | Registers
-// Version =  8 bits, [Net tracker bit][Big endianess bit][Version]
+// Version =  8 bits, [Net tracker bit][Big endianess bit][Label set bit]
+//            [Version]
 // Arch = ARGOS_ARCH_I386 or ARGOS_ARCH_X86_64
 // Attack type = (look in argos_check.h)
 // Timestamp = 32 bit timestamp
 // Registers = Register contents in the architecture's endianess
+// Memory blocks = Headers of the tainted blocks, the pages they are in are
+//                 appended to the CSI store (argos-csistore.h)
 int 
 argos_csi(CPUX86State *env, target_ulong new_pc, argos_rtag_t *eiptag, 
 		target_ulong old_pc, int code)
@@ -581,12 +625,16 @@ argos_csi(CPUX86State *env, target_ulong new_pc, argos_rtag_t *eiptag,
 #else
 	FILE *fp;
 	int rid;
-	char fn[128];
+	char fn[128], msg[192];
 
 	//rid = rand();
 	rid = argos_instance_id;
 	snprintf(fn, 128, LOG_FL_TEMPLATE, rid);
 
+	if (argos_store_open() != 0)
+		return -1;
+	csi_blocks = csi_new_blocks = 0;
+
 	if ((fp = fopen(fn, "wb")) == NULL) {
 		perror("Could not create argos log - fopen()");
 		return -1;
@@ -600,10 +648,17 @@ argos_csi(CPUX86State *env, target_ulong new_pc, argos_rtag_t *eiptag,
 
 	if (argos_log_finalize(fp) != 0)
 		goto cleanup;
+#ifdef ARGOS_LABEL_SETS
+	if (argos_label_write_marked(fp, ARGOS_LABEL_MARK_CSI) != 0)
+		goto cleanup;
+#endif
 	
 	fclose(fp);
 
-	argos_logf(LOG_MSG_TEMPLATE, fn);
+	snprintf(msg, sizeof(msg), LOG_MSG_TEMPLATE, fn);
+	argos_event("csi", msg, "\"file\":\"%s\",\"id\":%d,\"code\":%d,"
+			"\"blocks\":%u,\"new\":%u", fn, rid, code,
+			csi_blocks, csi_new_blocks);
 
 	return rid;
 
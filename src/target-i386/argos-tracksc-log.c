@@ -29,6 +29,21 @@ argos_tracksc_log * argos_tracksc_create_log(const char * path,
 
     log->log_file = log_file;
     log->state = state;
+#ifdef ARGOS_LABEL_SETS
+    {
+        char label_path[256];
+
+        snprintf(label_path, sizeof(label_path), "%s%s", path,
+                ARGOS_TRACKSC_LOG_LABEL_SUFFIX);
+        log->label_file = fopen(label_path, "wb");
+        if (!log->label_file)
+        {
+            fclose(log_file);
+            free(log);
+            return NULL;
+        }
+    }
+#endif
     log->current_entry = &log->buffered_entries[0];
 
     if (!write_header(log))
@@ -44,6 +59,10 @@ void argos_tracksc_close_log(argos_tracksc_log * log)
 {
     argos_tracksc_flush_log(log);
     fclose(log->log_file);
+#ifdef ARGOS_LABEL_SETS
+    argos_label_write_marked(log->label_file, ARGOS_LABEL_MARK_TRACKSC);
+    fclose(log->label_file);
+#endif
     free(log);
 }
 
@@ -142,6 +161,9 @@ log_entry:
             for (i = 0; i < ctx->instr_ctx.decoding.length; i++) 
             {
                 entry->instruction.netidx[i] = ARGOS_GET_NETIDX(ctx->instr_ctx.netidx[i]);
+#ifdef ARGOS_LABEL_SETS
+                argos_label_mark(entry->instruction.netidx[i], ARGOS_LABEL_MARK_TRACKSC);
+#endif
             }
         }
         entry->instruction.stage = ctx->instr_ctx.stage;
@@ -171,6 +193,9 @@ log_entry:
                 for (i = 0; i < ctx->instr_ctx.load.size; i++)
                 {
                     entry->memory_read.netidx[i] = ARGOS_GET_NETIDX(ctx->instr_ctx.load.netidx[i]);
+#ifdef ARGOS_LABEL_SETS
+                    argos_label_mark(entry->memory_read.netidx[i], ARGOS_LABEL_MARK_TRACKSC);
+#endif
                 }
             }
 #endif // ARGOS_NET_TRACKER
@@ -193,6 +218,9 @@ log_entry:
                 for (i = 0; i < ctx->instr_ctx.store.size; i++)
                 {
                     entry->memory_written.netidx[i] = ARGOS_GET_NETIDX(ctx->instr_ctx.store.netidx[i]);
+#ifdef ARGOS_LABEL_SETS
+                    argos_label_mark(entry->memory_written.netidx[i], ARGOS_LABEL_MARK_TRACKSC);
+#endif
                 }
             }
 #endif // ARGOS_NET_TRACKER
@@ -213,13 +241,23 @@ static inline int write_header(argos_tracksc_log * log)
     argos_tracksc_log_hdr hdr;
     hdr.signature = ARGOS_TRACKSC_LOG_SIGNATURE;
     hdr.version = ARGOS_TRACKSC_LOG_VERSION;
+    hdr.flags = 0;
 
+#ifdef TARGET_X86_64
+    ARGOS_TRACKSC_LOG_SET_ARCH_FLAG(hdr.flags, ARGOS_TRACKSC_LOG_ARCH_FLAG_X64);
+#else
     ARGOS_TRACKSC_LOG_SET_ARCH_FLAG(hdr.flags, ARGOS_TRACKSC_LOG_ARCH_FLAG_X86);
+#endif
 #ifdef ARGOS_NET_TRACKER
     ARGOS_TRACKSC_LOG_SET_NET_TRACKER_FLAG(hdr.flags, ARGOS_TRACKSC_LOG_NET_TRACKER_FLAG_ENABLED);
 #else
     ARGOS_TRACKSC_LOG_SET_NET_TRACKER_FLAG(hdr.flags, ARGOS_TRACKSC_LOG_NET_TRACKER_FLAG_DISABLED);
 #endif
+#ifdef ARGOS_LABEL_SETS
+    ARGOS_TRACKSC_LOG_SET_LABEL_SETS_FLAG(hdr.flags, 1);
+#else
+    ARGOS_TRACKSC_LOG_SET_LABEL_SETS_FLAG(hdr.flags, 0);
+#endif
 
     if (fwrite(&hdr, sizeof(hdr), 1, log->log_file) == 1)
     {
@@ -20,6 +20,13 @@
 #define ARGOS_TRACKSC_LOG_NET_TRACKER_FLAG_DISABLED 0
 #define ARGOS_TRACKSC_LOG_NET_TRACKER_FLAG_ENABLED 1
 
+// The label sets referenced by the netidx fields are written to a separate
+// file, with the name of the log followed by ARGOS_TRACKSC_LOG_LABEL_SUFFIX
+#define ARGOS_TRACKSC_LOG_LABEL_SETS_FLAG_MASK 0x20000000
+#define ARGOS_TRACKSC_LOG_SET_LABEL_SETS_FLAG(F, X) (F) = (((F) & \
+        ~(ARGOS_TRACKSC_LOG_LABEL_SETS_FLAG_MASK)) | ((X) << 29))
+#define ARGOS_TRACKSC_LOG_LABEL_SUFFIX ".labels"
+
 
 typedef enum {MEMORY_NONE, MEMORY_READ, MEMORY_WRITE} memory_access_type;
 
@@ -75,6 +82,9 @@ typedef struct
 typedef struct
 {
     FILE * log_file;
+#ifdef ARGOS_LABEL_SETS
+    FILE * label_file;
+#endif
     argos_tracksc_log_entry buffered_entries[10];
     // Current points to an entry in the buffered_entries.
     argos_tracksc_log_entry * current_entry;
@@ -15,6 +15,7 @@
 #include "../exec-all.h"
 #include "libdasm/libdasm.h"
 #include "winxp/internals.h"
+#include "argos-osprofile.h"
 #include "argos-tracksc-whitelist.h"
 #include "argos-tracksc-log.h"
 #include "argos-tracksc-context.h"
@@ -31,6 +32,10 @@ struct timeval stop_tracking;
 // TODO: Move this to the context.
 static argos_tracksc_log * binary_log = NULL;
 
+// A progress event is sent every that many logged instructions.
+#define ARGOS_TRACKSC_PROGRESS 4096
+static unsigned long logged_instructions = 0;
+
 static inline void instr_at_pc(CPUX86State * env);
 static inline void instr_at_addr(CPUX86State * env,
         target_phys_addr_t address);
@@ -122,6 +127,12 @@ void argos_tracksc_stop(CPUX86State * env)
     {
         perror("Failed to retrieve time of day!\nTiming is inaccurate.");
     }
+    argos_event("tracksc", NULL, "\"state\":\"stop\","
+            "\"instructions\":%lu,\"seconds\":%lu", logged_instructions,
+            (unsigned long)(stop_tracking.tv_sec - start_tracking.tv_sec));
+#else
+    argos_event("tracksc", NULL, "\"state\":\"stop\",\"instructions\":%lu",
+            logged_instructions);
 #endif
 }
 
@@ -143,13 +154,14 @@ void argos_tracksc_start(CPUX86State * env)
         perror("Failed to retrieve time of day!\nTiming is inaccurate.");
     }
 #endif
-    argos_logf("Starting shell-code tracking...\n");
-
     const unsigned filename_size = 128;
     char filename[filename_size];
 
     snprintf(filename, filename_size, ARGOS_TRACKSC_LOG_FILENAME_TEMPLATE,
             argos_instance_id);
+    argos_event("tracksc", "Starting shell-code tracking...\n",
+            "\"state\":\"start\",\"log\":\"%s\"", filename);
+    logged_instructions = 0;
     binary_log = argos_tracksc_create_log(filename, env);
     if (!binary_log)
     {
@@ -182,7 +194,7 @@ void argos_tracksc_before_instr_exec(CPUX86State * env)
         if (env->tracksc_ctx.running_code == SHELL_CODE)
         {
             // Filter kernel-code ran in the shell-code context.
-            if ( env->eip < 0x80000000 )
+            if ( env->eip < argos_osprofile.kernel_start )
             {
                 // For some reason some instructions are executed more than
                 // ones, probably restarted because of interrupts.
@@ -193,6 +205,12 @@ void argos_tracksc_before_instr_exec(CPUX86State * env)
 
                     instr_at_pc(env);
                     argos_tracksc_log_before_execution(binary_log);
+                    if ( ++logged_instructions % ARGOS_TRACKSC_PROGRESS == 0 )
+                    {
+                        argos_event("tracksc", NULL, "\"state\":"
+                                "\"progress\",\"instructions\":%lu",
+                                logged_instructions);
+                    }
                 }
                 /*else
                 {
@@ -414,8 +432,9 @@ static inline target_ulong get_current_thread_id(CPUX86State * env)
         address_translation_failure(env, teb_address);
     }
 
-    return *((target_ulong*)(translated_teb_address + TEB_CLIENT_ID +
-                CLIENT_ID_UNIQUE_THREAD));
+    return *((target_ulong*)(translated_teb_address +
+                argos_osprofile.teb_client_id +
+                argos_osprofile.client_id_thread));
 }
 
 static inline unsigned char in_shellcode_context(CPUX86State * env)
@@ -768,7 +787,7 @@ static void get_imported_modules(CPUX86State * env)
     target_ulong teb = env->segs[R_FS].base;
 
     target_ulong address_of_pointer_to_peb = teb +
-            TEB_PROCESS_ENVIRONMENT_BLOCK;
+            argos_osprofile.teb_peb;
     target_ulong * pointer_to_peb = (target_ulong*) translate_address(env,
             address_of_pointer_to_peb);
 
@@ -780,7 +799,8 @@ static void get_imported_modules(CPUX86State * env)
 
     target_ulong peb = *pointer_to_peb;
 
-    target_ulong address_of_pointer_to_loader_data = peb + PEB_LOADER_DATA;
+    target_ulong address_of_pointer_to_loader_data = peb +
+        argos_osprofile.peb_ldr;
     target_ulong * pointer_to_loader_data = (target_ulong*)
         translate_address(env, address_of_pointer_to_loader_data);
 
@@ -793,7 +813,7 @@ static void get_imported_modules(CPUX86State * env)
     target_ulong loader_data = *pointer_to_loader_data;
 
     target_ulong address_of_is_initialized = loader_data +
-        PEB_LDR_DATA_INITIALIZED;
+        argos_osprofile.ldr_initialized;
     uint8_t * initialized = (uint8_t*) translate_address(env,
             address_of_is_initialized);
 
@@ -806,7 +826,7 @@ static void get_imported_modules(CPUX86State * env)
     if ( *initialized )
     {
         target_ulong module_list = loader_data +
-            PEB_LDR_DATA_IN_LOAD_ORDER_MODULE_LIST;
+            argos_osprofile.ldr_load_order;
 
         target_ulong * pointer_to_loader_data_entry = (target_ulong*)
             translate_address(env, module_list + LIST_ENTRY_FLINK);
@@ -826,7 +846,7 @@ static void get_imported_modules(CPUX86State * env)
             char module_basename[ARGOS_MAX_PATH];
 
             target_ulong address_of_module_base = loader_data_entry +
-                LDR_MODULE_BASE_ADDRESS;
+                argos_osprofile.ldr_module_base;
             target_ulong * module_base = (target_ulong*) translate_address(env,
                     address_of_module_base);
 
@@ -837,7 +857,7 @@ static void get_imported_modules(CPUX86State * env)
             }
 
             target_ulong address_of_module_base_dll_name_length =
-                loader_data_entry + LDR_MODULE_BASE_DLL_NAME +
+                loader_data_entry + argos_osprofile.ldr_module_name +
                 UNICODE_STRING_LENGTH;
             uint16_t * module_base_dll_name_length = (uint16_t*)
                 translate_address(env, address_of_module_base_dll_name_length);
@@ -857,7 +877,7 @@ static void get_imported_modules(CPUX86State * env)
                     module_base_dll_name_length_in_characters < ARGOS_MAX_PATH)
             {
                 target_ulong address_of_pointer_to_module_base_dll_name =
-                    (loader_data_entry + LDR_MODULE_BASE_DLL_NAME +
+                    (loader_data_entry + argos_osprofile.ldr_module_name +
                      UNICODE_STRING_BUFFER);
                 target_ulong * address_of_module_base_dll_name =
                     (target_ulong*) translate_address(env,
@@ -1383,16 +1403,6 @@ void argos_tracksc_on_system_call(CPUX86State * env)
     }
 }
 
-void argos_tracksc_on_int2e(CPUX86State * env)
-{
-    // Windows NT uses the interrupt 2eh to perform system calls.
-    extern char * argos_wprofile;
-    if (!strcmp(argos_wprofile, "win2k" ))
-    {
-        argos_tracksc_on_system_call(env);
-    }
-}
-
 static void unexpected_state_failure(CPUX86State * env, unsigned line)
 {
     argos_logf("Argos is in an unexpected state at %s:%i.\n", __FILE__, line);
@@ -1403,30 +1413,6 @@ static void unexpected_state_failure(CPUX86State * env, unsigned line)
 #if 0
 
 // Quick hack of code from argos-csi.c to dump all the pages of the process.
-static uint64_t as_start_kernel[][2] = { 
-	{ 0xc0000000U, 0xffff810000000000ULL }, // Linux kernel
-	{ 0x80000000U, 0x0000000080000000ULL },  // Windows 2k kernel
-	{ 0x80000000U, 0x0000000080000000ULL },  // Windows XP kernel
-};
-
-static uint64_t as_stop_kernel[][2] = { 
-	{ 0xffffffffU, 0xffffffffffffffffULL }, // Linux kernel
-	{ 0xffffffffU, 0x00000000ffffffffULL },  // Windows 2k kernel
-	{ 0xffffffffU, 0x00000000ffffffffULL },  // Windows XP kernel
-};
-
-#ifdef TARGET_X86_64
-#define FIRST_KERNEL_ADDR(os) (as_start_kernel[(os)][1])
-#define LAST_KERNEL_ADDR(os) (as_stop_kernel[(os)][1] - TARGET_PAGE_SIZE + 1)
-#define FIRST_USER_ADDR(os) (0x00000000)
-#define LAST_USER_ADDR(os) (as_start_kernel[(os)][1] - TARGET_PAGE_SIZE + 1)
-#else
-#define FIRST_KERNEL_ADDR(os) (as_start_kernel[(os)][0])
-#define LAST_KERNEL_ADDR(os) (as_stop_kernel[(os)][0] - TARGET_PAGE_SIZE + 1)
-#define FIRST_USER_ADDR(os) (0x00000000)
-#define LAST_USER_ADDR(os) (as_start_kernel[(os)][0] - TARGET_PAGE_SIZE + 1)
-#endif
-
 struct _argos_page_dump_hdr
 {
     // Should equal to 'ARGOS'
@@ -1476,6 +1462,7 @@ dump_process(CPUX86State *env)
     PhysPageDesc *pdesc;
     FILE * fp;
     char fn[128];
+    int side, r;
 
     snprintf(fn, 128, "argos.pages.%i", argos_instance_id);
 
@@ -1497,26 +1484,27 @@ dump_process(CPUX86State *env)
         return -1;
     }
     // Code privilege level 0 (kernel)
-    if ((env->hflags & HF_CPL_MASK) == 0) {
-        page_i = FIRST_KERNEL_ADDR(argos_os_hint);
-        page_max = LAST_KERNEL_ADDR(argos_os_hint);
-    } else { // User
-        page_i = FIRST_USER_ADDR(argos_os_hint);
-        page_max = LAST_USER_ADDR(argos_os_hint);
-    }
-
-    do {
-        paddr = cpu_get_phys_page_debug(env, page_i);
-        if (paddr == -1)
-            goto next;
-        if (!(pdesc = phys_page_find(paddr >> TARGET_PAGE_BITS)))
-            goto next;
-        if (page_write(fp, env, page_i,
-                    pdesc->phys_offset & TARGET_PAGE_MASK) != 0)
-            return -1;
+    if ((env->hflags & HF_CPL_MASK) == 0)
+        side = ARGOS_OSPROFILE_KERNEL;
+    else // User
+        side = ARGOS_OSPROFILE_USER;
+
+    for (r = 0; r < argos_osprofile.nranges[side]; r++) {
+        page_i = argos_osprofile.ranges[side][r].start & TARGET_PAGE_MASK;
+        page_max = argos_osprofile.ranges[side][r].last & TARGET_PAGE_MASK;
+        do {
+            paddr = cpu_get_phys_page_debug(env, page_i);
+            if (paddr == -1)
+                goto next;
+            if (!(pdesc = phys_page_find(paddr >> TARGET_PAGE_BITS)))
+                goto next;
+            if (page_write(fp, env, page_i,
+                        pdesc->phys_offset & TARGET_PAGE_MASK) != 0)
+                return -1;
 next:
-        page_i += (target_ulong)TARGET_PAGE_SIZE;
-    } while (page_i <= page_max && page_i > 0);
+            page_i += (target_ulong)TARGET_PAGE_SIZE;
+        } while (page_i <= page_max && page_i > 0);
+    }
 
     fclose(fp);
     return 0;
@@ -33,21 +33,82 @@
 #include <stdlib.h>
 #include <time.h>
 #include <stddef.h>
+#include <errno.h>
 #include "cpu.h"
 #include "argos.h"
 
 #include "argos-bytemap.h"
 #include "argos-tag.h"
 #include "../argos-common.h"
+#ifndef CONFIG_USER_ONLY
+#include "../hw/hw.h"
+#endif
 
 extern void argos_tracksc_init(CPUX86State * env);
 extern void argos_tracksc_stop(CPUX86State * env);
 
+#ifndef CONFIG_USER_ONLY
+static void argos_put_rtag(QEMUFile *f, argos_rtag_t *tag)
+{
+    qemu_put_be64(f, argos_tag_origin(tag));
+#ifdef ARGOS_NET_TRACKER
+    qemu_put_be32(f, tag->netidx);
+#endif
+}
+
+static void argos_get_rtag(QEMUFile *f, argos_rtag_t *tag)
+{
+#ifdef ARGOS_NET_TRACKER
+    tag->origin = qemu_get_be64(f);
+    tag->netidx = qemu_get_be32(f);
+#else
+    *tag = qemu_get_be64(f);
+#endif
+}
+
+static void argos_cpu_save(QEMUFile *f, void *opaque)
+{
+    CPUX86State *env = opaque;
+    int i;
+
+    qemu_put_be32(f, sizeof(argos_bytemap_t));
+    argos_put_rtag(f, &env->t0tag);
+    argos_put_rtag(f, &env->t1tag);
+    argos_put_rtag(f, &env->t2tag);
+    for (i = 0; i < CPU_NB_REGS; i++)
+        argos_put_rtag(f, env->regtags + i);
+    qemu_put_sparse(f, (uint8_t *)env->envmap,
+                    ENVMAP_SIZE * sizeof(argos_bytemap_t));
+}
+
+static int argos_cpu_load(QEMUFile *f, void *opaque, int version_id)
+{
+    CPUX86State *env = opaque;
+    int i;
+
+    if (version_id != 1)
+        return -EINVAL;
+    if (qemu_get_be32(f) != sizeof(argos_bytemap_t))
+        return -EINVAL;
+    argos_get_rtag(f, &env->t0tag);
+    argos_get_rtag(f, &env->t1tag);
+    argos_get_rtag(f, &env->t2tag);
+    for (i = 0; i < CPU_NB_REGS; i++)
+        argos_get_rtag(f, env->regtags + i);
+    return qemu_get_sparse(f, (uint8_t *)env->envmap,
+                           ENVMAP_SIZE * sizeof(argos_bytemap_t));
+}
+#endif
+
 void argos_init(CPUX86State *env)
 {
     env->envmap = argos_bytemap_create(ENVMAP_SIZE);
     if (!env->envmap)
         exit(1);
+#ifndef CONFIG_USER_ONLY
+    register_savevm("argos cpu", env->cpu_index, 1, argos_cpu_save,
+                    argos_cpu_load, env);
+#endif
 }
 
 void argos_reset(CPUX86State *env)
@@ -466,6 +466,7 @@ typedef union {
 
 #include "argos-tag.h"
 #include "argos-tracksc-context.h"
+#include "argos-counters.h"
 
 #define NB_MMU_MODES 2
 
@@ -489,6 +490,9 @@ typedef struct CPUX86State {
 #ifdef ARGOS_TRACKSC
     argos_tracksc_ctx tracksc_ctx;
 #endif
+#ifdef ARGOS_COUNTERS
+    argos_counters_t counters;
+#endif
 
     /* emulator internal eflags handling */
     target_ulong cc_src;
@@ -26,6 +26,7 @@
 #include "argos-alert.h"
 #include "argos-assert.h"
 #include "argos-tracksc.h"
+#include "argos-osprofile.h"
 
 //#define DEBUG_PCALL
 
@@ -1097,7 +1098,8 @@ void helper_syscall(int next_eip_addend)
 
 #ifdef ARGOS_TRACKSC
     //if (argos_tracksc_is_tracking(env))
-    if ( ARGOS_TRACKSC_IS_TRACKING )
+    if ( ARGOS_TRACKSC_IS_TRACKING &&
+            (argos_osprofile.syscall_insns & ARGOS_SYSCALL_SYSCALL) )
     {
         argos_tracksc_on_system_call(env);
     }
@@ -1354,10 +1356,10 @@ void raise_interrupt(int intno, int is_int, int error_code,
     }
 
 #ifdef ARGOS_TRACKSC
-    //if ( intno == 0x2e && argos_tracksc_is_tracking(env))
-    if ( ARGOS_TRACKSC_IS_TRACKING && intno == 0x2e )
+    // The system call interrupt of the guest, 2eh on Windows 2000
+    if ( ARGOS_TRACKSC_IS_TRACKING && intno == argos_osprofile.syscall_int )
     {
-        argos_tracksc_on_int2e(env);
+        argos_tracksc_on_system_call(env);
     }
 #endif
 
@@ -2820,7 +2822,8 @@ void helper_sysenter(void)
 
 #ifdef ARGOS_TRACKSC
     //if (argos_tracksc_is_tracking(env))
-    if (ARGOS_TRACKSC_IS_TRACKING)
+    if (ARGOS_TRACKSC_IS_TRACKING &&
+            (argos_osprofile.syscall_insns & ARGOS_SYSCALL_SYSENTER))
     {
         argos_tracksc_on_system_call(env);
     }
@@ -574,7 +574,7 @@ void OPPROTO glue(op_movl_T0_Dshift, SUFFIX)(void)
 #if DATA_BITS <= 32
 void OPPROTO glue(glue(op_out, SUFFIX), _T0_T1)(void)
 {
-    glue(cpu_out, SUFFIX)(env, T0, T1 & DATA_MASK);
+    glue(argos_cpu_out, SUFFIX)(env, T0, T1 & DATA_MASK, T1TAG);
 }
 
 void OPPROTO glue(glue(op_in, SUFFIX), _T0_T1)(void)
@@ -591,7 +591,7 @@ void OPPROTO glue(glue(op_in, SUFFIX), _DX_T0)(void)
 
 void OPPROTO glue(glue(op_out, SUFFIX), _DX_T0)(void)
 {
-    glue(cpu_out, SUFFIX)(env, EDX & 0xffff, T0);
+    glue(argos_cpu_out, SUFFIX)(env, EDX & 0xffff, T0, T0TAG);
 }
 
 void OPPROTO glue(glue(op_check_io, SUFFIX), _T0)(void)
@@ -1777,6 +1777,14 @@ static inline int insn_const_size(unsigned int ot)
         return 4;
 }
 
+/* the last parameter holds the address of the TB */
+static inline void gen_tb_reloc(void)
+{
+    if (nb_gen_tb_relocs < MAX_TB_RELOCS)
+        gen_tb_relocs[nb_gen_tb_relocs] = gen_opparam_ptr - 1 - gen_opparam_buf;
+    nb_gen_tb_relocs++;
+}
+
 static inline void gen_goto_tb(DisasContext *s, int tb_num, target_ulong eip)
 {
     TranslationBlock *tb;
@@ -1792,8 +1800,12 @@ static inline void gen_goto_tb(DisasContext *s, int tb_num, target_ulong eip)
             gen_op_goto_tb0(TBPARAM(tb));
         else
             gen_op_goto_tb1(TBPARAM(tb));
+#ifndef USE_DIRECT_JUMP
+        gen_tb_reloc();
+#endif
         gen_jmp_im(eip);
         gen_op_movl_T0_im((long)tb + tb_num);
+        gen_tb_reloc();
         gen_op_exit_tb();
     } else {
         /* jump to another page: currently not optimized */
@@ -6865,6 +6877,7 @@ static inline int gen_intermediate_code_internal(CPUState *env,
     gen_opc_end = gen_opc_buf + OPC_MAX_SIZE;
     gen_opparam_ptr = gen_opparam_buf;
     nb_gen_labels = 0;
+    nb_gen_tb_relocs = 0;
 
     dc->is_jmp = DISAS_NEXT;
     pc_ptr = pc_start;
@@ -6926,6 +6939,8 @@ static inline int gen_intermediate_code_internal(CPUState *env,
         }
     }
     *gen_opc_ptr = INDEX_op_end;
+    nb_gen_opc = gen_opc_ptr - gen_opc_buf + 1;
+    nb_gen_opparams = gen_opparam_ptr - gen_opparam_buf;
     /* we don't forget to fill the last values */
     if (search_pc) {
         j = gen_opc_ptr - gen_opc_buf;
@@ -4,17 +4,9 @@
 #define IMAGE_DOS_SIGNATURE 0x5A4D
 #define IMAGE_PE_SIGNATURE 0x00004550
 
-// Offsets into the struct _TEB
-#define TEB_CLIENT_ID 0x20
-#define TEB_PROCESS_ENVIRONMENT_BLOCK 0x30
-// Offsets into the struct _PEB
-#define PEB_LOADER_DATA 0xc
-// Offsets into the struct _PEB_LDR_DATA
-#define PEB_LDR_DATA_INITIALIZED 0x4
-#define PEB_LDR_DATA_IN_LOAD_ORDER_MODULE_LIST 0xc
-// Offsets into the struct _LDR_MODULE
-#define LDR_MODULE_BASE_ADDRESS 0x18
-#define LDR_MODULE_BASE_DLL_NAME 0x2c
+// The offsets into the _TEB, _PEB and loader structures change between
+// Windows versions, they are in the OS profile (argos-osprofile.h)
+
 // Offsets into the struct UNICODE_STRING
 #define UNICODE_STRING_LENGTH 0x0
 #define UNICODE_STRING_MAXIMUM_LENGTH 0x2
@@ -22,9 +14,6 @@
 // Offsets into the struct LIST_ENTRY
 #define LIST_ENTRY_FLINK 0x0
 #define LIST_ENTRY_BLINK 0x4
-// Offsets into the struct CLIENT_ID
-#define CLIENT_ID_UNIQUE_PROCESS 0x0
-#define CLIENT_ID_UNIQUE_THREAD 0x4
 // Offsets into the struct IMAGE_DOS_HEADER
 #define IMAGE_DOS_HEADER_E_MAGIC 0x0
 #define IMAGE_DOS_HEADER_E_LFANEW 0x3c
@@ -0,0 +1,523 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Persistent translation cache
+ *
+ * Every translated block that fits in one guest page is recorded with
+ * the micro ops generated for it, keyed by its virtual PC, CS base and
+ * flags, and validated by a hash of the guest code bytes. Entries are
+ * loaded when Argos starts and new ones are appended to the file from a
+ * timer, so the translation path never waits for the disk. The file is
+ * also keyed by the Argos whitelists, which the translator looks up. It
+ * is opened for appending and locked while it is read or written, so that
+ * several emulators can share it.
+ */
+#include "qemu-common.h"
+#include "exec-all.h"
+#include "qemu-timer.h"
+#include "tbcache.h"
+#include "argos-whitelist.h"
+
+#ifndef _WIN32
+#include <sys/file.h>
+#else
+#define LOCK_EX 0
+#define LOCK_UN 0
+#endif
+
+//#define DEBUG_TBCACHE
+
+#define TBCACHE_MAGIC   0x31434254 /* "TBC1" */
+#define TBCACHE_VERSION 2
+
+#define TBCACHE_HASH_BITS 16
+#define TBCACHE_HASH_SIZE (1 << TBCACHE_HASH_BITS)
+
+/* stop recording new blocks past this size */
+#define TBCACHE_MAX_BYTES (64 * 1024 * 1024)
+
+/* interval between writes of the new entries, in ms */
+#define TBCACHE_SAVE_INTERVAL 5000
+
+/* number of parameters of each micro op */
+static const uint8_t tbcache_op_nb_params[] = {
+#define DEF(s, n, copy_size) n,
+#include "opc.h"
+#undef DEF
+};
+
+#define TBCACHE_NB_OPS (int)sizeof(tbcache_op_nb_params)
+
+typedef struct TBCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t op_signature;
+    uint32_t cpuid_features;
+    uint32_t cpuid_ext_features;
+    uint64_t whitelist_hash;
+} TBCacheHeader;
+
+/* on disk, a record is followed by the parameters (uint32_t), the
+   opcodes, the labels, the relocated parameter indexes and their
+   addends (all uint16_t) */
+typedef struct TBCacheRecord {
+    uint64_t pc;
+    uint64_t cs_base;
+    uint64_t flags;
+    uint64_t code_hash;
+    uint16_t cflags;
+    uint16_t size;
+    uint16_t nb_ops;
+    uint16_t nb_params;
+    uint16_t nb_labels;
+    uint16_t nb_relocs;
+} TBCacheRecord;
+
+typedef struct TBCacheEntry {
+    struct TBCacheEntry *hash_next;
+    struct TBCacheEntry *save_next;
+    TBCacheRecord rec;
+    uint32_t data[0];
+} TBCacheEntry;
+
+int tbcache_enabled;
+
+static FILE *tbcache_file;
+static QEMUTimer *tbcache_timer;
+static TBCacheEntry *tbcache_hash[TBCACHE_HASH_SIZE];
+static TBCacheEntry *tbcache_save_first;
+static TBCacheEntry **tbcache_save_last = &tbcache_save_first;
+static unsigned long tbcache_bytes;
+
+/* statistics */
+static int tbcache_nb_loaded;
+static int tbcache_nb_added;
+static int tbcache_nb_saved;
+static uint64_t tbcache_nb_hits;
+static uint64_t tbcache_nb_misses;
+static uint64_t tbcache_nb_stale;
+
+static uint64_t tbcache_fnv(uint64_t h, const void *buf, int len)
+{
+    const uint8_t *p = buf;
+
+    while (len-- > 0) {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static inline unsigned int tbcache_hash_func(uint64_t pc, uint64_t cs_base,
+                                             uint64_t flags)
+{
+    uint64_t h;
+
+    h = pc ^ (pc >> TBCACHE_HASH_BITS) ^ (cs_base >> 4) ^ (flags * 31);
+    return h & (TBCACHE_HASH_SIZE - 1);
+}
+
+static inline int tbcache_data_size(const TBCacheRecord *rec)
+{
+    return rec->nb_params * sizeof(uint32_t) +
+        (rec->nb_ops + rec->nb_labels + 2 * rec->nb_relocs) *
+        sizeof(uint16_t);
+}
+
+/* host address of the guest code at 'pc'. The code TLB entry is valid
+   here, as the caller just resolved the physical page of the block */
+static uint8_t *tbcache_code_ptr(CPUState *env, target_ulong pc)
+{
+    int mmu_idx, index, pd;
+
+    index = (pc >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    mmu_idx = cpu_mmu_index(env);
+    if (env->tlb_table[mmu_idx][index].addr_code != (pc & TARGET_PAGE_MASK))
+        return NULL;
+    pd = env->tlb_table[mmu_idx][index].addr_code & ~TARGET_PAGE_MASK;
+    if (pd > IO_MEM_ROM && !(pd & IO_MEM_ROMD))
+        return NULL;
+    return (uint8_t *)(long)(pc + env->tlb_table[mmu_idx][index].addend);
+}
+
+/* the generated code also depends on the debugging state */
+static inline int tbcache_usable(CPUState *env)
+{
+    if (env->nb_breakpoints > 0 || env->singlestep_enabled)
+        return 0;
+#ifdef ARGOS_TRACKSC
+    if (env->tracksc_ctx.single_step)
+        return 0;
+#endif
+    return 1;
+}
+
+static void tbcache_insert(TBCacheEntry *e)
+{
+    unsigned int h;
+
+    h = tbcache_hash_func(e->rec.pc, e->rec.cs_base, e->rec.flags);
+    e->hash_next = tbcache_hash[h];
+    tbcache_hash[h] = e;
+    tbcache_bytes += sizeof(TBCacheEntry) + tbcache_data_size(&e->rec);
+}
+
+static void tbcache_init_header(TBCacheHeader *hdr)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->magic = TBCACHE_MAGIC;
+    hdr->version = TBCACHE_VERSION;
+    hdr->op_signature = dyngen_op_signature();
+    hdr->cpuid_features = first_cpu->cpuid_features;
+    hdr->cpuid_ext_features = first_cpu->cpuid_ext_features;
+    hdr->whitelist_hash = argos_whitelist_hash();
+}
+
+static void tbcache_lock(int op)
+{
+#ifndef _WIN32
+    while (flock(fileno(tbcache_file), op) < 0 && errno == EINTR)
+        ;
+#endif
+}
+
+/* 0 if the file still starts with the header of this run. Another
+   emulator sharing the file may have recreated it */
+static int tbcache_check_header(void)
+{
+    TBCacheHeader hdr, cur;
+
+    tbcache_init_header(&cur);
+    fseek(tbcache_file, 0, SEEK_SET);
+    if (fread(&hdr, 1, sizeof(hdr), tbcache_file) != sizeof(hdr) ||
+        memcmp(&hdr, &cur, sizeof(hdr)) != 0)
+        return -1;
+    return 0;
+}
+
+/* the translator trusts the micro ops it is given, so a record must only
+   refer to the buffers it fills */
+static int tbcache_check_record(const TBCacheRecord *rec,
+                                const uint32_t *data)
+{
+    const uint16_t *opc, *labels, *relocs;
+    int i, nb_params = 0;
+
+    if (rec->nb_ops == 0)
+        return -1;
+    opc = (const uint16_t *)(data + rec->nb_params);
+    for (i = 0; i < rec->nb_ops; i++) {
+        if (opc[i] >= TBCACHE_NB_OPS)
+            return -1;
+        nb_params += tbcache_op_nb_params[opc[i]];
+    }
+    /* the last op must be INDEX_op_end, the first one of opc.h */
+    if (nb_params != rec->nb_params || opc[rec->nb_ops - 1] != 0)
+        return -1;
+    labels = opc + rec->nb_ops;
+    for (i = 0; i < rec->nb_labels; i++) {
+        if (labels[i] >= rec->nb_ops)
+            return -1;
+    }
+    relocs = labels + rec->nb_labels;
+    for (i = 0; i < rec->nb_relocs; i++) {
+        if (relocs[i] >= rec->nb_params)
+            return -1;
+    }
+    return 0;
+}
+
+/* called with the file locked */
+static int tbcache_load(void)
+{
+    TBCacheRecord rec;
+    TBCacheEntry *e;
+    long good;
+    int len;
+
+    if (tbcache_check_header() < 0)
+        return -1;
+
+    good = ftell(tbcache_file);
+    while (fread(&rec, 1, sizeof(rec), tbcache_file) == sizeof(rec)) {
+        if (rec.nb_ops > OPC_BUF_SIZE || rec.nb_params > OPPARAM_BUF_SIZE ||
+            rec.nb_labels > OPC_BUF_SIZE || rec.nb_relocs > MAX_TB_RELOCS)
+            break;
+        len = tbcache_data_size(&rec);
+        e = qemu_malloc(sizeof(TBCacheEntry) + len);
+        if (!e)
+            break;
+        if (fread(e->data, 1, len, tbcache_file) != len ||
+            tbcache_check_record(&rec, e->data) < 0) {
+            qemu_free(e);
+            break;
+        }
+        e->rec = rec;
+        e->save_next = NULL;
+        tbcache_insert(e);
+        tbcache_nb_loaded++;
+        good = ftell(tbcache_file);
+    }
+
+    /* drop a partially written or corrupted record, and all that
+       follows it, so that appending works */
+    if (ftruncate(fileno(tbcache_file), good) < 0)
+        return -1;
+    return 0;
+}
+
+static void tbcache_save(void)
+{
+    TBCacheEntry *e;
+
+    if (!tbcache_save_first)
+        return;
+    tbcache_lock(LOCK_EX);
+    /* the blocks are dropped if the file was recreated for another
+       configuration */
+    if (tbcache_check_header() == 0) {
+        /* the stream is in append mode, the records go to the end */
+        fseek(tbcache_file, 0, SEEK_END);
+        for (e = tbcache_save_first; e != NULL; e = e->save_next) {
+            fwrite(&e->rec, 1, sizeof(e->rec), tbcache_file);
+            fwrite(e->data, 1, tbcache_data_size(&e->rec), tbcache_file);
+            tbcache_nb_saved++;
+        }
+        fflush(tbcache_file);
+    }
+    tbcache_lock(LOCK_UN);
+    tbcache_save_first = NULL;
+    tbcache_save_last = &tbcache_save_first;
+}
+
+static void tbcache_save_timer(void *opaque)
+{
+    tbcache_save();
+    qemu_mod_timer(tbcache_timer,
+                   qemu_get_clock(rt_clock) + TBCACHE_SAVE_INTERVAL);
+}
+
+/* open the cache file and load the blocks saved by a previous run. The
+   file is recreated if it was produced by another build, CPU model or
+   whitelist */
+int tbcache_open(const char *filename)
+{
+    TBCacheHeader hdr;
+
+    tbcache_file = fopen(filename, "a+b");
+    if (!tbcache_file) {
+        fprintf(stderr, "Could not open translation cache %s\n", filename);
+        return -1;
+    }
+    tbcache_lock(LOCK_EX);
+    if (tbcache_load() < 0) {
+        if (ftruncate(fileno(tbcache_file), 0) < 0) {
+            tbcache_lock(LOCK_UN);
+            fclose(tbcache_file);
+            tbcache_file = NULL;
+            fprintf(stderr, "Could not truncate translation cache %s\n",
+                    filename);
+            return -1;
+        }
+        tbcache_init_header(&hdr);
+        fseek(tbcache_file, 0, SEEK_END);
+        fwrite(&hdr, 1, sizeof(hdr), tbcache_file);
+        fflush(tbcache_file);
+    }
+    tbcache_lock(LOCK_UN);
+#ifdef DEBUG_TBCACHE
+    fprintf(stderr, "tbcache: loaded %d blocks from %s\n",
+            tbcache_nb_loaded, filename);
+#endif
+
+    tbcache_timer = qemu_new_timer(rt_clock, tbcache_save_timer, NULL);
+    qemu_mod_timer(tbcache_timer,
+                   qemu_get_clock(rt_clock) + TBCACHE_SAVE_INTERVAL);
+    tbcache_enabled = 1;
+    return 0;
+}
+
+void tbcache_close(void)
+{
+    if (!tbcache_enabled)
+        return;
+    if (tbcache_file) {
+        tbcache_save();
+        fclose(tbcache_file);
+        tbcache_file = NULL;
+    }
+    tbcache_enabled = 0;
+}
+
+/* the file belongs to the process we were forked from: the child keeps
+   the blocks it inherited for lookups, but neither saves the pending
+   ones nor records new ones */
+void tbcache_after_fork(void)
+{
+    if (!tbcache_enabled)
+        return;
+    qemu_del_timer(tbcache_timer);
+    qemu_free_timer(tbcache_timer);
+    tbcache_timer = NULL;
+    tbcache_save_first = NULL;
+    tbcache_save_last = &tbcache_save_first;
+    /* nothing is buffered, the master flushed its streams before it
+       forked */
+    fclose(tbcache_file);
+    tbcache_file = NULL;
+}
+
+/* fill the micro op buffers for 'tb' from the cache. Return 0 on
+   success, or -1 if gen_intermediate_code() must be called */
+int tbcache_lookup(CPUState *env, TranslationBlock *tb)
+{
+    TBCacheEntry *e;
+    uint8_t *code;
+    uint32_t *params;
+    uint16_t *p;
+    uint64_t code_hash;
+    int i, hashed_size;
+
+    if (!tbcache_usable(env))
+        return -1;
+    code = tbcache_code_ptr(env, tb->pc);
+    if (!code)
+        return -1;
+
+    hashed_size = -1;
+    code_hash = 0;
+    e = tbcache_hash[tbcache_hash_func(tb->pc, tb->cs_base, tb->flags)];
+    for (; e != NULL; e = e->hash_next) {
+        if (e->rec.pc != tb->pc || e->rec.cs_base != tb->cs_base ||
+            e->rec.flags != tb->flags || e->rec.cflags != tb->cflags)
+            continue;
+        if (((tb->pc + e->rec.size - 1) & TARGET_PAGE_MASK) !=
+            (tb->pc & TARGET_PAGE_MASK))
+            continue;
+        if (e->rec.size != hashed_size) {
+            hashed_size = e->rec.size;
+            code_hash = tbcache_fnv(0xcbf29ce484222325ULL, code,
+                                    hashed_size);
+        }
+        if (e->rec.code_hash == code_hash)
+            break;
+        tbcache_nb_stale++;
+    }
+    if (!e) {
+        tbcache_nb_misses++;
+        return -1;
+    }
+
+    params = e->data;
+    memcpy(gen_opparam_buf, params, e->rec.nb_params * sizeof(uint32_t));
+    p = (uint16_t *)(params + e->rec.nb_params);
+    memcpy(gen_opc_buf, p, e->rec.nb_ops * sizeof(uint16_t));
+    p += e->rec.nb_ops;
+    for (i = 0; i < e->rec.nb_labels; i++)
+        gen_labels[i] = p[i];
+    nb_gen_labels = e->rec.nb_labels;
+    p += e->rec.nb_labels;
+    for (i = 0; i < e->rec.nb_relocs; i++)
+        gen_opparam_buf[p[i]] = (uint32_t)(long)tb + p[e->rec.nb_relocs + i];
+    tb->size = e->rec.size;
+    tbcache_nb_hits++;
+    return 0;
+}
+
+/* record the micro ops that gen_intermediate_code() just produced */
+void tbcache_add(CPUState *env, TranslationBlock *tb)
+{
+    TBCacheRecord rec;
+    TBCacheEntry *e;
+    uint8_t *code;
+    uint16_t *p;
+    int i;
+
+    if (!tbcache_file || tbcache_bytes >= TBCACHE_MAX_BYTES ||
+        !tbcache_usable(env))
+        return;
+    if (nb_gen_tb_relocs > MAX_TB_RELOCS || tb->size == 0 ||
+        ((tb->pc + tb->size - 1) & TARGET_PAGE_MASK) !=
+        (tb->pc & TARGET_PAGE_MASK))
+        return;
+    code = tbcache_code_ptr(env, tb->pc);
+    if (!code)
+        return;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.pc = tb->pc;
+    rec.cs_base = tb->cs_base;
+    rec.flags = tb->flags;
+    rec.code_hash = tbcache_fnv(0xcbf29ce484222325ULL, code, tb->size);
+    rec.cflags = tb->cflags;
+    rec.size = tb->size;
+    rec.nb_ops = nb_gen_opc;
+    rec.nb_params = nb_gen_opparams;
+    rec.nb_labels = nb_gen_labels;
+    rec.nb_relocs = nb_gen_tb_relocs;
+
+    e = qemu_malloc(sizeof(TBCacheEntry) + tbcache_data_size(&rec));
+    if (!e)
+        return;
+    e->rec = rec;
+    memcpy(e->data, gen_opparam_buf, rec.nb_params * sizeof(uint32_t));
+    p = (uint16_t *)(e->data + rec.nb_params);
+    memcpy(p, gen_opc_buf, rec.nb_ops * sizeof(uint16_t));
+    p += rec.nb_ops;
+    for (i = 0; i < rec.nb_labels; i++)
+        p[i] = gen_labels[i];
+    p += rec.nb_labels;
+    for (i = 0; i < rec.nb_relocs; i++) {
+        p[i] = gen_tb_relocs[i];
+        p[rec.nb_relocs + i] = gen_opparam_buf[gen_tb_relocs[i]] -
+            (uint32_t)(long)tb;
+    }
+
+    tbcache_insert(e);
+    e->save_next = NULL;
+    *tbcache_save_last = e;
+    tbcache_save_last = &e->save_next;
+    tbcache_nb_added++;
+}
+
+void tbcache_dump_info(FILE *f,
+                       int (*cpu_fprintf)(FILE *f, const char *fmt, ...))
+{
+    if (!tbcache_enabled)
+        return;
+    cpu_fprintf(f, "TB cache blocks     %d loaded, %d added, %d saved "
+                "(%lu KB)\n", tbcache_nb_loaded, tbcache_nb_added,
+                tbcache_nb_saved, tbcache_bytes >> 10);
+    cpu_fprintf(f, "TB cache lookups    %" PRIu64 " hits, %" PRIu64
+                " misses, %" PRIu64 " stale\n", tbcache_nb_hits,
+                tbcache_nb_misses, tbcache_nb_stale);
+}
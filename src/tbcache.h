@@ -0,0 +1,58 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Persistent translation cache
+ *
+ * The micro op sequences produced by gen_intermediate_code() are saved
+ * to a file and reused after a restart, so that the guest kernel and
+ * services of a fixed image do not have to be decoded again.
+ */
+#ifndef TBCACHE_H
+#define TBCACHE_H
+
+#if defined(TARGET_I386) && !defined(CONFIG_USER_ONLY)
+#define USE_TBCACHE
+#endif
+
+#ifdef USE_TBCACHE
+extern int tbcache_enabled;
+
+int tbcache_open(const char *filename);
+void tbcache_close(void);
+void tbcache_after_fork(void);
+int tbcache_lookup(CPUState *env, struct TranslationBlock *tb);
+void tbcache_add(CPUState *env, struct TranslationBlock *tb);
+void tbcache_dump_info(FILE *f,
+                       int (*cpu_fprintf)(FILE *f, const char *fmt, ...));
+#endif
+
+#endif
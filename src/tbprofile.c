@@ -0,0 +1,347 @@
+/* Copyright (c) 2006-2008, Georgios Portokalidis
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of the Vrije Universiteit nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+   FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+   COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+   INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+   OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Sampling profiler of the translated blocks
+ *
+ * The samples are aggregated by the signal handler in an open addressing
+ * table keyed by the PC, CS base and flags of the block, which is
+ * allocated when the profiler starts, so the handler never allocates
+ * memory. A block that is retranslated keeps its entry. Samples that
+ * find the table full are only counted as lost.
+ *
+ * The other threads block all signals, so the handler always runs in the
+ * CPU thread and races only with the monitor, which blocks SIGPROF while
+ * it reads the table.
+ */
+#include "qemu-common.h"
+#include "exec-all.h"
+#include "tbprofile.h"
+
+#ifdef USE_TBPROFILE
+
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+#define TBPROFILE_HASH_BITS 16
+#define TBPROFILE_HASH_SIZE (1 << TBPROFILE_HASH_BITS)
+#define TBPROFILE_MAX_PROBES 32
+
+/* blocks shown by "info tbprofile" */
+#define TBPROFILE_REPORT_SIZE 30
+
+/* the host PC tells the generated code from the helpers */
+#if defined(__linux__) && defined(__i386__)
+#define TBPROFILE_HOST_PC(uc) ((unsigned long)(uc)->uc_mcontext.gregs[REG_EIP])
+#elif defined(__linux__) && defined(__x86_64__)
+#define TBPROFILE_HOST_PC(uc) ((unsigned long)(uc)->uc_mcontext.gregs[REG_RIP])
+#endif
+
+typedef struct TBProfileEntry {
+    target_ulong pc;
+    target_ulong cs_base;
+    uint64_t flags;
+    uint16_t size;
+    uint16_t used;
+    uint32_t code;      /* samples in the generated code */
+    uint32_t helper;    /* samples in the helpers */
+} TBProfileEntry;
+
+static TBProfileEntry *tbprofile_table;
+static int tbprofile_hz;
+static int tbprofile_nb_blocks;
+
+/* statistics */
+static uint64_t tbprofile_nb_samples;
+static uint64_t tbprofile_nb_cpu;       /* in cpu_exec(), outside a block */
+static uint64_t tbprofile_nb_main;      /* in the main loop and devices */
+static uint64_t tbprofile_nb_lost;
+
+static unsigned int tbprofile_hash(target_ulong pc, uint64_t flags)
+{
+    uint32_t h;
+
+    h = (uint32_t)pc ^ (uint32_t)(flags * 0x9e3779b1);
+    h ^= h >> 16;
+    return (h * 0x45d9f3b) & (TBPROFILE_HASH_SIZE - 1);
+}
+
+static TBProfileEntry *tbprofile_lookup(TranslationBlock *tb)
+{
+    TBProfileEntry *e;
+    unsigned int h;
+    int i;
+
+    h = tbprofile_hash(tb->pc, tb->flags);
+    for(i = 0; i < TBPROFILE_MAX_PROBES; i++) {
+        e = &tbprofile_table[(h + i) & (TBPROFILE_HASH_SIZE - 1)];
+        if (!e->used) {
+            e->used = 1;
+            e->pc = tb->pc;
+            e->cs_base = tb->cs_base;
+            e->flags = tb->flags;
+            tbprofile_nb_blocks++;
+            return e;
+        }
+        if (e->pc == tb->pc && e->cs_base == tb->cs_base &&
+            e->flags == tb->flags)
+            return e;
+    }
+    return NULL;
+}
+
+static void tbprofile_signal(int sig, siginfo_t *info, void *puc)
+{
+    CPUState *env = cpu_single_env;
+    TranslationBlock *tb;
+    TBProfileEntry *e;
+    int in_code = 1;
+#ifdef TBPROFILE_HOST_PC
+    unsigned long pc;
+
+    pc = TBPROFILE_HOST_PC((ucontext_t *)puc);
+    in_code = (pc - (unsigned long)code_gen_buffer) < code_gen_buffer_size;
+#endif
+
+    tbprofile_nb_samples++;
+    if (!env) {
+        tbprofile_nb_main++;
+        return;
+    }
+    tb = env->current_tb;
+    if (!tb) {
+        tbprofile_nb_cpu++;
+        return;
+    }
+    e = tbprofile_lookup(tb);
+    if (!e) {
+        tbprofile_nb_lost++;
+        return;
+    }
+    e->size = tb->size;
+    if (in_code)
+        e->code++;
+    else
+        e->helper++;
+}
+
+static void tbprofile_block(sigset_t *old)
+{
+    sigset_t set;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGPROF);
+    sigprocmask(SIG_BLOCK, &set, old);
+}
+
+int tbprofile_start(int hz)
+{
+    struct sigaction act;
+    struct itimerval itv;
+
+    if (hz <= 0)
+        hz = TBPROFILE_DEFAULT_HZ;
+    if (!tbprofile_table) {
+        tbprofile_table = qemu_mallocz(TBPROFILE_HASH_SIZE *
+                                       sizeof(TBProfileEntry));
+        if (!tbprofile_table)
+            return -1;
+    }
+
+    sigfillset(&act.sa_mask);
+    act.sa_flags = SA_SIGINFO | SA_RESTART;
+    act.sa_sigaction = tbprofile_signal;
+    sigaction(SIGPROF, &act, NULL);
+
+    itv.it_interval.tv_sec = 0;
+    itv.it_interval.tv_usec = 1000000 / hz;
+    if (itv.it_interval.tv_usec == 0)
+        itv.it_interval.tv_usec = 1;
+    itv.it_value = itv.it_interval;
+    if (setitimer(ITIMER_PROF, &itv, NULL) < 0) {
+        perror("tbprofile: setitimer");
+        return -1;
+    }
+    tbprofile_hz = hz;
+    return 0;
+}
+
+void tbprofile_stop(void)
+{
+    struct itimerval itv;
+
+    if (!tbprofile_hz)
+        return;
+    memset(&itv, 0, sizeof(itv));
+    setitimer(ITIMER_PROF, &itv, NULL);
+    signal(SIGPROF, SIG_IGN);
+    tbprofile_hz = 0;
+}
+
+void tbprofile_reset(void)
+{
+    sigset_t old;
+
+    tbprofile_block(&old);
+    if (tbprofile_table)
+        memset(tbprofile_table, 0, TBPROFILE_HASH_SIZE *
+               sizeof(TBProfileEntry));
+    tbprofile_nb_blocks = 0;
+    tbprofile_nb_samples = 0;
+    tbprofile_nb_cpu = 0;
+    tbprofile_nb_main = 0;
+    tbprofile_nb_lost = 0;
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+static int tbprofile_cmp(const void *a, const void *b)
+{
+    const TBProfileEntry *e1 = *(const TBProfileEntry **)a;
+    const TBProfileEntry *e2 = *(const TBProfileEntry **)b;
+    uint32_t n1 = e1->code + e1->helper;
+    uint32_t n2 = e2->code + e2->helper;
+
+    if (n1 != n2)
+        return (n1 < n2) ? 1 : -1;
+    return (e1->pc < e2->pc) ? -1 : (e1->pc > e2->pc);
+}
+
+/* the used entries, the most sampled first */
+static TBProfileEntry **tbprofile_sorted(int *count)
+{
+    TBProfileEntry **v;
+    int i, n;
+
+    v = qemu_malloc((tbprofile_nb_blocks + 1) * sizeof(TBProfileEntry *));
+    if (!v)
+        return NULL;
+    n = 0;
+    for(i = 0; i < TBPROFILE_HASH_SIZE && n < tbprofile_nb_blocks; i++) {
+        if (tbprofile_table[i].used)
+            v[n++] = &tbprofile_table[i];
+    }
+    qsort(v, n, sizeof(TBProfileEntry *), tbprofile_cmp);
+    *count = n;
+    return v;
+}
+
+static const char *tbprofile_mode(const TBProfileEntry *e)
+{
+#ifdef TARGET_I386
+    return ((e->flags & HF_CPL_MASK) == 3) ? "user" : "kernel";
+#else
+    return "guest";
+#endif
+}
+
+/* one line per stack, in the format of flamegraph.pl */
+int tbprofile_save(const char *filename)
+{
+    TBProfileEntry **v;
+    sigset_t old;
+    FILE *f;
+    int i, n;
+
+    f = fopen(filename, "w");
+    if (!f)
+        return -1;
+    tbprofile_block(&old);
+    if (tbprofile_table && (v = tbprofile_sorted(&n)) != NULL) {
+        for(i = 0; i < n; i++) {
+            if (v[i]->code)
+                fprintf(f, "argos;%s;tb_" TARGET_FMT_lx ";code %u\n",
+                        tbprofile_mode(v[i]), v[i]->pc, v[i]->code);
+            if (v[i]->helper)
+                fprintf(f, "argos;%s;tb_" TARGET_FMT_lx ";helper %u\n",
+                        tbprofile_mode(v[i]), v[i]->pc, v[i]->helper);
+        }
+        qemu_free(v);
+    }
+    if (tbprofile_nb_cpu)
+        fprintf(f, "argos;cpu_exec %" PRIu64 "\n", tbprofile_nb_cpu);
+    if (tbprofile_nb_main)
+        fprintf(f, "argos;main_loop %" PRIu64 "\n", tbprofile_nb_main);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return fclose(f);
+}
+
+void tbprofile_dump_info(FILE *f,
+                         int (*cpu_fprintf)(FILE *f, const char *fmt, ...))
+{
+    TBProfileEntry **v;
+    uint64_t total, code = 0, helper = 0;
+    sigset_t old;
+    int i, n;
+
+    if (!tbprofile_table) {
+        cpu_fprintf(f, "TB profiler not started\n");
+        return;
+    }
+    tbprofile_block(&old);
+    v = tbprofile_sorted(&n);
+    for(i = 0; v && i < n; i++) {
+        code += v[i]->code;
+        helper += v[i]->helper;
+    }
+    total = tbprofile_nb_samples ? tbprofile_nb_samples : 1;
+    if (tbprofile_hz)
+        cpu_fprintf(f, "running at %d Hz\n", tbprofile_hz);
+    else
+        cpu_fprintf(f, "stopped\n");
+    cpu_fprintf(f, "samples         %" PRIu64 "\n", tbprofile_nb_samples);
+    cpu_fprintf(f, "  blocks        %" PRIu64 " (%0.1f%%)\n",
+                code + helper, (code + helper) * 100.0 / total);
+    cpu_fprintf(f, "    code        %" PRIu64 "\n", code);
+    cpu_fprintf(f, "    helpers     %" PRIu64 "\n", helper);
+    cpu_fprintf(f, "  cpu_exec      %" PRIu64 " (%0.1f%%)\n",
+                tbprofile_nb_cpu, tbprofile_nb_cpu * 100.0 / total);
+    cpu_fprintf(f, "  main loop     %" PRIu64 " (%0.1f%%)\n",
+                tbprofile_nb_main, tbprofile_nb_main * 100.0 / total);
+    cpu_fprintf(f, "  lost          %" PRIu64 "\n", tbprofile_nb_lost);
+    cpu_fprintf(f, "distinct blocks %d\n", tbprofile_nb_blocks);
+    if (v && n > 0) {
+        cpu_fprintf(f, "\n%-*s %5s %8s %8s %6s %8s %8s\n",
+                    (int)(2 * sizeof(target_ulong)), "pc", "size", "flags",
+                    "samples", "%", "code", "helper");
+        for(i = 0; i < n && i < TBPROFILE_REPORT_SIZE; i++) {
+            cpu_fprintf(f, TARGET_FMT_lx " %5d %08x %8u %5.1f%% %8u %8u\n",
+                        v[i]->pc, v[i]->size, (uint32_t)v[i]->flags,
+                        v[i]->code + v[i]->helper,
+                        (v[i]->code + v[i]->helper) * 100.0 / total,
+                        v[i]->code, v[i]->helper);
+        }
+    }
+    qemu_free(v);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+#endif /* USE_TBPROFILE */
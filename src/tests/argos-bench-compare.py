@@ -0,0 +1,110 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+# Copyright (c) 2006-2008, Georgios Portokalidis
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above
+#    copyright notice, this list of conditions and the following
+#    disclaimer in the documentation and/or other materials provided
+#    with the distribution.
+#  * Neither the name of the Vrije Universiteit nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+# FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+# COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+# STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+# OF THE POSSIBILITY OF SUCH DAMAGE.
+
+"""Compares the results of argos-bench.py against a baseline, and exits with
+status 1 when a workload got worse by more than the threshold."""
+
+import sys
+import json
+from optparse import OptionParser
+
+# Metrics, and whether higher values are better
+METRICS = [
+    ('seconds', False),
+    ('insns_per_sec', True),
+    ('tb_translated', False),
+    ('rss_kb', False),
+]
+
+
+def load(fn):
+    f = open(fn)
+    data = json.load(f)
+    f.close()
+    results = {}
+    for r in data['results']:
+        results[(r['config'], r['workload'])] = r
+    return results
+
+
+def main():
+    parser = OptionParser(usage='usage: %prog [options] baseline.json '
+                          'results.json')
+    parser.add_option('-t', '--threshold', dest='threshold', type='float',
+                      default=5.0,
+                      help='percentage that counts as a regression '
+                      '[%default]')
+    parser.add_option('-m', '--metric', dest='metrics', action='append',
+                      default=[], help='only compare this metric '
+                      '(repeatable)')
+    (opts, args) = parser.parse_args()
+    if len(args) != 2:
+        parser.error('a baseline and a results file are needed')
+
+    base = load(args[0])
+    cur = load(args[1])
+    metrics = [m for m in METRICS if not opts.metrics or m[0] in opts.metrics]
+
+    regressions = 0
+    print('%-12s %-10s %-14s %14s %14s %8s' %
+          ('config', 'workload', 'metric', 'baseline', 'current', 'change'))
+    for key in sorted(cur.keys()):
+        if key not in base:
+            print('%-12s %-10s %-14s %14s' % (key[0], key[1], '-', 'new'))
+            continue
+        for metric, higher_better in metrics:
+            b = base[key].get(metric)
+            c = cur[key].get(metric)
+            if not b or c is None:
+                continue
+            change = (float(c) - b) * 100.0 / b
+            worse = change < -opts.threshold if higher_better \
+                else change > opts.threshold
+            flag = ''
+            if worse:
+                flag = '  REGRESSION'
+                regressions += 1
+            print('%-12s %-10s %-14s %14s %14s %+7.1f%%%s' %
+                  (key[0], key[1], metric, b, c, change, flag))
+    for key in sorted(base.keys()):
+        if key not in cur:
+            print('%-12s %-10s %-14s %14s' % (key[0], key[1], '-', 'missing'))
+
+    if regressions:
+        print('%d regressions over %.1f%%' % (regressions, opts.threshold))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,260 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+# Copyright (c) 2006-2008, Georgios Portokalidis
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above
+#    copyright notice, this list of conditions and the following
+#    disclaimer in the documentation and/or other materials provided
+#    with the distribution.
+#  * Neither the name of the Vrije Universiteit nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+# FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+# COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+# STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+# OF THE POSSIBILITY OF SUCH DAMAGE.
+
+"""Runs the benchmark workloads under every memory tracking configuration of
+the user mode emulator, and writes the results to a JSON file.
+
+Every configuration is built in its own tree under bench-build. The
+workloads are the static i386 programs built by "make bench-progs". For
+every workload and configuration the file records the best wall clock time
+of the runs, the guest instructions per second (when perf can count the
+instructions of a native run), the translated blocks and the maximum RSS of
+the emulator, which reports them through ARGOS_STATS.
+
+In the user mode emulator the memory map is always a page map and the
+network tracker is compiled out, so the configurations that differ are the
+inner map of the pages, bytes (pagemap) or bits (lowmem), and shell-code
+tracking. Other configurations can be given with --config name=flags."""
+
+import sys
+import os
+import re
+import time
+import json
+import platform
+import subprocess
+from optparse import OptionParser
+
+CONFIGS = [
+    ('pagemap', []),
+    ('lowmem', ['--enable-lowmem']),
+    ('tracksc', ['--enable-tracksc']),
+]
+
+WORKLOADS = [
+    ('test-i386', ['./bench-test-i386']),
+    ('sha1', ['./bench-sha1']),
+    ('memcpy', ['./bench-memcpy']),
+    ('branch', ['./bench-branch']),
+    ('taint', ['./argos-taint-test', '-b', '200000']),
+]
+
+TARGET = 'i386-linux-user'
+EMULATOR = 'argos-i386'
+
+# Lines of the ARGOS_STATS file
+STATS = [
+    ('tbs', re.compile(r'^TB count\s+(\d+)')),
+    ('tb_translated', re.compile(r'^TB translated\s+(\d+)')),
+    ('tb_flushes', re.compile(r'^TB flush count\s+(\d+)')),
+    ('rss_kb', re.compile(r'^Max RSS\s+(\d+)')),
+]
+
+
+def run(cmd, cwd=None, quiet=True):
+    out = None
+    if quiet:
+        out = open(os.devnull, 'w')
+    ret = subprocess.call(cmd, cwd=cwd, stdout=out, stderr=out)
+    if out:
+        out.close()
+    return ret
+
+
+def build(src, builddir, name, flags, extra, jobs):
+    tree = os.path.join(builddir, name)
+    stamp = os.path.join(tree, 'bench-flags')
+    wanted = ' '.join(flags + extra)
+    if not os.path.isdir(tree):
+        os.makedirs(tree)
+    configured = None
+    if os.path.exists(stamp):
+        configured = open(stamp).read()
+    if configured != wanted:
+        sys.stderr.write('configuring %s: %s\n' % (name, wanted))
+        cmd = [os.path.join(src, 'configure'), '--enable-linux-user']
+        if run(cmd + flags + extra, cwd=tree) != 0:
+            return None
+        open(stamp, 'w').write(wanted)
+    sys.stderr.write('building %s\n' % name)
+    if run(['make', '-j%d' % jobs, 'subdir-' + TARGET], cwd=tree) != 0:
+        return None
+    return os.path.join(tree, TARGET, EMULATOR)
+
+
+def native_instructions(cmd):
+    """Instructions of a native run, or None without perf"""
+    try:
+        p = subprocess.Popen(['perf', 'stat', '-x,', '-e', 'instructions:u',
+                              '--'] + cmd, stdout=open(os.devnull, 'w'),
+                             stderr=subprocess.PIPE)
+    except OSError:
+        return None
+    err = p.communicate()[1].decode('ascii', 'replace')
+    if p.returncode != 0:
+        return None
+    for line in err.splitlines():
+        fields = line.split(',')
+        if len(fields) > 2 and fields[2].startswith('instructions'):
+            try:
+                return int(fields[0])
+            except ValueError:
+                return None
+    return None
+
+
+def read_stats(fn):
+    stats = {}
+    if not os.path.exists(fn):
+        return stats
+    for line in open(fn):
+        for key, regexp in STATS:
+            m = regexp.match(line)
+            if m:
+                stats[key] = int(m.group(1))
+    os.unlink(fn)
+    return stats
+
+
+def bench(emulator, cmd, runs, statsfn):
+    best = None
+    env = dict(os.environ)
+    env['ARGOS_STATS'] = statsfn
+    for i in range(runs):
+        devnull = open(os.devnull, 'w')
+        start = time.time()
+        ret = subprocess.call([emulator] + cmd, env=env, stdout=devnull,
+                              stderr=devnull)
+        elapsed = time.time() - start
+        devnull.close()
+        stats = read_stats(statsfn)
+        if ret != 0:
+            return None
+        if best is None or elapsed < best['seconds']:
+            best = stats
+            best['seconds'] = round(elapsed, 4)
+    return best
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(sys.argv[0]))
+    parser = OptionParser(usage='usage: %prog [options]')
+    parser.add_option('-o', '--out', dest='out', default='bench.json',
+                      help='write the results to FILE [%default]')
+    parser.add_option('-s', '--src', dest='src',
+                      default=os.path.dirname(here),
+                      help='Argos source tree [%default]')
+    parser.add_option('-b', '--builddir', dest='builddir',
+                      default=os.path.join(here, 'bench-build'),
+                      help='where the configurations are built [%default]')
+    parser.add_option('-c', '--config', dest='configs', action='append',
+                      default=[], metavar='NAME[=FLAGS]',
+                      help='only this configuration, or a new one with '
+                      'these configure flags (repeatable)')
+    parser.add_option('-w', '--workload', dest='workloads', action='append',
+                      default=[], help='only this workload (repeatable)')
+    parser.add_option('-r', '--runs', dest='runs', type='int', default=3,
+                      help='runs of every workload, the best is kept '
+                      '[%default]')
+    parser.add_option('-j', '--jobs', dest='jobs', type='int', default=4,
+                      help='parallel make jobs [%default]')
+    parser.add_option('--configure-flags', dest='extra', default='',
+                      help='flags passed to every configure')
+    (opts, args) = parser.parse_args()
+
+    known = dict(CONFIGS)
+    configs = []
+    for c in opts.configs:
+        if '=' in c:
+            name, flags = c.split('=', 1)
+            configs.append((name, flags.split()))
+        elif c in known:
+            configs.append((c, known[c]))
+        else:
+            parser.error('unknown configuration %s' % c)
+    if not configs:
+        configs = CONFIGS
+    workloads = [w for w in WORKLOADS
+                 if not opts.workloads or w[0] in opts.workloads]
+
+    insns = {}
+    for name, cmd in workloads:
+        insns[name] = native_instructions(cmd)
+
+    results = []
+    failed = 0
+    statsfn = os.path.join(here, 'bench-stats.%d' % os.getpid())
+    for config, flags in configs:
+        emulator = build(opts.src, opts.builddir, config, flags,
+                         opts.extra.split(), opts.jobs)
+        if emulator is None:
+            sys.stderr.write('%s: build failed\n' % config)
+            failed += 1
+            continue
+        for name, cmd in workloads:
+            r = bench(emulator, cmd, opts.runs, statsfn)
+            if r is None:
+                sys.stderr.write('%s/%s: run failed\n' % (config, name))
+                failed += 1
+                continue
+            r['config'] = config
+            r['workload'] = name
+            r['insns'] = insns[name]
+            r['insns_per_sec'] = None
+            if insns[name] and r['seconds'] > 0:
+                r['insns_per_sec'] = int(insns[name] / r['seconds'])
+            results.append(r)
+            sys.stderr.write('%-12s %-10s %8.3fs %8s TBs %8s KB\n' %
+                             (config, name, r['seconds'],
+                              r.get('tb_translated', '-'),
+                              r.get('rss_kb', '-')))
+
+    out = {
+        'version': 1,
+        'date': time.strftime('%Y-%m-%d %H:%M:%S'),
+        'host': platform.node(),
+        'machine': platform.machine(),
+        'runs': opts.runs,
+        'results': results,
+    }
+    f = open(opts.out, 'w')
+    json.dump(out, f, indent=1, sort_keys=True)
+    f.write('\n')
+    f.close()
+    if failed:
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,420 @@
+/*
+ * Taint propagation tests for the Argos user mode emulator
+ *
+ * Every test runs one class of i386 instructions on a tainted and on a
+ * clean input buffer and checks how many bytes of its output are tainted.
+ * Results left in registers are stored to memory first, so the stores are
+ * tested as well. The input is tainted by reading it from a socket, which
+ * the default taint policy of the emulator trusts least, and the taint is
+ * read back through the debug hook:
+ *
+ *   argos-i386 -taint-debug ./argos-taint-test [-v]
+ *
+ * With -b N, every test is instead run N times on the tainted input and
+ * the rate of the instructions of its class is printed. The hook is not
+ * needed then, so the same binary also runs natively.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+/* must match linux-user/argos-syscall.h */
+#define ARGOS_NR_debug    0x4152
+#define ARGOS_DEBUG_TAINT 1
+#define ARGOS_DEBUG_CLEAR 2
+#define ARGOS_DEBUG_COUNT 3
+#define ARGOS_DEBUG_REGS  4
+
+/* QEMU register numbers */
+#define R_ESI 6
+#define R_EDI 7
+
+#define BUF_SIZE 64
+
+static unsigned char tainted[BUF_SIZE] __attribute__((aligned(16)));
+static unsigned char clean[BUF_SIZE] __attribute__((aligned(16)));
+static unsigned char out[BUF_SIZE] __attribute__((aligned(16)));
+
+static int verbose;
+static int nb_checks, nb_failed;
+
+static int argos_debug(int op, void *addr, int len)
+{
+    int ret;
+
+    asm volatile ("int $0x80"
+                  : "=a" (ret)
+                  : "0" (ARGOS_NR_debug), "b" (op), "c" (addr), "d" (len)
+                  : "memory");
+    return ret;
+}
+
+static void check(const char *name, const char *input, void *buf, int len,
+                  int expected)
+{
+    int n;
+
+    n = argos_debug(ARGOS_DEBUG_COUNT, buf, len);
+    nb_checks++;
+    if (n != expected) {
+        nb_failed++;
+        printf("FAIL %-12s %-7s %d of %d bytes tainted, expected %d\n",
+               name, input, n, len, expected);
+    } else if (verbose) {
+        printf("ok   %-12s %-7s %d of %d bytes tainted\n",
+               name, input, n, len);
+    }
+}
+
+/* ALU with immediate operands */
+static void t_alu_imm(const unsigned char *s, unsigned char *d)
+{
+    asm volatile ("movl (%0), %%eax\n"
+                  "addl $1, %%eax\n"
+                  "subl $3, %%eax\n"
+                  "andl $0xffff, %%eax\n"
+                  "orl $0x100, %%eax\n"
+                  "xorl $0x55, %%eax\n"
+                  "adcl $0, %%eax\n"
+                  "notl %%eax\n"
+                  "negl %%eax\n"
+                  "movl %%eax, (%1)\n"
+                  : : "r" (s), "r" (d) : "eax", "cc", "memory");
+}
+
+/* ALU with a memory source or destination */
+static void t_alu_mem(const unsigned char *s, unsigned char *d)
+{
+    asm volatile ("movl $5, %%eax\n"
+                  "addl (%0), %%eax\n"
+                  "subl 4(%0), %%eax\n"
+                  "movl %%eax, (%1)\n"
+                  "movl $0, 4(%1)\n"
+                  "movl 8(%0), %%ecx\n"
+                  "addl %%ecx, 4(%1)\n"
+                  : : "r" (s), "r" (d) : "eax", "ecx", "cc", "memory");
+}
+
+/* ALU between registers */
+static void t_alu_reg(const unsigned char *s, unsigned char *d)
+{
+    asm volatile ("movl (%0), %%ecx\n"
+                  "movl $1, %%eax\n"
+                  "addl %%ecx, %%eax\n"
+                  "imull %%ecx, %%eax\n"
+                  "orl %%ecx, %%eax\n"
+                  "movl %%eax, (%1)\n"
+                  : : "r" (s), "r" (d) : "eax", "ecx", "cc", "memory");
+}
+
+static void t_muldiv(const unsigned char *s, unsigned char *d)
+{
+    asm volatile ("movl (%0), %%eax\n"
+                  "movl $3, %%ecx\n"
+                  "mull %%ecx\n"
+                  "movl %%eax, (%1)\n"
+                  "movl %%edx, 4(%1)\n"
+                  "movl $0, %%edx\n"
+                  "movl (%0), %%eax\n"
+                  "movl $7, %%ecx\n"
+                  "divl %%ecx\n"
+                  "movl %%eax, 8(%1)\n"
+                  "movl %%edx, 12(%1)\n"
+                  : : "r" (s), "r" (d) : "eax", "ecx", "edx", "cc", "memory");
+}
+
+static void t_shift(const unsigned char *s, unsigned char *d)
+{
+    asm volatile ("movl (%0), %%eax\n"
+                  "shll $3, %%eax\n"
+                  "shrl $1, %%eax\n"
+                  "sarl $2, %%eax\n"
+                  "roll $5, %%eax\n"
+                  "rorl $1, %%eax\n"
+                  "movl %%eax, (%1)\n"
+                  "movl $2, %%ecx\n"
+                  "movl 4(%0), %%eax\n"
+                  "shll %%cl, %%eax\n"
+                  "movl %%eax, 4(%1)\n"
+                  : : "r" (s), "r" (d) : "eax", "ecx", "cc", "memory");
+}
+
+/* byte and word loads and stores; the last byte is an immediate */
+static void t_partial(const unsigned char *s, unsigned char *d)
+{
+    asm volatile ("movzbl (%0), %%eax\n"
+                  "movb %%al, (%1)\n"
+                  "movzwl 2(%0), %%eax\n"
+                  "movw %%ax, 2(%1)\n"
+                  "movb 1(%0), %%ah\n"
+                  "movb %%ah, 1(%1)\n"
+                  "movb $1, 4(%1)\n"
+                  : : "r" (s), "r" (d) : "eax", "memory");
+}
+
+/* tainted values overwritten with constants */
+static void t_overwrite(const unsigned char *s, unsigned char *d)
+{
+    asm volatile ("movl (%0), %%eax\n"
+                  "movl $7, %%eax\n"
+                  "movl %%eax, (%1)\n"
+                  "movl (%0), %%eax\n"
+                  "movl %%eax, 4(%1)\n"
+                  "movl $9, 4(%1)\n"
+                  : : "r" (s), "r" (d) : "eax", "memory");
+}
+
+static void t_lea(const unsigned char *s, unsigned char *d)
+{
+    asm volatile ("movl (%0), %%ecx\n"
+                  "leal 4(%%ecx,%%ecx,2), %%eax\n"
+                  "movl %%eax, (%1)\n"
+                  : : "r" (s), "r" (d) : "eax", "ecx", "memory");
+}
+
+/* extensions and exchanges */
+static void t_xchg(const unsigned char *s, unsigned char *d)
+{
+    asm volatile ("movzbl (%0), %%eax\n"
+                  "movsbl 1(%0), %%ecx\n"
+                  "xchgl %%eax, %%ecx\n"
+                  "bswap %%eax\n"
+                  "movl %%eax, (%1)\n"
+                  "movl %%ecx, 4(%1)\n"
+                  : : "r" (s), "r" (d) : "eax", "ecx", "memory");
+}
+
+static void t_cmov(const unsigned char *s, unsigned char *d)
+{
+    asm volatile ("movl $0, %%eax\n"
+                  "cmpl $0, %%eax\n"
+                  "cmovel (%0), %%eax\n"
+                  "movl %%eax, (%1)\n"
+                  : : "r" (s), "r" (d) : "eax", "cc", "memory");
+}
+
+/* the last word is pushed as an immediate */
+static void t_stack(const unsigned char *s, unsigned char *d)
+{
+    asm volatile ("pushl (%0)\n"
+                  "popl %%eax\n"
+                  "movl %%eax, (%1)\n"
+                  "pushl %%eax\n"
+                  "popl 4(%1)\n"
+                  "pushl $1\n"
+                  "popl 8(%1)\n"
+                  : : "r" (s), "r" (d) : "eax", "memory");
+}
+
+/* the last two words are filled from a constant */
+static void t_string(const unsigned char *s, unsigned char *d)
+{
+    const unsigned char *si = s;
+    unsigned char *di = d;
+    int n = 16;
+
+    asm volatile ("cld\n"
+                  "rep movsb\n"
+                  "lodsl\n"
+                  "stosl\n"
+                  "movl $0, %%eax\n"
+                  "movl $2, %%ecx\n"
+                  "rep stosl\n"
+                  : "+S" (si), "+D" (di), "+c" (n) : : "eax", "memory");
+}
+
+static void t_mmx(const unsigned char *s, unsigned char *d)
+{
+    asm volatile ("movq (%0), %%mm0\n"
+                  "movq 8(%0), %%mm1\n"
+                  "paddb %%mm1, %%mm0\n"
+                  "psllq $8, %%mm0\n"
+                  "pand %%mm1, %%mm0\n"
+                  "punpcklbw %%mm1, %%mm0\n"
+                  "movq %%mm0, (%1)\n"
+                  "movd %%mm1, %%eax\n"
+                  "movl %%eax, 8(%1)\n"
+                  "emms\n"
+                  : : "r" (s), "r" (d) : "eax", "mm0", "mm1", "memory");
+}
+
+static void t_sse(const unsigned char *s, unsigned char *d)
+{
+    asm volatile ("movdqu (%0), %%xmm0\n"
+                  "movdqu 16(%0), %%xmm1\n"
+                  "paddd %%xmm1, %%xmm0\n"
+                  "pshufd $0x1b, %%xmm0, %%xmm0\n"
+                  "pand %%xmm1, %%xmm0\n"
+                  "movdqu %%xmm0, (%1)\n"
+                  "movd %%xmm1, %%eax\n"
+                  "movl %%eax, 16(%1)\n"
+                  : : "r" (s), "r" (d) : "eax", "xmm0", "xmm1", "memory");
+}
+
+typedef struct TaintTest {
+    const char *name;
+    void (*fn)(const unsigned char *s, unsigned char *d);
+    int len;        /* bytes of the output that are checked */
+    int tainted;    /* of which tainted when the input is */
+    int nb_ops;     /* instructions of the class in fn */
+} TaintTest;
+
+static const TaintTest tests[] = {
+    { "alu_imm", t_alu_imm, 4, 4, 8 },
+    { "alu_mem", t_alu_mem, 8, 8, 3 },
+    { "alu_reg", t_alu_reg, 4, 4, 3 },
+    { "muldiv", t_muldiv, 16, 16, 2 },
+    { "shift", t_shift, 8, 8, 6 },
+    { "partial", t_partial, 5, 4, 7 },
+    { "overwrite", t_overwrite, 8, 0, 2 },
+    { "lea", t_lea, 4, 4, 1 },
+    { "xchg", t_xchg, 8, 8, 4 },
+    { "cmov", t_cmov, 4, 4, 1 },
+    { "stack", t_stack, 12, 8, 6 },
+    { "string", t_string, 28, 20, 20 },
+    { "mmx", t_mmx, 12, 12, 8 },
+    { "sse", t_sse, 20, 20, 7 },
+};
+
+#define NB_TESTS (sizeof(tests) / sizeof(tests[0]))
+
+/* mask of the tagged registers after ESI is loaded from s and EDI is
+   set to a constant */
+static int tainted_regs(const unsigned char *s)
+{
+    int ret;
+
+    asm volatile ("movl (%%ecx), %%esi\n"
+                  "movl $0, %%edi\n"
+                  "int $0x80\n"
+                  : "=a" (ret)
+                  : "0" (ARGOS_NR_debug), "b" (ARGOS_DEBUG_REGS), "c" (s)
+                  : "edx", "esi", "edi", "memory");
+    return ret;
+}
+
+static void check_regs(void)
+{
+    int mask;
+
+    nb_checks += 2;
+    mask = tainted_regs(tainted);
+    if (!(mask & (1 << R_ESI)) || (mask & (1 << R_EDI))) {
+        nb_failed++;
+        printf("FAIL %-12s %-7s register mask %#x\n", "regs", "tainted",
+               mask);
+    }
+    mask = tainted_regs(clean);
+    if (mask & (1 << R_ESI)) {
+        nb_failed++;
+        printf("FAIL %-12s %-7s register mask %#x\n", "regs", "clean", mask);
+    }
+}
+
+/* the data read from a socket are tainted by the default policy */
+static int seed(unsigned char *buf, int len)
+{
+    unsigned char data[BUF_SIZE];
+    int sv[2], i;
+
+    for(i = 0; i < len; i++)
+        data[i] = i + 1;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        return -1;
+    }
+    if (write(sv[0], data, len) != len || read(sv[1], buf, len) != len) {
+        perror("seed");
+        return -1;
+    }
+    close(sv[0]);
+    close(sv[1]);
+    return 0;
+}
+
+static int run_tests(void)
+{
+    const TaintTest *t;
+    int i;
+
+    if (argos_debug(ARGOS_DEBUG_COUNT, tainted, 1) < 0) {
+        fprintf(stderr, "the debug hook is not available, run under "
+                "argos-i386 -taint-debug\n");
+        return 2;
+    }
+    check("seed", "tainted", tainted, BUF_SIZE, BUF_SIZE);
+    check("seed", "clean", clean, BUF_SIZE, 0);
+
+    for(i = 0; i < NB_TESTS; i++) {
+        t = &tests[i];
+        argos_debug(ARGOS_DEBUG_CLEAR, out, BUF_SIZE);
+        t->fn(tainted, out);
+        check(t->name, "tainted", out, t->len, t->tainted);
+        argos_debug(ARGOS_DEBUG_CLEAR, out, BUF_SIZE);
+        t->fn(clean, out);
+        check(t->name, "clean", out, t->len, 0);
+    }
+    check_regs();
+
+    printf("%d of %d checks failed\n", nb_failed, nb_checks);
+    return nb_failed ? 1 : 0;
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void run_bench(int iterations)
+{
+    const TaintTest *t;
+    double start, secs;
+    int i, j;
+
+    for(i = 0; i < NB_TESTS; i++) {
+        t = &tests[i];
+        start = now();
+        for(j = 0; j < iterations; j++)
+            t->fn(tainted, out);
+        secs = now() - start;
+        if (secs <= 0)
+            secs = 1e-6;
+        printf("%-12s %12.0f ops/s\n", t->name,
+               (double)iterations * t->nb_ops / secs);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, iterations = 0;
+
+    while ((c = getopt(argc, argv, "vb:")) != -1) {
+        switch(c) {
+        case 'v':
+            verbose = 1;
+            break;
+        case 'b':
+            iterations = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-v] [-b iterations]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    for(i = 0; i < BUF_SIZE; i++)
+        clean[i] = i + 1;
+    if (seed(tainted, BUF_SIZE) < 0)
+        return 2;
+    if (iterations > 0) {
+        run_bench(iterations);
+        return 0;
+    }
+    return run_tests();
+}
@@ -0,0 +1,88 @@
+/*
+ * Branch kernel for the Argos benchmarks
+ *
+ * A small bytecode interpreter with a switch dispatch, indirect calls and
+ * data dependent conditional branches. It executes many short translated
+ * blocks and stresses block chaining and lookup.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ROUNDS 2000000
+
+enum { OP_ADD, OP_SUB, OP_XOR, OP_SHL, OP_JNZ, OP_CALL, OP_DEC, OP_END };
+
+static unsigned int regs[4];
+
+static unsigned int f0(unsigned int x) { return x * 3 + 1; }
+static unsigned int f1(unsigned int x) { return x >> 1; }
+static unsigned int f2(unsigned int x) { return x ^ 0x5a5a5a5a; }
+static unsigned int f3(unsigned int x) { return x + (x << 5); }
+
+static unsigned int (*const funcs[4])(unsigned int) = { f0, f1, f2, f3 };
+
+static const unsigned char prog[] = {
+    OP_ADD, 0, 1,
+    OP_XOR, 1, 0,
+    OP_SHL, 2, 3,
+    OP_CALL, 3, 0,
+    OP_SUB, 0, 2,
+    OP_DEC, 3, 0,
+    OP_JNZ, 3, 0,
+    OP_END, 0, 0,
+};
+
+static unsigned int run(unsigned int seed)
+{
+    const unsigned char *pc = prog;
+
+    regs[0] = seed;
+    regs[1] = seed * 2654435761U;
+    regs[2] = 1;
+    regs[3] = 8 + (seed & 7);
+    for(;;) {
+        switch(pc[0]) {
+        case OP_ADD:
+            regs[pc[1]] += regs[pc[2]];
+            break;
+        case OP_SUB:
+            regs[pc[1]] -= regs[pc[2]];
+            break;
+        case OP_XOR:
+            regs[pc[1]] ^= regs[pc[2]];
+            break;
+        case OP_SHL:
+            regs[pc[1]] = (regs[pc[1]] << 1) | (regs[pc[2]] & 1);
+            break;
+        case OP_CALL:
+            regs[0] = funcs[regs[pc[1]] & 3](regs[0]);
+            break;
+        case OP_DEC:
+            regs[pc[1]]--;
+            break;
+        case OP_JNZ:
+            if (regs[pc[1]] != 0) {
+                pc = prog;
+                continue;
+            }
+            break;
+        case OP_END:
+            return regs[0];
+        }
+        pc += 3;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int i, sum = 0;
+
+    for(i = 0; i < ROUNDS; i++) {
+        if (sum & 1)
+            sum += run(i);
+        else
+            sum ^= run(i + sum);
+    }
+    printf("branch: %08x\n", sum);
+    return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * Memory copy kernel for the Argos benchmarks
+ *
+ * Copies and fills buffers of several sizes, with aligned and unaligned
+ * addresses. Every byte moved also moves its taint, so this stresses the
+ * load/store paths of the memory map.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUF_SIZE (1 << 20)
+#define ROUNDS 64
+
+static unsigned char src[BUF_SIZE + 64], dst[BUF_SIZE + 64];
+
+static const int sizes[] = { 1, 3, 8, 17, 64, 255, 4096, 65536, BUF_SIZE };
+
+int main(int argc, char **argv)
+{
+    int i, j, k, off;
+    unsigned int sum = 0;
+    size_t len;
+
+    for(i = 0; i < BUF_SIZE + 64; i++)
+        src[i] = i * 7;
+
+    for(i = 0; i < ROUNDS; i++) {
+        for(j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+            len = sizes[j];
+            off = (i + j) & 7;
+            /* small copies are repeated so that every size moves about
+               the same amount of data */
+            for(k = 0; k < BUF_SIZE / len; k += (len < 64) ? 4 : 1) {
+                memcpy(dst + off, src + (k * len) % (BUF_SIZE - len + 1), len);
+                sum += dst[off + len - 1];
+            }
+            memset(dst, i, len);
+            memmove(dst + 1, dst, len - 1);
+            sum += dst[len / 2];
+        }
+    }
+    printf("memcpy: %08x\n", sum);
+    return 0;
+}
@@ -29,6 +29,7 @@
 #include "cpu.h"
 #include "exec-all.h"
 #include "disas.h"
+#include "tbcache.h"
 
 extern int dyngen_code(uint8_t *gen_code_buf,
                        uint16_t *label_offsets, uint16_t *jmp_offsets,
@@ -45,6 +46,10 @@ uint16_t gen_opc_buf[OPC_BUF_SIZE];
 uint32_t gen_opparam_buf[OPPARAM_BUF_SIZE];
 long gen_labels[OPC_BUF_SIZE];
 int nb_gen_labels;
+int nb_gen_opc;
+int nb_gen_opparams;
+uint16_t gen_tb_relocs[MAX_TB_RELOCS];
+int nb_gen_tb_relocs;
 
 target_ulong gen_opc_pc[OPC_BUF_SIZE];
 uint8_t gen_opc_instr_start[OPC_BUF_SIZE];
@@ -146,6 +151,26 @@ unsigned long code_gen_max_block_size(void)
     return max;
 }
 
+/* identify the micro op set of this binary, so that micro ops saved by
+   another build are never reused */
+uint64_t dyngen_op_signature(void)
+{
+    static const char op_table[] =
+#define DEF(s, n, copy_size) #s " " #n " " #copy_size "\n"
+#include "opc.h"
+#undef DEF
+        ;
+    uint64_t h;
+    int i;
+
+    h = 0xcbf29ce484222325ULL;
+    for (i = 0; i < sizeof(op_table) - 1; i++) {
+        h ^= (uint8_t)op_table[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
 /* return non zero if the very first instruction is invalid so that
    the virtual CPU can trigger an exception.
 
@@ -157,8 +182,17 @@ int cpu_gen_code(CPUState *env, TranslationBlock *tb, int *gen_code_size_ptr)
     uint8_t *gen_code_buf;
     int gen_code_size;
 
+#ifdef USE_TBCACHE
+    if (tbcache_enabled && tbcache_lookup(env, tb) == 0)
+        goto gen_code;
+#endif
     if (gen_intermediate_code(env, tb) < 0)
         return -1;
+#ifdef USE_TBCACHE
+    if (tbcache_enabled)
+        tbcache_add(env, tb);
+ gen_code:
+#endif
     
     /* generate machine code */
     tb->tb_next_offset[0] = 0xffff;
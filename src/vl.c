@@ -82,6 +82,9 @@
 
 #include <linux/ppdev.h>
 #include <linux/parport.h>
+#ifdef CONFIG_EPOLL
+#include <sys/epoll.h>
+#endif
 #else
 #include <sys/stat.h>
 #include <sys/ethernet.h>
@@ -145,6 +148,14 @@ int inet_aton(const char *cp, struct in_addr *ia);
 #include "disas.h"
 
 #include "exec-all.h"
+#include "tbcache.h"
+#include "tbprofile.h"
+#include "argos-netfilter.h"
+#include "argos-osprofile.h"
+#include "argos-disktaint.h"
+#include "iothread.h"
+#include "forkserver.h"
+#include "memmerge.h"
 
 #define DEFAULT_NETWORK_SCRIPT "/etc/argos-ifup"
 #define DEFAULT_NETWORK_DOWN_SCRIPT "/etc/argos-ifdown"
@@ -268,7 +279,6 @@ static int event_pending = 1;
 
 #define TFR(expr) do { if ((expr) != -1) break; } while (errno == EINTR)
 
-int argos_os_hint = 0;
 int argos_csilog = 1;
 int argos_fsc = 1;
 // Upon instantiation this will be given a random number.
@@ -287,20 +297,58 @@ FILE *argos_nt_fl = NULL;
 /* Control socket stuff */
 /************************/
 
+// Output to the control socket never blocks. Messages and events are
+// appended whole to a bounded queue, which is written to the socket as it
+// drains, from the write handler of the main loop. When the queue is full
+// the message is dropped and counted, and the client is told how many were
+// lost before the next message that fits.
+
+//! Size of the outbound queue
+#define CTRLSOCK_QUEUE_SIZE (256 * 1024)
+//! Largest message
+#define CTRLSOCK_MSG_MAX 2048
+//! Time given to the client to take the queued messages at exit (ms)
+#define CTRLSOCK_DRAIN_TIMEOUT 2000
+
 struct ctrlsock_state {
 	int listen_sd, sd, connected;
 	FILE *fp;
+	//! Outbound ring
+	char queue[CTRLSOCK_QUEUE_SIZE];
+	int queue_head, queue_len, queue_peak;
+	//! Non zero while the write handler is installed
+	int writing;
+	//! Messages queued and dropped
+	uint64_t sent, dropped;
+	//! Drops not reported to the client yet
+	uint64_t pending_drops;
+	//! Periodic stats event
+	QEMUTimer *stats_timer;
+	time_t start;
 };
 
-enum { CTRLSOCK_reset, CTRLSOCK_shutdown, CTRLSOCK_pause, CTRLSOCK_resume, CTRLSOCK_pid };
+enum { CTRLSOCK_reset, CTRLSOCK_shutdown, CTRLSOCK_pause, CTRLSOCK_resume, 
+	CTRLSOCK_pid, CTRLSOCK_stats, CTRLSOCK_fork };
 
 
 static const char *ctrlsock_laddr = NULL;
 static int ctrlsock_lport = 1374;
 static struct ctrlsock_state *ctrlsock = NULL;
+//! Send JSON lines instead of text
+static int ctrlsock_json = 0;
+//! Seconds between stats events, 0 disables them
+static int ctrlsock_stats_interval = 0;
+//! Sequence number of the events, gaps show drops
+static uint64_t ctrlsock_seq = 0;
+//! Children asked for by FORK, 0 for the -forkserver size
+static int ctrlsock_fork_size = 0;
 
 
 static void control_socket_accept(void *opaque);
+static void control_socket_stats(void);
+#ifdef ARGOS_COUNTERS
+static void control_socket_counters(void);
+#endif
 /*static void control_socket_respond(const char * command, const char * response);*/
 
 
@@ -308,6 +356,12 @@ static int
 control_socket_process(const char *line)
 {
 	int cmd = -1;
+	const char *p;
+
+	// JSON requests carry the command in the "cmd" member
+	if (*line == '{' && (p = strstr(line, "\"cmd\"")) != NULL &&
+			(p = strchr(p + 5, '"')) != NULL)
+		line = p + 1;
 
 	if (strncasecmp(line, "RESET", 5) == 0)
     {
@@ -324,6 +378,15 @@ control_socket_process(const char *line)
 	else if (strncasecmp(line, "RESUME", 6) == 0)
     {
 		cmd = CTRLSOCK_resume;
+    }
+	else if (strncasecmp(line, "STATS", 5) == 0)
+    {
+		cmd = CTRLSOCK_stats;
+    }
+	else if (strncasecmp(line, "FORK", 4) == 0)
+    {
+		cmd = CTRLSOCK_fork;
+		ctrlsock_fork_size = atoi(line + 4);
     }
     /*else if (strncasecmp(line, "PID", 3) == 0)
     {
@@ -355,6 +418,19 @@ control_cmd_run(int cmd)
 	case CTRLSOCK_resume:
 		vm_start();
 		break;
+	case CTRLSOCK_stats:
+		control_socket_stats();
+#ifdef ARGOS_COUNTERS
+		control_socket_counters();
+#endif
+		break;
+#ifdef USE_FORKSERVER
+	case CTRLSOCK_fork:
+		// The guest is ready, it is not resumed in this process
+		if (forkserver_start(ctrlsock_fork_size) < 0)
+			argos_logf("Could not start the fork server\n");
+		break;
+#endif
     /*case CTRLSOCK_pid:
         // log10(2^32-1) + 1 = 11.
         response_buffer = calloc(11, sizeof(char));
@@ -375,6 +451,17 @@ control_cmd_run(int cmd)
 
 }
 
+static void
+control_socket_close(struct ctrlsock_state *s)
+{
+	qemu_set_fd_handler2(s->sd, NULL, NULL, NULL, NULL);
+	fclose(s->fp);
+	s->connected = 0;
+	s->writing = 0;
+	s->queue_head = s->queue_len = 0;
+	s->pending_drops = 0;
+}
+
 static void 
 control_socket_read(void *opaque)
 {
@@ -382,26 +469,197 @@ control_socket_read(void *opaque)
 	int cmd;
 	struct ctrlsock_state *s = (struct ctrlsock_state *)opaque;
 
-	for (;;) {
-		if (fgets(buf, 1024, s->fp) == NULL) {
-			if (ferror(s->fp) != 0 && (errno != EINTR || 
-						errno != EWOULDBLOCK))
-				goto err;
-		} /*else {
-			printf("control_socket_read() = %s", buf);
-			argos_logf("%s", buf);
-		}*/
-		cmd = control_socket_process(buf);
-		control_cmd_run(cmd);
+	if (fgets(buf, 1024, s->fp) == NULL) {
+		if (ferror(s->fp) && (errno == EINTR || errno == EWOULDBLOCK)) {
+			clearerr(s->fp);
+			return;
+		}
+		/* Close socket */
+		if (!feof(s->fp))
+			perror("fgets()");
+		control_socket_close(s);
 		return;
 	}
+	/*printf("control_socket_read() = %s", buf);
+	argos_logf("%s", buf);*/
+	cmd = control_socket_process(buf);
+	control_cmd_run(cmd);
+}
 
-err:
-	/* Close socket */
-	perror("fgets()");
-	qemu_set_fd_handler2(s->sd, NULL, NULL, NULL, NULL);
-	fclose(s->fp);
-	s->connected = 0;
+static void control_socket_writable(void *opaque);
+
+//! Write as much of the queue as the socket takes without blocking
+static void
+control_socket_flush(struct ctrlsock_state *s)
+{
+	int len, n;
+
+	while (s->queue_len > 0) {
+		len = s->queue_len;
+		if (s->queue_head + len > CTRLSOCK_QUEUE_SIZE)
+			len = CTRLSOCK_QUEUE_SIZE - s->queue_head;
+#ifdef MSG_NOSIGNAL
+		n = send(s->sd, s->queue + s->queue_head, len, MSG_NOSIGNAL);
+#else
+		n = send(s->sd, s->queue + s->queue_head, len, 0);
+#endif
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			perror("send()");
+			control_socket_close(s);
+			return;
+		}
+		s->queue_head = (s->queue_head + n) % CTRLSOCK_QUEUE_SIZE;
+		s->queue_len -= n;
+	}
+	if (s->queue_len == 0)
+		s->queue_head = 0;
+
+	// Only wait for the socket to become writable while there is output
+	if ((s->queue_len > 0) != s->writing) {
+		s->writing = s->queue_len > 0;
+		qemu_set_fd_handler2(s->sd, NULL, control_socket_read,
+				s->writing ? control_socket_writable : NULL, s);
+	}
+}
+
+static void
+control_socket_writable(void *opaque)
+{
+	control_socket_flush((struct ctrlsock_state *)opaque);
+}
+
+static void
+control_socket_push(struct ctrlsock_state *s, const char *msg, int len)
+{
+	int tail, n;
+
+	tail = (s->queue_head + s->queue_len) % CTRLSOCK_QUEUE_SIZE;
+	n = CTRLSOCK_QUEUE_SIZE - tail;
+	if (n > len)
+		n = len;
+	memcpy(s->queue + tail, msg, n);
+	memcpy(s->queue, msg + n, len - n);
+	s->queue_len += len;
+	if (s->queue_len > s->queue_peak)
+		s->queue_peak = s->queue_len;
+}
+
+//! Queue a whole message, or drop it if it does not fit
+static void
+control_socket_queue(struct ctrlsock_state *s, const char *msg, int len)
+{
+	char note[128];
+	int n = 0;
+
+	if (s->pending_drops) {
+		if (ctrlsock_json)
+			n = snprintf(note, sizeof(note), "{\"event\":\"dropped\","
+					"\"count\":%llu,\"total\":%llu}\n",
+					(unsigned long long)s->pending_drops,
+					(unsigned long long)s->dropped);
+		else
+			n = snprintf(note, sizeof(note), 
+					"[ARGOS] Dropped <%llu> messages\n",
+					(unsigned long long)s->pending_drops);
+	}
+	if (len > CTRLSOCK_MSG_MAX || 
+			s->queue_len + n + len > CTRLSOCK_QUEUE_SIZE) {
+		s->dropped++;
+		s->pending_drops++;
+		return;
+	}
+	if (n > 0) {
+		control_socket_push(s, note, n);
+		s->pending_drops = 0;
+	}
+	control_socket_push(s, msg, len);
+	s->sent++;
+	control_socket_flush(s);
+}
+
+//! Give the client a last chance to take the queued messages
+static void
+control_socket_drain(void)
+{
+	struct ctrlsock_state *s = ctrlsock;
+	struct pollfd pfd;
+	int waited = 0;
+
+	if (s == NULL)
+		return;
+	while (s->connected && s->queue_len > 0 && 
+			waited < CTRLSOCK_DRAIN_TIMEOUT) {
+		pfd.fd = s->sd;
+		pfd.events = POLLOUT;
+		if (poll(&pfd, 1, 100) == 0)
+			waited += 100;
+		control_socket_flush(s);
+	}
+}
+
+//! Escape \a str for a JSON string, truncating it to fit \a size
+static void
+json_escape(char *buf, int size, const char *str)
+{
+	int n = 0;
+	unsigned char c;
+
+	for (; (c = *str) != '\0' && n < size - 7; str++) {
+		if (c == '"' || c == '\\') {
+			buf[n++] = '\\';
+			buf[n++] = c;
+		} else if (c < 0x20) {
+			n += sprintf(buf + n, "\\u%04x", c);
+		} else
+			buf[n++] = c;
+	}
+	buf[n] = '\0';
+}
+
+static void
+argos_vevent(const char *type, const char *text, const char *fmt, va_list ap)
+{
+	char msg[CTRLSOCK_MSG_MAX + 1];
+	struct timeval tv;
+	int n;
+
+	if (!ctrlsock_json || !ctrlsock || !ctrlsock->connected) {
+		if (text)
+			argos_logf("%s", text);
+		return;
+	}
+
+	gettimeofday(&tv, NULL);
+	n = snprintf(msg, sizeof(msg), 
+			"{\"event\":\"%s\",\"seq\":%llu,\"time\":%ld.%06ld",
+			type, (unsigned long long)ctrlsock_seq++, 
+			(long)tv.tv_sec, (long)tv.tv_usec);
+	if (fmt && *fmt && n < (int)sizeof(msg) - 1) {
+		msg[n++] = ',';
+		n += vsnprintf(msg + n, sizeof(msg) - n, fmt, ap);
+	}
+	// A message that cannot be closed is dropped, not sent truncated
+	if (n >= (int)sizeof(msg) - 2) {
+		ctrlsock->dropped++;
+		ctrlsock->pending_drops++;
+		return;
+	}
+	n += snprintf(msg + n, sizeof(msg) - n, "}\n");
+	control_socket_queue(ctrlsock, msg, n);
+}
+
+void
+argos_event(const char *type, const char *text, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	argos_vevent(type, text, fmt, ap);
+	va_end(ap);
 }
 
 /*static void control_socket_write(char * buf, unsigned len)
@@ -458,8 +716,13 @@ control_socket_cleanup(void)
 {
 	if (ctrlsock == NULL)
 		return;
+	control_socket_drain();
 	if (ctrlsock->connected)
-		qemu_set_fd_handler2(ctrlsock->sd, NULL, NULL, NULL, NULL);
+		control_socket_close(ctrlsock);
+	if (ctrlsock->stats_timer) {
+		qemu_del_timer(ctrlsock->stats_timer);
+		qemu_free_timer(ctrlsock->stats_timer);
+	}
 	qemu_set_fd_handler2(ctrlsock->listen_sd, NULL, NULL, NULL, NULL);
 	qemu_free(ctrlsock);
 	ctrlsock = NULL;
@@ -474,10 +737,18 @@ argos_logf(const char *fmt, ...)
 
 	va_start(ap, fmt);
 	if (ctrlsock && ctrlsock->connected) {
-		socket_set_block(ctrlsock->sd);
-		n = vfprintf(ctrlsock->fp, fmt, ap);
-		fflush(ctrlsock->fp);
-		socket_set_nonblock(ctrlsock->sd);
+		char msg[CTRLSOCK_MSG_MAX], esc[CTRLSOCK_MSG_MAX / 2];
+
+		n = vsnprintf(msg, sizeof(msg), fmt, ap);
+		if (n >= (int)sizeof(msg))
+			n = sizeof(msg) - 1;
+		if (ctrlsock_json) {
+			if (n > 0 && msg[n - 1] == '\n')
+				msg[n - 1] = '\0';
+			json_escape(esc, sizeof(esc), msg);
+			argos_event("log", NULL, "\"msg\":\"%s\"", esc);
+		} else
+			control_socket_queue(ctrlsock, msg, n);
 	} else {
 		n = vprintf(fmt, ap);
 		fflush(stdout);
@@ -517,17 +788,89 @@ control_socket_accept(void *opaque)
 	}
 	if (getcwd(buf, 1024) == NULL) {
 		perror("getcwd()");
+		fclose(s->fp);
 		return;
 	}
 
-	fprintf(s->fp, "%s\n", buf);
-	fflush(s->fp);
-
 	socket_set_nonblock(sd);
 	s->connected = 1;
 	s->sd = sd;
+	s->writing = 0;
 	qemu_set_fd_handler(sd, control_socket_read, NULL, s);
 	//printf("connected!\n");
+
+	if (ctrlsock_json) {
+		char esc[1024];
+
+		json_escape(esc, sizeof(esc), buf);
+		argos_event("hello", NULL, "\"cwd\":\"%s\",\"pid\":%d,"
+				"\"instance\":%d", esc, (int)getpid(), 
+				argos_instance_id);
+	} else
+		argos_logf("%s\n", buf);
+}
+
+static void
+control_socket_stats(void)
+{
+	struct ctrlsock_state *s = ctrlsock;
+	char text[256];
+	long uptime;
+
+	if (s == NULL || !s->connected)
+		return;
+	uptime = (long)(time(NULL) - s->start);
+	snprintf(text, sizeof(text), "[ARGOS] Stats running <%d> uptime <%ld> "
+			"queued <%d> peak <%d> sent <%llu> dropped <%llu>\n",
+			vm_running, uptime, s->queue_len, s->queue_peak,
+			(unsigned long long)s->sent, 
+			(unsigned long long)s->dropped);
+	argos_event("stats", text, "\"running\":%d,\"uptime\":%ld,"
+			"\"queued\":%d,\"peak\":%d,\"sent\":%llu,"
+			"\"dropped\":%llu", vm_running, uptime, s->queue_len,
+			s->queue_peak, (unsigned long long)s->sent, 
+			(unsigned long long)s->dropped);
+}
+
+#ifdef ARGOS_COUNTERS
+static void
+control_socket_counters(void)
+{
+	argos_counters_t c;
+	char text[256];
+
+	argos_counters_sum(&c);
+	snprintf(text, sizeof(text), "[ARGOS] Counters loads <%llu> "
+			"stores <%llu> checks <%llu> ci <%llu> walks <%llu> "
+			"alerts <%llu>\n", (unsigned long long)c.tainted_loads,
+			(unsigned long long)c.tainted_stores,
+			(unsigned long long)c.checks,
+			(unsigned long long)c.ci_checks,
+			(unsigned long long)c.pc_walks,
+			(unsigned long long)c.alerts);
+	argos_event("counters", text, "\"tainted_loads\":%llu,"
+			"\"tainted_stores\":%llu,\"checks\":%llu,"
+			"\"ci_checks\":%llu,\"pc_walks\":%llu,\"alerts\":%llu",
+			(unsigned long long)c.tainted_loads,
+			(unsigned long long)c.tainted_stores,
+			(unsigned long long)c.checks,
+			(unsigned long long)c.ci_checks,
+			(unsigned long long)c.pc_walks,
+			(unsigned long long)c.alerts);
+}
+#endif
+
+static void
+control_socket_stats_tick(void *opaque)
+{
+	struct ctrlsock_state *s = (struct ctrlsock_state *)opaque;
+
+	control_socket_stats();
+#ifdef ARGOS_COUNTERS
+	control_socket_counters();
+#endif
+	qemu_mod_timer(s->stats_timer, qemu_get_clock(rt_clock) + 
+			ctrlsock_stats_interval * 1000);
 }
 
 static int
@@ -537,6 +880,7 @@ control_socket_listen(const char *target, int port)
 
 	struct ctrlsock_state *s;
 	int sd, e, sopt;
+	static int drain_registered = 0;
 
 	printf("control_socket_listen(target=%s, port=%d)\n", target, port);
 
@@ -575,6 +919,19 @@ control_socket_listen(const char *target, int port)
 
 	ctrlsock = s;
         qemu_set_fd_handler(sd, control_socket_accept, NULL, s);
+	s->start = time(NULL);
+	if (ctrlsock_stats_interval > 0) {
+		s->stats_timer = qemu_new_timer(rt_clock, 
+				control_socket_stats_tick, s);
+		qemu_mod_timer(s->stats_timer, qemu_get_clock(rt_clock) +
+				ctrlsock_stats_interval * 1000);
+	}
+	// alerts are often followed by exit(). The fork server children
+	// listen again, but inherit the handler.
+	if (!drain_registered) {
+		atexit(control_socket_drain);
+		drain_registered = 1;
+	}
 	return 0;
 	
 err:
@@ -762,6 +1119,29 @@ void cpu_outl(CPUState *env, int addr, int val)
 #endif
 }
 
+const argos_rtag_t *argos_ioport_wtag = &argos_clean_tag;
+
+void argos_cpu_outb(CPUState *env, int addr, int val, const argos_rtag_t *tag)
+{
+    argos_ioport_wtag = tag;
+    cpu_outb(env, addr, val);
+    argos_ioport_wtag = &argos_clean_tag;
+}
+
+void argos_cpu_outw(CPUState *env, int addr, int val, const argos_rtag_t *tag)
+{
+    argos_ioport_wtag = tag;
+    cpu_outw(env, addr, val);
+    argos_ioport_wtag = &argos_clean_tag;
+}
+
+void argos_cpu_outl(CPUState *env, int addr, int val, const argos_rtag_t *tag)
+{
+    argos_ioport_wtag = tag;
+    cpu_outl(env, addr, val);
+    argos_ioport_wtag = &argos_clean_tag;
+}
+
 int argos_cpu_inb(CPUState *env, int addr, argos_rtag_t *tag)
 {
     int val;
@@ -4016,10 +4396,93 @@ int qemu_can_send_packet(VLANClientState *vc1)
     return 0;
 }
 
+/* number of packets queued in all clients */
+static int vlan_nb_queued;
+
+/* maximum number of free packets kept for reuse */
+#define VLAN_PACKET_POOL_MAX 512
+
+static VLANPacket *vlan_packet_pool;
+static int vlan_packet_pool_len;
+
+/* allocate a packet with a single reference, from the pool if possible */
+VLANPacket *qemu_packet_alloc(int size)
+{
+    VLANPacket *p;
+    int buf_size;
+
+    if (size <= VLAN_PACKET_SIZE && vlan_packet_pool) {
+        p = vlan_packet_pool;
+        vlan_packet_pool = p->next;
+        vlan_packet_pool_len--;
+    } else {
+        buf_size = size > VLAN_PACKET_SIZE ? size : VLAN_PACKET_SIZE;
+        p = qemu_malloc(sizeof(VLANPacket) + buf_size);
+        if (!p)
+            return NULL;
+        p->buf_size = buf_size;
+    }
+    p->next = NULL;
+    p->refcnt = 1;
+    p->size = size;
+    return p;
+}
+
+void qemu_packet_unref(VLANPacket *p)
+{
+    if (--p->refcnt > 0)
+        return;
+    if (p->buf_size == VLAN_PACKET_SIZE &&
+        vlan_packet_pool_len < VLAN_PACKET_POOL_MAX) {
+        p->next = vlan_packet_pool;
+        vlan_packet_pool = p;
+        vlan_packet_pool_len++;
+    } else {
+        qemu_free(p);
+    }
+}
+
+static void qemu_queue_packet(VLANClientState *vc, VLANPacket *p)
+{
+    if (vc->queue_len >= VLAN_QUEUE_MAX_LEN) {
+        vc->queue_drops++;
+        return;
+    }
+    vc->queue[(vc->queue_first + vc->queue_len) % VLAN_QUEUE_MAX_LEN] =
+        qemu_packet_ref(p);
+    if (++vc->queue_len > vc->queue_max_len)
+        vc->queue_max_len = vc->queue_len;
+    vlan_nb_queued++;
+}
+
+static inline int qemu_must_queue(VLANClientState *vc)
+{
+    /* keep the order of the packets that are already queued */
+    return vc->queue_len ||
+        (vc->fd_can_read && !vc->fd_can_read(vc->opaque));
+}
+
+/* send a packet filled by a backend; the caller keeps its reference */
+void qemu_send_packet_buf(VLANClientState *vc1, VLANPacket *p)
+{
+    VLANState *vlan = vc1->vlan;
+    VLANClientState *vc;
+
+    for(vc = vlan->first_client; vc != NULL; vc = vc->next) {
+        if (vc != vc1) {
+            if (qemu_must_queue(vc))
+                qemu_queue_packet(vc, p);
+            else
+                vc->fd_read(vc->opaque, p->data, p->size);
+        }
+    }
+}
+
 void qemu_send_packet(VLANClientState *vc1, const uint8_t *buf, int size)
 {
     VLANState *vlan = vc1->vlan;
     VLANClientState *vc;
+    VLANPacket *p = NULL;
 
 #if 0
     printf("vlan %d send:\n", vlan->id);
@@ -4027,7 +4490,52 @@ void qemu_send_packet(VLANClientState *vc1, const uint8_t *buf, int size)
 #endif
     for(vc = vlan->first_client; vc != NULL; vc = vc->next) {
         if (vc != vc1) {
-            vc->fd_read(vc->opaque, buf, size);
+            if (qemu_must_queue(vc)) {
+                /* a single copy is shared by all the queues */
+                if (!p) {
+                    p = qemu_packet_alloc(size);
+                    if (!p) {
+                        vc->queue_drops++;
+                        continue;
+                    }
+                    memcpy(p->data, buf, size);
+                }
+                qemu_queue_packet(vc, p);
+            } else {
+                vc->fd_read(vc->opaque, buf, size);
+            }
+        }
+    }
+    if (p)
+        qemu_packet_unref(p);
+}
+
+/* deliver the queued packets that the client can receive now */
+void qemu_flush_queued_packets(VLANClientState *vc)
+{
+    VLANPacket *p;
+
+    while (vc->queue_len > 0) {
+        if (vc->fd_can_read && !vc->fd_can_read(vc->opaque))
+            break;
+        p = vc->queue[vc->queue_first];
+        vc->queue_first = (vc->queue_first + 1) % VLAN_QUEUE_MAX_LEN;
+        vc->queue_len--;
+        vlan_nb_queued--;
+        vc->fd_read(vc->opaque, p->data, p->size);
+        qemu_packet_unref(p);
+    }
+}
+
+static void qemu_flush_vlan_queues(void)
+{
+    VLANState *vlan;
+    VLANClientState *vc;
+
+    for(vlan = first_vlan; vlan != NULL; vlan = vlan->next) {
+        for(vc = vlan->first_client; vc != NULL; vc = vc->next) {
+            if (vc->queue_len)
+                qemu_flush_queued_packets(vc);
         }
     }
 }
@@ -4224,6 +4732,10 @@ typedef struct TAPState {
     VLANClientState *vc;
     int fd;
     char down_script[1024];
+    /* to open another interface in a fork server child */
+    int reopen;
+    char ifname[64];
+    char setup_script[1024];
 } TAPState;
 
 static void tap_receive(void *opaque, const uint8_t *buf, int size)
@@ -4239,28 +4751,67 @@ static void tap_receive(void *opaque, const uint8_t *buf, int size)
     }
 }
 
+/* maximum number of frames read from the tap device per wakeup */
+#define TAP_MAX_BATCH 64
+
 static void tap_send(void *opaque)
 {
     TAPState *s = opaque;
-    uint8_t buf[4096];
-    int size;
-
+    VLANPacket *p;
+    int size, n;
 #ifdef __sun__
     struct strbuf sbuf;
-    int f = 0;
-    sbuf.maxlen = sizeof(buf);
-    sbuf.buf = buf;
-    size = getmsg(s->fd, NULL, &sbuf, &f) >=0 ? sbuf.len : -1;
+    int f;
+#endif
+
+    /* the fd is non blocking, drain it instead of waiting for select()
+       to return once per frame */
+    for(n = 0; n < TAP_MAX_BATCH; n++) {
+        /* read straight into a packet, that the clients which cannot
+           receive it yet share */
+        p = qemu_packet_alloc(VLAN_PACKET_SIZE);
+        if (!p)
+            break;
+#ifdef __sun__
+        f = 0;
+        sbuf.maxlen = VLAN_PACKET_SIZE;
+        sbuf.buf = p->data;
+        size = getmsg(s->fd, NULL, &sbuf, &f) >=0 ? sbuf.len : -1;
 #else
-    size = read(s->fd, buf, sizeof(buf));
+        size = read(s->fd, p->data, VLAN_PACKET_SIZE);
 #endif
-    if (size > 0) {
-        qemu_send_packet(s->vc, buf, size);
+        if (size > 0) {
+            p->size = size;
+            qemu_send_packet_buf(s->vc, p);
+        }
+        qemu_packet_unref(p);
+        if (size <= 0)
+            break;
     }
 }
 
+#ifdef USE_IOTHREAD
+static void tap_iothread_read(void *opaque, const uint8_t *buf, int size)
+{
+    TAPState *s = opaque;
+
+    qemu_send_packet(s->vc, buf, size);
+}
+#endif
+
 /* fd support */
 
+static void tap_set_fd(TAPState *s, int fd)
+{
+    s->fd = fd;
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+#ifdef USE_IOTHREAD
+    if (!iothread_enabled ||
+        !iothread_add_reader(s->fd, 4096, tap_iothread_read, s))
+#endif
+        qemu_set_fd_handler(s->fd, tap_send, NULL, s);
+}
+
 static TAPState *net_tap_fd_init(VLANState *vlan, int fd)
 {
     TAPState *s;
@@ -4268,9 +4819,8 @@ static TAPState *net_tap_fd_init(VLANState *vlan, int fd)
     s = qemu_mallocz(sizeof(TAPState));
     if (!s)
         return NULL;
-    s->fd = fd;
     s->vc = qemu_new_vlan_client(vlan, tap_receive, NULL, s);
-    qemu_set_fd_handler(s->fd, tap_send, NULL, s);
+    tap_set_fd(s, fd);
     snprintf(s->vc->info_str, sizeof(s->vc->info_str), "tap: fd=%d", fd);
     return s;
 }
@@ -4523,8 +5073,56 @@ static int net_tap_init(VLANState *vlan, const char *ifname1,
              "tap: ifname=%s setup_script=%s", ifname, setup_script);
     if (down_script && strcmp(down_script, "no"))
         snprintf(s->down_script, sizeof(s->down_script), "%s", down_script);
+    s->reopen = 1;
+    if (ifname1 != NULL)
+        pstrcpy(s->ifname, sizeof(s->ifname), ifname1);
+    pstrcpy(s->setup_script, sizeof(s->setup_script), setup_script);
+    return 0;
+}
+
+#ifdef USE_FORKSERVER
+/* A forked child must not read the interface of the master. A fixed
+   name gets the slot number appended, a template like "tap%d" is given
+   to the kernel again. */
+static int net_tap_after_fork(TAPState *s, int slot)
+{
+    char ifname[sizeof(s->ifname)], path[PATH_MAX];
+    int fd;
+
+    qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+    if (!s->reopen) {
+        fprintf(stderr, "warning: tap fd=%d is not available in the fork "
+                "server children\n", s->fd);
+        close(s->fd);
+        s->fd = -1;
+        return 0;
+    }
+    close(s->fd);
+    s->fd = -1;
+    if (s->ifname[0] == '\0' || strchr(s->ifname, '%'))
+        pstrcpy(ifname, sizeof(ifname), s->ifname);
+    else
+        snprintf(ifname, sizeof(ifname), "%.*s.%d",
+                 (int)sizeof(ifname) - 12, s->ifname, slot);
+    TFR(fd = tap_open(ifname, sizeof(ifname)));
+    if (fd < 0)
+        return -1;
+    if (s->setup_script[0] != '\0' &&
+        launch_script(s->setup_script, ifname, fd)) {
+        close(fd);
+        return -1;
+    }
+    tap_set_fd(s, fd);
+    snprintf(s->vc->info_str, sizeof(s->vc->info_str),
+             "tap: ifname=%s setup_script=%.*s", ifname,
+             (int)(sizeof(s->vc->info_str) - sizeof(ifname) - 32),
+             s->setup_script);
+    /* the child works in another directory */
+    if (s->down_script[0] && realpath(s->down_script, path))
+        pstrcpy(s->down_script, sizeof(s->down_script), path);
     return 0;
 }
+#endif
 
 #endif /* !_WIN32 */
 
@@ -4644,21 +5242,28 @@ static void net_socket_send(void *opaque)
 static void net_unixsocket_send(void *opaque)
 {
     NetSocketState *s = opaque;
-    uint8_t buf[4096];
+    VLANPacket *p;
     int size;
-
 #ifdef __sun__
     struct strbuf sbuf;
     int f = 0;
-    sbuf.maxlen = sizeof(buf);
-    sbuf.buf = buf;
+#endif
+
+    p = qemu_packet_alloc(VLAN_PACKET_SIZE);
+    if (!p)
+        return;
+#ifdef __sun__
+    sbuf.maxlen = VLAN_PACKET_SIZE;
+    sbuf.buf = p->data;
     size = getmsg(s->fd, NULL, &sbuf, &f) >=0 ? sbuf.len : -1;
 #else
-    size = read(s->fd, buf, sizeof(buf));
+    size = read(s->fd, p->data, VLAN_PACKET_SIZE);
 #endif
     if (size > 0) {
-        qemu_send_packet(s->vc, buf, size);
+        p->size = size;
+        qemu_send_packet_buf(s->vc, p);
     }
+    qemu_packet_unref(p);
 }
 
 
@@ -5670,8 +6275,13 @@ void do_info_network(void)
 
     for(vlan = first_vlan; vlan != NULL; vlan = vlan->next) {
         term_printf("VLAN %d devices:\n", vlan->id);
-        for(vc = vlan->first_client; vc != NULL; vc = vc->next)
+        for(vc = vlan->first_client; vc != NULL; vc = vc->next) {
             term_printf("  %s\n", vc->info_str);
+            if (vc->fd_can_read)
+                term_printf("    receive queue: %d packets (max %d), "
+                            "%lu dropped\n", vc->queue_len,
+                            vc->queue_max_len, vc->queue_drops);
+        }
     }
 }
 
@@ -6262,49 +6872,217 @@ typedef struct IOHandlerRecord {
     /* temporary data */
     struct pollfd *ufd;
     struct IOHandlerRecord *next;
+#ifdef CONFIG_EPOLL
+    /* events the fd is registered for in the epoll set */
+    uint32_t epoll_events;
+    /* the fd cannot be added to the epoll set (e.g. regular files) */
+    int no_epoll;
+    /* in the list of handlers that are checked on every iteration */
+    int polled;
+    struct IOHandlerRecord *next_polled;
+#endif
 } IOHandlerRecord;
 
 static IOHandlerRecord *first_io_handler;
 
-/* XXX: fd_read_poll should be suppressed, but an API change is
-   necessary in the character devices to suppress fd_can_read(). */
-int qemu_set_fd_handler2(int fd,
-                         IOCanRWHandler *fd_read_poll,
-                         IOHandler *fd_read,
-                         IOHandler *fd_write,
-                         void *opaque)
+/* live handlers, indexed by fd */
+static IOHandlerRecord **io_handler_table;
+static int io_handler_table_size;
+
+static IOHandlerRecord *io_handler_lookup(int fd)
 {
-    IOHandlerRecord **pioh, *ioh;
+    if (fd < 0 || fd >= io_handler_table_size)
+        return NULL;
+    return io_handler_table[fd];
+}
 
-    if (!fd_read && !fd_write) {
-        pioh = &first_io_handler;
-        for(;;) {
-            ioh = *pioh;
-            if (ioh == NULL)
-                break;
-            if (ioh->fd == fd) {
-                ioh->deleted = 1;
-                break;
-            }
-            pioh = &ioh->next;
-        }
-    } else {
-        for(ioh = first_io_handler; ioh != NULL; ioh = ioh->next) {
-            if (ioh->fd == fd)
-                goto found;
-        }
-        ioh = qemu_mallocz(sizeof(IOHandlerRecord));
-        if (!ioh)
-            return -1;
-        ioh->next = first_io_handler;
-        first_io_handler = ioh;
-    found:
+static int io_handler_table_set(int fd, IOHandlerRecord *ioh)
+{
+    IOHandlerRecord **table;
+    int size;
+
+    if (fd >= io_handler_table_size) {
+        size = io_handler_table_size ? io_handler_table_size : 64;
+        while (size <= fd)
+            size *= 2;
+        table = realloc(io_handler_table, size * sizeof(IOHandlerRecord *));
+        if (!table)
+            return -1;
+        memset(table + io_handler_table_size, 0,
+               (size - io_handler_table_size) * sizeof(IOHandlerRecord *));
+        io_handler_table = table;
+        io_handler_table_size = size;
+    }
+    io_handler_table[fd] = ioh;
+    return 0;
+}
+
+#ifdef CONFIG_EPOLL
+
+/* On Linux the handlers are kept in an epoll set, so that a wakeup does
+   not cost a pass over all of them. Only the handlers with a
+   fd_read_poll callback, whose interest changes behind our back, are
+   checked on every iteration. If epoll is not available select() is
+   used as on the other hosts. */
+
+#define IO_EPOLL_MAX_EVENTS 64
+
+static int io_epoll_fd = -1;
+static int io_epoll_tried;
+static IOHandlerRecord *first_polled_io_handler;
+
+static int io_use_epoll(void)
+{
+    if (!io_epoll_tried) {
+        io_epoll_tried = 1;
+        io_epoll_fd = epoll_create(IO_EPOLL_MAX_EVENTS);
+        if (io_epoll_fd >= 0)
+            fcntl(io_epoll_fd, F_SETFD, FD_CLOEXEC);
+    }
+    return io_epoll_fd >= 0;
+}
+
+static void io_epoll_update(IOHandlerRecord *ioh, uint32_t events)
+{
+    struct epoll_event ev;
+    int op, ret;
+
+    if (ioh->no_epoll || events == ioh->epoll_events)
+        return;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = ioh->fd;
+    if (!ioh->epoll_events)
+        op = EPOLL_CTL_ADD;
+    else if (!events)
+        op = EPOLL_CTL_DEL;
+    else
+        op = EPOLL_CTL_MOD;
+    ret = epoll_ctl(io_epoll_fd, op, ioh->fd, &ev);
+    /* the fd may have been closed and reused without being unregistered */
+    if (ret < 0 && errno == EEXIST)
+        ret = epoll_ctl(io_epoll_fd, EPOLL_CTL_MOD, ioh->fd, &ev);
+    else if (ret < 0 && errno == ENOENT && op == EPOLL_CTL_MOD)
+        ret = epoll_ctl(io_epoll_fd, EPOLL_CTL_ADD, ioh->fd, &ev);
+    if (ret < 0 && op != EPOLL_CTL_DEL) {
+        if (errno == EPERM) {
+            /* always ready, like select() reports it */
+            ioh->no_epoll = 1;
+            ioh->epoll_events = 0;
+            return;
+        }
+        perror("epoll_ctl");
+    }
+    ioh->epoll_events = events;
+}
+
+static uint32_t io_epoll_wanted(IOHandlerRecord *ioh)
+{
+    uint32_t events = 0;
+
+    if (ioh->deleted)
+        return 0;
+    if (ioh->fd_read &&
+        (!ioh->fd_read_poll || ioh->fd_read_poll(ioh->opaque) != 0))
+        events |= EPOLLIN;
+    if (ioh->fd_write)
+        events |= EPOLLOUT;
+    return events;
+}
+
+static void io_epoll_changed(IOHandlerRecord *ioh)
+{
+    int polled;
+
+    if (!io_use_epoll())
+        return;
+    if (!ioh->fd_read_poll && !ioh->no_epoll)
+        io_epoll_update(ioh, io_epoll_wanted(ioh));
+    polled = !ioh->deleted && (ioh->fd_read_poll || ioh->no_epoll);
+    if (polled && !ioh->polled) {
+        ioh->next_polled = first_polled_io_handler;
+        first_polled_io_handler = ioh;
+        ioh->polled = 1;
+    }
+    /* handlers leave the polled list when they are freed */
+}
+
+static void io_epoll_unpoll(IOHandlerRecord *ioh)
+{
+    IOHandlerRecord **pioh;
+
+    for(pioh = &first_polled_io_handler; *pioh != NULL;
+        pioh = &(*pioh)->next_polled) {
+        if (*pioh == ioh) {
+            *pioh = ioh->next_polled;
+            break;
+        }
+    }
+}
+
+#ifdef USE_FORKSERVER
+/* a forked child shares the epoll set with its parent, so it must build
+   its own before it changes any handler */
+static void io_epoll_after_fork(void)
+{
+    IOHandlerRecord *ioh;
+
+    if (io_epoll_fd < 0)
+        return;
+    close(io_epoll_fd);
+    io_epoll_fd = -1;
+    io_epoll_tried = 0;
+    for(ioh = first_io_handler; ioh != NULL; ioh = ioh->next) {
+        ioh->epoll_events = 0;
+        if (!ioh->deleted)
+            io_epoll_changed(ioh);
+    }
+}
+#endif
+
+#endif /* CONFIG_EPOLL */
+
+/* XXX: fd_read_poll should be suppressed, but an API change is
+   necessary in the character devices to suppress fd_can_read(). */
+int qemu_set_fd_handler2(int fd,
+                         IOCanRWHandler *fd_read_poll,
+                         IOHandler *fd_read,
+                         IOHandler *fd_write,
+                         void *opaque)
+{
+    IOHandlerRecord *ioh;
+
+    ioh = io_handler_lookup(fd);
+    if (!fd_read && !fd_write) {
+        if (ioh) {
+            ioh->deleted = 1;
+            io_handler_table[fd] = NULL;
+#ifdef CONFIG_EPOLL
+            if (io_use_epoll())
+                io_epoll_update(ioh, 0);
+#endif
+        }
+    } else {
+        if (!ioh) {
+            ioh = qemu_mallocz(sizeof(IOHandlerRecord));
+            if (!ioh)
+                return -1;
+            if (io_handler_table_set(fd, ioh) < 0) {
+                qemu_free(ioh);
+                return -1;
+            }
+            ioh->next = first_io_handler;
+            first_io_handler = ioh;
+        }
         ioh->fd = fd;
         ioh->fd_read_poll = fd_read_poll;
         ioh->fd_read = fd_read;
         ioh->fd_write = fd_write;
         ioh->opaque = opaque;
         ioh->deleted = 0;
+#ifdef CONFIG_EPOLL
+        io_epoll_changed(ioh);
+#endif
     }
     return 0;
 }
@@ -6634,6 +7412,66 @@ uint64_t qemu_get_be64(QEMUFile *f)
     return v;
 }
 
+/* Sparse buffers: only the runs containing non zero bytes are saved, as
+   their length, offset and data. A zero length ends the buffer. */
+#define SPARSE_MIN_GAP  64
+#define SPARSE_MAX_RUN  (1 << 20)
+
+/* return the offset of the first non zero byte at or after i */
+static size_t sparse_skip_zeros(const uint8_t *buf, size_t i, size_t size)
+{
+    while (i < size && (i & (sizeof(long) - 1)) && buf[i] == 0)
+        i++;
+    while (i + sizeof(long) <= size && *(const long *)(buf + i) == 0)
+        i += sizeof(long);
+    while (i < size && buf[i] == 0)
+        i++;
+    return i;
+}
+
+void qemu_put_sparse(QEMUFile *f, const uint8_t *buf, size_t size)
+{
+    size_t start, end, next;
+
+    start = sparse_skip_zeros(buf, 0, size);
+    while (start < size) {
+        /* extend the run over gaps too small to be worth a new run */
+        end = start;
+        for(;;) {
+            while (end < size && buf[end] != 0 &&
+                   end - start < SPARSE_MAX_RUN)
+                end++;
+            if (end == size || end - start >= SPARSE_MAX_RUN)
+                break;
+            next = sparse_skip_zeros(buf, end, size);
+            if (next == size || next - end >= SPARSE_MIN_GAP)
+                break;
+            end = next;
+        }
+        qemu_put_be32(f, end - start);
+        qemu_put_be64(f, start);
+        qemu_put_buffer(f, buf + start, end - start);
+        start = sparse_skip_zeros(buf, end, size);
+    }
+    qemu_put_be32(f, 0);
+}
+
+int qemu_get_sparse(QEMUFile *f, uint8_t *buf, size_t size)
+{
+    uint32_t len;
+    uint64_t offset;
+
+    memset(buf, 0, size);
+    while ((len = qemu_get_be32(f)) != 0) {
+        offset = qemu_get_be64(f);
+        if (offset > size || len > size - offset)
+            return -EINVAL;
+        if (qemu_get_buffer(f, buf + offset, len) != len)
+            return -EIO;
+    }
+    return 0;
+}
+
 typedef struct SaveStateEntry {
     char idstr[256];
     int instance_id;
@@ -6677,7 +7515,14 @@ int register_savevm(const char *idstr,
 #define QEMU_VM_FILE_MAGIC   0x5145564d
 #define QEMU_VM_FILE_VERSION 0x00000002
 
-static int qemu_savevm_state(QEMUFile *f)
+/* sections not saved in raw snapshots: the RAM is stored separately and
+   the taint state starts clean */
+static int raw_vm_skip_se(SaveStateEntry *se)
+{
+    return !strcmp(se->idstr, "ram") || !strncmp(se->idstr, "argos ", 6);
+}
+
+static int qemu_savevm_state(QEMUFile *f, int raw)
 {
     SaveStateEntry *se;
     int len, ret;
@@ -6689,6 +7534,8 @@ static int qemu_savevm_state(QEMUFile *f)
     qemu_put_be64(f, 0); /* total size */
 
     for(se = first_se; se != NULL; se = se->next) {
+        if (raw && raw_vm_skip_se(se))
+            continue;
         /* ID string */
         len = strlen(se->idstr);
         qemu_put_byte(f, len);
@@ -6904,7 +7751,7 @@ void do_savevm(const char *name)
         term_printf("Could not open VM state file\n");
         goto the_end;
     }
-    ret = qemu_savevm_state(f);
+    ret = qemu_savevm_state(f, 0);
     sn->vm_state_size = qemu_ftell(f);
     qemu_fclose(f);
     if (ret < 0) {
@@ -7880,6 +8727,276 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
     return 0;
 }
 
+/***********************************************************/
+/* argos memory map */
+
+#if ARGOS_MEMMAP == ARGOS_BITMAP
+#define ARGOS_MEMMAP_BYTES(len) ((len) / 8 + 1)
+#else
+#define ARGOS_MEMMAP_BYTES(len) ((len) * sizeof(argos_bytemap_t))
+#endif
+
+#if ARGOS_MEMMAP == ARGOS_PAGEMAP
+#if ARGOS_INNER_PAGEMAP == ARGOS_BITMAP
+#define ARGOS_PAGEMAP_INNER_BYTES (ARGOS_PAGEMAP_PAGE_SIZE / 8 + 1)
+#else
+#define ARGOS_PAGEMAP_INNER_BYTES \
+    (ARGOS_PAGEMAP_PAGE_SIZE * sizeof(argos_pagemap_inner_t))
+#endif
+#endif
+
+static void argos_memmap_save(QEMUFile *f, void *opaque)
+{
+#if ARGOS_MEMMAP == ARGOS_PAGEMAP
+    unsigned long i;
+#endif
+
+    qemu_put_be32(f, ARGOS_MEMMAP);
+    qemu_put_be32(f, sizeof(argos_bytemap_t));
+    qemu_put_be64(f, phys_ram_size);
+#if ARGOS_MEMMAP == ARGOS_PAGEMAP
+    /* only the pages that have a map */
+    for(i = 0; i < ARGOS_PAGEMAP_PGOFF(phys_ram_size); i++) {
+        if (argos_memmap[i]) {
+            qemu_put_be32(f, i);
+            qemu_put_sparse(f, (uint8_t *)argos_memmap[i],
+                            ARGOS_PAGEMAP_INNER_BYTES);
+        }
+    }
+    qemu_put_be32(f, -1);
+#else
+    qemu_put_sparse(f, (uint8_t *)argos_memmap,
+                    ARGOS_MEMMAP_BYTES(phys_ram_size));
+#endif
+}
+
+static int argos_memmap_load(QEMUFile *f, void *opaque, int version_id)
+{
+#if ARGOS_MEMMAP == ARGOS_PAGEMAP
+    uint32_t i;
+    int ret;
+#endif
+
+    if (version_id != 1)
+        return -EINVAL;
+    if (qemu_get_be32(f) != ARGOS_MEMMAP ||
+        qemu_get_be32(f) != sizeof(argos_bytemap_t) ||
+        qemu_get_be64(f) != phys_ram_size) {
+        fprintf(stderr, "Taint map was saved by a different configuration\n");
+        return -EINVAL;
+    }
+#if ARGOS_MEMMAP == ARGOS_PAGEMAP
+    argos_pagemap_reset(argos_memmap, phys_ram_size);
+    while ((i = qemu_get_be32(f)) != (uint32_t)-1) {
+        if (i >= ARGOS_PAGEMAP_PGOFF(phys_ram_size))
+            return -EINVAL;
+        argos_memmap[i] = ARGOS_PAGEMAP_INNER_CREATEZ(ARGOS_PAGEMAP_PAGE_SIZE);
+        if (!argos_memmap[i])
+            return -ENOMEM;
+        ret = qemu_get_sparse(f, (uint8_t *)argos_memmap[i],
+                              ARGOS_PAGEMAP_INNER_BYTES);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+#else
+    return qemu_get_sparse(f, (uint8_t *)argos_memmap,
+                           ARGOS_MEMMAP_BYTES(phys_ram_size));
+#endif
+}
+
+/***********************************************************/
+/* raw snapshots */
+
+/* Raw snapshots keep the RAM uncompressed and page aligned, so that it
+   can be mapped copy-on-write instead of being read back.
+
+   Header | padding up to ram_offset | RAM | device state
+   Header = magic, version, ram size, ram offset, device state offset */
+#define RAW_VM_FILE_MAGIC   0x41525653
+#define RAW_VM_FILE_VERSION 0x00000001
+#define RAW_VM_CHUNK_SIZE   (1024 * 1024)
+
+static unsigned long raw_vm_ram_offset(void)
+{
+    unsigned long align;
+
+#ifdef _WIN32
+    align = 4096;
+#else
+    align = getpagesize();
+    if (align < 4096)
+        align = 4096;
+#endif
+    return align;
+}
+
+/* The state is written to a temporary file that is renamed over the old
+   one, as the old file may be mapped under phys_ram_base, by this
+   instance or by another one that loaded it: truncating it in place would
+   make the pages that were not copied yet fault. */
+void do_savevm_raw(const char *filename)
+{
+    QEMUFile *f;
+    char tmp_filename[PATH_MAX];
+    unsigned long ram_offset;
+    ram_addr_t i;
+    int saved_vm_running, ret;
+
+    qemu_aio_flush();
+
+    saved_vm_running = vm_running;
+    vm_stop(0);
+
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+    f = qemu_fopen(tmp_filename, "wb");
+    if (!f) {
+        term_printf("Could not open VM state file '%s'\n", tmp_filename);
+        goto the_end;
+    }
+    ram_offset = raw_vm_ram_offset();
+    qemu_put_be32(f, RAW_VM_FILE_MAGIC);
+    qemu_put_be32(f, RAW_VM_FILE_VERSION);
+    qemu_put_be64(f, phys_ram_size);
+    qemu_put_be64(f, ram_offset);
+    qemu_put_be64(f, ram_offset + phys_ram_size);
+    qemu_fseek(f, ram_offset, SEEK_SET);
+    for(i = 0; i < phys_ram_size; i += RAW_VM_CHUNK_SIZE)
+        qemu_put_buffer(f, phys_ram_base + i,
+                        MIN(RAW_VM_CHUNK_SIZE, phys_ram_size - i));
+    ret = qemu_savevm_state(f, 1);
+    if (ret == 0) {
+        qemu_fflush(f);
+        if (fflush(f->outfile) != 0)
+            ret = -errno;
+#ifndef _WIN32
+        else if (fsync(fileno(f->outfile)) != 0)
+            ret = -errno;
+#endif
+    }
+    qemu_fclose(f);
+    if (ret == 0) {
+#ifdef _WIN32
+        unlink(filename);
+#endif
+        if (rename(tmp_filename, filename) < 0)
+            ret = -errno;
+    }
+    if (ret < 0) {
+        term_printf("Error %d while writing VM\n", ret);
+        unlink(tmp_filename);
+    }
+
+ the_end:
+    if (saved_vm_running)
+        vm_start();
+}
+
+/* the taint state of a raw snapshot is always clean */
+static void raw_vm_clear_taint(void)
+{
+#ifdef TARGET_I386
+    CPUState *env;
+#endif
+
+#if ARGOS_MEMMAP != ARGOS_PAGEMAP && defined(MADV_DONTNEED)
+    {
+        unsigned long len, page;
+
+        /* drop the pages of the map instead of touching all of them */
+        len = ARGOS_MEMMAP_BYTES(phys_ram_size);
+        page = getpagesize();
+        if (((unsigned long)argos_memmap & (page - 1)) == 0 &&
+            madvise(argos_memmap, len & ~(page - 1), MADV_DONTNEED) == 0)
+            memset((uint8_t *)argos_memmap + (len & ~(page - 1)), 0,
+                   len & (page - 1));
+        else
+            argos_memmap_clear(0, phys_ram_size);
+    }
+#else
+    argos_memmap_clear(0, phys_ram_size);
+#endif
+#ifdef TARGET_I386
+    for(env = first_cpu; env != NULL; env = env->next_cpu)
+        argos_reset(env);
+#endif
+}
+
+static int raw_vm_load_ram(QEMUFile *f, unsigned long ram_offset)
+{
+    ram_addr_t i;
+
+#ifndef _WIN32
+    if ((ram_offset & (getpagesize() - 1)) == 0 &&
+        ((unsigned long)phys_ram_base & (getpagesize() - 1)) == 0 &&
+        mmap(phys_ram_base, phys_ram_size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, fileno(f->outfile),
+             ram_offset) != MAP_FAILED) {
+#ifdef USE_MEMMERGE
+        memmerge_remapped();
+#endif
+        return 0;
+    }
+#endif
+    /* could not map it, read it */
+    qemu_fseek(f, ram_offset, SEEK_SET);
+    for(i = 0; i < phys_ram_size; i += RAW_VM_CHUNK_SIZE) {
+        int len = MIN(RAW_VM_CHUNK_SIZE, phys_ram_size - i);
+        if (qemu_get_buffer(f, phys_ram_base + i, len) != len)
+            return -EIO;
+    }
+    return 0;
+}
+
+void do_loadvm_raw(const char *filename)
+{
+    QEMUFile *f;
+    uint64_t ram_offset, state_offset;
+    int saved_vm_running, ret;
+
+    qemu_aio_flush();
+
+    saved_vm_running = vm_running;
+    vm_stop(0);
+
+    f = qemu_fopen(filename, "rb");
+    if (!f) {
+        term_printf("Could not open VM state file '%s'\n", filename);
+        goto the_end;
+    }
+    if (qemu_get_be32(f) != RAW_VM_FILE_MAGIC ||
+        qemu_get_be32(f) != RAW_VM_FILE_VERSION) {
+        term_printf("'%s' is not a raw VM state file\n", filename);
+        goto fail;
+    }
+    if (qemu_get_be64(f) != phys_ram_size) {
+        term_printf("RAM size of '%s' does not match\n", filename);
+        goto fail;
+    }
+    ram_offset = qemu_get_be64(f);
+    state_offset = qemu_get_be64(f);
+
+    ret = raw_vm_load_ram(f, ram_offset);
+    if (ret < 0) {
+        term_printf("Error %d while loading RAM\n", ret);
+        goto fail;
+    }
+    memset(phys_ram_dirty, 0xff, phys_ram_size >> TARGET_PAGE_BITS);
+    raw_vm_clear_taint();
+    if (first_cpu)
+        tb_flush(first_cpu);
+
+    qemu_fseek(f, state_offset, SEEK_SET);
+    ret = qemu_loadvm_state(f);
+    if (ret < 0)
+        term_printf("Error %d while loading VM state\n", ret);
+ fail:
+    qemu_fclose(f);
+ the_end:
+    if (saved_vm_running)
+        vm_start();
+}
+
 /***********************************************************/
 /* bottom halves (can be seen as timers which expire ASAP) */
 
@@ -8048,6 +9165,14 @@ void qemu_del_vm_stop_handler(VMStopHandler *cb, void *opaque)
 
 void vm_start(void)
 {
+#ifdef USE_FORKSERVER
+    /* the children read the disk images of the master */
+    if (forkserver_active()) {
+        fprintf(stderr, "The guest cannot run while the fork server has "
+                "children\n");
+        return;
+    }
+#endif
     if (!vm_running) {
         cpu_enable_ticks();
         vm_running = 1;
@@ -8070,6 +9195,87 @@ void vm_stop(int reason)
     }
 }
 
+#ifdef USE_FORKSERVER
+/* Called in a fork server child before it resumes the guest. The child
+   gets its own epoll set, alarm timer, disk overlays, tap interfaces and
+   control socket, and writes its logs in the directory "argos.fork.N" of
+   its slot. */
+int qemu_after_fork(int slot)
+{
+    VLANState *vlan;
+    VLANClientState *vc;
+    char dir[64];
+    int fd;
+
+#ifdef CONFIG_EPOLL
+    io_epoll_after_fork();
+#endif
+    /* the monitor and the consoles on stdio stay with the master */
+    qemu_set_fd_handler2(0, NULL, NULL, NULL, NULL);
+    TFR(fd = open("/dev/null", O_RDONLY));
+    if (fd >= 0) {
+        dup2(fd, 0);
+        close(fd);
+    }
+
+    quit_timers();
+    init_timer_alarm();
+
+    qemu_aio_after_fork();
+    if (bdrv_fork_overlays() < 0)
+        return -1;
+    argos_disktaint_after_fork();
+
+#ifdef USE_IOTHREAD
+    iothread_after_fork();
+#endif
+#ifdef USE_TBCACHE
+    tbcache_after_fork();
+#endif
+    for(vlan = first_vlan; vlan != NULL; vlan = vlan->next) {
+        for(vc = vlan->first_client; vc != NULL; vc = vc->next) {
+            if (vc->fd_read == tap_receive &&
+                net_tap_after_fork(vc->opaque, slot) < 0)
+                return -1;
+        }
+    }
+
+    if (ctrlsock) {
+        fd = ctrlsock->listen_sd;
+        /* the queued messages are for the client of the master */
+        ctrlsock->queue_len = 0;
+        ctrlsock->pending_drops = 0;
+        control_socket_cleanup();
+        close(fd);
+        if (control_socket_listen(ctrlsock_laddr,
+                                  ctrlsock_lport + 1 + slot) != 0)
+            return -1;
+    }
+
+    snprintf(dir, sizeof(dir), "argos.fork.%d", slot);
+    if ((mkdir(dir, 0755) < 0 && errno != EEXIST) || chdir(dir) < 0) {
+        perror(dir);
+        return -1;
+    }
+#ifdef ARGOS_NET_TRACKER
+    if (!(argos_nt_fl = freopen("argos.netlog", "wb", argos_nt_fl))) {
+        fprintf(stderr, "Could not create net tracker log file"
+                " argos.netlog\n");
+        return -1;
+    }
+#endif
+#ifdef ARGOS_COUNTERS
+    {
+        CPUState *env;
+
+        for(env = first_cpu; env != NULL; env = env->next_cpu)
+            memset(&env->counters, 0, sizeof(env->counters));
+    }
+#endif
+    return 0;
+}
+#endif
+
 /* reset/shutdown handler */
 
 typedef struct QEMUResetEntry {
@@ -8142,54 +9348,33 @@ void qemu_system_powerdown_request(void)
         cpu_interrupt(cpu_single_env, CPU_INTERRUPT_EXIT);
 }
 
-void main_loop_wait(int timeout)
+/* remove deleted IO handlers */
+static void io_handlers_cleanup(void)
+{
+    IOHandlerRecord **pioh, *ioh;
+
+    pioh = &first_io_handler;
+    while (*pioh) {
+        ioh = *pioh;
+        if (ioh->deleted) {
+            *pioh = ioh->next;
+#ifdef CONFIG_EPOLL
+            if (ioh->polled)
+                io_epoll_unpoll(ioh);
+#endif
+            qemu_free(ioh);
+        } else
+            pioh = &ioh->next;
+    }
+}
+
+static void main_loop_select(int timeout)
 {
     IOHandlerRecord *ioh;
     fd_set rfds, wfds, xfds;
     int ret, nfds;
-#ifdef _WIN32
-    int ret2, i;
-#endif
     struct timeval tv;
-    PollingEntry *pe;
-
-
-    /* XXX: need to suppress polling by better using win32 events */
-    ret = 0;
-    for(pe = first_polling_entry; pe != NULL; pe = pe->next) {
-        ret |= pe->func(pe->opaque);
-    }
-#ifdef _WIN32
-    if (ret == 0) {
-        int err;
-        WaitObjects *w = &wait_objects;
-
-        ret = WaitForMultipleObjects(w->num, w->events, FALSE, timeout);
-        if (WAIT_OBJECT_0 + 0 <= ret && ret <= WAIT_OBJECT_0 + w->num - 1) {
-            if (w->func[ret - WAIT_OBJECT_0])
-                w->func[ret - WAIT_OBJECT_0](w->opaque[ret - WAIT_OBJECT_0]);
 
-            /* Check for additional signaled events */
-            for(i = (ret - WAIT_OBJECT_0 + 1); i < w->num; i++) {
-
-                /* Check if event is signaled */
-                ret2 = WaitForSingleObject(w->events[i], 0);
-                if(ret2 == WAIT_OBJECT_0) {
-                    if (w->func[i])
-                        w->func[i](w->opaque[i]);
-                } else if (ret2 == WAIT_TIMEOUT) {
-                } else {
-                    err = GetLastError();
-                    fprintf(stderr, "WaitForSingleObject error %d %d\n", i, err);
-                }
-            }
-        } else if (ret == WAIT_TIMEOUT) {
-        } else {
-            err = GetLastError();
-            fprintf(stderr, "WaitForMultipleObjects error %d %d\n", ret, err);
-        }
-    }
-#endif
     /* poll any events */
     /* XXX: separate device handlers from system ones */
     nfds = -1;
@@ -8226,8 +9411,6 @@ void main_loop_wait(int timeout)
 #endif
     ret = select(nfds + 1, &rfds, &wfds, &xfds, &tv);
     if (ret > 0) {
-        IOHandlerRecord **pioh;
-
         for(ioh = first_io_handler; ioh != NULL; ioh = ioh->next) {
             if (!ioh->deleted && ioh->fd_read && FD_ISSET(ioh->fd, &rfds)) {
                 ioh->fd_read(ioh->opaque);
@@ -8237,17 +9420,103 @@ void main_loop_wait(int timeout)
             }
         }
 
-	/* remove deleted IO handlers */
-	pioh = &first_io_handler;
-	while (*pioh) {
-            ioh = *pioh;
-            if (ioh->deleted) {
-                *pioh = ioh->next;
-                qemu_free(ioh);
-            } else
-                pioh = &ioh->next;
+        io_handlers_cleanup();
+    }
+#if defined(CONFIG_SLIRP)
+    if (slirp_inited) {
+        if (ret < 0) {
+            FD_ZERO(&rfds);
+            FD_ZERO(&wfds);
+            FD_ZERO(&xfds);
+        }
+        slirp_select_poll(&rfds, &wfds, &xfds);
+    }
+#endif
+}
+
+#ifdef CONFIG_EPOLL
+static void io_epoll_dispatch(struct epoll_event *events, int n)
+{
+    IOHandlerRecord *ioh;
+    uint32_t ev;
+    int i;
+
+    for(i = 0; i < n; i++) {
+        ioh = io_handler_lookup(events[i].data.fd);
+        if (!ioh)
+            continue;
+        ev = events[i].events;
+        if (ev & (EPOLLERR | EPOLLHUP))
+            ev |= ioh->epoll_events;
+        if (!ioh->deleted && ioh->fd_read && (ev & EPOLLIN))
+            ioh->fd_read(ioh->opaque);
+        if (!ioh->deleted && ioh->fd_write && (ev & EPOLLOUT))
+            ioh->fd_write(ioh->opaque);
+    }
+}
+
+static void main_loop_epoll(int timeout)
+{
+    struct epoll_event events[IO_EPOLL_MAX_EVENTS];
+    IOHandlerRecord *ioh;
+    int n, nb_ready;
+#if defined(CONFIG_SLIRP)
+    fd_set rfds, wfds, xfds;
+    struct timeval tv;
+    int ret, nfds;
+#endif
+
+    /* only the handlers that decide at run time whether they can read,
+       and the fds epoll does not support, have to be looked at */
+    nb_ready = 0;
+    for(ioh = first_polled_io_handler; ioh != NULL; ioh = ioh->next_polled) {
+        if (ioh->deleted)
+            continue;
+        if (ioh->no_epoll)
+            nb_ready += io_epoll_wanted(ioh) != 0;
+        else
+            io_epoll_update(ioh, io_epoll_wanted(ioh));
+    }
+    if (nb_ready)
+        timeout = 0;
+
+#if defined(CONFIG_SLIRP)
+    ret = 0;
+    if (slirp_inited) {
+        /* slirp only knows select(), wait for its fds and for the epoll
+           set together */
+        nfds = io_epoll_fd;
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        FD_ZERO(&xfds);
+        FD_SET(io_epoll_fd, &rfds);
+        slirp_select_fill(&nfds, &rfds, &wfds, &xfds);
+        tv.tv_sec = 0;
+        tv.tv_usec = timeout * 1000;
+        ret = select(nfds + 1, &rfds, &wfds, &xfds, &tv);
+        n = 0;
+        if (ret > 0 && FD_ISSET(io_epoll_fd, &rfds))
+            n = epoll_wait(io_epoll_fd, events, IO_EPOLL_MAX_EVENTS, 0);
+    } else
+#endif
+        n = epoll_wait(io_epoll_fd, events, IO_EPOLL_MAX_EVENTS, timeout);
+
+    if (n > 0)
+        io_epoll_dispatch(events, n);
+    if (nb_ready) {
+        for(ioh = first_polled_io_handler; ioh != NULL;
+            ioh = ioh->next_polled) {
+            if (!ioh->no_epoll || ioh->deleted)
+                continue;
+            if (ioh->fd_read &&
+                (!ioh->fd_read_poll || ioh->fd_read_poll(ioh->opaque) != 0))
+                ioh->fd_read(ioh->opaque);
+            if (!ioh->deleted && ioh->fd_write)
+                ioh->fd_write(ioh->opaque);
         }
     }
+    io_handlers_cleanup();
+
 #if defined(CONFIG_SLIRP)
     if (slirp_inited) {
         if (ret < 0) {
@@ -8258,6 +9527,64 @@ void main_loop_wait(int timeout)
         slirp_select_poll(&rfds, &wfds, &xfds);
     }
 #endif
+}
+#endif /* CONFIG_EPOLL */
+
+void main_loop_wait(int timeout)
+{
+    int ret;
+#ifdef _WIN32
+    int ret2, i;
+#endif
+    PollingEntry *pe;
+
+    /* the guest NICs may have made room for the queued packets */
+    if (vlan_nb_queued)
+        qemu_flush_vlan_queues();
+
+    /* XXX: need to suppress polling by better using win32 events */
+    ret = 0;
+    for(pe = first_polling_entry; pe != NULL; pe = pe->next) {
+        ret |= pe->func(pe->opaque);
+    }
+#ifdef _WIN32
+    if (ret == 0) {
+        int err;
+        WaitObjects *w = &wait_objects;
+
+        ret = WaitForMultipleObjects(w->num, w->events, FALSE, timeout);
+        if (WAIT_OBJECT_0 + 0 <= ret && ret <= WAIT_OBJECT_0 + w->num - 1) {
+            if (w->func[ret - WAIT_OBJECT_0])
+                w->func[ret - WAIT_OBJECT_0](w->opaque[ret - WAIT_OBJECT_0]);
+
+            /* Check for additional signaled events */
+            for(i = (ret - WAIT_OBJECT_0 + 1); i < w->num; i++) {
+
+                /* Check if event is signaled */
+                ret2 = WaitForSingleObject(w->events[i], 0);
+                if(ret2 == WAIT_OBJECT_0) {
+                    if (w->func[i])
+                        w->func[i](w->opaque[i]);
+                } else if (ret2 == WAIT_TIMEOUT) {
+                } else {
+                    err = GetLastError();
+                    fprintf(stderr, "WaitForSingleObject error %d %d\n", i, err);
+                }
+            }
+        } else if (ret == WAIT_TIMEOUT) {
+        } else {
+            err = GetLastError();
+            fprintf(stderr, "WaitForMultipleObjects error %d %d\n", ret, err);
+        }
+    }
+#endif
+#ifdef CONFIG_EPOLL
+    if (io_use_epoll())
+        main_loop_epoll(timeout);
+    else
+#endif
+        main_loop_select(timeout);
+
     qemu_aio_poll();
 
     if (vm_running) {
@@ -8364,6 +9691,22 @@ static int main_loop(void)
     return ret;
 }
 
+#ifdef USE_MEMMERGE
+static int mem_merge;
+#endif
+
+#ifdef USE_TBPROFILE
+static const char *tbprofile_filename;
+
+static void tbprofile_exit(void)
+{
+    tbprofile_stop();
+    if (tbprofile_save(tbprofile_filename) < 0)
+        fprintf(stderr, "Could not write the TB profile to '%s'\n",
+                tbprofile_filename);
+}
+#endif
+
 static void help(int exitcode)
 {
     printf("ARGOS Secure PC emulator version " ARGOS_VERSION ", Copyright (c) 2005-2008 Georgios Portokalidis\n"
@@ -8472,6 +9815,7 @@ static void help(int exitcode)
 	   "                 (optional if argos logs are disabled)\n"
            "-winxp          use it when emulating Windows XP\n"
 	   "                 (optional if argos logs are disabled)\n"
+           "-osprofile file load the guest OS profile from 'file'\n"
            "-no-csilog      do not generate an argos log when an attack is detected\n"
            "-no-fsc         do not inject forensics shellcode after an attack is detected\n"
 #ifdef ARGOS_TRACKSC
@@ -8481,9 +9825,30 @@ static void help(int exitcode)
 #ifdef ARGOS_WHITELIST
            "-wp profile     set the whitelist OS to profile\n"
 #endif
+           "-tbcache file   save translated blocks to 'file' and reuse them\n"
+           "                on the next run\n"
+#endif
+#ifdef USE_TBPROFILE
+           "-tbprofile file sample the executed blocks and write the folded\n"
+           "                stacks to 'file' on exit\n"
+#endif
+#ifdef USE_MEMMERGE
+           "-mem-merge      let the host merge the identical clean pages of the\n"
+           "                guest RAM with those of other instances\n"
+#endif
+#ifdef USE_FORKSERVER
+           "-forkserver n   fork n instances when the 'forkserver start' monitor\n"
+           "                command or the FORK control command is given\n"
 #endif
            "-csaddr addr    enable the control socket, and start listening on addr\n"
            "-csport port    set the control socket port, default is 1374\n"
+           "-csjson         send JSON lines events on the control socket\n"
+           "-csstats secs   send a stats event on the control socket every 'secs'\n"
+           "-taint-filter expr only taint the received frames that match 'expr'\n"
+           "-taint-bpf file only taint the received frames accepted by the BPF\n"
+           "                program in 'file' (tcpdump -ddd format)\n"
+           "-disk-taint     keep the taint of the data written to the hard disks\n"
+           "                in <image>.taint\n"
 	   "\n"
 
            "Linux boot specific:\n"
@@ -8514,6 +9879,8 @@ static void help(int exitcode)
 #endif
            "-no-reboot      exit instead of rebooting\n"
            "-loadvm file    start right away with a saved state (loadvm in monitor)\n"
+           "-loadvm-raw file\n"
+           "                start right away with a raw snapshot (loadvm_raw in monitor)\n"
 	   "-vnc display    start a VNC server on display\n"
 #ifndef _WIN32
 	   "-daemonize      daemonize QEMU after initializing\n"
@@ -8524,6 +9891,20 @@ static void help(int exitcode)
 #endif
            "-clock          force the use of the given methods for timer alarm.\n"
            "                To see what timers are available use -clock help\n"
+           "-tb-size n      set the translated code buffer size to n MB\n"
+#ifdef USE_IOTHREAD
+           "-iothread       read the tap devices from a separate thread\n"
+#endif
+#ifndef _WIN32
+           "-aio-threads n  use up to n threads for disk I/O (default 8)\n"
+#endif
+           "-qcow2-cache l2[,refcount]\n"
+           "                set the qcow2 metadata cache sizes in kB\n"
+           "                (default 2048,256)\n"
+#ifndef _WIN32
+           "-mmap-backing   read the backing files of the disk images from a\n"
+           "                shared mapping\n"
+#endif
            "\n"
            "During emulation, the following keys are useful:\n"
            "ctrl-alt-f      toggle full screen\n"
@@ -8603,6 +9984,7 @@ enum {
     QEMU_OPTION_serial,
     QEMU_OPTION_parallel,
     QEMU_OPTION_loadvm,
+    QEMU_OPTION_loadvm_raw,
     QEMU_OPTION_full_screen,
     QEMU_OPTION_no_frame,
     QEMU_OPTION_alt_grab,
@@ -8626,20 +10008,35 @@ enum {
     QEMU_OPTION_old_param,
     QEMU_OPTION_clock,
     QEMU_OPTION_startdate,
+    QEMU_OPTION_tb_size,
+    QEMU_OPTION_iothread,
+    QEMU_OPTION_aio_threads,
+    QEMU_OPTION_qcow2_cache,
+    QEMU_OPTION_mmap_backing,
     /* Argos specific */
     QEMU_OPTION_linux,
     QEMU_OPTION_win2k,
     QEMU_OPTION_winxp,
+    QEMU_OPTION_osprofile,
     QEMU_OPTION_wp,
     QEMU_OPTION_csilog,
     QEMU_OPTION_no_fsc,
     QEMU_OPTION_cs_laddr,
     QEMU_OPTION_cs_lport,
+    QEMU_OPTION_cs_json,
+    QEMU_OPTION_cs_stats,
 #ifdef ARGOS_TRACKSC
     QEMU_OPTION_tracksc,
     QEMU_OPTION_tracksc_whitelist,
 #endif
     QEMU_OPTION_argos_id,
+    QEMU_OPTION_tbcache,
+    QEMU_OPTION_tbprofile,
+    QEMU_OPTION_forkserver,
+    QEMU_OPTION_mem_merge,
+    QEMU_OPTION_taint_filter,
+    QEMU_OPTION_taint_bpf,
+    QEMU_OPTION_disk_taint,
 };
 
 typedef struct QEMUOption {
@@ -8715,6 +10112,7 @@ const QEMUOption qemu_options[] = {
     { "serial", HAS_ARG, QEMU_OPTION_serial },
     { "parallel", HAS_ARG, QEMU_OPTION_parallel },
     { "loadvm", HAS_ARG, QEMU_OPTION_loadvm },
+    { "loadvm-raw", HAS_ARG, QEMU_OPTION_loadvm_raw },
     { "full-screen", 0, QEMU_OPTION_full_screen },
 #ifdef CONFIG_SDL
     { "no-frame", 0, QEMU_OPTION_no_frame },
@@ -8745,11 +10143,23 @@ const QEMUOption qemu_options[] = {
 #endif
     { "clock", HAS_ARG, QEMU_OPTION_clock },
     { "startdate", HAS_ARG, QEMU_OPTION_startdate },
+    { "tb-size", HAS_ARG, QEMU_OPTION_tb_size },
+#ifdef USE_IOTHREAD
+    { "iothread", 0, QEMU_OPTION_iothread },
+#endif
+#ifndef _WIN32
+    { "aio-threads", HAS_ARG, QEMU_OPTION_aio_threads },
+#endif
+    { "qcow2-cache", HAS_ARG, QEMU_OPTION_qcow2_cache },
+#ifndef _WIN32
+    { "mmap-backing", 0, QEMU_OPTION_mmap_backing },
+#endif
 
     /* Argos specific */
     { "linux", 0, QEMU_OPTION_linux },
     { "win2k", 0, QEMU_OPTION_win2k },
     { "winxp", 0, QEMU_OPTION_winxp },
+    { "osprofile", HAS_ARG, QEMU_OPTION_osprofile },
     { "wp", 1, QEMU_OPTION_wp },
     { "no-csilog", 0, QEMU_OPTION_csilog },
     { "no-fsc", 0, QEMU_OPTION_no_fsc },
@@ -8758,11 +10168,26 @@ const QEMUOption qemu_options[] = {
     { "vnc", HAS_ARG, QEMU_OPTION_vnc },
     { "csaddr", HAS_ARG, QEMU_OPTION_cs_laddr },
     { "csport", HAS_ARG, QEMU_OPTION_cs_lport },
+    { "csjson", 0, QEMU_OPTION_cs_json },
+    { "csstats", HAS_ARG, QEMU_OPTION_cs_stats },
 #ifdef ARGOS_TRACKSC
     { "tracksc", 0, QEMU_OPTION_tracksc },
     { "tracksc-whitelist", HAS_ARG, QEMU_OPTION_tracksc_whitelist },
 #endif
     { "argos-id", HAS_ARG, QEMU_OPTION_argos_id },
+    { "tbcache", HAS_ARG, QEMU_OPTION_tbcache },
+#ifdef USE_TBPROFILE
+    { "tbprofile", HAS_ARG, QEMU_OPTION_tbprofile },
+#endif
+#ifdef USE_FORKSERVER
+    { "forkserver", HAS_ARG, QEMU_OPTION_forkserver },
+#endif
+#ifdef USE_MEMMERGE
+    { "mem-merge", 0, QEMU_OPTION_mem_merge },
+#endif
+    { "taint-filter", HAS_ARG, QEMU_OPTION_taint_filter },
+    { "taint-bpf", HAS_ARG, QEMU_OPTION_taint_bpf },
+    { "disk-taint", 0, QEMU_OPTION_disk_taint },
 
     { NULL },
 };
@@ -9017,6 +10442,7 @@ int main(int argc, char **argv)
     char parallel_devices[MAX_PARALLEL_PORTS][128];
     int parallel_device_index;
     const char *loadvm = NULL;
+    const char *loadvm_raw = NULL;
     QEMUMachine *machine;
     const char *cpu_model;
     char usb_devices[MAX_USB_CMDLINE][128];
@@ -9024,6 +10450,8 @@ int main(int argc, char **argv)
     int fds[2];
     const char *pid_file = NULL;
     VLANState *vlan;
+    int tb_size;
+    const char *tbcache_filename;
 
     LIST_INIT (&vm_change_state_head);
 #ifndef _WIN32
@@ -9068,6 +10496,8 @@ int main(int argc, char **argv)
 #endif
     snapshot = 0;
     nographic = 0;
+    tb_size = 0;
+    tbcache_filename = NULL;
     kernel_filename = NULL;
     kernel_cmdline = "";
     cyls = heads = secs = 0;
@@ -9498,6 +10928,9 @@ int main(int argc, char **argv)
 	    case QEMU_OPTION_loadvm:
 		loadvm = optarg;
 		break;
+            case QEMU_OPTION_loadvm_raw:
+                loadvm_raw = optarg;
+                break;
             case QEMU_OPTION_full_screen:
                 full_screen = 1;
                 break;
@@ -9633,22 +11066,65 @@ int main(int argc, char **argv)
                     }
                 }
                 break;
+            case QEMU_OPTION_tb_size:
+                tb_size = strtol(optarg, NULL, 0);
+                if (tb_size < 0)
+                    tb_size = 0;
+                break;
+#ifdef USE_IOTHREAD
+            case QEMU_OPTION_iothread:
+                iothread_enabled = 1;
+                break;
+#endif
+#ifndef _WIN32
+            case QEMU_OPTION_aio_threads:
+                qemu_aio_max_threads = strtol(optarg, NULL, 0);
+                if (qemu_aio_max_threads < 1) {
+                    fprintf(stderr, "Invalid number of AIO threads\n");
+                    exit(1);
+                }
+                break;
+#endif
+            case QEMU_OPTION_qcow2_cache:
+                {
+                    char *p;
+
+                    qcow2_l2_cache_size = strtol(optarg, &p, 0) * 1024;
+                    if (*p == ',')
+                        qcow2_refcount_cache_size =
+                            strtol(p + 1, &p, 0) * 1024;
+                    if (*p != '\0' || qcow2_l2_cache_size <= 0 ||
+                        qcow2_refcount_cache_size <= 0) {
+                        fprintf(stderr, "Invalid qcow2 cache size\n");
+                        exit(1);
+                    }
+                }
+                break;
+#ifndef _WIN32
+            case QEMU_OPTION_mmap_backing:
+                bdrv_mmap_backing = 1;
+                break;
+#endif
 
 	    case QEMU_OPTION_linux:
-		argos_os_hint = 0;
+		argos_osprofile_select("linux");
 		if (argos_wprofile == NULL)
 			argos_wprofile = "linux";
 		break;
 	    case QEMU_OPTION_win2k:
-		argos_os_hint = 1;
+		argos_osprofile_select("win2k");
 		if (argos_wprofile == NULL)
 			argos_wprofile = "win2k";
 		break;
 	    case QEMU_OPTION_winxp:
-		argos_os_hint = 2;
+		argos_osprofile_select("winxp");
 		if (argos_wprofile == NULL)
 			argos_wprofile = "winxp";
 		break;
+	    case QEMU_OPTION_osprofile:
+		if (argos_osprofile_load(optarg) != 0)
+			exit(1);
+		break;
 	    case QEMU_OPTION_wp:
 		argos_wprofile = strdup(optarg);
 		break;
@@ -9664,11 +11140,18 @@ int main(int argc, char **argv)
 	    case QEMU_OPTION_cs_lport:
 		ctrlsock_lport = atoi(optarg);
 		break;
+	    case QEMU_OPTION_cs_json:
+		ctrlsock_json = 1;
+		break;
+	    case QEMU_OPTION_cs_stats:
+		ctrlsock_stats_interval = atoi(optarg);
+		break;
 #ifdef ARGOS_TRACKSC
 	    case QEMU_OPTION_tracksc:
 		if (!argos_fsc)
 		{
-                    if ( argos_os_hint == 2 )
+                    // The shell-code context is found in the TEB
+                    if ( argos_osprofile.has_internals )
                     {
 			argos_tracksc = 1;
                         fprintf(stderr, "Shell-code tracking is enabled, make "
@@ -9676,8 +11159,9 @@ int main(int argc, char **argv)
                     }
                     else
                     {
-                        fprintf(stderr, "Shell-code tracking is currently "
-                                "only available for Windows XP!\n");
+                        fprintf(stderr, "Shell-code tracking needs the "
+                                "Windows internals of the OS profile "
+                                "(-winxp or -osprofile)!\n");
                         exit(1);
                     }
 		}
@@ -9713,6 +11197,40 @@ int main(int argc, char **argv)
                     }
                 }
                 break;
+            case QEMU_OPTION_tbcache:
+                tbcache_filename = optarg;
+                break;
+#ifdef USE_TBPROFILE
+            case QEMU_OPTION_tbprofile:
+                tbprofile_filename = optarg;
+                break;
+#endif
+#ifdef USE_FORKSERVER
+            case QEMU_OPTION_forkserver:
+                forkserver_size = atoi(optarg);
+                if (forkserver_size < 1) {
+                    fprintf(stderr, "Invalid number of instances: %s\n",
+                            optarg);
+                    exit(1);
+                }
+                break;
+#endif
+#ifdef USE_MEMMERGE
+            case QEMU_OPTION_mem_merge:
+                mem_merge = 1;
+                break;
+#endif
+            case QEMU_OPTION_taint_filter:
+                if (argos_netfilter_compile(optarg) < 0)
+                    exit(1);
+                break;
+            case QEMU_OPTION_taint_bpf:
+                if (argos_netfilter_load(optarg) < 0)
+                    exit(1);
+                break;
+            case QEMU_OPTION_disk_taint:
+                argos_disktaint_enabled = 1;
+                break;
             }
         }
     }
@@ -9889,6 +11407,9 @@ int main(int argc, char **argv)
         exit(1);
     }
 
+    /* init the dynamic translator */
+    cpu_exec_init_all((unsigned long)tb_size * 1024 * 1024);
+
     // ARGOS
 #ifdef ARGOS_WHITELIST
     init_argos_whitelist();
@@ -9931,6 +11452,10 @@ int main(int argc, char **argv)
         fprintf(stderr, "Could not allocate argos memory map\n");
         exit(1);
     }
+#ifdef USE_MEMMERGE
+    if (mem_merge && memmerge_start() < 0)
+        fprintf(stderr, "warning: the guest RAM cannot be merged\n");
+#endif
 #ifdef ARGOS_NET_TRACKER
     if (!(argos_nt_fl = fopen("argos.netlog", "wb"))) {
         fprintf(stderr, "Could not create net tracker log file"
@@ -9964,6 +11489,12 @@ int main(int argc, char **argv)
 
     register_savevm("timer", 0, 2, timer_save, timer_load, NULL);
     register_savevm("ram", 0, 2, ram_save, ram_load, NULL);
+    register_savevm("argos memmap", 0, 1, argos_memmap_save,
+                    argos_memmap_load, NULL);
+#ifdef ARGOS_LABEL_SETS
+    register_savevm("argos labels", 0, 1, argos_label_save,
+                    argos_label_load, NULL);
+#endif
 
     init_ioports();
 
@@ -10039,6 +11570,16 @@ int main(int argc, char **argv)
     machine->init(ram_size, vga_ram_size, boot_devices, ds,
                   kernel_filename, kernel_cmdline, initrd_filename, cpu_model);
 
+    if (tbcache_filename) {
+#ifdef USE_TBCACHE
+        if (tbcache_open(tbcache_filename) < 0)
+            fprintf(stderr, "Could not open translation cache '%s'\n",
+                    tbcache_filename);
+#else
+        fprintf(stderr, "Translation cache not supported for this target\n");
+#endif
+    }
+
     /* init USB devices */
     if (usb_enabled) {
         for(i = 0; i < usb_devices_index; i++) {
@@ -10068,6 +11609,8 @@ int main(int argc, char **argv)
 
     if (loadvm)
         do_loadvm(loadvm);
+    if (loadvm_raw)
+        do_loadvm_raw(loadvm_raw);
 
     {
         /* XXX: simplify init */
@@ -10101,7 +11644,15 @@ again1:
         close(fd);
     }
 
+#ifdef USE_TBPROFILE
+    if (tbprofile_filename && tbprofile_start(TBPROFILE_DEFAULT_HZ) == 0)
+        atexit(tbprofile_exit);
+#endif
+
     main_loop();
+#ifdef USE_TBCACHE
+    tbcache_close();
+#endif
     quit_timers();
 
     if (ctrlsock_laddr)